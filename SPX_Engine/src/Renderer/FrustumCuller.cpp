@@ -0,0 +1,237 @@
+#include "FrustumCuller.h"
+#include "../SPX/JobSystem.h"
+#include "../SPX/Profiler.h"
+#include "../SPX/AllocationCounter.h"
+#include <immintrin.h>
+#include <cfloat>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles AVX intrinsics whatever /arch is set to, so nothing needs adding to the AVX functions.
+#define SPX_TARGET_AVX
+#else
+#define SPX_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+namespace {
+	bool cpuHasAvx() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		// The CPU having AVX isn't enough, the OS has to save the YMM registers on a context switch too.
+		return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+
+	// Checked once at startup. The project is built without /arch:AVX so it still runs on CPUs without it.
+	const bool gHasAvx = cpuHasAvx();
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProj) {
+	// GLM is column major, so a row of the matrix is made up of the same index from each column.
+	glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+	glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+	glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+	glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+	Frustum frustum;
+	frustum.mPlanes[0] = row3 + row0; // Left
+	frustum.mPlanes[1] = row3 - row0; // Right
+	frustum.mPlanes[2] = row3 + row1; // Bottom (top once the projection's y is flipped, doesn't matter for culling)
+	frustum.mPlanes[3] = row3 - row1; // Top
+	frustum.mPlanes[4] = row3 + row2; // Near
+	frustum.mPlanes[5] = row3 - row2; // Far
+
+	// Normalize so the plane distance is in world units and can be compared directly against a radius.
+	for (auto& plane : frustum.mPlanes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+void FrustumCuller::resize(size_t objectCount) {
+	SPX_ALLOCATION_SCOPE(AllocationTag::Culling);
+	mObjectCount = objectCount;
+	size_t padded = (objectCount + 7) & ~static_cast<size_t>(7);
+
+	// Padding entries get a negative infinite radius so they can never be inside.
+	mSphereX.assign(padded, 0.0f);
+	mSphereY.assign(padded, 0.0f);
+	mSphereZ.assign(padded, 0.0f);
+	mSphereRadius.assign(padded, -FLT_MAX);
+	mBoxX.assign(padded, 0.0f);
+	mBoxY.assign(padded, 0.0f);
+	mBoxZ.assign(padded, 0.0f);
+	mExtentX.assign(padded, 0.0f);
+	mExtentY.assign(padded, 0.0f);
+	mExtentZ.assign(padded, 0.0f);
+	mVisibility.assign(padded, 0);
+	mVisibleIndices.reserve(objectCount);
+}
+
+void FrustumCuller::updateBounds(size_t index, const BoundingSphere& sphere, const AABB& box, const glm::mat4& transform) {
+	glm::vec3 center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+
+	// A non-uniform scale stretches the sphere, so use the largest axis scale to stay conservative.
+	float scaleX = glm::length(glm::vec3(transform[0]));
+	float scaleY = glm::length(glm::vec3(transform[1]));
+	float scaleZ = glm::length(glm::vec3(transform[2]));
+	float maxScale = std::max(scaleX, std::max(scaleY, scaleZ));
+
+	mSphereX[index] = center.x;
+	mSphereY[index] = center.y;
+	mSphereZ[index] = center.z;
+	mSphereRadius[index] = sphere.radius * maxScale;
+
+	AABB worldBox = transformAABB(box, transform);
+	mBoxX[index] = worldBox.center.x;
+	mBoxY[index] = worldBox.center.y;
+	mBoxZ[index] = worldBox.center.z;
+	mExtentX[index] = worldBox.extents.x;
+	mExtentY[index] = worldBox.extents.y;
+	mExtentZ[index] = worldBox.extents.z;
+}
+
+AABB FrustumCuller::transformAABB(const AABB& box, const glm::mat4& transform) {
+	// Transforming an AABB: the new center is the transformed center and the new extents are the old extents
+	// projected onto each world axis using the absolute value of the rotation/scale part of the matrix.
+	AABB worldBox;
+	worldBox.center = glm::vec3(transform * glm::vec4(box.center, 1.0f));
+	worldBox.extents.x = std::abs(transform[0][0]) * box.extents.x + std::abs(transform[1][0]) * box.extents.y + std::abs(transform[2][0]) * box.extents.z;
+	worldBox.extents.y = std::abs(transform[0][1]) * box.extents.x + std::abs(transform[1][1]) * box.extents.y + std::abs(transform[2][1]) * box.extents.z;
+	worldBox.extents.z = std::abs(transform[0][2]) * box.extents.x + std::abs(transform[1][2]) * box.extents.y + std::abs(transform[2][2]) * box.extents.z;
+	return worldBox;
+}
+
+void FrustumCuller::cull(const Frustum& frustum, JobSystem* jobSystem, FrameArena* arena) {
+	SPX_PROFILE_ZONE("Frustum cull");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (!jobSystem || jobSystem->getThreadCount() == 1 || mObjectCount < PARALLEL_CULL_THRESHOLD)
+		cullRange(frustum, 0, mObjectCount);
+	else {
+		jobSystem->parallelFor(mObjectCount, CULL_BATCH_SIZE, [this, &frustum](size_t begin, size_t end) {
+			cullRange(frustum, begin, end);
+		}, arena);
+	}
+
+	mVisibleIndices.clear();
+	for (size_t i = 0; i < mObjectCount; i++) {
+		if (mVisibility[i])
+			mVisibleIndices.push_back(static_cast<uint32_t>(i));
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	mStats.mTotalObjects = static_cast<uint32_t>(mObjectCount);
+	mStats.mVisibleObjects = static_cast<uint32_t>(mVisibleIndices.size());
+	mStats.mCulledObjects = mStats.mTotalObjects - mStats.mVisibleObjects;
+	mStats.mCullTimeMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// begin is always a multiple of 8 and the arrays are padded, so the loop can always load full registers.
+void FrustumCuller::cullRange(const Frustum& frustum, size_t begin, size_t end) {
+	SPX_PROFILE_ZONE("Frustum cull range");
+	if (gHasAvx)
+		cullRangeAvx(frustum, begin, end);
+	else
+		cullRangeSse(frustum, begin, end);
+}
+
+// AVX: 8 objects per instruction.
+SPX_TARGET_AVX void FrustumCuller::cullRangeAvx(const Frustum& frustum, size_t begin, size_t end) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+	for (size_t i = begin; i < end; i += 8) {
+		__m256 sx = _mm256_loadu_ps(&mSphereX[i]);
+		__m256 sy = _mm256_loadu_ps(&mSphereY[i]);
+		__m256 sz = _mm256_loadu_ps(&mSphereZ[i]);
+		__m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(&mSphereRadius[i]), signMask);
+		__m256 bx = _mm256_loadu_ps(&mBoxX[i]);
+		__m256 by = _mm256_loadu_ps(&mBoxY[i]);
+		__m256 bz = _mm256_loadu_ps(&mBoxZ[i]);
+		__m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+		__m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+		__m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (const auto& plane : frustum.mPlanes) {
+			__m256 nx = _mm256_set1_ps(plane.x);
+			__m256 ny = _mm256_set1_ps(plane.y);
+			__m256 nz = _mm256_set1_ps(plane.z);
+			__m256 nw = _mm256_set1_ps(plane.w);
+
+			// Sphere: signed distance from the plane must be greater than -radius.
+			__m256 sphereDist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, sx), _mm256_mul_ps(ny, sy)),
+				_mm256_add_ps(_mm256_mul_ps(nz, sz), nw));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(sphereDist, negRadius, _CMP_GE_OQ));
+
+			// AABB: distance of the center plus the box's projected radius onto the plane normal.
+			__m256 boxDist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, bx), _mm256_mul_ps(ny, by)),
+				_mm256_add_ps(_mm256_mul_ps(nz, bz), nw));
+			__m256 boxRadius = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex),
+				_mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)),
+				_mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(boxDist, boxRadius), zero, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (int lane = 0; lane < 8; lane++)
+			mVisibility[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+	}
+
+	// The rest of the program is SSE. Clearing the upper halves avoids the penalty for switching between the two.
+	_mm256_zeroupper();
+}
+
+// SSE: 4 objects per instruction. Always available on x64.
+void FrustumCuller::cullRangeSse(const Frustum& frustum, size_t begin, size_t end) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for (size_t i = begin; i < end; i += 4) {
+		__m128 sx = _mm_loadu_ps(&mSphereX[i]);
+		__m128 sy = _mm_loadu_ps(&mSphereY[i]);
+		__m128 sz = _mm_loadu_ps(&mSphereZ[i]);
+		__m128 negRadius = _mm_xor_ps(_mm_loadu_ps(&mSphereRadius[i]), signMask);
+		__m128 bx = _mm_loadu_ps(&mBoxX[i]);
+		__m128 by = _mm_loadu_ps(&mBoxY[i]);
+		__m128 bz = _mm_loadu_ps(&mBoxZ[i]);
+		__m128 ex = _mm_loadu_ps(&mExtentX[i]);
+		__m128 ey = _mm_loadu_ps(&mExtentY[i]);
+		__m128 ez = _mm_loadu_ps(&mExtentZ[i]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (const auto& plane : frustum.mPlanes) {
+			__m128 nx = _mm_set1_ps(plane.x);
+			__m128 ny = _mm_set1_ps(plane.y);
+			__m128 nz = _mm_set1_ps(plane.z);
+			__m128 nw = _mm_set1_ps(plane.w);
+
+			// Sphere: signed distance from the plane must be greater than -radius.
+			__m128 sphereDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)),
+				_mm_add_ps(_mm_mul_ps(nz, sz), nw));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(sphereDist, negRadius));
+
+			// AABB: distance of the center plus the box's projected radius onto the plane normal.
+			__m128 boxDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, bx), _mm_mul_ps(ny, by)),
+				_mm_add_ps(_mm_mul_ps(nz, bz), nw));
+			__m128 boxRadius = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+				_mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+				_mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(boxDist, boxRadius), zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+			mVisibility[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+	}
+}
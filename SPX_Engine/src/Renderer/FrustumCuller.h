@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../pch.h"
+#include "VulkanWrapper/DataStructures.h"
+
+// ******************************************************************************************************************************
+//															FRUSTUM CULLING
+// Every object's world space bounding sphere and AABB are kept in a structure of arrays (one array per component) so that
+// SSE/AVX can test 4 or 8 objects against a frustum plane with a single instruction. An object is only visible if it
+// is not fully behind any of the six planes for both its sphere and its box. AVX is used when the CPU has it, checked at
+// runtime, otherwise SSE.
+//
+// The planes are pulled straight out of the combined projection * view matrix (Gribb/Hartmann method), so they are in
+// world space and the bounds never have to be transformed into clip space.
+// ******************************************************************************************************************************
+
+class JobSystem;
+class FrameArena;
+
+struct Frustum {
+	// Left, Right, Bottom, Top, Near, Far. xyz is the normal pointing into the frustum, w is the distance.
+	glm::vec4 mPlanes[6];
+
+	static Frustum fromMatrix(const glm::mat4& viewProj);
+};
+
+struct CullingStats {
+	uint32_t mTotalObjects{ 0 };
+	uint32_t mVisibleObjects{ 0 };
+	uint32_t mCulledObjects{ 0 };
+	double mCullTimeMs{ 0.0 };
+	// Filled in by the occlusion culler. mVisibleObjects already has these removed.
+	uint32_t mOccludedObjects{ 0 };
+	double mOcclusionTimeMs{ 0.0 };
+};
+
+class FrustumCuller {
+public:
+	// Resizes the SoA arrays. Padding to a multiple of 8 lets the SIMD loop run without a scalar tail.
+	void resize(size_t objectCount);
+	size_t getObjectCount() const { return mObjectCount; }
+
+	// Transforms the model space bounds by the object's transform into world space and stores them at index.
+	void updateBounds(size_t index, const BoundingSphere& sphere, const AABB& box, const glm::mat4& transform);
+
+	// World space sphere stored by the last updateBounds at index. The Hi-Z culler uploads these to the GPU.
+	BoundingSphere getWorldSphere(size_t index) const { return { glm::vec3(mSphereX[index], mSphereY[index], mSphereZ[index]), mSphereRadius[index] }; }
+
+	// Model space box to world space box. Also used by the occlusion culler.
+	static AABB transformAABB(const AABB& box, const glm::mat4& transform);
+
+	// Tests every object against the frustum and fills mVisibleIndices. Big scenes are split into jobs when a job system is
+	// given, made in arena if there is one.
+	void cull(const Frustum& frustum, JobSystem* jobSystem = nullptr, FrameArena* arena = nullptr);
+
+	std::vector<uint32_t> mVisibleIndices;
+	CullingStats mStats;
+
+	// Objects above this count are split into jobs. Below it scheduling costs more than the test.
+	static const size_t PARALLEL_CULL_THRESHOLD = 4096;
+	// Objects per job. A multiple of 8 so no two jobs share a SIMD batch.
+	static const size_t CULL_BATCH_SIZE = 2048;
+
+private:
+	void cullRange(const Frustum& frustum, size_t begin, size_t end);
+	void cullRangeAvx(const Frustum& frustum, size_t begin, size_t end);
+	void cullRangeSse(const Frustum& frustum, size_t begin, size_t end);
+
+	size_t mObjectCount{ 0 };
+
+	// World space bounding sphere
+	std::vector<float> mSphereX;
+	std::vector<float> mSphereY;
+	std::vector<float> mSphereZ;
+	std::vector<float> mSphereRadius;
+
+	// World space AABB
+	std::vector<float> mBoxX;
+	std::vector<float> mBoxY;
+	std::vector<float> mBoxZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+
+	// One byte per object written by the culling jobs. Kept separate from mVisibleIndices so that jobs
+	// never write to the same memory, then compacted on the calling thread.
+	std::vector<uint8_t> mVisibility;
+};
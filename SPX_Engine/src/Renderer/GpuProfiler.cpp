@@ -0,0 +1,278 @@
+#include "GpuProfiler.h"
+#include "VulkanWrapper/VDevice.h"
+#include "../SPX/AllocationCounter.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+GpuProfiler::GpuProfiler(VDevice& device, uint32_t framesInFlight, uint32_t maxScopesPerFrame)
+	:mDevice(device), mMaxScopes(std::max(1u, maxScopesPerFrame)) {
+	SPX_ALLOCATION_SCOPE(AllocationTag::Profiling);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(mDevice.mPhysicalDevice, &properties);
+	mTimestampPeriod = properties.limits.timestampPeriod;
+
+	// Not every queue family has timestamps, and the ones that do don't always have all 64 bits.
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(mDevice.mPhysicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(mDevice.mPhysicalDevice, &familyCount, families.data());
+	uint32_t graphicsFamily = VDevice::findQueueFamilies(mDevice.mPhysicalDevice, mDevice.mSurface).graphicsFamily.value();
+	uint32_t validBits = families[graphicsFamily].timestampValidBits;
+
+	if (validBits == 0) {
+		CORE_ERROR("The graphics queue doesn't support timestamps, the GPU profiler is disabled.");
+		mEnabled = false;
+		return;
+	}
+	mTimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo queryInfo{};
+	queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryInfo.queryCount = mMaxScopes * 2;
+
+	mFrames.resize(framesInFlight);
+	for (auto& frame : mFrames) {
+		if (vkCreateQueryPool(mDevice.mLogicalDevice, &queryInfo, nullptr, &frame.mPool) != VK_SUCCESS) {
+			CORE_ERROR("Failed to create a timestamp query pool, the GPU profiler is disabled.");
+			mEnabled = false;
+			return;
+		}
+	}
+
+	// Calibration needs the GPU's clock and a host clock that steady_clock is built on. MSVC's steady_clock reads the
+	// performance counter and libstdc++'s reads CLOCK_MONOTONIC.
+#ifdef _WIN32
+	mHostDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+	mHostDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+	if (mDevice.isExtensionEnabled(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+		auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+			vkGetInstanceProcAddr(mDevice.mInstance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+		mGetCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+			vkGetDeviceProcAddr(mDevice.mLogicalDevice, "vkGetCalibratedTimestampsEXT"));
+
+		if (getTimeDomains && mGetCalibratedTimestamps) {
+			uint32_t domainCount = 0;
+			getTimeDomains(mDevice.mPhysicalDevice, &domainCount, nullptr);
+			std::vector<VkTimeDomainEXT> domains(domainCount);
+			getTimeDomains(mDevice.mPhysicalDevice, &domainCount, domains.data());
+
+			bool hasDevice = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+			bool hasHost = std::find(domains.begin(), domains.end(), mHostDomain) != domains.end();
+			mCalibrated = hasDevice && hasHost;
+		}
+	}
+
+	CORE_INFO("GPU profiler: {} scopes per frame, {} valid timestamp bits, {:.3f} ns per tick, {}.", mMaxScopes, validBits,
+		mTimestampPeriod, mCalibrated ? "calibrated against the CPU clock" : "not calibrated");
+}
+
+GpuProfiler::~GpuProfiler() {
+	for (auto& frame : mFrames)
+		vkDestroyQueryPool(mDevice.mLogicalDevice, frame.mPool, nullptr);
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frame, uint64_t frameNumber) {
+	if (!mEnabled)
+		return;
+
+	FrameQueries& queries = mFrames[frame];
+	if (queries.mRecorded)
+		readback(queries);
+
+	queries.mScopeCount = 0;
+	queries.mFrameNumber = frameNumber;
+	queries.mRecorded = true;
+
+	// Has to be outside any render pass, which the start of the command buffer always is.
+	vkCmdResetQueryPool(cmd, queries.mPool, 0, mMaxScopes * 2);
+	mCurrent = &queries;
+	mOpenScopes.clear();
+	beginScope(cmd, "Frame");
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer cmd) {
+	if (!mCurrent)
+		return;
+
+	if (mOpenScopes.size() > 1)
+		CORE_ERROR("GPU profiler: {} scopes still open at the end of the frame.", mOpenScopes.size() - 1);
+	while (!mOpenScopes.empty())
+		endScope(cmd);
+	mCurrent = nullptr;
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer cmd, const std::string& name) {
+	if (!mCurrent)
+		return;
+
+	uint32_t scope = addScope(name);
+	writeScopeBegin(cmd, scope);
+	// Pushed even if it was dropped, so the matching endScope still pops it.
+	mOpenScopes.push_back(scope);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer cmd) {
+	if (!mCurrent || mOpenScopes.empty())
+		return;
+
+	writeScopeEnd(cmd, mOpenScopes.back());
+	mOpenScopes.pop_back();
+}
+
+uint32_t GpuProfiler::addScope(const std::string& name) {
+	if (!mCurrent)
+		return UINT32_MAX;
+
+	if (mCurrent->mScopeCount >= mMaxScopes) {
+		if (!mWarnedOverflow) {
+			CORE_ERROR("GPU profiler: more than {} scopes in a frame, the rest aren't timed.", mMaxScopes);
+			mWarnedOverflow = true;
+		}
+		return UINT32_MAX;
+	}
+
+	if (mCurrent->mScopeCount == mCurrent->mScopes.size())
+		mCurrent->mScopes.emplace_back();
+
+	// The innermost open scope that wasn't dropped is the parent.
+	Scope& scope = mCurrent->mScopes[mCurrent->mScopeCount];
+	scope.mName = name;
+	scope.mParent = UINT32_MAX;
+	scope.mDepth = 0;
+	for (auto open = mOpenScopes.rbegin(); open != mOpenScopes.rend(); ++open) {
+		if (*open != UINT32_MAX) {
+			scope.mParent = *open;
+			scope.mDepth = mCurrent->mScopes[*open].mDepth + 1;
+			break;
+		}
+	}
+
+	return mCurrent->mScopeCount++;
+}
+
+void GpuProfiler::writeScopeBegin(VkCommandBuffer cmd, uint32_t scope) const {
+	if (mCurrent && scope != UINT32_MAX)
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mCurrent->mPool, scope * 2);
+}
+
+void GpuProfiler::writeScopeEnd(VkCommandBuffer cmd, uint32_t scope) const {
+	if (mCurrent && scope != UINT32_MAX)
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mCurrent->mPool, scope * 2 + 1);
+}
+
+void GpuProfiler::readback(FrameQueries& queries) {
+	uint32_t queryCount = queries.mScopeCount * 2;
+	if (queryCount == 0)
+		return;
+
+	// Each query is its value then its availability. The frame has finished, so everything that was written is
+	// available. A scope that was never ended isn't, and comes back with no duration instead of failing the whole read.
+	std::vector<uint64_t>& data = mReadbackData;
+	data.resize(queryCount * 2);
+	VkResult result = vkGetQueryPoolResults(mDevice.mLogicalDevice, queries.mPool, 0, queryCount, data.size() * sizeof(uint64_t),
+		data.data(), sizeof(uint64_t) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	if (result != VK_SUCCESS && result != VK_NOT_READY) {
+		CORE_ERROR("GPU profiler: failed to read back frame {}.", queries.mFrameNumber);
+		return;
+	}
+
+	auto timestamp = [&data](uint32_t query) { return data[query * 2]; };
+	auto available = [&data](uint32_t query) { return data[query * 2 + 1] != 0; };
+	auto ticksToMs = [this](uint64_t ticks) { return (ticks & mTimestampMask) * mTimestampPeriod / 1000000.0; };
+
+	uint64_t frameStart = timestamp(0);
+
+	if (mHistory.size() < HISTORY_SIZE)
+		mHistory.emplace_back();
+	GpuFrameResult& frame = mHistory[mHistoryNext];
+	frame.mFrameNumber = queries.mFrameNumber;
+	frame.mScopes.resize(queries.mScopeCount);
+	for (uint32_t i = 0; i < queries.mScopeCount; i++) {
+		GpuScopeResult& scope = frame.mScopes[i];
+		scope.mName = queries.mScopes[i].mName;
+		scope.mParent = queries.mScopes[i].mParent;
+		scope.mDepth = queries.mScopes[i].mDepth;
+		scope.mStartMs = 0.0;
+		scope.mDurationMs = 0.0;
+		scope.mChildren.clear();
+		if (available(i * 2) && available(i * 2 + 1)) {
+			scope.mStartMs = ticksToMs(timestamp(i * 2) - frameStart);
+			scope.mDurationMs = ticksToMs(timestamp(i * 2 + 1) - timestamp(i * 2));
+		}
+		if (scope.mParent != UINT32_MAX)
+			frame.mScopes[scope.mParent].mChildren.push_back(i);
+	}
+
+	frame.mCalibrated = mCalibrated && available(0);
+	frame.mCpuStart = frame.mCalibrated ? toCpuTime(frameStart) : std::chrono::steady_clock::time_point();
+
+	// Copy assigning reuses what mLatestFrame already has.
+	mLatestFrame = frame;
+	mHistoryNext = (mHistoryNext + 1) % HISTORY_SIZE;
+}
+
+std::chrono::steady_clock::time_point GpuProfiler::toCpuTime(uint64_t gpuTicks) {
+	// A GPU and host timestamp taken at the same moment. The frame's start is placed relative to them.
+	VkCalibratedTimestampInfoEXT infos[2]{};
+	infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+	infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[1].timeDomain = mHostDomain;
+
+	uint64_t timestamps[2] = { 0, 0 };
+	uint64_t maxDeviation = 0;
+	mGetCalibratedTimestamps(mDevice.mLogicalDevice, 2, infos, timestamps, &maxDeviation);
+
+	// The frame started before the calibration, so this is negative. The mask handles the counter wrapping in between.
+	uint64_t ticksAgo = (timestamps[0] - gpuTicks) & mTimestampMask;
+	double gpuOffsetNs = -static_cast<double>(ticksAgo) * mTimestampPeriod;
+
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	double hostNs = static_cast<double>(timestamps[1]) * 1000000000.0 / frequency.QuadPart;
+#else
+	double hostNs = static_cast<double>(timestamps[1]);
+#endif
+
+	auto sinceEpoch = std::chrono::nanoseconds(static_cast<int64_t>(hostNs + gpuOffsetNs));
+	return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(sinceEpoch));
+}
+
+std::vector<GpuFrameResult> GpuProfiler::getHistory() const {
+	if (mHistory.size() < HISTORY_SIZE)
+		return mHistory;
+
+	// Full, so mHistoryNext is the oldest.
+	std::vector<GpuFrameResult> history(mHistory.begin() + mHistoryNext, mHistory.end());
+	history.insert(history.end(), mHistory.begin(), mHistory.begin() + mHistoryNext);
+	return history;
+}
+
+std::vector<double> GpuProfiler::getScopeHistory(const std::string& name) const {
+	std::vector<double> durations;
+	for (const auto& frame : getHistory()) {
+		for (const auto& scope : frame.mScopes) {
+			if (scope.mName == name) {
+				durations.push_back(scope.mDurationMs);
+				break;
+			}
+		}
+	}
+	return durations;
+}
+
+void GpuProfiler::logFrame(const GpuFrameResult& frame) {
+	// Scopes are stored in the order they began, which is already depth first.
+	CORE_TRACE("GPU frame {}:", frame.mFrameNumber);
+	for (const auto& scope : frame.mScopes)
+		CORE_TRACE("  {}{:<24} {:8.3f} ms (at {:.3f} ms)", std::string(scope.mDepth * 2, ' '), scope.mName, scope.mDurationMs, scope.mStartMs);
+}
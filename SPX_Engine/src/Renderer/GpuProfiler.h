@@ -0,0 +1,145 @@
+#pragma once
+
+#include "../pch.h"
+
+// ******************************************************************************************************************************
+//															GPU PROFILER
+// Times what the GPU does with timestamp queries. Scopes are pairs of timestamps written into the command buffer, and
+// they nest, so a frame comes back as a tree: Frame > render graph passes > draw groups.
+//
+// There's one query pool per frame in flight. A frame's pool is only read back once the renderer has waited for that
+// frame's timeline value, so every result is already there and reading them never stalls. The cost is that results
+// are mFramesInFlight frames old.
+//
+// Both timestamps of a scope are written at BOTTOM_OF_PIPE, which is when everything recorded before them has finished.
+// A TOP_OF_PIPE start would be written as soon as the GPU reaches it, while earlier work is still running.
+//
+// With VK_EXT_calibrated_timestamps the frame's GPU start is also converted to a steady_clock time, so GPU work can be
+// lined up against CPU timings.
+// ******************************************************************************************************************************
+
+class VDevice;
+
+struct GpuScopeResult {
+	std::string mName;
+	// Relative to the start of the frame.
+	double mStartMs{ 0.0 };
+	double mDurationMs{ 0.0 };
+	uint32_t mDepth{ 0 };
+	// Index into the frame's scopes, UINT32_MAX for the frame itself.
+	uint32_t mParent{ UINT32_MAX };
+	std::vector<uint32_t> mChildren;
+};
+
+struct GpuFrameResult {
+	uint64_t mFrameNumber{ 0 };
+	// mScopes[0] is the whole frame, the rest are in the order they were begun.
+	std::vector<GpuScopeResult> mScopes;
+	// Only set when calibrated timestamps are available.
+	bool mCalibrated{ false };
+	std::chrono::steady_clock::time_point mCpuStart;
+
+	double getFrameMs() const { return mScopes.empty() ? 0.0 : mScopes[0].mDurationMs; }
+};
+
+class GpuProfiler {
+public:
+	GpuProfiler(VDevice& device, uint32_t framesInFlight, uint32_t maxScopesPerFrame = 256);
+	~GpuProfiler();
+
+	// Call once the frame's resources are free (its timeline value has been reached), with its command buffer just begun.
+	// Reads back whatever that frame slot recorded last time, then starts this frame's root scope.
+	void beginFrame(VkCommandBuffer cmd, uint32_t frame, uint64_t frameNumber);
+	void endFrame(VkCommandBuffer cmd);
+
+	// Nested in whichever scope is open. Only the recording thread can begin and end scopes.
+	void beginScope(VkCommandBuffer cmd, const std::string& name);
+	void endScope(VkCommandBuffer cmd);
+
+	// For secondary command buffers recorded on other threads. addScope is called on the recording thread and makes a
+	// child of the open scope without writing anything. The timestamps can then be written from any thread, each scope by
+	// one thread. Returns UINT32_MAX when the frame is out of queries, writing that does nothing.
+	uint32_t addScope(const std::string& name);
+	void writeScopeBegin(VkCommandBuffer cmd, uint32_t scope) const;
+	void writeScopeEnd(VkCommandBuffer cmd, uint32_t scope) const;
+
+	bool isEnabled() const { return mEnabled; }
+	bool isCalibrated() const { return mCalibrated; }
+
+	// The newest frame the GPU has finished. Empty until the first one comes back.
+	const GpuFrameResult& getLatestFrame() const { return mLatestFrame; }
+	// Oldest first, at most HISTORY_SIZE frames.
+	std::vector<GpuFrameResult> getHistory() const;
+	// A scope's duration over the history, oldest first. Frames without it are skipped.
+	std::vector<double> getScopeHistory(const std::string& name) const;
+
+	// Logs the frame as an indented tree.
+	static void logFrame(const GpuFrameResult& frame);
+
+	static const uint32_t HISTORY_SIZE = 240;
+
+private:
+	struct Scope {
+		std::string mName;
+		uint32_t mParent{ UINT32_MAX };
+		uint32_t mDepth{ 0 };
+	};
+
+	struct FrameQueries {
+		VkQueryPool mPool{ VK_NULL_HANDLE };
+		// Scope i uses queries 2i and 2i + 1. Only the first mScopeCount are this frame's. The rest are left from earlier
+		// frames so their names keep their storage, and naming scopes doesn't allocate every frame.
+		std::vector<Scope> mScopes;
+		uint32_t mScopeCount{ 0 };
+		uint64_t mFrameNumber{ 0 };
+		bool mRecorded{ false };
+	};
+
+	void readback(FrameQueries& queries);
+	// Where the GPU timestamp gpuTicks lands on the steady_clock.
+	std::chrono::steady_clock::time_point toCpuTime(uint64_t gpuTicks);
+
+	VDevice& mDevice;
+	bool mEnabled{ true };
+	uint32_t mMaxScopes{ 0 };
+	// Nanoseconds per tick.
+	double mTimestampPeriod{ 1.0 };
+	// Bits of the timestamp that are valid on the graphics queue.
+	uint64_t mTimestampMask{ ~0ull };
+
+	std::vector<FrameQueries> mFrames;
+	FrameQueries* mCurrent{ nullptr };
+	// Open scopes, innermost last.
+	std::vector<uint32_t> mOpenScopes;
+	// Scopes dropped because the frame ran out of queries, logged once.
+	bool mWarnedOverflow{ false };
+
+	bool mCalibrated{ false };
+	VkTimeDomainEXT mHostDomain{ VK_TIME_DOMAIN_DEVICE_EXT };
+	PFN_vkGetCalibratedTimestampsEXT mGetCalibratedTimestamps{ nullptr };
+
+	// The query results, kept around so reading them back doesn't allocate every frame.
+	std::vector<uint64_t> mReadbackData;
+	GpuFrameResult mLatestFrame;
+	// Frames are read back into their slot in place, once it's been filled the strings and vectors in it are reused.
+	std::vector<GpuFrameResult> mHistory;
+	uint32_t mHistoryNext{ 0 };
+};
+
+// Begins a scope and ends it when it goes out of scope. A null profiler does nothing.
+class GpuScope {
+public:
+	GpuScope(GpuProfiler* profiler, VkCommandBuffer cmd, const std::string& name)
+		:mProfiler(profiler), mCmd(cmd) {
+		if (mProfiler)
+			mProfiler->beginScope(mCmd, name);
+	}
+	~GpuScope() {
+		if (mProfiler)
+			mProfiler->endScope(mCmd);
+	}
+
+private:
+	GpuProfiler* mProfiler;
+	VkCommandBuffer mCmd;
+};
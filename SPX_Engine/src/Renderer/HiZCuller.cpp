@@ -0,0 +1,358 @@
+#include "HiZCuller.h"
+#include "FrustumCuller.h"
+#include "RenderObject.h"
+#include "Mesh.h"
+#include "VulkanWrapper/VDevice.h"
+#include "VulkanWrapper/VImage.h"
+#include "VulkanWrapper/VComputePipeline.h"
+#include "VulkanWrapper/VMemoryTracker.h"
+#include "VulkanWrapper/VMemoryPools.h"
+
+HiZCuller::HiZCuller(VDevice& device, VImage& depthImage, VkExtent2D extent, uint32_t objectCount, uint32_t framesInFlight)
+	:mDevice(device), mDepthImage(depthImage), mObjectCount(objectCount), mFramesInFlight(framesInFlight) {
+	createPyramid(extent);
+
+	mObjectBuffers.resize(mFramesInFlight);
+	for (auto& buffer : mObjectBuffers)
+		createBuffer(sizeof(ObjectData) * mObjectCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, buffer);
+
+	createBuffer(sizeof(VkDrawIndexedIndirectCommand) * mObjectCount * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY, mDrawBuffer);
+	createBuffer(sizeof(uint32_t) * mObjectCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY, mVisibilityBuffer);
+
+	createDescriptors();
+
+	mReducePipeline = new VComputePipeline("src/ShaderFiles/depthreduce.spv", mDevice, mReduceSetLayout, sizeof(glm::vec2));
+	mCullPipeline = new VComputePipeline("src/ShaderFiles/hizcull.spv", mDevice, mCullSetLayout, sizeof(CullPushConstants));
+
+	CORE_INFO("Hi-Z culler created with a {}x{} depth pyramid ({} levels).", mPyramidWidth, mPyramidHeight, mPyramidLevels);
+}
+
+HiZCuller::~HiZCuller() {
+	delete mCullPipeline;
+	delete mReducePipeline;
+
+	vkDestroyDescriptorPool(mDevice.mLogicalDevice, mDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(mDevice.mLogicalDevice, mReduceSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(mDevice.mLogicalDevice, mCullSetLayout, nullptr);
+
+	for (auto& buffer : mObjectBuffers) {
+		mDevice.mMemoryTracker->untrack(buffer.mAlloc);
+		vmaDestroyBuffer(mDevice.mAllocator, buffer.mBuffer, buffer.mAlloc);
+	}
+	mDevice.mMemoryTracker->untrack(mDrawBuffer.mAlloc);
+	vmaDestroyBuffer(mDevice.mAllocator, mDrawBuffer.mBuffer, mDrawBuffer.mAlloc);
+	mDevice.mMemoryTracker->untrack(mVisibilityBuffer.mAlloc);
+	vmaDestroyBuffer(mDevice.mAllocator, mVisibilityBuffer.mBuffer, mVisibilityBuffer.mAlloc);
+
+	vkDestroySampler(mDevice.mLogicalDevice, mPyramidSampler, nullptr);
+	for (auto view : mPyramidMips)
+		vkDestroyImageView(mDevice.mLogicalDevice, view, nullptr);
+	delete mPyramid;
+}
+
+void HiZCuller::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, AllocatedBuffer& buffer) {
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	// Vulkan doesn't allow zero sized buffers, so an empty scene still gets a tiny one.
+	bufferInfo.size = std::max<VkDeviceSize>(size, 16);
+	bufferInfo.usage = usage;
+
+	VmaAllocationCreateInfo vmaAllocInfo{};
+	vmaAllocInfo.usage = memoryUsage;
+	VMemoryTracker::tag(vmaAllocInfo, MemoryCategory::Other);
+
+	if (mDevice.mMemoryPools->createBuffer(bufferInfo, vmaAllocInfo, MemoryClass::General, buffer.mBuffer, buffer.mAlloc) != VK_SUCCESS)
+		CORE_ERROR("Error creating Hi-Z culling buffer.");
+	mDevice.mMemoryTracker->track(buffer.mAlloc, MemoryCategory::Other);
+}
+
+void HiZCuller::createPyramid(VkExtent2D extent) {
+	// Round down to a power of two. Each pyramid texel then covers a little more than 2x2 depth texels at most,
+	// and every level after the first is an exact 2x2 reduction.
+	auto previousPow2 = [](uint32_t value) {
+		uint32_t result = 1;
+		while (result * 2 <= value)
+			result *= 2;
+		return result;
+	};
+
+	mPyramidWidth = previousPow2(extent.width);
+	mPyramidHeight = previousPow2(extent.height);
+
+	mPyramidLevels = 1;
+	uint32_t width = mPyramidWidth;
+	uint32_t height = mPyramidHeight;
+	while (width > 1 || height > 1) {
+		mPyramidLevels++;
+		width /= 2;
+		height /= 2;
+	}
+
+	mPyramid = new VImage(mDevice, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, "Depth Pyramid", { mPyramidWidth, mPyramidHeight }, mPyramidLevels);
+
+	// The compute shader writes one level at a time, so every level needs its own view.
+	mPyramidMips.resize(mPyramidLevels);
+	for (uint32_t i = 0; i < mPyramidLevels; i++) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = mPyramid->mImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = i;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(mDevice.mLogicalDevice, &viewInfo, nullptr, &mPyramidMips[i]) != VK_SUCCESS)
+			CORE_ERROR("Failed to create depth pyramid view for level {}.", i);
+	}
+
+	// Nearest filtering. The cull shader picks its own texels and a blend of depths would not be conservative.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(mPyramidLevels);
+
+	if (vkCreateSampler(mDevice.mLogicalDevice, &samplerInfo, nullptr, &mPyramidSampler) != VK_SUCCESS)
+		CORE_ERROR("Failed to create the depth pyramid sampler.");
+}
+
+void HiZCuller::createDescriptors() {
+	// Reduce: the level above (or the depth buffer) as a sampler, the level being written as a storage image.
+	std::array<VkDescriptorSetLayoutBinding, 2> reduceBindings{};
+	reduceBindings[0].binding = 0;
+	reduceBindings[0].descriptorCount = 1;
+	reduceBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	reduceBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	reduceBindings[1].binding = 1;
+	reduceBindings[1].descriptorCount = 1;
+	reduceBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	reduceBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(reduceBindings.size());
+	layoutInfo.pBindings = reduceBindings.data();
+
+	if (vkCreateDescriptorSetLayout(mDevice.mLogicalDevice, &layoutInfo, nullptr, &mReduceSetLayout) != VK_SUCCESS)
+		CORE_ERROR("Failed to create depth reduce descriptor layout.");
+
+	// Cull: objects, draw commands, visibility and the pyramid.
+	std::array<VkDescriptorSetLayoutBinding, 4> cullBindings{};
+	for (uint32_t i = 0; i < 3; i++) {
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	cullBindings[3].binding = 3;
+	cullBindings[3].descriptorCount = 1;
+	cullBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	cullBindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+	layoutInfo.pBindings = cullBindings.data();
+
+	if (vkCreateDescriptorSetLayout(mDevice.mLogicalDevice, &layoutInfo, nullptr, &mCullSetLayout) != VK_SUCCESS)
+		CORE_ERROR("Failed to create Hi-Z cull descriptor layout.");
+
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = mPyramidLevels + mFramesInFlight;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = mPyramidLevels;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = 3 * mFramesInFlight;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = mPyramidLevels + mFramesInFlight;
+
+	if (vkCreateDescriptorPool(mDevice.mLogicalDevice, &poolInfo, nullptr, &mDescriptorPool) != VK_SUCCESS)
+		CORE_ERROR("Failed to create Hi-Z descriptor pool.");
+
+	std::vector<VkDescriptorSetLayout> reduceLayouts(mPyramidLevels, mReduceSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = mDescriptorPool;
+	allocInfo.descriptorSetCount = mPyramidLevels;
+	allocInfo.pSetLayouts = reduceLayouts.data();
+
+	mReduceSets.resize(mPyramidLevels);
+	if (vkAllocateDescriptorSets(mDevice.mLogicalDevice, &allocInfo, mReduceSets.data()) != VK_SUCCESS)
+		CORE_ERROR("Failed to allocate depth reduce descriptor sets.");
+
+	std::vector<VkDescriptorSetLayout> cullLayouts(mFramesInFlight, mCullSetLayout);
+	allocInfo.descriptorSetCount = mFramesInFlight;
+	allocInfo.pSetLayouts = cullLayouts.data();
+
+	mCullSets.resize(mFramesInFlight);
+	if (vkAllocateDescriptorSets(mDevice.mLogicalDevice, &allocInfo, mCullSets.data()) != VK_SUCCESS)
+		CORE_ERROR("Failed to allocate Hi-Z cull descriptor sets.");
+
+	// Level 0 reads the depth buffer, every other level reads the one above it.
+	for (uint32_t i = 0; i < mPyramidLevels; i++) {
+		VkDescriptorImageInfo sourceInfo{};
+		sourceInfo.sampler = mPyramidSampler;
+		sourceInfo.imageView = i == 0 ? mDepthImage.mImageView : mPyramidMips[i - 1];
+		sourceInfo.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo targetInfo{};
+		targetInfo.imageView = mPyramidMips[i];
+		targetInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> writes{};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = mReduceSets[i];
+		writes[0].dstBinding = 0;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo = &sourceInfo;
+
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = mReduceSets[i];
+		writes[1].dstBinding = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = 1;
+		writes[1].pImageInfo = &targetInfo;
+
+		vkUpdateDescriptorSets(mDevice.mLogicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	for (uint32_t i = 0; i < mFramesInFlight; i++) {
+		std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+		bufferInfos[0].buffer = mObjectBuffers[i].mBuffer;
+		bufferInfos[1].buffer = mDrawBuffer.mBuffer;
+		bufferInfos[2].buffer = mVisibilityBuffer.mBuffer;
+		for (auto& info : bufferInfos) {
+			info.offset = 0;
+			info.range = VK_WHOLE_SIZE;
+		}
+
+		VkDescriptorImageInfo pyramidInfo{};
+		pyramidInfo.sampler = mPyramidSampler;
+		pyramidInfo.imageView = mPyramid->mImageView;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 4> writes{};
+		for (uint32_t binding = 0; binding < 4; binding++) {
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = mCullSets[i];
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorCount = 1;
+			if (binding < 3) {
+				writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[binding].pBufferInfo = &bufferInfos[binding];
+			}
+			else {
+				writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				writes[binding].pImageInfo = &pyramidInfo;
+			}
+		}
+
+		vkUpdateDescriptorSets(mDevice.mLogicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void HiZCuller::updateObjects(uint32_t frame, const FrustumCuller& frustumCuller, const std::vector<RenderObject>& objects, const glm::mat4& view) {
+	if (mObjectCount == 0)
+		return;
+
+	void* data;
+	vmaMapMemory(mDevice.mAllocator, mObjectBuffers[frame].mAlloc, &data);
+	ObjectData* objectData = static_cast<ObjectData*>(data);
+
+	for (uint32_t i = 0; i < mObjectCount; i++) {
+		BoundingSphere sphere = frustumCuller.getWorldSphere(i);
+		// The view matrix has no scale, so the radius doesn't change.
+		objectData[i].mSphere = glm::vec4(glm::vec3(view * glm::vec4(sphere.center, 1.0f)), sphere.radius);
+		objectData[i].mIndexCount = static_cast<uint32_t>(objects.at(i).mMesh->mIndices.size());
+	}
+
+	vmaUnmapMemory(mDevice.mAllocator, mObjectBuffers[frame].mAlloc);
+}
+
+void HiZCuller::cullEarly(VkCommandBuffer cmd, uint32_t frame, const glm::mat4& projection) {
+	if (mFirstFrame) {
+		// Nothing was visible "last frame", so the early pass draws nothing and the late pass picks everything up.
+		vkCmdFillBuffer(cmd, mVisibilityBuffer.mBuffer, 0, VK_WHOLE_SIZE, 0);
+
+		VkMemoryBarrier fillBarrier{};
+		fillBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		fillBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &fillBarrier, 0, nullptr, 0, nullptr);
+		mFirstFrame = false;
+	}
+
+	// Waiting on last frame's indirect draws and late cull is up to the render graph, both buffers are imported into it.
+
+	dispatchCull(cmd, frame, projection, false);
+}
+
+void HiZCuller::cullLate(VkCommandBuffer cmd, uint32_t frame, const glm::mat4& projection) {
+	dispatchCull(cmd, frame, projection, true);
+}
+
+void HiZCuller::dispatchCull(VkCommandBuffer cmd, uint32_t frame, const glm::mat4& projection, bool latePass) {
+	if (mObjectCount == 0)
+		return;
+
+	CullPushConstants constants{};
+	constants.mP00 = projection[0][0];
+	// The projection's y is flipped for Vulkan. The shader mirrors the frustum with abs() so it only wants the magnitude.
+	constants.mP11 = std::abs(projection[1][1]);
+	constants.mP22 = projection[2][2];
+	constants.mP32 = projection[3][2];
+	// Pull the clip planes back out of the perspective matrix so they can never disagree with it.
+	constants.mZNear = projection[3][2] / (projection[2][2] - 1.0f);
+	constants.mZFar = projection[3][2] / (projection[2][2] + 1.0f);
+	constants.mPyramidWidth = static_cast<float>(mPyramidWidth);
+	constants.mPyramidHeight = static_cast<float>(mPyramidHeight);
+	constants.mObjectCount = mObjectCount;
+	constants.mLatePass = latePass ? 1 : 0;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipeline->mPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipeline->mPipelineLayout, 0, 1, &mCullSets[frame], 0, nullptr);
+	vkCmdPushConstants(cmd, mCullPipeline->mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmd, (mObjectCount + 63) / 64, 1, 1);
+}
+
+void HiZCuller::buildPyramid(VkCommandBuffer cmd) {
+	// The render graph has already moved the depth buffer to SHADER_READ_ONLY and the pyramid to GENERAL.
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mReducePipeline->mPipeline);
+
+	for (uint32_t i = 0; i < mPyramidLevels; i++) {
+		glm::vec2 levelSize(std::max(1u, mPyramidWidth >> i), std::max(1u, mPyramidHeight >> i));
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mReducePipeline->mPipelineLayout, 0, 1, &mReduceSets[i], 0, nullptr);
+		vkCmdPushConstants(cmd, mReducePipeline->mPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(levelSize), &levelSize);
+		vkCmdDispatch(cmd, (static_cast<uint32_t>(levelSize.x) + 31) / 32, (static_cast<uint32_t>(levelSize.y) + 31) / 32, 1);
+
+		// The next level reads this one. Levels are all in one graph pass, so these barriers stay here.
+		VkImageMemoryBarrier levelBarrier{};
+		levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.image = mPyramid->mImage;
+		levelBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../pch.h"
+#include "VulkanWrapper/DataStructures.h"
+
+// ******************************************************************************************************************************
+//															HI-Z OCCLUSION CULLING
+// Occlusion culling on the GPU using a hierarchical depth buffer (Hi-Z). After the depth buffer is drawn, a compute shader
+// reduces it into a mip chain (the depth pyramid) where every texel holds the furthest depth of the area it covers.
+// A bounding sphere is projected to the screen, the mip where it covers 2x2 texels is picked and if the sphere's closest
+// point is still behind the furthest depth there, the object is hidden.
+//
+// Every frame runs in two phases so nothing pops in:
+// Early: Objects visible last frame are drawn (frustum culled only). This fills the depth buffer with most of the occluders.
+// Late:  The pyramid is built from that depth, everything is tested against it and objects that are visible now but were
+//        not drawn in the early phase are drawn. The result becomes next frame's visibility.
+//
+// The compute shader writes the instanceCount of a VkDrawIndexedIndirectCommand per object, so hidden objects still get
+// a draw call recorded but it draws zero instances. Nothing is read back to the CPU.
+// ******************************************************************************************************************************
+
+class VDevice;
+class VImage;
+class VComputePipeline;
+class FrustumCuller;
+class RenderObject;
+
+class HiZCuller {
+public:
+	HiZCuller(VDevice& device, VImage& depthImage, VkExtent2D extent, uint32_t objectCount, uint32_t framesInFlight);
+	~HiZCuller();
+
+	// Copies the view space bounding sphere of every object into this frame's object buffer.
+	// The world space spheres come from the frustum culler, which already updated them this frame.
+	void updateObjects(uint32_t frame, const FrustumCuller& frustumCuller, const std::vector<RenderObject>& objects, const glm::mat4& view);
+
+	// These record only the dispatches. They're render graph passes, so the barriers between them (and the depth and
+	// pyramid layout changes) come from the graph.
+
+	// Writes the early phase draws. Must be recorded before the first render pass.
+	void cullEarly(VkCommandBuffer cmd, uint32_t frame, const glm::mat4& projection);
+	// Reduces the depth buffer into the pyramid. Recorded between the two render passes, with the depth buffer sampled
+	// and the pyramid in GENERAL.
+	void buildPyramid(VkCommandBuffer cmd);
+	// Writes the late phase draws and next frame's visibility.
+	void cullLate(VkCommandBuffer cmd, uint32_t frame, const glm::mat4& projection);
+
+	VkBuffer getDrawBuffer() const { return mDrawBuffer.mBuffer; }
+	VkDeviceSize getEarlyDrawOffset(uint32_t object) const { return static_cast<VkDeviceSize>(object) * sizeof(VkDrawIndexedIndirectCommand); }
+	VkDeviceSize getLateDrawOffset(uint32_t object) const { return static_cast<VkDeviceSize>(mObjectCount + object) * sizeof(VkDrawIndexedIndirectCommand); }
+
+	uint32_t getPyramidLevels() const { return mPyramidLevels; }
+	// For importing into the render graph.
+	const VImage& getPyramid() const { return *mPyramid; }
+	VkExtent2D getPyramidExtent() const { return { mPyramidWidth, mPyramidHeight }; }
+	VkBuffer getVisibilityBuffer() const { return mVisibilityBuffer.mBuffer; }
+
+private:
+	// Mirrors the layouts in hizcull.comp
+	struct ObjectData {
+		glm::vec4 mSphere;
+		uint32_t mIndexCount;
+		uint32_t mPad[3];
+	};
+
+	struct CullPushConstants {
+		float mP00, mP11, mP22, mP32;
+		float mZNear, mZFar;
+		float mPyramidWidth, mPyramidHeight;
+		uint32_t mObjectCount;
+		uint32_t mLatePass;
+	};
+
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, AllocatedBuffer& buffer);
+	void createPyramid(VkExtent2D extent);
+	void createDescriptors();
+	void dispatchCull(VkCommandBuffer cmd, uint32_t frame, const glm::mat4& projection, bool latePass);
+
+	VDevice& mDevice;
+	VImage& mDepthImage;
+	uint32_t mObjectCount{ 0 };
+	uint32_t mFramesInFlight{ 0 };
+	// The pyramid layout and the visibility buffer have to be initialized the first time they're used.
+	bool mFirstFrame{ true };
+
+	// Depth pyramid. Power of two sized so every level is exactly half of the one above.
+	VImage* mPyramid{ nullptr };
+	std::vector<VkImageView> mPyramidMips;
+	uint32_t mPyramidWidth{ 0 };
+	uint32_t mPyramidHeight{ 0 };
+	uint32_t mPyramidLevels{ 0 };
+	VkSampler mPyramidSampler{ VK_NULL_HANDLE };
+
+	// One object buffer per frame in flight since the CPU writes it every frame.
+	std::vector<AllocatedBuffer> mObjectBuffers;
+	// Early draws followed by late draws.
+	AllocatedBuffer mDrawBuffer;
+	// One uint per object, persists between frames.
+	AllocatedBuffer mVisibilityBuffer;
+
+	VComputePipeline* mReducePipeline{ nullptr };
+	VComputePipeline* mCullPipeline{ nullptr };
+
+	VkDescriptorPool mDescriptorPool{ VK_NULL_HANDLE };
+	VkDescriptorSetLayout mReduceSetLayout{ VK_NULL_HANDLE };
+	VkDescriptorSetLayout mCullSetLayout{ VK_NULL_HANDLE };
+	// One per pyramid level
+	std::vector<VkDescriptorSet> mReduceSets;
+	// One per frame in flight
+	std::vector<VkDescriptorSet> mCullSets;
+};
@@ -0,0 +1,355 @@
+#include "MemoryDefragmenter.h"
+#include "Mesh.h"
+#include "Texture.h"
+#include "GpuProfiler.h"
+#include "VulkanWrapper/VDevice.h"
+#include "VulkanWrapper/VImage.h"
+#include "../SPX/Profiler.h"
+
+MemoryDefragmenter::MemoryDefragmenter(VDevice& device, uint32_t framesInFlight)
+	:mDevice(device), mFramesInFlight(framesInFlight), mStaleTextures(framesInFlight) {}
+
+bool MemoryDefragmenter::begin(const std::unordered_map<std::string, Mesh*>& meshes,
+	const std::unordered_map<std::string, Texture*>& textures) {
+	if (isRunning())
+		return false;
+
+	SPX_PROFILE_ZONE("Defragment begin");
+	auto start = std::chrono::steady_clock::now();
+	mStats = DefragmentationStats();
+	mMovables.clear();
+
+	// Sizes are read now, VMA's allocation info can't be asked for again until the defragmentation ends.
+	auto addBuffer = [this](AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage) {
+		if (buffer.mAlloc == VK_NULL_HANDLE)
+			return;
+		VmaAllocationInfo info;
+		vmaGetAllocationInfo(mDevice.mAllocator, buffer.mAlloc, &info);
+		Movable movable;
+		movable.mBuffer = &buffer;
+		movable.mBufferSize = size;
+		movable.mBufferUsage = usage;
+		movable.mAllocationSize = info.size;
+		movable.mMemory = info.deviceMemory;
+		movable.mOffset = info.offset;
+		mMovables[buffer.mAlloc] = movable;
+	};
+	for (const auto& mesh : meshes) {
+		addBuffer(mesh.second->mVertexBuffer, sizeof(Vertex) * mesh.second->mVertices.size(), Mesh::VERTEX_BUFFER_USAGE);
+		addBuffer(mesh.second->mIndexBuffer, sizeof(uint32_t) * mesh.second->mIndices.size(), Mesh::INDEX_BUFFER_USAGE);
+	}
+	for (const auto& texture : textures) {
+		VImage* image = texture.second->mTextureImage;
+		if (!image || image->mAllocation == VK_NULL_HANDLE)
+			continue;
+		Movable movable;
+		movable.mTexture = texture.second;
+		movable.mAllocationSize = image->mAllocationInfo.size;
+		movable.mMemory = image->mAllocationInfo.deviceMemory;
+		movable.mOffset = image->mAllocationInfo.offset;
+		mMovables[image->mAllocation] = movable;
+	}
+
+	std::vector<VmaAllocation> allocations;
+	allocations.reserve(mMovables.size());
+	for (const auto& movable : mMovables)
+		allocations.push_back(movable.first);
+
+	// No CPU moves, everything is copied on the GPU, so there's no limit on what the whole plan moves. The per pass
+	// limits are applied when the moves are taken.
+	VmaDefragmentationInfo2 info{};
+	info.flags = VMA_DEFRAGMENTATION_FLAG_INCREMENTAL;
+	info.allocationCount = static_cast<uint32_t>(allocations.size());
+	info.pAllocations = allocations.data();
+	info.maxCpuBytesToMove = 0;
+	info.maxCpuAllocationsToMove = 0;
+	info.maxGpuBytesToMove = VK_WHOLE_SIZE;
+	info.maxGpuAllocationsToMove = UINT32_MAX;
+
+	VkResult result = vmaDefragmentationBegin(mDevice.mAllocator, &info, &mVmaStats, &mContext);
+	mStats.mCpuTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (result != VK_NOT_READY) {
+		if (result != VK_SUCCESS)
+			CORE_ERROR("Defragmentation failed to start ({}).", static_cast<int>(result));
+		mContext = VK_NULL_HANDLE;
+		mMovables.clear();
+		return false;
+	}
+
+	CORE_INFO("Defragmenting {} mesh and texture allocations, up to {} moves and {:.1f} MB a pass.", allocations.size(),
+		mMaxMovesPerPass, mMaxBytesPerPass / 1048576.0);
+	return true;
+}
+
+void MemoryDefragmenter::update(VkCommandBuffer cmd, uint32_t currentFrame, uint64_t frameNumber, GpuProfiler* profiler) {
+	if (!isRunning())
+		return;
+
+	SPX_PROFILE_ZONE("Defragment");
+	auto start = std::chrono::steady_clock::now();
+	mStats.mFrames++;
+
+	// The frame that copied the last pass has to finish before its old places can be reused. This frame slot was waited
+	// on before update was called, and it's the pass's slot once mFramesInFlight frames have gone by.
+	bool finished = false;
+	if (mPassInFlight && frameNumber >= mPassFrame + mFramesInFlight)
+		finished = endPass();
+
+	if (finished)
+		end();
+	else if (!mPassInFlight) {
+		GpuScope scope(profiler, cmd, "Defragment");
+		recordPass(cmd, frameNumber);
+	}
+
+	mStats.mCpuTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MemoryDefragmenter::recordPass(VkCommandBuffer cmd, uint64_t frameNumber) {
+	// Moves are taken one at a time until the budget's used up. VMA hands out each move once, the pass just gets longer.
+	std::vector<VmaDefragmentationPassMoveInfo> moves;
+	VkDeviceSize passBytes = 0;
+	while (moves.size() < mMaxMovesPerPass && passBytes < mMaxBytesPerPass) {
+		VmaDefragmentationPassMoveInfo move{};
+		VmaDefragmentationPassInfo passInfo{};
+		passInfo.moveCount = 1;
+		passInfo.pMoves = &move;
+		vmaBeginDefragmentationPass(mDevice.mAllocator, mContext, &passInfo);
+		if (passInfo.moveCount == 0)
+			break;
+
+		moves.push_back(move);
+		auto movable = mMovables.find(move.allocation);
+		if (movable != mMovables.end())
+			passBytes += movable->second.mAllocationSize;
+	}
+
+	mStats.mPasses++;
+	mPassInFlight = true;
+	mPassFrame = frameNumber;
+	// Nothing left in the plan. Ending the pass commits it and lets VMA free the empty blocks. Whatever VMA couldn't plan
+	// is given up on rather than tried again every frame.
+	if (moves.empty()) {
+		endPass();
+		end();
+		return;
+	}
+
+	// Copies are recorded in batches: barriers into the transfer layouts, the copies, barriers back. Copies in a batch
+	// have nothing between them, so a batch ends early when a move touches memory the batch already uses:
+	//   - its source was written by the batch (the plan moves the same allocation twice, the second copy reads the first),
+	//   - its destination was read by the batch (VMA placed it where an earlier move of this pass just moved out of),
+	//   - or its destination was written by the batch.
+	// The next batch's first barrier then waits for the copies before it. It also waits for the draws of the frames still
+	// in flight, which read the old places until they finish. Old places from earlier passes were only given back to VMA
+	// once every frame that used them had retired, so those are safe to write.
+	std::vector<VkImageMemoryBarrier> toTransfer;
+	std::vector<VkImageMemoryBarrier> toShaderRead;
+	std::vector<std::function<void()>> copies;
+	std::vector<MemoryRange> batchReads;
+	std::vector<MemoryRange> batchWrites;
+	auto overlapsAny = [](const MemoryRange& range, const std::vector<MemoryRange>& ranges) {
+		for (const MemoryRange& other : ranges) {
+			if (range.overlaps(other))
+				return true;
+		}
+		return false;
+	};
+
+	auto flush = [&]() {
+		if (copies.empty())
+			return;
+		// Frames before this one (and earlier batches of this one) read the old buffers and images, and may have read
+		// the memory this batch writes. The source stages cover those reads, the transfer stage the earlier copies.
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+		for (const auto& copy : copies)
+			copy();
+
+		// The copies have to land before anything draws with them, or before the next batch copies them again.
+		VkMemoryBarrier written{};
+		written.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		written.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		written.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			1, &written, 0, nullptr, static_cast<uint32_t>(toShaderRead.size()), toShaderRead.data());
+
+		toTransfer.clear();
+		toShaderRead.clear();
+		copies.clear();
+		batchReads.clear();
+		batchWrites.clear();
+	};
+
+	for (const auto& move : moves) {
+		auto found = mMovables.find(move.allocation);
+		if (found == mMovables.end()) {
+			// Only the allocations passed to begin can be moved, so this would be a VMA bug.
+			CORE_ERROR("Defragmentation moved an allocation it wasn't given.");
+			continue;
+		}
+		Movable& movable = found->second;
+		MemoryRange source{ movable.mMemory, movable.mOffset, movable.mAllocationSize };
+		MemoryRange destination{ move.memory, move.offset, movable.mAllocationSize };
+		if (overlapsAny(source, batchWrites) || overlapsAny(destination, batchReads) || overlapsAny(destination, batchWrites))
+			flush();
+
+		mStats.mAllocationsMoved++;
+		mStats.mBytesMoved += movable.mAllocationSize;
+
+		if (movable.mBuffer) {
+			VkBufferCreateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			bufferInfo.size = movable.mBufferSize;
+			bufferInfo.usage = movable.mBufferUsage;
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			VkBuffer buffer;
+			if (vkCreateBuffer(mDevice.mLogicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+				CORE_ERROR("Defragmentation couldn't create a buffer to move into.");
+				continue;
+			}
+			vkBindBufferMemory(mDevice.mLogicalDevice, buffer, move.memory, move.offset);
+
+			VkBuffer oldBuffer = movable.mBuffer->mBuffer;
+			VkDeviceSize size = movable.mBufferSize;
+			copies.push_back([cmd, oldBuffer, buffer, size]() {
+				VkBufferCopy region{};
+				region.size = size;
+				vkCmdCopyBuffer(cmd, oldBuffer, buffer, 1, &region);
+			});
+
+			mRetired.push_back({ oldBuffer, VK_NULL_HANDLE, VK_NULL_HANDLE });
+			movable.mBuffer->mBuffer = buffer;
+		}
+		else {
+			Texture* texture = movable.mTexture;
+			VImage* image = texture->mTextureImage;
+			VkImage newImage = VK_NULL_HANDLE;
+			VkImageView newImageView = VK_NULL_HANDLE;
+			image->createAt(move.memory, move.offset, newImage, newImageView);
+			if (newImage == VK_NULL_HANDLE)
+				continue;
+
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, image->mMipLevels, 0, 1 };
+
+			barrier.image = image->mImage;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			toTransfer.push_back(barrier);
+
+			barrier.image = newImage;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			toTransfer.push_back(barrier);
+
+			// Back to how textures are read. The old image stays a transfer source, nothing uses it again.
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+			toShaderRead.push_back(barrier);
+
+			VkImage oldImage = image->mImage;
+			VkExtent2D extent = image->mExtent;
+			uint32_t mipLevels = image->mMipLevels;
+			copies.push_back([cmd, oldImage, newImage, extent, mipLevels]() {
+				std::vector<VkImageCopy> regions(mipLevels);
+				for (uint32_t mip = 0; mip < mipLevels; mip++) {
+					regions[mip].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+					regions[mip].dstSubresource = regions[mip].srcSubresource;
+					regions[mip].extent = { std::max(1u, extent.width >> mip), std::max(1u, extent.height >> mip), 1 };
+				}
+				vkCmdCopyImage(cmd, oldImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					mipLevels, regions.data());
+			});
+
+			// newImage and newImageView come back as the old ones.
+			image->swapImage(newImage, newImageView);
+			mRetired.push_back({ VK_NULL_HANDLE, newImage, newImageView });
+			texture->updateDescriptor();
+			for (auto& stale : mStaleTextures)
+				stale.insert(texture);
+		}
+
+		batchReads.push_back(source);
+		batchWrites.push_back(destination);
+		movable.mMemory = move.memory;
+		movable.mOffset = move.offset;
+	}
+	flush();
+}
+
+bool MemoryDefragmenter::endPass() {
+	// Commits every move taken since the last end. VMA frees the old places and any block that's now empty.
+	VkResult result = vmaEndDefragmentationPass(mDevice.mAllocator, mContext);
+	mPassInFlight = false;
+
+	for (const auto& retired : mRetired) {
+		if (retired.mBuffer != VK_NULL_HANDLE)
+			vkDestroyBuffer(mDevice.mLogicalDevice, retired.mBuffer, nullptr);
+		if (retired.mImageView != VK_NULL_HANDLE)
+			vkDestroyImageView(mDevice.mLogicalDevice, retired.mImageView, nullptr);
+		if (retired.mImage != VK_NULL_HANDLE)
+			vkDestroyImage(mDevice.mLogicalDevice, retired.mImage, nullptr);
+	}
+	mRetired.clear();
+
+	return result == VK_SUCCESS;
+}
+
+void MemoryDefragmenter::end() {
+	vmaDefragmentationEnd(mDevice.mAllocator, mContext);
+	mContext = VK_NULL_HANDLE;
+
+	// The allocations are where they'll stay now, so the images' copies of their info can be brought up to date.
+	for (const auto& movable : mMovables) {
+		if (movable.second.mTexture)
+			vmaGetAllocationInfo(mDevice.mAllocator, movable.first, &movable.second.mTexture->mTextureImage->mAllocationInfo);
+	}
+	mMovables.clear();
+
+	mStats.mBlocksFreed = mVmaStats.deviceMemoryBlocksFreed;
+	mStats.mBytesFreed = mVmaStats.bytesFreed;
+	CORE_INFO("Defragmentation done in {} frames ({} passes): moved {} allocations ({:.1f} MB), freed {} blocks ({:.1f} MB), "
+		"{:.2f} ms of CPU time.", mStats.mFrames, mStats.mPasses, mStats.mAllocationsMoved, mStats.mBytesMoved / 1048576.0,
+		mStats.mBlocksFreed, mStats.mBytesFreed / 1048576.0, mStats.mCpuTimeMs);
+}
+
+void MemoryDefragmenter::cancel() {
+	if (!isRunning())
+		return;
+
+	if (mPassInFlight)
+		endPass();
+	CORE_WARN("Defragmentation stopped before it finished.");
+	end();
+}
+
+void MemoryDefragmenter::takeStaleTextures(uint32_t currentFrame, std::vector<Texture*>& stale) {
+	stale.clear();
+	// Almost every frame, nothing has moved.
+	if (mStaleTextures[currentFrame].empty())
+		return;
+
+	stale.assign(mStaleTextures[currentFrame].begin(), mStaleTextures[currentFrame].end());
+	mStaleTextures[currentFrame].clear();
+}
+
+double MemoryDefragmenter::getFragmentation(VmaAllocator allocator, VkDeviceSize* freeBytes) {
+	VmaStats stats;
+	vmaCalculateStats(allocator, &stats);
+	if (freeBytes)
+		*freeBytes = stats.total.unusedBytes;
+	if (stats.total.unusedBytes == 0 || stats.total.unusedRangeCount == 0)
+		return 0.0;
+	return 1.0 - static_cast<double>(stats.total.unusedRangeSizeMax) / stats.total.unusedBytes;
+}
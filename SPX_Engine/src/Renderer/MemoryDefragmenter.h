@@ -0,0 +1,119 @@
+#pragma once
+
+#include "../pch.h"
+#include "../ThirdParty/vk_mem_alloc.h"
+#include <unordered_set>
+
+// ******************************************************************************************************************************
+//														MEMORY DEFRAGMENTER
+// Compacts the memory of meshes and textures while the engine keeps drawing. Loading and freeing assets leaves holes in
+// VMA's blocks, and blocks that are mostly empty can't be given back, so memory use creeps up until allocations fail.
+//
+// Uses VMA's incremental defragmentation. begin plans every move at once, then each pass takes a few of them (at most
+// mMaxMovesPerPass allocations and mMaxBytesPerPass bytes). For every move a new buffer or image is made at the new place,
+// the frame's command buffer copies the old one into it, and the mesh or texture is switched over to it straight away,
+// so the frame that copies already draws with the new one.
+//
+// The old place can't be given back to VMA until every frame that read it has finished. That's mFramesInFlight frames
+// later, when the frame slot that recorded the copies comes back around. Then the pass is ended (VMA frees the old places
+// and any block left empty), the old buffers and images are destroyed and the next pass starts.
+//
+// Vertex and index buffers are bound from the mesh every time they're recorded, so they pick up the new buffer on
+// their own. Textures are in descriptor sets, one per frame in flight, which can only be rewritten while the GPU isn't
+// using them. Each moved texture is handed out once per frame slot by takeStaleTextures for the renderer to rewrite.
+//
+// Nothing that's being moved may be freed while a defragmentation is running.
+// ******************************************************************************************************************************
+
+class VDevice;
+class Mesh;
+class Texture;
+class GpuProfiler;
+struct AllocatedBuffer;
+
+struct DefragmentationStats {
+	uint32_t mPasses{ 0 };
+	// From begin to the end of the last pass.
+	uint32_t mFrames{ 0 };
+	uint32_t mAllocationsMoved{ 0 };
+	VkDeviceSize mBytesMoved{ 0 };
+	// Blocks left empty and given back to the driver.
+	uint32_t mBlocksFreed{ 0 };
+	VkDeviceSize mBytesFreed{ 0 };
+	// Planning, making the new resources and recording the copies. The copies themselves show up in the GPU profiler.
+	double mCpuTimeMs{ 0.0 };
+};
+
+class MemoryDefragmenter {
+public:
+	MemoryDefragmenter(VDevice& device, uint32_t framesInFlight);
+
+	// Plans moves for every mesh and texture. Returns false if one is already running or nothing needs to move.
+	bool begin(const std::unordered_map<std::string, Mesh*>& meshes, const std::unordered_map<std::string, Texture*>& textures);
+	// Call once a frame after the frame's timeline wait, with the frame's command buffer recording and outside a render
+	// pass, before anything that draws with meshes or textures is recorded.
+	void update(VkCommandBuffer cmd, uint32_t currentFrame, uint64_t frameNumber, GpuProfiler* profiler);
+	// After the GPU is idle. Finishes the pass in flight and drops the rest of the plan.
+	void cancel();
+	bool isRunning() const { return mContext != VK_NULL_HANDLE; }
+
+	// Fills stale with the textures that moved since this frame slot's descriptor sets were last written. Each is only
+	// handed out once per slot. stale is cleared first, pass the same vector every frame so it keeps its capacity.
+	void takeStaleTextures(uint32_t currentFrame, std::vector<Texture*>& stale);
+	const DefragmentationStats& getLastStats() const { return mStats; }
+
+	// 1 - largest free range / total free bytes over every block. 0 when all the free space is in one piece.
+	static double getFragmentation(VmaAllocator allocator, VkDeviceSize* freeBytes = nullptr);
+
+	uint32_t mMaxMovesPerPass{ 32 };
+	VkDeviceSize mMaxBytesPerPass{ 32 * 1024 * 1024 };
+
+private:
+	// What owns an allocation being defragmented. Exactly one of mBuffer and mTexture is set.
+	struct Movable {
+		AllocatedBuffer* mBuffer{ nullptr };
+		VkDeviceSize mBufferSize{ 0 };
+		VkBufferUsageFlags mBufferUsage{ 0 };
+		Texture* mTexture{ nullptr };
+		VkDeviceSize mAllocationSize{ 0 };
+		// Where the allocation is now. Updated as soon as a move is recorded, it's the source of the next one.
+		VkDeviceMemory mMemory{ VK_NULL_HANDLE };
+		VkDeviceSize mOffset{ 0 };
+	};
+	// Part of a VkDeviceMemory a batch of copies reads or writes.
+	struct MemoryRange {
+		VkDeviceMemory mMemory{ VK_NULL_HANDLE };
+		VkDeviceSize mOffset{ 0 };
+		VkDeviceSize mSize{ 0 };
+
+		bool overlaps(const MemoryRange& other) const {
+			return mMemory == other.mMemory && mOffset < other.mOffset + other.mSize && other.mOffset < mOffset + mSize;
+		}
+	};
+	// Replaced by a move, destroyed when the pass ends.
+	struct Retired {
+		VkBuffer mBuffer{ VK_NULL_HANDLE };
+		VkImage mImage{ VK_NULL_HANDLE };
+		VkImageView mImageView{ VK_NULL_HANDLE };
+	};
+
+	void recordPass(VkCommandBuffer cmd, uint64_t frameNumber);
+	// Returns true when there are no moves left.
+	bool endPass();
+	void end();
+
+	VDevice& mDevice;
+	uint32_t mFramesInFlight;
+
+	VmaDefragmentationContext mContext{ VK_NULL_HANDLE };
+	// VMA writes into this until vmaDefragmentationEnd.
+	VmaDefragmentationStats mVmaStats{};
+	DefragmentationStats mStats;
+	std::unordered_map<VmaAllocation, Movable> mMovables;
+
+	bool mPassInFlight{ false };
+	uint64_t mPassFrame{ 0 };
+	std::vector<Retired> mRetired;
+	// [frame]
+	std::vector<std::unordered_set<Texture*>> mStaleTextures;
+};
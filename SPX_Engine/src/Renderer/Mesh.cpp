@@ -3,9 +3,15 @@
 #include "../ThirdParty/tiny_obj_loader.h"
 #include "../ThirdParty/vk_mem_alloc.h"
 #include "VulkanWrapper/VDevice.h"
-
-Mesh::Mesh(std::string fileLocation, VDevice& device, size_t numSwapChainImages)
-	:mDevice(device), mNumSwapChainImages(numSwapChainImages) {
+#include "VulkanWrapper/VMemoryTracker.h"
+#include "VulkanWrapper/VMemoryPools.h"
+#include "../SPX/Profiler.h"
+#include "../SPX/AllocationCounter.h"
+
+Mesh::Mesh(std::string fileLocation, VDevice& device)
+	:mDevice(device) {
+	SPX_PROFILE_ZONE("Load mesh");
+	SPX_ALLOCATION_SCOPE(AllocationTag::Meshes);
 	// Loads model and its vertices and indices.
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -43,15 +49,66 @@ Mesh::Mesh(std::string fileLocation, VDevice& device, size_t numSwapChainImages)
 		}
 	}
 
+	calculateBounds();
+
 	CORE_INFO("Model loaded successfully.");
 }
 
 Mesh::~Mesh() {}
 
+void Mesh::loadPositions(const std::string& fileLocation, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices) {
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fileLocation.c_str())) {
+		throw std::runtime_error(warn + err);
+	}
+
+	// Positions only, so the obj's own vertex indices are already unique. No need for the hashing done above.
+	positions.resize(attrib.vertices.size() / 3);
+	for (size_t i = 0; i < positions.size(); i++)
+		positions[i] = { attrib.vertices[3 * i + 0], attrib.vertices[3 * i + 1], attrib.vertices[3 * i + 2] };
+
+	indices.clear();
+	for (const auto& shape : shapes) {
+		for (const auto& index : shape.mesh.indices)
+			indices.push_back(static_cast<uint32_t>(index.vertex_index));
+	}
+}
+
+void Mesh::calculateBounds() {
+	if (mVertices.empty())
+		return;
+
+	glm::vec3 minPos = mVertices[0].pos;
+	glm::vec3 maxPos = mVertices[0].pos;
+
+	for (const auto& vertex : mVertices) {
+		minPos = glm::min(minPos, vertex.pos);
+		maxPos = glm::max(maxPos, vertex.pos);
+	}
+
+	mBoundingBox.center = (minPos + maxPos) * 0.5f;
+	mBoundingBox.extents = (maxPos - minPos) * 0.5f;
+
+	// Centering the sphere on the box center and growing it to the furthest vertex gives a tighter sphere
+	// than using the box's corner distance.
+	float maxDistSq = 0.0f;
+	for (const auto& vertex : mVertices) {
+		glm::vec3 d = vertex.pos - mBoundingBox.center;
+		maxDistSq = std::max(maxDistSq, glm::dot(d, d));
+	}
+
+	mBoundingSphere.center = mBoundingBox.center;
+	mBoundingSphere.radius = std::sqrt(maxDistSq);
+}
+
 void Mesh::createBuffers() {
+	SPX_PROFILE_FUNCTION();
 	createVertexBuffer();
 	createIndexBuffer();
-	createUniformBuffers();
 }
 
 void Mesh::createVertexBuffer() {
@@ -59,13 +116,15 @@ void Mesh::createVertexBuffer() {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = sizeof(Vertex) * mVertices.size();
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	bufferInfo.usage = VERTEX_BUFFER_USAGE;
 
 	VmaAllocationCreateInfo vmaAllocInfo{};
 	vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	VMemoryTracker::tag(vmaAllocInfo, MemoryCategory::Mesh);
 
-	if (vmaCreateBuffer(mDevice.mAllocator, &bufferInfo, &vmaAllocInfo, &mVertexBuffer.mBuffer, &mVertexBuffer.mAlloc, nullptr) != VK_SUCCESS)
+	if (mDevice.mMemoryPools->createBuffer(bufferInfo, vmaAllocInfo, MemoryClass::Geometry, mVertexBuffer.mBuffer, mVertexBuffer.mAlloc) != VK_SUCCESS)
 		CORE_ERROR("Error createing Vertex Buffer in model.");
+	mDevice.mMemoryTracker->track(mVertexBuffer.mAlloc, MemoryCategory::Mesh);
 
 	//vmaDestroyBuffer(mDevice.mAllocator, mVertexBuffer, mVertexBufferAlloc);
 
@@ -84,13 +143,15 @@ void Mesh::createIndexBuffer() {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = sizeof(mIndices[0]) * mIndices.size();
-	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	bufferInfo.usage = INDEX_BUFFER_USAGE;
 
 	VmaAllocationCreateInfo vmaAllocInfo{};
 	vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	VMemoryTracker::tag(vmaAllocInfo, MemoryCategory::Mesh);
 
-	if (vmaCreateBuffer(mDevice.mAllocator, &bufferInfo, &vmaAllocInfo, &mIndexBuffer.mBuffer, &mIndexBuffer.mAlloc, nullptr) != VK_SUCCESS)
+	if (mDevice.mMemoryPools->createBuffer(bufferInfo, vmaAllocInfo, MemoryClass::Geometry, mIndexBuffer.mBuffer, mIndexBuffer.mAlloc) != VK_SUCCESS)
 		CORE_ERROR("Error createing Index Buffer in model.");
+	mDevice.mMemoryTracker->track(mIndexBuffer.mAlloc, MemoryCategory::Mesh);
 
 	//vmaDestroyBuffer(mDevice.mAllocator, mIndexBuffer, mIndexBufferAlloc);
 
@@ -102,57 +163,3 @@ void Mesh::createIndexBuffer() {
 
 	CORE_TRACE("Index buffer created.");
 }
-
-void Mesh::createUniformBuffers() {
-	mUniformBuffers.resize(mNumSwapChainImages);
-
-	for (size_t i = 0; i < mNumSwapChainImages; i++) {
-		VkBufferCreateInfo bufferInfo{};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = sizeof(UniformBufferObject);
-		bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-
-		VmaAllocationCreateInfo vmaAllocInfo{};
-		vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-
-		if (vmaCreateBuffer(mDevice.mAllocator, &bufferInfo, &vmaAllocInfo, &mUniformBuffers[i].mBuffer, &mUniformBuffers[i].mAlloc, nullptr) != VK_SUCCESS)
-			CORE_ERROR("Error creating Uniform Buffer in model.");
-
-		//vmaDestroyBuffer(mDevice.mAllocator, mUniformBuffers[i], mUniformBufferAllocs[i]);
-		CORE_TRACE("Uniform buffer created.");
-	}
-}
-
-void Mesh::updateUniformBuffers(VkExtent2D extent, uint32_t currentImage) {
-	// Calculate time in seconds
-	static auto startTime = std::chrono::high_resolution_clock::now();
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-
-	UniformBufferObject ubo = {};
-	// Rotate 90 degress per second
-	// existing transform, rotation angle and rotation axis as prams
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	//ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(.0f, 1.0f, 1.0f));
-	//ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(250.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	//ubo.model = glm::mat4(1.0f);
-	// Look at the geometry from above at 45 degree angle.
-	// eyepos, center pos, up axis are the params
-	ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	// Perspective projection with 45 degree vertial field of view.
-	// Next param is aspect ratio, near and far view planes.
-	// Important to use current swapchain extent incase the window is resized.
-	ubo.proj = glm::perspective(glm::radians(45.0f), extent.width / (float)extent.height, 0.1f, 1000.0f);
-	// GLM has the Y coordinate flipped, so I have to flip it by timesing by -1 or it will be rendered upsidedown
-	ubo.proj[1][1] *= -1;
-
-	// All transforms are defined now, so I can copy the data in the uniform buffer obj to the current uniform buffer.
-	// This happens the same as vertex buffer, but without the staging buffer becuase it gets called so often, it creates too much overhead
-	void* data;
-	vmaMapMemory(mDevice.mAllocator, mUniformBuffers[currentImage].mAlloc, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vmaUnmapMemory(mDevice.mAllocator, mUniformBuffers[currentImage].mAlloc);
-
-	// Doing uniform buffers this way is not the most efficent way to pass frequently changing values to the shader.
-	// A more efficent way to pass a small buffer of data to shaders are PUSH CONSTANTS.
-}
@@ -10,26 +10,34 @@ class VDevice;
 
 class Mesh {
 public:
-	Mesh(std::string fileLocation, VDevice& device, size_t numSwapChainImages);
+	// Meshes are shared. Every RenderObject using the same file points at the same Mesh, the per object uniform
+	// buffers live on the RenderObject.
+	Mesh(std::string fileLocation, VDevice& device);
 	~Mesh();
 
 	void createBuffers();
 	void createVertexBuffer();
 	void createIndexBuffer();
-	// TODO: Figure out if I really need a uniform buffer for each swapchain image. So far as I understand
-	//		 it removes the possiblity of trying to update a buffer while it is being accessed.
-	void createUniformBuffers();
-	void updateUniformBuffers(VkExtent2D extent, uint32_t currentImage);
+	// Loads only the positions and indices of a model. Used for low poly occluder meshes that are never drawn.
+	static void loadPositions(const std::string& fileLocation, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices);
+	// Builds the model space bounding sphere and AABB from mVertices. Called once the model is loaded.
+	void calculateBounds();
 
 	std::vector<Vertex> mVertices;
 	std::vector<uint32_t> mIndices;
 
+	BoundingSphere mBoundingSphere;
+	AABB mBoundingBox;
+
 	AllocatedBuffer mVertexBuffer;
 	AllocatedBuffer mIndexBuffer;
-	std::vector<AllocatedBuffer> mUniformBuffers;
+	// Transfer source and destination so defragmentation can copy them somewhere else.
+	static const VkBufferUsageFlags VERTEX_BUFFER_USAGE = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	static const VkBufferUsageFlags INDEX_BUFFER_USAGE = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
 
 private:
 	VDevice& mDevice;
-	size_t mNumSwapChainImages{ 0 };
 };
\ No newline at end of file
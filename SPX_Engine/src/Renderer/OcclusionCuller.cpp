@@ -0,0 +1,259 @@
+#include "OcclusionCuller.h"
+#include "../SPX/JobSystem.h"
+#include <immintrin.h>
+#include <cfloat>
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height) {
+	SPX_ALLOCATION_SCOPE(AllocationTag::Culling);
+	// Round up to whole tiles so no tile is ever partially outside the buffer.
+	mTilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	mTilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	mWidth = mTilesX * TILE_WIDTH;
+	mHeight = mTilesY * TILE_HEIGHT;
+
+	mDepth.assign(static_cast<size_t>(mWidth) * mHeight, 1.0f);
+	mTiles.resize(static_cast<size_t>(mTilesX) * mTilesY);
+}
+
+void OcclusionCuller::renderOccluders(const std::vector<Occluder>& occluders, const glm::mat4& viewProj, JobSystem* jobSystem,
+	FrameArena* arena) {
+	mViewProj = viewProj;
+	binTriangles(occluders, viewProj);
+
+	uint32_t tileCount = static_cast<uint32_t>(mTiles.size());
+
+	// One job per tile. Tiles don't share memory so no synchronization is needed.
+	if (!jobSystem) {
+		for (uint32_t tile = 0; tile < tileCount; tile++)
+			rasterizeTile(tile);
+		return;
+	}
+
+	jobSystem->parallelFor(tileCount, 1, [this](size_t begin, size_t end) {
+		for (size_t tile = begin; tile < end; tile++)
+			rasterizeTile(static_cast<uint32_t>(tile));
+	}, arena);
+}
+
+void OcclusionCuller::binTriangles(const std::vector<Occluder>& occluders, const glm::mat4& viewProj) {
+	mTriangles.clear();
+	for (auto& tile : mTiles)
+		tile.mTriangles.clear();
+
+	std::vector<glm::vec4>& clipPositions = mClipPositions;
+
+	for (const auto& occluder : occluders) {
+		glm::mat4 mvp = viewProj * occluder.mTransform;
+
+		clipPositions.resize(occluder.mPositions.size());
+		for (size_t i = 0; i < occluder.mPositions.size(); i++)
+			clipPositions[i] = mvp * glm::vec4(occluder.mPositions[i], 1.0f);
+
+		for (size_t i = 0; i + 2 < occluder.mIndices.size(); i += 3) {
+			glm::vec4 c0 = clipPositions[occluder.mIndices[i + 0]];
+			glm::vec4 c1 = clipPositions[occluder.mIndices[i + 1]];
+			glm::vec4 c2 = clipPositions[occluder.mIndices[i + 2]];
+
+			// Skipping triangles that cross the near plane instead of clipping them is conservative.
+			// A missing occluder triangle can only make things visible, never hide them.
+			if (c0.w < NEAR_CLIP_W || c1.w < NEAR_CLIP_W || c2.w < NEAR_CLIP_W)
+				continue;
+
+			glm::vec2 s0((c0.x / c0.w * 0.5f + 0.5f) * mWidth, (c0.y / c0.w * 0.5f + 0.5f) * mHeight);
+			glm::vec2 s1((c1.x / c1.w * 0.5f + 0.5f) * mWidth, (c1.y / c1.w * 0.5f + 0.5f) * mHeight);
+			glm::vec2 s2((c2.x / c2.w * 0.5f + 0.5f) * mWidth, (c2.y / c2.w * 0.5f + 0.5f) * mHeight);
+			float z0 = c0.z / c0.w;
+			float z1 = c1.z / c1.w;
+			float z2 = c2.z / c2.w;
+
+			float area = (s1.x - s0.x) * (s2.y - s0.y) - (s2.x - s0.x) * (s1.y - s0.y);
+			if (std::abs(area) < 1e-6f)
+				continue;
+
+			// Both windings are rasterized so occluders don't need consistent winding. Swapping two vertices
+			// makes every triangle positive so the edge tests below only have one sign to check.
+			if (area < 0.0f) {
+				std::swap(s1, s2);
+				std::swap(z1, z2);
+				area = -area;
+			}
+
+			ScreenTriangle tri;
+			tri.mV0 = s0;
+			tri.mV1 = s1;
+			tri.mV2 = s2;
+
+			tri.mMinX = std::max(0, static_cast<int>(std::floor(std::min(s0.x, std::min(s1.x, s2.x)))));
+			tri.mMinY = std::max(0, static_cast<int>(std::floor(std::min(s0.y, std::min(s1.y, s2.y)))));
+			tri.mMaxX = std::min(static_cast<int>(mWidth) - 1, static_cast<int>(std::floor(std::max(s0.x, std::max(s1.x, s2.x)))));
+			tri.mMaxY = std::min(static_cast<int>(mHeight) - 1, static_cast<int>(std::floor(std::max(s0.y, std::max(s1.y, s2.y)))));
+
+			if (tri.mMinX > tri.mMaxX || tri.mMinY > tri.mMaxY)
+				continue;
+
+			// Depth is linear in screen space after the perspective divide, so it can be stored as a plane.
+			tri.mDepthA = ((z1 - z0) * (s2.y - s0.y) - (z2 - z0) * (s1.y - s0.y)) / area;
+			tri.mDepthB = ((s1.x - s0.x) * (z2 - z0) - (s2.x - s0.x) * (z1 - z0)) / area;
+			tri.mDepthC = z0 - tri.mDepthA * s0.x - tri.mDepthB * s0.y;
+
+			uint32_t triIndex = static_cast<uint32_t>(mTriangles.size());
+			mTriangles.push_back(tri);
+
+			for (int ty = tri.mMinY / static_cast<int>(TILE_HEIGHT); ty <= tri.mMaxY / static_cast<int>(TILE_HEIGHT); ty++) {
+				for (int tx = tri.mMinX / static_cast<int>(TILE_WIDTH); tx <= tri.mMaxX / static_cast<int>(TILE_WIDTH); tx++)
+					mTiles[ty * mTilesX + tx].mTriangles.push_back(triIndex);
+			}
+		}
+	}
+}
+
+void OcclusionCuller::rasterizeTile(uint32_t tileIndex) {
+	Tile& tile = mTiles[tileIndex];
+	float* depth = &mDepth[static_cast<size_t>(tileIndex) * TILE_WIDTH * TILE_HEIGHT];
+
+	const int tileX = static_cast<int>((tileIndex % mTilesX) * TILE_WIDTH);
+	const int tileY = static_cast<int>((tileIndex / mTilesX) * TILE_HEIGHT);
+
+	// Clear to the far plane.
+	const __m128 farDepth = _mm_set1_ps(1.0f);
+	for (uint32_t i = 0; i < TILE_WIDTH * TILE_HEIGHT; i += 4)
+		_mm_storeu_ps(depth + i, farDepth);
+
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (uint32_t triIndex : tile.mTriangles) {
+		const ScreenTriangle& tri = mTriangles[triIndex];
+
+		int minX = std::max(tri.mMinX, tileX);
+		int maxX = std::min(tri.mMaxX, tileX + static_cast<int>(TILE_WIDTH) - 1);
+		int minY = std::max(tri.mMinY, tileY);
+		int maxY = std::min(tri.mMaxY, tileY + static_cast<int>(TILE_HEIGHT) - 1);
+
+		// Edge functions in the form E(x, y) = a * x + b * y + c. A pixel is inside when all three are positive.
+		// Edge 0: v1 -> v2, Edge 1: v2 -> v0, Edge 2: v0 -> v1
+		float a0 = -(tri.mV2.y - tri.mV1.y), b0 = tri.mV2.x - tri.mV1.x;
+		float a1 = -(tri.mV0.y - tri.mV2.y), b1 = tri.mV0.x - tri.mV2.x;
+		float a2 = -(tri.mV1.y - tri.mV0.y), b2 = tri.mV1.x - tri.mV0.x;
+		float c0 = -(a0 * tri.mV1.x + b0 * tri.mV1.y);
+		float c1 = -(a1 * tri.mV2.x + b1 * tri.mV2.y);
+		float c2 = -(a2 * tri.mV0.x + b2 * tri.mV0.y);
+
+		__m128 va0 = _mm_set1_ps(a0), vb0 = _mm_set1_ps(b0), vc0 = _mm_set1_ps(c0);
+		__m128 va1 = _mm_set1_ps(a1), vb1 = _mm_set1_ps(b1), vc1 = _mm_set1_ps(c1);
+		__m128 va2 = _mm_set1_ps(a2), vb2 = _mm_set1_ps(b2), vc2 = _mm_set1_ps(c2);
+		__m128 vDepthA = _mm_set1_ps(tri.mDepthA), vDepthB = _mm_set1_ps(tri.mDepthB), vDepthC = _mm_set1_ps(tri.mDepthC);
+
+		// Start on a group of 4 so the loads line up with the tile rows. Extra lanes on the left are still
+		// inside the tile and get rejected by the edge tests if they're outside the triangle.
+		int startX = minX & ~3;
+
+		for (int y = minY; y <= maxY; y++) {
+			__m128 py = _mm_set1_ps(static_cast<float>(y) + 0.5f);
+			float* row = depth + (y - tileY) * TILE_WIDTH;
+
+			__m128 rowE0 = _mm_add_ps(_mm_mul_ps(vb0, py), vc0);
+			__m128 rowE1 = _mm_add_ps(_mm_mul_ps(vb1, py), vc1);
+			__m128 rowE2 = _mm_add_ps(_mm_mul_ps(vb2, py), vc2);
+			__m128 rowDepth = _mm_add_ps(_mm_mul_ps(vDepthB, py), vDepthC);
+
+			for (int x = startX; x <= maxX; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(va0, px), rowE0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(va1, px), rowE1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(va2, px), rowE2);
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(e0, zero), _mm_cmpgt_ps(e1, zero)), _mm_cmpgt_ps(e2, zero));
+
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				float* dst = row + (x - tileX);
+				__m128 current = _mm_loadu_ps(dst);
+				__m128 z = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(vDepthA, px), rowDepth));
+				_mm_storeu_ps(dst, _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, current)));
+			}
+		}
+	}
+
+	// Furthest depth in the tile. If an object is nearer than this it can't be hidden by anything in the tile,
+	// and if it is further the whole tile hides it.
+	__m128 maxDepth = _mm_loadu_ps(depth);
+	for (uint32_t i = 4; i < TILE_WIDTH * TILE_HEIGHT; i += 4)
+		maxDepth = _mm_max_ps(maxDepth, _mm_loadu_ps(depth + i));
+
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, maxDepth);
+	tile.mMaxDepth = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+}
+
+bool OcclusionCuller::isVisible(const AABB& worldBox) const {
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float minDepth = FLT_MAX;
+
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 offset((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+		glm::vec4 clip = mViewProj * glm::vec4(worldBox.center + offset * worldBox.extents, 1.0f);
+
+		// Box crosses the near plane so the camera is basically inside it.
+		if (clip.w < NEAR_CLIP_W)
+			return true;
+
+		float sx = (clip.x / clip.w * 0.5f + 0.5f) * mWidth;
+		float sy = (clip.y / clip.w * 0.5f + 0.5f) * mHeight;
+		minX = std::min(minX, sx);
+		maxX = std::max(maxX, sx);
+		minY = std::min(minY, sy);
+		maxY = std::max(maxY, sy);
+		minDepth = std::min(minDepth, clip.z / clip.w);
+	}
+
+	int x0 = std::max(0, static_cast<int>(std::floor(minX)));
+	int y0 = std::max(0, static_cast<int>(std::floor(minY)));
+	int x1 = std::min(static_cast<int>(mWidth) - 1, static_cast<int>(std::floor(maxX)));
+	int y1 = std::min(static_cast<int>(mHeight) - 1, static_cast<int>(std::floor(maxY)));
+
+	// Off screen boxes are the frustum culler's job. Treat them as visible to stay conservative.
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	const __m128 objDepth = _mm_set1_ps(minDepth);
+	const __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 rectMin = _mm_set1_ps(static_cast<float>(x0));
+	const __m128 rectMax = _mm_set1_ps(static_cast<float>(x1));
+
+	for (int ty = y0 / static_cast<int>(TILE_HEIGHT); ty <= y1 / static_cast<int>(TILE_HEIGHT); ty++) {
+		for (int tx = x0 / static_cast<int>(TILE_WIDTH); tx <= x1 / static_cast<int>(TILE_WIDTH); tx++) {
+			uint32_t tileIndex = ty * mTilesX + tx;
+
+			// Coarse test: every pixel in the tile is closer than the nearest point of the box.
+			if (mTiles[tileIndex].mMaxDepth < minDepth)
+				continue;
+
+			const float* depth = &mDepth[static_cast<size_t>(tileIndex) * TILE_WIDTH * TILE_HEIGHT];
+			int tileX = tx * static_cast<int>(TILE_WIDTH);
+			int tileY = ty * static_cast<int>(TILE_HEIGHT);
+
+			int startX = std::max(x0, tileX) & ~3;
+			int endX = std::min(x1, tileX + static_cast<int>(TILE_WIDTH) - 1);
+			int startY = std::max(y0, tileY);
+			int endY = std::min(y1, tileY + static_cast<int>(TILE_HEIGHT) - 1);
+
+			for (int y = startY; y <= endY; y++) {
+				const float* row = depth + (y - tileY) * TILE_WIDTH;
+
+				for (int x = startX; x <= endX; x += 4) {
+					__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+					__m128 inRect = _mm_and_ps(_mm_cmpge_ps(px, rectMin), _mm_cmple_ps(px, rectMax));
+
+					// Any pixel further away than the box's nearest point means part of the box could show.
+					__m128 passes = _mm_and_ps(inRect, _mm_cmpge_ps(_mm_loadu_ps(row + (x - tileX)), objDepth));
+					if (_mm_movemask_ps(passes) != 0)
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../pch.h"
+#include "VulkanWrapper/DataStructures.h"
+
+// ******************************************************************************************************************************
+//															OCCLUSION CULLING
+// Software occlusion culling on the CPU. A small set of occluders (big meshes or dedicated low poly stand-ins) are rasterized
+// into a low resolution depth buffer, then the AABB of every object that survived frustum culling is tested against it.
+// Nothing is read back from the GPU, so this costs no GPU time and adds no latency.
+//
+// The depth buffer is split into tiles. Each tile stores its pixels plus the furthest depth inside it, which makes the
+// buffer hierarchical: most tests are answered by the tile's max depth without touching a single pixel.
+// Tiles are rasterized independently, so the work is spread across cores by screen tile.
+//
+// Depth here is NDC z/w where smaller is closer, the same as the LESS compare used by the graphics pipeline.
+// ******************************************************************************************************************************
+
+class JobSystem;
+class FrameArena;
+
+struct Occluder {
+	std::vector<glm::vec3> mPositions;
+	std::vector<uint32_t> mIndices;
+	glm::mat4 mTransform{ 1.0f };
+};
+
+class OcclusionCuller {
+public:
+	OcclusionCuller(uint32_t width = 320, uint32_t height = 192);
+
+	// Clears the depth buffer and rasterizes the occluders with the given camera. Tiles are rasterized as jobs if a job system is given.
+	void renderOccluders(const std::vector<Occluder>& occluders, const glm::mat4& viewProj, JobSystem* jobSystem = nullptr,
+		FrameArena* arena = nullptr);
+
+	// Returns false if the world space box is completely hidden behind the rasterized occluders.
+	bool isVisible(const AABB& worldBox) const;
+
+	uint32_t getWidth() const { return mWidth; }
+	uint32_t getHeight() const { return mHeight; }
+
+	static const uint32_t TILE_WIDTH = 32;
+	static const uint32_t TILE_HEIGHT = 16;
+
+	// Objects nearer than this in clip space w are treated as visible since they can't be projected safely.
+	static constexpr float NEAR_CLIP_W = 0.1f;
+
+private:
+	// Triangle in screen space ready for rasterization.
+	struct ScreenTriangle {
+		glm::vec2 mV0, mV1, mV2;
+		// Depth as a plane over screen space: z = mDepthA * x + mDepthB * y + mDepthC
+		float mDepthA, mDepthB, mDepthC;
+		// Screen space bounding box in pixels.
+		int mMinX, mMinY, mMaxX, mMaxY;
+	};
+
+	struct Tile {
+		std::vector<uint32_t> mTriangles;
+		float mMaxDepth{ 1.0f };
+	};
+
+	void binTriangles(const std::vector<Occluder>& occluders, const glm::mat4& viewProj);
+	void rasterizeTile(uint32_t tileIndex);
+
+	glm::mat4 mViewProj{ 1.0f };
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mTilesX;
+	uint32_t mTilesY;
+
+	// Stored tile by tile (all pixels of tile 0, then tile 1...) so a thread only touches its own cache lines.
+	std::vector<float> mDepth;
+	std::vector<Tile> mTiles;
+	std::vector<ScreenTriangle> mTriangles;
+	// One occluder's vertices in clip space. Kept around so binning doesn't allocate every frame.
+	std::vector<glm::vec4> mClipPositions;
+};
@@ -0,0 +1,128 @@
+#include "PipelineStateCache.h"
+#include "VulkanWrapper/VDevice.h"
+#include "../SPX/JobSystem.h"
+
+PipelineStateCache::PipelineStateCache(VDevice& device, JobSystem* jobSystem)
+	:mDevice(device), mJobSystem(jobSystem), mPendingCompiles(new JobCounter()) {}
+
+PipelineStateCache::~PipelineStateCache() {
+	waitForPending();
+
+	for (auto& entry : mEntries) {
+		delete entry.second->mPipeline;
+		delete entry.second;
+	}
+	delete mPendingCompiles;
+}
+
+void PipelineStateCache::prepare(const std::vector<GraphicsPipelineDescription>& descriptions) {
+	std::vector<Entry*> toCompile;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (const auto& description : descriptions) {
+			if (findEntry(description))
+				continue;
+
+			// Descriptions repeated in the same call land here on the second copy, so they're only compiled once.
+			Entry* entry = new Entry();
+			entry->mDescription = description;
+			entry->mCompiling = true;
+			mEntries.emplace(description.hash(), entry);
+			toCompile.push_back(entry);
+		}
+	}
+
+	for (Entry* entry : toCompile) {
+		if (mJobSystem)
+			mJobSystem->run([this, entry]() { compile(entry); }, mPendingCompiles);
+		else
+			compile(entry);
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats.mCompiledInBackground += static_cast<uint32_t>(toCompile.size());
+}
+
+void PipelineStateCache::waitForPending() {
+	if (mJobSystem)
+		mJobSystem->wait(*mPendingCompiles);
+}
+
+VGraphicsPipeline* PipelineStateCache::getPipeline(const GraphicsPipelineDescription& description) {
+	Entry* entry = nullptr;
+	bool compileHere = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		entry = findEntry(description);
+		if (entry && !entry->mCompiling) {
+			mStats.mHits++;
+			return entry->mPipeline;
+		}
+
+		if (!entry) {
+			entry = new Entry();
+			entry->mDescription = description;
+			entry->mCompiling = true;
+			mEntries.emplace(description.hash(), entry);
+			compileHere = true;
+			mStats.mStalls++;
+		}
+	}
+
+	if (compileHere) {
+		CORE_INFO("Pipeline ({}, {}) wasn't prepared, compiling it on the calling thread.", description.mVertexShader, description.mFragmentShader);
+		compile(entry);
+	}
+	else {
+		// Already compiling as a job. Waiting on the counter also runs other jobs in the meantime.
+		waitForPending();
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	return entry->mPipeline;
+}
+
+VGraphicsPipeline* PipelineStateCache::findPipeline(const GraphicsPipelineDescription& description) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	Entry* entry = findEntry(description);
+	if (!entry || entry->mCompiling)
+		return nullptr;
+
+	mStats.mHits++;
+	return entry->mPipeline;
+}
+
+PipelineStateCacheStats PipelineStateCache::getStats() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	PipelineStateCacheStats stats = mStats;
+	stats.mPipelines = static_cast<uint32_t>(mEntries.size());
+	return stats;
+}
+
+PipelineStateCache::Entry* PipelineStateCache::findEntry(const GraphicsPipelineDescription& description) {
+	auto range = mEntries.equal_range(description.hash());
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->mDescription == description)
+			return it->second;
+	}
+	return nullptr;
+}
+
+void PipelineStateCache::compile(Entry* entry) {
+	VGraphicsPipeline* pipeline = nullptr;
+
+	// A missing shader file throws. On a worker thread that would take down the whole program, so it's logged here
+	// and the entry is left without a pipeline.
+	try {
+		pipeline = new VGraphicsPipeline(mDevice, entry->mDescription);
+	}
+	catch (const std::exception& e) {
+		CORE_ERROR("Failed to compile pipeline ({}, {}): {}", entry->mDescription.mVertexShader, entry->mDescription.mFragmentShader, e.what());
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	entry->mPipeline = pipeline;
+	entry->mCompiling = false;
+}
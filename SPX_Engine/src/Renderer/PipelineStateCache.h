@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../pch.h"
+#include "VulkanWrapper/VGraphicsPipeline.h"
+#include <mutex>
+
+// ******************************************************************************************************************************
+//														PIPELINE STATE CACHE
+// Every graphics pipeline the renderer uses comes from here. Pipelines are looked up by their description, so two
+// materials that end up with the same shaders and state share one VkPipeline instead of compiling it twice.
+//
+// Compiling a pipeline can take tens of milliseconds, so it should never happen while a frame is being recorded.
+// During loading every description that will be needed is handed to prepare(), which compiles the missing ones as jobs
+// on the job system (vkCreateGraphicsPipelines is safe to call from several threads, and they all share the device's
+// VkPipelineCache). waitForPending() blocks until they're all done. getPipeline() on something that was never prepared
+// still works, it just compiles on the spot and counts as a stall.
+// ******************************************************************************************************************************
+
+class VDevice;
+class JobSystem;
+class JobCounter;
+
+struct PipelineStateCacheStats {
+	uint32_t mPipelines{ 0 };
+	// Lookups that found an existing pipeline.
+	uint32_t mHits{ 0 };
+	// Pipelines compiled as jobs by prepare().
+	uint32_t mCompiledInBackground{ 0 };
+	// Pipelines getPipeline() had to compile itself because nobody prepared them.
+	uint32_t mStalls{ 0 };
+};
+
+class PipelineStateCache {
+public:
+	// Without a job system prepare() compiles on the calling thread.
+	PipelineStateCache(VDevice& device, JobSystem* jobSystem = nullptr);
+	~PipelineStateCache();
+
+	// Starts compiling every description that isn't already cached or compiling. Returns straight away.
+	void prepare(const std::vector<GraphicsPipelineDescription>& descriptions);
+	// Blocks until everything passed to prepare() has been compiled.
+	void waitForPending();
+
+	// Returns the pipeline for description, compiling it now if it was never prepared. If it's still compiling in the
+	// background this waits for it. nullptr if the compile failed, the error is logged when it happens.
+	VGraphicsPipeline* getPipeline(const GraphicsPipelineDescription& description);
+	// Never blocks. nullptr if the pipeline isn't ready (yet).
+	VGraphicsPipeline* findPipeline(const GraphicsPipelineDescription& description);
+
+	PipelineStateCacheStats getStats();
+
+private:
+	struct Entry {
+		GraphicsPipelineDescription mDescription;
+		// Null until the compile finishes. Only written once, under mMutex.
+		VGraphicsPipeline* mPipeline{ nullptr };
+		bool mCompiling{ false };
+	};
+
+	// Returns the entry for description, or nullptr. Call with mMutex held.
+	Entry* findEntry(const GraphicsPipelineDescription& description);
+	void compile(Entry* entry);
+
+	VDevice& mDevice;
+	JobSystem* mJobSystem{ nullptr };
+
+	std::mutex mMutex;
+	// Keyed by the description's hash. Collisions are possible in theory, so each bucket is checked with ==.
+	std::unordered_multimap<uint64_t, Entry*> mEntries;
+	JobCounter* mPendingCompiles{ nullptr };
+
+	PipelineStateCacheStats mStats;
+};
@@ -0,0 +1,911 @@
+#include "RenderGraph.h"
+#include "GpuProfiler.h"
+#include "VulkanWrapper/VDevice.h"
+#include "VulkanWrapper/VImage.h"
+#include "VulkanWrapper/VMemoryTracker.h"
+#include "VulkanWrapper/VMemoryPools.h"
+#include "../SPX/AllocationCounter.h"
+
+namespace {
+	const VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	bool lifetimesOverlap(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+		return !(lastA < firstB || lastB < firstA);
+	}
+}
+
+// ******************************************************************************************************************************
+//																PASS BUILDER
+// ******************************************************************************************************************************
+
+void RGPassBuilder::read(RGResource resource, RGAccess access) {
+	if (!resource.isValid()) {
+		CORE_ERROR("Render graph: pass {} reads an invalid resource.", mGraph.mPasses[mPassIndex].mName);
+		return;
+	}
+
+	RenderGraph::Usage usage;
+	usage.mResource = resource.mIndex;
+	usage.mVersion = resource.mVersion;
+	usage.mAccess = access;
+	mGraph.mPasses[mPassIndex].mUsages.push_back(usage);
+}
+
+RGResource RGPassBuilder::write(RGResource resource, RGAccess access) {
+	if (!resource.isValid()) {
+		CORE_ERROR("Render graph: pass {} writes an invalid resource.", mGraph.mPasses[mPassIndex].mName);
+		return resource;
+	}
+
+	// Versions are a straight line. Writing an old version would mean two passes both think they produce the next one.
+	RenderGraph::Resource& target = mGraph.mResources[resource.mIndex];
+	if (resource.mVersion != target.mLatestVersion)
+		CORE_ERROR("Render graph: pass {} writes version {} of {}, but version {} already exists.", mGraph.mPasses[mPassIndex].mName,
+			resource.mVersion, target.mName, target.mLatestVersion);
+
+	RenderGraph::Usage usage;
+	usage.mResource = resource.mIndex;
+	usage.mVersion = ++target.mLatestVersion;
+	usage.mAccess = access;
+	usage.mWrite = true;
+	mGraph.mPasses[mPassIndex].mUsages.push_back(usage);
+
+	return RGResource{ resource.mIndex, usage.mVersion };
+}
+
+RGResource RGPassBuilder::writeColor(RGResource resource, bool clear) {
+	RGResource result = write(resource, RGAccess::COLOR_ATTACHMENT);
+	RenderGraph::Pass& pass = mGraph.mPasses[mPassIndex];
+	pass.mUsages.back().mClear = clear;
+	pass.mColorAttachments.push_back(static_cast<uint32_t>(pass.mUsages.size() - 1));
+	return result;
+}
+
+RGResource RGPassBuilder::writeDepth(RGResource resource, bool clear) {
+	RGResource result = write(resource, RGAccess::DEPTH_ATTACHMENT);
+	RenderGraph::Pass& pass = mGraph.mPasses[mPassIndex];
+	pass.mUsages.back().mClear = clear;
+	pass.mDepthAttachment = static_cast<uint32_t>(pass.mUsages.size() - 1);
+	return result;
+}
+
+void RGPassBuilder::setSideEffects() {
+	mGraph.mPasses[mPassIndex].mSideEffects = true;
+}
+
+void RGPassBuilder::setExecute(std::function<void(const RGPassContext&)> execute) {
+	mGraph.mPasses[mPassIndex].mExecute = std::move(execute);
+}
+
+// ******************************************************************************************************************************
+//																RENDER GRAPH
+// ******************************************************************************************************************************
+
+RenderGraph::RenderGraph(VDevice& device)
+	:mDevice(device) {
+}
+
+RenderGraph::~RenderGraph() {
+	destroyResources();
+}
+
+RGResource RenderGraph::createImage(const std::string& name, const RGImageDesc& desc) {
+	uint32_t index = addResource(name, true, false);
+	mResources[index].mDesc = desc;
+	return RGResource{ index, 0 };
+}
+
+RGResource RenderGraph::importImage(const std::string& name, const RGImageDesc& desc, const RGImportInfo& importInfo) {
+	uint32_t index = addResource(name, true, true);
+	mResources[index].mDesc = desc;
+	mResources[index].mImportInfo = importInfo;
+	return RGResource{ index, 0 };
+}
+
+RGResource RenderGraph::importBuffer(const std::string& name, const RGImportInfo& importInfo) {
+	uint32_t index = addResource(name, false, true);
+	mResources[index].mImportInfo = importInfo;
+	return RGResource{ index, 0 };
+}
+
+void RenderGraph::setImportedImage(RGResource resource, VkImage image, VkImageView view) {
+	mResources[resource.mIndex].mImage = image;
+	mResources[resource.mIndex].mImageView = view;
+}
+
+void RenderGraph::setImportedBuffer(RGResource resource, VkBuffer buffer) {
+	mResources[resource.mIndex].mBuffer = buffer;
+}
+
+void RenderGraph::setClearValue(RGResource resource, const VkClearValue& clearValue) {
+	mResources[resource.mIndex].mClearValue = clearValue;
+}
+
+RGPassBuilder RenderGraph::addPass(const std::string& name) {
+	Pass pass;
+	pass.mName = name;
+	mPasses.push_back(pass);
+	mCompiled = false;
+	return RGPassBuilder(*this, static_cast<uint32_t>(mPasses.size() - 1));
+}
+
+uint32_t RenderGraph::addResource(const std::string& name, bool isImage, bool imported) {
+	Resource resource;
+	resource.mName = name;
+	resource.mIsImage = isImage;
+	resource.mImported = imported;
+	mResources.push_back(resource);
+	mCompiled = false;
+	return static_cast<uint32_t>(mResources.size() - 1);
+}
+
+bool RenderGraph::compile() {
+	SPX_ALLOCATION_SCOPE(AllocationTag::RenderGraph);
+	auto start = std::chrono::high_resolution_clock::now();
+	destroyResources();
+	mStats = RenderGraphStats{};
+	mStats.mPasses = static_cast<uint32_t>(mPasses.size());
+
+	cullPasses();
+	if (!sortPasses())
+		return false;
+	computeLifetimes();
+	createTransientImages();
+
+	for (uint32_t passIndex : mExecutionOrder) {
+		Pass& pass = mPasses[passIndex];
+		if (!pass.mColorAttachments.empty() || pass.mDepthAttachment != UINT32_MAX)
+			createRenderPass(pass);
+	}
+
+	mCompiled = true;
+	auto end = std::chrono::high_resolution_clock::now();
+	CORE_INFO("Render graph compiled in {:.3f} ms.", std::chrono::duration<double, std::milli>(end - start).count());
+	logStats();
+	return true;
+}
+
+void RenderGraph::cullPasses() {
+	// Which pass wrote each version of each resource.
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> producers;
+	for (uint32_t p = 0; p < mPasses.size(); p++) {
+		mPasses[p].mCulled = true;
+		for (const Usage& usage : mPasses[p].mUsages) {
+			if (usage.mWrite)
+				producers[{ usage.mResource, usage.mVersion }] = p;
+		}
+	}
+
+	// Walk backwards from everything that has to happen: passes with side effects and the final version of every
+	// imported resource. Anything not reached is culled.
+	std::vector<uint32_t> stack;
+	for (uint32_t p = 0; p < mPasses.size(); p++) {
+		bool needed = mPasses[p].mSideEffects;
+		for (const Usage& usage : mPasses[p].mUsages) {
+			const Resource& resource = mResources[usage.mResource];
+			if (usage.mWrite && resource.mImported && usage.mVersion == resource.mLatestVersion)
+				needed = true;
+		}
+
+		if (needed) {
+			mPasses[p].mCulled = false;
+			stack.push_back(p);
+		}
+	}
+
+	while (!stack.empty()) {
+		uint32_t p = stack.back();
+		stack.pop_back();
+
+		for (const Usage& usage : mPasses[p].mUsages) {
+			// A read needs whoever wrote that version. A write that doesn't clear keeps (or modifies) the previous contents,
+			// so it needs the previous version's writer too.
+			uint32_t neededVersion = usage.mVersion;
+			if (usage.mWrite) {
+				if (usage.mClear || usage.mVersion == 1)
+					continue;
+				neededVersion = usage.mVersion - 1;
+			}
+
+			auto it = producers.find({ usage.mResource, neededVersion });
+			if (it != producers.end() && mPasses[it->second].mCulled) {
+				mPasses[it->second].mCulled = false;
+				stack.push_back(it->second);
+			}
+		}
+	}
+
+	for (const Pass& pass : mPasses) {
+		if (pass.mCulled) {
+			mStats.mCulledPasses++;
+			CORE_TRACE("Render graph: culled pass {}, nothing uses what it writes.", pass.mName);
+		}
+	}
+}
+
+bool RenderGraph::sortPasses() {
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> producers;
+	std::map<std::pair<uint32_t, uint32_t>, std::vector<uint32_t>> readers;
+	for (uint32_t p = 0; p < mPasses.size(); p++) {
+		if (mPasses[p].mCulled)
+			continue;
+		for (const Usage& usage : mPasses[p].mUsages) {
+			if (usage.mWrite)
+				producers[{ usage.mResource, usage.mVersion }] = p;
+			else
+				readers[{ usage.mResource, usage.mVersion }].push_back(p);
+		}
+	}
+
+	std::set<std::pair<uint32_t, uint32_t>> edges;
+	auto addEdge = [&edges](uint32_t from, uint32_t to) {
+		if (from != to)
+			edges.insert({ from, to });
+	};
+
+	for (uint32_t p = 0; p < mPasses.size(); p++) {
+		if (mPasses[p].mCulled)
+			continue;
+
+		for (const Usage& usage : mPasses[p].mUsages) {
+			if (!usage.mWrite) {
+				// Read after write.
+				auto producer = producers.find({ usage.mResource, usage.mVersion });
+				if (producer != producers.end())
+					addEdge(producer->second, p);
+				continue;
+			}
+
+			// Write after write.
+			auto previous = producers.find({ usage.mResource, usage.mVersion - 1 });
+			if (previous != producers.end())
+				addEdge(previous->second, p);
+
+			// Write after read. Everyone reading the old contents goes first.
+			auto oldReaders = readers.find({ usage.mResource, usage.mVersion - 1 });
+			if (oldReaders != readers.end()) {
+				for (uint32_t reader : oldReaders->second)
+					addEdge(reader, p);
+			}
+		}
+	}
+
+	// Kahn's algorithm. The ready set is ordered, so between passes that could go in either order the one added
+	// first wins and the order stays predictable.
+	std::vector<uint32_t> incoming(mPasses.size(), 0);
+	std::vector<std::vector<uint32_t>> outgoing(mPasses.size());
+	for (const auto& edge : edges) {
+		outgoing[edge.first].push_back(edge.second);
+		incoming[edge.second]++;
+	}
+
+	std::set<uint32_t> ready;
+	uint32_t survivingPasses = 0;
+	for (uint32_t p = 0; p < mPasses.size(); p++) {
+		if (mPasses[p].mCulled)
+			continue;
+		survivingPasses++;
+		if (incoming[p] == 0)
+			ready.insert(p);
+	}
+
+	mExecutionOrder.clear();
+	while (!ready.empty()) {
+		uint32_t p = *ready.begin();
+		ready.erase(ready.begin());
+		mExecutionOrder.push_back(p);
+
+		for (uint32_t next : outgoing[p]) {
+			if (--incoming[next] == 0)
+				ready.insert(next);
+		}
+	}
+
+	if (mExecutionOrder.size() != survivingPasses) {
+		CORE_ERROR("Render graph: the passes depend on each other in a cycle, can't order them.");
+		mExecutionOrder.clear();
+		return false;
+	}
+
+	return true;
+}
+
+void RenderGraph::computeLifetimes() {
+	for (auto& resource : mResources) {
+		resource.mFirstUse = UINT32_MAX;
+		resource.mLastUse = 0;
+	}
+
+	for (uint32_t position = 0; position < mExecutionOrder.size(); position++) {
+		for (const Usage& usage : mPasses[mExecutionOrder[position]].mUsages) {
+			Resource& resource = mResources[usage.mResource];
+			resource.mFirstUse = std::min(resource.mFirstUse, position);
+			resource.mLastUse = std::max(resource.mLastUse, position);
+		}
+	}
+}
+
+void RenderGraph::createTransientImages() {
+	// Usage flags are whatever the passes do with the image.
+	std::vector<VkImageUsageFlags> usages(mResources.size(), 0);
+	for (uint32_t passIndex : mExecutionOrder) {
+		for (const Usage& usage : mPasses[passIndex].mUsages)
+			usages[usage.mResource] |= getImageUsage(usage.mAccess);
+	}
+
+	std::vector<uint32_t> transients;
+	std::vector<VkMemoryRequirements> requirements(mResources.size());
+	for (uint32_t i = 0; i < mResources.size(); i++) {
+		Resource& resource = mResources[i];
+		if (resource.mImported || !resource.mIsImage || resource.mFirstUse == UINT32_MAX)
+			continue;
+
+		VkImageCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		createInfo.imageType = VK_IMAGE_TYPE_2D;
+		createInfo.extent = { resource.mDesc.mExtent.width, resource.mDesc.mExtent.height, 1 };
+		createInfo.mipLevels = resource.mDesc.mMipLevels;
+		createInfo.arrayLayers = 1;
+		createInfo.format = resource.mDesc.mFormat;
+		createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		createInfo.usage = usages[i];
+		createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		// Created without memory, it's bound once every image has found its slot.
+		if (vkCreateImage(mDevice.mLogicalDevice, &createInfo, nullptr, &resource.mImage) != VK_SUCCESS) {
+			CORE_ERROR("Render graph: failed to create transient image {}.", resource.mName);
+			continue;
+		}
+
+		vkGetImageMemoryRequirements(mDevice.mLogicalDevice, resource.mImage, &requirements[i]);
+		mStats.mUnaliasedBytes += requirements[i].size;
+		transients.push_back(i);
+	}
+
+	// Biggest first, so the small images fill the space the big ones leave instead of each starting a new block.
+	std::sort(transients.begin(), transients.end(), [&requirements](uint32_t a, uint32_t b) {
+		return requirements[a].size > requirements[b].size;
+	});
+
+	for (uint32_t index : transients) {
+		Resource& resource = mResources[index];
+		const VkMemoryRequirements& request = requirements[index];
+
+		uint32_t slotIndex = UINT32_MAX;
+		for (uint32_t s = 0; s < mMemorySlots.size() && slotIndex == UINT32_MAX; s++) {
+			MemorySlot& slot = mMemorySlots[s];
+			if ((slot.mRequirements.memoryTypeBits & request.memoryTypeBits) == 0)
+				continue;
+
+			bool free = true;
+			for (uint32_t other : slot.mResources) {
+				if (lifetimesOverlap(resource.mFirstUse, resource.mLastUse, mResources[other].mFirstUse, mResources[other].mLastUse))
+					free = false;
+			}
+			if (free)
+				slotIndex = s;
+		}
+
+		if (slotIndex == UINT32_MAX) {
+			mMemorySlots.push_back(MemorySlot{});
+			slotIndex = static_cast<uint32_t>(mMemorySlots.size() - 1);
+			mMemorySlots[slotIndex].mRequirements = request;
+		}
+		else {
+			VkMemoryRequirements& merged = mMemorySlots[slotIndex].mRequirements;
+			merged.size = std::max(merged.size, request.size);
+			merged.alignment = std::max(merged.alignment, request.alignment);
+			merged.memoryTypeBits &= request.memoryTypeBits;
+		}
+
+		mMemorySlots[slotIndex].mResources.push_back(index);
+		resource.mMemorySlot = slotIndex;
+	}
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	VMemoryTracker::tag(allocInfo, MemoryCategory::Attachment);
+
+	for (auto& slot : mMemorySlots) {
+		if (mDevice.mMemoryPools->allocateMemory(slot.mRequirements, allocInfo, MemoryClass::RenderTarget, slot.mAllocation) != VK_SUCCESS) {
+			CORE_ERROR("Render graph: failed to allocate {} bytes for transient images.", slot.mRequirements.size);
+			continue;
+		}
+		mDevice.mMemoryTracker->track(slot.mAllocation, MemoryCategory::Attachment);
+		mStats.mTransientBytes += slot.mRequirements.size;
+
+		for (uint32_t index : slot.mResources) {
+			Resource& resource = mResources[index];
+			// Every image in the slot starts at offset 0, they're never alive at the same time.
+			vmaBindImageMemory(mDevice.mAllocator, slot.mAllocation, resource.mImage);
+
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = resource.mImage;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.mDesc.mFormat;
+			viewInfo.subresourceRange = { resource.mDesc.mAspect, 0, resource.mDesc.mMipLevels, 0, 1 };
+
+			if (vkCreateImageView(mDevice.mLogicalDevice, &viewInfo, nullptr, &resource.mImageView) != VK_SUCCESS)
+				CORE_ERROR("Render graph: failed to create the view for transient image {}.", resource.mName);
+		}
+	}
+
+	mStats.mTransientImages = static_cast<uint32_t>(transients.size());
+	mStats.mTransientAllocations = static_cast<uint32_t>(mMemorySlots.size());
+}
+
+void RenderGraph::createRenderPass(Pass& pass) {
+	std::vector<uint32_t> attachmentUsages = pass.mColorAttachments;
+	if (pass.mDepthAttachment != UINT32_MAX)
+		attachmentUsages.push_back(pass.mDepthAttachment);
+
+	uint32_t position = static_cast<uint32_t>(std::find(mExecutionOrder.begin(), mExecutionOrder.end(),
+		static_cast<uint32_t>(&pass - mPasses.data())) - mExecutionOrder.begin());
+
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<VkAttachmentReference> colorRefs;
+	VkAttachmentReference depthRef{};
+
+	for (uint32_t usageIndex : attachmentUsages) {
+		const Usage& usage = pass.mUsages[usageIndex];
+		const Resource& resource = mResources[usage.mResource];
+		bool isDepth = usage.mAccess == RGAccess::DEPTH_ATTACHMENT;
+		VkImageLayout layout = getAccessInfo(usage.mAccess, true).mLayout;
+
+		VkAttachmentDescription attachment{};
+		attachment.format = resource.mDesc.mFormat;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+
+		// Load only if there's something to load: an earlier pass wrote it this frame, or it's an import that keeps
+		// its contents between frames.
+		bool hasContents = usage.mVersion > 1 || (resource.mImported &&
+			(resource.mImportInfo.mPersistent || resource.mImportInfo.mInitialLayout != VK_IMAGE_LAYOUT_UNDEFINED));
+		if (usage.mClear)
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		else
+			attachment.loadOp = hasContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+		// Store only if anything looks at it afterwards. A depth buffer only used inside this pass never leaves the tile memory.
+		bool usedLater = resource.mImported || resource.mLastUse > position;
+		attachment.storeOp = usedLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+		// The graph's barriers already put the image in the right layout, the render pass doesn't transition anything.
+		attachment.initialLayout = layout;
+		attachment.finalLayout = layout;
+
+		VkAttachmentReference reference{};
+		reference.attachment = static_cast<uint32_t>(attachments.size());
+		reference.layout = layout;
+		if (isDepth)
+			depthRef = reference;
+		else
+			colorRefs.push_back(reference);
+
+		attachments.push_back(attachment);
+	}
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+	subpass.pColorAttachments = colorRefs.data();
+	subpass.pDepthStencilAttachment = pass.mDepthAttachment != UINT32_MAX ? &depthRef : nullptr;
+
+	// No subpass dependencies. Everything outside the pass is synchronized with the graph's own barriers.
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+
+	if (vkCreateRenderPass(mDevice.mLogicalDevice, &renderPassInfo, nullptr, &pass.mRenderPass) != VK_SUCCESS)
+		CORE_ERROR("Render graph: failed to create the render pass for {}.", pass.mName);
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(Pass& pass) {
+	std::vector<VkImageView>& views = mFramebufferViews;
+	views.clear();
+	for (uint32_t usageIndex : pass.mColorAttachments)
+		views.push_back(mResources[pass.mUsages[usageIndex].mResource].mImageView);
+	if (pass.mDepthAttachment != UINT32_MAX)
+		views.push_back(mResources[pass.mUsages[pass.mDepthAttachment].mResource].mImageView);
+
+	auto it = pass.mFramebuffers.find(views);
+	if (it != pass.mFramebuffers.end())
+		return it->second;
+
+	// Every attachment is the size of the first one.
+	const RGImageDesc& desc = mResources[pass.mUsages[pass.mColorAttachments.empty() ? pass.mDepthAttachment : pass.mColorAttachments[0]].mResource].mDesc;
+
+	VkFramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = pass.mRenderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+	framebufferInfo.pAttachments = views.data();
+	framebufferInfo.width = desc.mExtent.width;
+	framebufferInfo.height = desc.mExtent.height;
+	framebufferInfo.layers = 1;
+
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+	if (vkCreateFramebuffer(mDevice.mLogicalDevice, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS)
+		CORE_ERROR("Render graph: failed to create a framebuffer for {}.", pass.mName);
+
+	pass.mFramebuffers[views] = framebuffer;
+	return framebuffer;
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd, FrameArena& arena) {
+	if (!mCompiled) {
+		CORE_ERROR("Render graph: execute called before compile.");
+		return;
+	}
+
+	mStats.mBarrierCalls = 0;
+	mStats.mImageBarriers = 0;
+
+	// Imports start where they were left last frame (persistent) or from their initial state. Transients start undefined,
+	// and pick up what they have to wait for from their memory slot on their first use.
+	for (auto& resource : mResources) {
+		if (resource.mImported && (!resource.mImportInfo.mPersistent || !resource.mHasPersistentState)) {
+			resource.mState = ResourceState{};
+			resource.mState.mLayout = resource.mImportInfo.mInitialLayout;
+			resource.mState.mWriteStages = resource.mImportInfo.mInitialStages;
+		}
+		else if (!resource.mImported)
+			resource.mState = ResourceState{};
+	}
+
+	FrameVector<VkImageMemoryBarrier> imageBarriers(arena);
+	imageBarriers.reserve(mResources.size());
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	VkPipelineStageFlags srcStages = 0;
+	VkPipelineStageFlags dstStages = 0;
+
+	for (uint32_t position = 0; position < mExecutionOrder.size(); position++) {
+		Pass& pass = mPasses[mExecutionOrder[position]];
+
+		addBarriers(pass, position, imageBarriers, memoryBarrier, srcStages, dstStages);
+		flushBarriers(cmd, imageBarriers, memoryBarrier, srcStages, dstStages);
+
+		RGPassContext context;
+		context.mCmd = cmd;
+		context.mGraph = this;
+
+		FrameVector<VkClearValue> clearValues(arena);
+		if (pass.mRenderPass != VK_NULL_HANDLE) {
+			FrameVector<uint32_t> attachmentUsages(pass.mColorAttachments.begin(), pass.mColorAttachments.end(), arena);
+			if (pass.mDepthAttachment != UINT32_MAX)
+				attachmentUsages.push_back(pass.mDepthAttachment);
+			for (uint32_t usageIndex : attachmentUsages)
+				clearValues.push_back(mResources[pass.mUsages[usageIndex].mResource].mClearValue);
+
+			const RGImageDesc& desc = mResources[pass.mUsages[attachmentUsages[0]].mResource].mDesc;
+
+			context.mRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			context.mRenderPassInfo.renderPass = pass.mRenderPass;
+			context.mRenderPassInfo.framebuffer = getFramebuffer(pass);
+			context.mRenderPassInfo.renderArea.offset = { 0, 0 };
+			context.mRenderPassInfo.renderArea.extent = desc.mExtent;
+			context.mRenderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+			context.mRenderPassInfo.pClearValues = clearValues.data();
+		}
+
+		// The barriers before the pass aren't part of its time.
+		GpuScope scope(mProfiler, cmd, pass.mName);
+		if (pass.mExecute)
+			pass.mExecute(context);
+	}
+
+	// Hand the imports back in the layout their owner expects (present for the swapchain).
+	for (auto& resource : mResources) {
+		if (!resource.mImported || !resource.mIsImage || resource.mImportInfo.mFinalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+			resource.mImportInfo.mFinalLayout == resource.mState.mLayout)
+			continue;
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = resource.mState.mWriteAccess;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = resource.mState.mLayout;
+		barrier.newLayout = resource.mImportInfo.mFinalLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = resource.mImage;
+		barrier.subresourceRange = { getBarrierAspect(resource), 0, resource.mDesc.mMipLevels, 0, 1 };
+		imageBarriers.push_back(barrier);
+
+		srcStages |= resource.mState.mWriteStages | resource.mState.mReadStages;
+		dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+		resource.mState.mLayout = resource.mImportInfo.mFinalLayout;
+		resource.mState.mWriteStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		resource.mState.mWriteAccess = 0;
+		resource.mState.mReadStages = 0;
+		resource.mState.mReadAccess = 0;
+	}
+	flushBarriers(cmd, imageBarriers, memoryBarrier, srcStages, dstStages);
+
+	for (auto& resource : mResources) {
+		if (resource.mImported && resource.mImportInfo.mPersistent)
+			resource.mHasPersistentState = true;
+	}
+}
+
+void RenderGraph::addBarriers(const Pass& pass, uint32_t position, FrameVector<VkImageMemoryBarrier>& imageBarriers,
+	VkMemoryBarrier& memoryBarrier, VkPipelineStageFlags& srcStages, VkPipelineStageFlags& dstStages) {
+	// A pass can use one resource more than once (read and write it). The uses are merged into one requirement.
+	struct Requirement {
+		VkPipelineStageFlags mStages{ 0 };
+		VkAccessFlags mAccess{ 0 };
+		VkImageLayout mLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		bool mWrite{ false };
+	};
+	// Nodes come from the same frame arena as the barriers.
+	using RequirementAllocator = FrameAllocator<std::pair<const uint32_t, Requirement>>;
+	std::map<uint32_t, Requirement, std::less<uint32_t>, RequirementAllocator> requirements(RequirementAllocator(imageBarriers.get_allocator()));
+
+	for (const Usage& usage : pass.mUsages) {
+		AccessInfo info = getAccessInfo(usage.mAccess, usage.mWrite);
+		Requirement& requirement = requirements[usage.mResource];
+
+		if (requirement.mStages != 0 && requirement.mLayout != info.mLayout && mResources[usage.mResource].mIsImage)
+			CORE_ERROR("Render graph: pass {} uses {} in two different layouts.", pass.mName, mResources[usage.mResource].mName);
+
+		requirement.mStages |= info.mStages;
+		requirement.mAccess |= info.mAccess;
+		requirement.mLayout = info.mLayout;
+		requirement.mWrite |= usage.mWrite;
+	}
+
+	for (const auto& entry : requirements) {
+		Resource& resource = mResources[entry.first];
+		const Requirement& requirement = entry.second;
+		ResourceState& state = resource.mState;
+
+		// First use of a transient this frame. Its memory was last used by another image (or itself last frame), so
+		// it has to wait for that.
+		if (!resource.mImported && resource.mMemorySlot != UINT32_MAX && position == resource.mFirstUse) {
+			const MemorySlot& slot = mMemorySlots[resource.mMemorySlot];
+			state.mWriteStages = slot.mLastStages;
+			state.mWriteAccess = slot.mLastAccess;
+		}
+
+		bool layoutChange = resource.mIsImage && state.mLayout != requirement.mLayout;
+		VkPipelineStageFlags waitStages = 0;
+		VkAccessFlags waitAccess = 0;
+
+		if (layoutChange || requirement.mWrite) {
+			// Writes wait for the last write and every read since (write after read only needs the execution dependency).
+			waitStages = state.mWriteStages | state.mReadStages;
+			waitAccess = state.mWriteAccess;
+		}
+		else if (state.mWriteStages != 0 && ((state.mReadStages & requirement.mStages) != requirement.mStages ||
+			(state.mReadAccess & requirement.mAccess) != requirement.mAccess)) {
+			// Read after write, the first time this kind of read happens since the write.
+			waitStages = state.mWriteStages;
+			waitAccess = state.mWriteAccess;
+		}
+
+		if (layoutChange) {
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = waitAccess;
+			barrier.dstAccessMask = requirement.mAccess;
+			barrier.oldLayout = state.mLayout;
+			barrier.newLayout = requirement.mLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = resource.mImage;
+			barrier.subresourceRange = { getBarrierAspect(resource), 0, resource.mDesc.mMipLevels, 0, 1 };
+			imageBarriers.push_back(barrier);
+
+			srcStages |= waitStages;
+			dstStages |= requirement.mStages;
+		}
+		else if (waitStages != 0) {
+			// No layout change, so one global memory barrier covers every buffer and image in the batch.
+			memoryBarrier.srcAccessMask |= waitAccess;
+			memoryBarrier.dstAccessMask |= requirement.mAccess;
+			srcStages |= waitStages;
+			dstStages |= requirement.mStages;
+		}
+
+		if (requirement.mWrite) {
+			state.mWriteStages = requirement.mStages;
+			state.mWriteAccess = requirement.mAccess & WRITE_ACCESS_MASK;
+			state.mReadStages = 0;
+			state.mReadAccess = 0;
+		}
+		else if (layoutChange) {
+			// The transition is a write of its own. Anything later has to come after this barrier's second scope.
+			state.mWriteStages = requirement.mStages;
+			state.mWriteAccess = 0;
+			state.mReadStages = requirement.mStages;
+			state.mReadAccess = requirement.mAccess;
+		}
+		else {
+			state.mReadStages |= requirement.mStages;
+			state.mReadAccess |= requirement.mAccess;
+		}
+		state.mLayout = resource.mIsImage ? requirement.mLayout : state.mLayout;
+
+		if (!resource.mImported && resource.mMemorySlot != UINT32_MAX) {
+			MemorySlot& slot = mMemorySlots[resource.mMemorySlot];
+			slot.mLastStages = state.mWriteStages | state.mReadStages;
+			slot.mLastAccess = state.mWriteAccess;
+		}
+	}
+}
+
+void RenderGraph::flushBarriers(VkCommandBuffer cmd, FrameVector<VkImageMemoryBarrier>& imageBarriers, VkMemoryBarrier& memoryBarrier,
+	VkPipelineStageFlags& srcStages, VkPipelineStageFlags& dstStages) {
+	bool hasMemoryBarrier = memoryBarrier.srcAccessMask != 0 || memoryBarrier.dstAccessMask != 0;
+	if (imageBarriers.empty() && !hasMemoryBarrier && srcStages == 0)
+		return;
+
+	// Nothing to wait on (a transition out of UNDEFINED) still needs a valid stage.
+	if (srcStages == 0)
+		srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	if (dstStages == 0)
+		dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+	vkCmdPipelineBarrier(cmd, srcStages, dstStages, 0, hasMemoryBarrier ? 1 : 0, hasMemoryBarrier ? &memoryBarrier : nullptr,
+		0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.empty() ? nullptr : imageBarriers.data());
+
+	mStats.mBarrierCalls++;
+	mStats.mImageBarriers += static_cast<uint32_t>(imageBarriers.size());
+
+	imageBarriers.clear();
+	memoryBarrier.srcAccessMask = 0;
+	memoryBarrier.dstAccessMask = 0;
+	srcStages = 0;
+	dstStages = 0;
+}
+
+VkImageAspectFlags RenderGraph::getBarrierAspect(const Resource& resource) const {
+	// Barriers on a combined depth/stencil format have to include both aspects.
+	VkImageAspectFlags aspect = resource.mDesc.mAspect;
+	if ((aspect & VK_IMAGE_ASPECT_DEPTH_BIT) && VImage::hasStencilComponent(resource.mDesc.mFormat))
+		aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	return aspect;
+}
+
+RenderGraph::AccessInfo RenderGraph::getAccessInfo(RGAccess access, bool write) {
+	AccessInfo info{ VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+
+	switch (access) {
+	case RGAccess::COLOR_ATTACHMENT:
+		info.mStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		info.mAccess = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+		if (write)
+			info.mAccess |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		info.mLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		break;
+	case RGAccess::DEPTH_ATTACHMENT:
+		info.mStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		info.mAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		if (write)
+			info.mAccess |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		info.mLayout = write ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		break;
+	case RGAccess::FRAGMENT_SAMPLED:
+		info.mStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		info.mAccess = VK_ACCESS_SHADER_READ_BIT;
+		info.mLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		break;
+	case RGAccess::COMPUTE_SAMPLED:
+		info.mStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		info.mAccess = VK_ACCESS_SHADER_READ_BIT;
+		info.mLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		break;
+	case RGAccess::COMPUTE_STORAGE:
+		info.mStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		info.mAccess = VK_ACCESS_SHADER_READ_BIT;
+		if (write)
+			info.mAccess |= VK_ACCESS_SHADER_WRITE_BIT;
+		info.mLayout = VK_IMAGE_LAYOUT_GENERAL;
+		break;
+	case RGAccess::INDIRECT_ARGUMENTS:
+		// Buffers only, the layout is never used.
+		info.mStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		info.mAccess = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		info.mLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		break;
+	case RGAccess::TRANSFER_SRC:
+		info.mStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		info.mAccess = VK_ACCESS_TRANSFER_READ_BIT;
+		info.mLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		break;
+	case RGAccess::TRANSFER_DST:
+		info.mStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		info.mAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+		info.mLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		break;
+	}
+
+	return info;
+}
+
+VkImageUsageFlags RenderGraph::getImageUsage(RGAccess access) {
+	switch (access) {
+	case RGAccess::COLOR_ATTACHMENT: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	case RGAccess::DEPTH_ATTACHMENT: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	case RGAccess::FRAGMENT_SAMPLED:
+	case RGAccess::COMPUTE_SAMPLED: return VK_IMAGE_USAGE_SAMPLED_BIT;
+	case RGAccess::COMPUTE_STORAGE: return VK_IMAGE_USAGE_STORAGE_BIT;
+	case RGAccess::TRANSFER_SRC: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	case RGAccess::TRANSFER_DST: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	default: return 0;
+	}
+}
+
+VkImage RenderGraph::getImage(RGResource resource) const {
+	return mResources[resource.mIndex].mImage;
+}
+
+VkImageView RenderGraph::getImageView(RGResource resource) const {
+	return mResources[resource.mIndex].mImageView;
+}
+
+VkBuffer RenderGraph::getBuffer(RGResource resource) const {
+	return mResources[resource.mIndex].mBuffer;
+}
+
+VkRenderPass RenderGraph::getRenderPass(const std::string& passName) const {
+	for (const auto& pass : mPasses) {
+		if (pass.mName == passName)
+			return pass.mRenderPass;
+	}
+	return VK_NULL_HANDLE;
+}
+
+void RenderGraph::logStats() const {
+	CORE_INFO("Render graph: {} passes ({} culled), {} transient images in {} allocations ({:.2f} MB, {:.2f} MB without aliasing).",
+		mStats.mPasses, mStats.mCulledPasses, mStats.mTransientImages, mStats.mTransientAllocations,
+		mStats.mTransientBytes / (1024.0 * 1024.0), mStats.mUnaliasedBytes / (1024.0 * 1024.0));
+
+	std::string order;
+	for (uint32_t passIndex : mExecutionOrder)
+		order += (order.empty() ? "" : " -> ") + mPasses[passIndex].mName;
+	CORE_TRACE("Render graph order: {}", order);
+}
+
+void RenderGraph::destroyResources() {
+	for (auto& pass : mPasses) {
+		for (auto& entry : pass.mFramebuffers)
+			vkDestroyFramebuffer(mDevice.mLogicalDevice, entry.second, nullptr);
+		pass.mFramebuffers.clear();
+
+		if (pass.mRenderPass != VK_NULL_HANDLE)
+			vkDestroyRenderPass(mDevice.mLogicalDevice, pass.mRenderPass, nullptr);
+		pass.mRenderPass = VK_NULL_HANDLE;
+	}
+
+	for (auto& resource : mResources) {
+		if (resource.mImported)
+			continue;
+		if (resource.mImageView != VK_NULL_HANDLE)
+			vkDestroyImageView(mDevice.mLogicalDevice, resource.mImageView, nullptr);
+		if (resource.mImage != VK_NULL_HANDLE)
+			vkDestroyImage(mDevice.mLogicalDevice, resource.mImage, nullptr);
+		resource.mImageView = VK_NULL_HANDLE;
+		resource.mImage = VK_NULL_HANDLE;
+		resource.mMemorySlot = UINT32_MAX;
+	}
+
+	for (auto& slot : mMemorySlots) {
+		if (slot.mAllocation != VK_NULL_HANDLE) {
+			mDevice.mMemoryTracker->untrack(slot.mAllocation);
+			vmaFreeMemory(mDevice.mAllocator, slot.mAllocation);
+		}
+	}
+	mMemorySlots.clear();
+	mCompiled = false;
+}
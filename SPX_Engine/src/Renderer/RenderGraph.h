@@ -0,0 +1,268 @@
+#pragma once
+
+#include "../pch.h"
+#include "../ThirdParty/vk_mem_alloc.h"
+#include "../SPX/FrameArena.h"
+
+// ******************************************************************************************************************************
+//															RENDER GRAPH
+// The frame is described as a list of passes that say which images and buffers they read and write, instead of every
+// pass placing its own barriers and layout transitions. The graph is set up once, compiled, and then executed every frame.
+//
+// Resources are versioned. Writing a resource returns a new handle for the new contents, and reading uses whatever handle
+// you have. That's enough to work out who depends on who no matter what order the passes were added in:
+//   - a read of version N waits for the pass that wrote version N
+//   - the write of version N+1 waits for the write of N and for every read of N
+//
+// compile():
+//   1. Culls passes whose results nothing uses. Imported resources count as used (they outlive the frame), and so do
+//      passes marked with setSideEffects().
+//   2. Orders the remaining passes topologically. Ties go to the order they were added in.
+//   3. Works out the first and last pass using each transient image and packs images whose lifetimes don't overlap
+//      into the same VMA allocation.
+//   4. Creates a VkRenderPass for every pass with attachments. Load and store ops come from the graph: an attachment
+//      nobody reads afterwards isn't stored, one with no earlier contents isn't loaded.
+//
+// execute() walks the passes and tracks each resource's layout and last access. Before each pass every barrier it needs
+// is batched into a single vkCmdPipelineBarrier. Buffers share one global memory barrier. Read after read never gets a
+// barrier, and a read only waits once per write. Its scratch (barrier batches, clear values) comes from the frame's arena.
+// ******************************************************************************************************************************
+
+class VDevice;
+class RenderGraph;
+class GpuProfiler;
+
+// A versioned handle to a graph resource.
+struct RGResource {
+	uint32_t mIndex{ UINT32_MAX };
+	uint32_t mVersion{ 0 };
+
+	bool isValid() const { return mIndex != UINT32_MAX; }
+};
+
+// How a pass uses a resource. Each maps to the pipeline stage, access mask and image layout it needs.
+enum class RGAccess {
+	COLOR_ATTACHMENT,
+	DEPTH_ATTACHMENT,
+	// Sampled in SHADER_READ_ONLY_OPTIMAL.
+	FRAGMENT_SAMPLED,
+	COMPUTE_SAMPLED,
+	// Storage images and buffers, or anything else a compute shader touches in GENERAL.
+	COMPUTE_STORAGE,
+	INDIRECT_ARGUMENTS,
+	TRANSFER_SRC,
+	TRANSFER_DST
+};
+
+struct RGImageDesc {
+	VkFormat mFormat{ VK_FORMAT_UNDEFINED };
+	VkExtent2D mExtent{ 0, 0 };
+	uint32_t mMipLevels{ 1 };
+	VkImageAspectFlags mAspect{ VK_IMAGE_ASPECT_COLOR_BIT };
+};
+
+// Where an imported resource comes from and where it has to end up.
+struct RGImportInfo {
+	VkImageLayout mInitialLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+	// Stages the first barrier waits on. For a swapchain image that's the stage its acquire semaphore is waited at.
+	VkPipelineStageFlags mInitialStages{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
+	// Transitioned to this after the last pass. UNDEFINED leaves it in whatever layout the last pass used.
+	VkImageLayout mFinalLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+	// The resource lives across frames, so the state it was left in carries over to the next execute. The initial
+	// state is only used the first time. Without this every frame starts from the initial state (swapchain images).
+	bool mPersistent{ false };
+};
+
+// Handed to a pass when it's executed.
+struct RGPassContext {
+	VkCommandBuffer mCmd{ VK_NULL_HANDLE };
+	// Only filled in for passes with attachments. The pass begins the render pass itself so it can pick inline or
+	// secondary command buffer contents.
+	VkRenderPassBeginInfo mRenderPassInfo{};
+	RenderGraph* mGraph{ nullptr };
+};
+
+struct RenderGraphStats {
+	uint32_t mPasses{ 0 };
+	uint32_t mCulledPasses{ 0 };
+	uint32_t mTransientImages{ 0 };
+	// Memory blocks backing the transient images. Less than mTransientImages when some of them alias.
+	uint32_t mTransientAllocations{ 0 };
+	VkDeviceSize mTransientBytes{ 0 };
+	// What the transient images would take without aliasing.
+	VkDeviceSize mUnaliasedBytes{ 0 };
+	// Filled in by execute().
+	uint32_t mBarrierCalls{ 0 };
+	uint32_t mImageBarriers{ 0 };
+};
+
+// Declares what one pass uses. Returned by RenderGraph::addPass.
+class RGPassBuilder {
+public:
+	RGPassBuilder(RenderGraph& graph, uint32_t passIndex) :mGraph(graph), mPassIndex(passIndex) {}
+
+	void read(RGResource resource, RGAccess access);
+	// Returns the handle for the contents after this pass.
+	RGResource write(RGResource resource, RGAccess access);
+
+	// Attachments make this a render pass. clear clears it when the pass begins (with the value from setClearValue),
+	// otherwise the graph loads it if it has earlier contents.
+	RGResource writeColor(RGResource resource, bool clear);
+	RGResource writeDepth(RGResource resource, bool clear);
+
+	// Never culled, even if nothing reads what it writes.
+	void setSideEffects();
+	void setExecute(std::function<void(const RGPassContext&)> execute);
+
+private:
+	RenderGraph& mGraph;
+	uint32_t mPassIndex;
+};
+
+class RenderGraph {
+public:
+	RenderGraph(VDevice& device);
+	~RenderGraph();
+
+	// Transient image, owned by the graph. Its usage flags come from how the passes use it and its memory can be shared
+	// with other transient images that are never alive at the same time.
+	RGResource createImage(const std::string& name, const RGImageDesc& desc);
+	// Images and buffers owned by someone else. The handles can change every frame (swapchain images), set them with
+	// setImportedImage/setImportedBuffer before execute.
+	RGResource importImage(const std::string& name, const RGImageDesc& desc, const RGImportInfo& importInfo);
+	RGResource importBuffer(const std::string& name, const RGImportInfo& importInfo);
+
+	void setImportedImage(RGResource resource, VkImage image, VkImageView view);
+	void setImportedBuffer(RGResource resource, VkBuffer buffer);
+	// Used by whichever pass clears the image.
+	void setClearValue(RGResource resource, const VkClearValue& clearValue);
+
+	RGPassBuilder addPass(const std::string& name);
+
+	// Culls, orders, aliases and creates the render passes. Call once after every pass has been added.
+	bool compile();
+	// arena is the frame's, for the barrier batches and clear values.
+	void execute(VkCommandBuffer cmd, FrameArena& arena);
+
+	VkImage getImage(RGResource resource) const;
+	VkImageView getImageView(RGResource resource) const;
+	VkBuffer getBuffer(RGResource resource) const;
+	// Compatible with any pipeline built for a render pass with the same attachment formats.
+	VkRenderPass getRenderPass(const std::string& passName) const;
+
+	// Every pass is timed as a scope named after it. Optional.
+	void setProfiler(GpuProfiler* profiler) { mProfiler = profiler; }
+
+	const RenderGraphStats& getStats() const { return mStats; }
+	void logStats() const;
+
+private:
+	friend class RGPassBuilder;
+
+	struct Usage {
+		uint32_t mResource{ 0 };
+		// The version read, or the version this pass produced for a write.
+		uint32_t mVersion{ 0 };
+		RGAccess mAccess{ RGAccess::COMPUTE_STORAGE };
+		bool mWrite{ false };
+		bool mClear{ false };
+	};
+
+	struct Pass {
+		std::string mName;
+		std::vector<Usage> mUsages;
+		std::function<void(const RGPassContext&)> mExecute;
+		bool mSideEffects{ false };
+		bool mCulled{ false };
+
+		// Attachments as indices into mUsages, in the order they appear in the render pass. Depth is always last.
+		std::vector<uint32_t> mColorAttachments;
+		uint32_t mDepthAttachment{ UINT32_MAX };
+		VkRenderPass mRenderPass{ VK_NULL_HANDLE };
+		// Keyed by the attachment views, which change with the swapchain image.
+		std::map<std::vector<VkImageView>, VkFramebuffer> mFramebuffers;
+	};
+
+	// Where a resource was left by the last access.
+	struct ResourceState {
+		VkImageLayout mLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		// The last write, which later accesses have to wait for.
+		VkPipelineStageFlags mWriteStages{ 0 };
+		VkAccessFlags mWriteAccess{ 0 };
+		// Reads since that write. The next write has to wait for them, later reads of the same kind are already visible.
+		VkPipelineStageFlags mReadStages{ 0 };
+		VkAccessFlags mReadAccess{ 0 };
+	};
+
+	struct Resource {
+		std::string mName;
+		bool mIsImage{ true };
+		bool mImported{ false };
+		RGImageDesc mDesc;
+		RGImportInfo mImportInfo;
+		VkClearValue mClearValue{};
+
+		VkImage mImage{ VK_NULL_HANDLE };
+		VkImageView mImageView{ VK_NULL_HANDLE };
+		VkBuffer mBuffer{ VK_NULL_HANDLE };
+
+		// Bumped by every write while the graph is built.
+		uint32_t mLatestVersion{ 0 };
+		// Passes (in execution order) that first and last use the resource. Only valid after compile.
+		uint32_t mFirstUse{ UINT32_MAX };
+		uint32_t mLastUse{ 0 };
+		// Transient images: which memory block they live in.
+		uint32_t mMemorySlot{ UINT32_MAX };
+
+		ResourceState mState;
+		// Persistent imports keep their state between frames once they've been through one.
+		bool mHasPersistentState{ false };
+	};
+
+	// One VMA allocation shared by transient images with non overlapping lifetimes.
+	struct MemorySlot {
+		VmaAllocation mAllocation{ VK_NULL_HANDLE };
+		VkMemoryRequirements mRequirements{};
+		std::vector<uint32_t> mResources;
+		// The last access of whichever image used the memory last, the next image in it has to wait for that.
+		VkPipelineStageFlags mLastStages{ 0 };
+		VkAccessFlags mLastAccess{ 0 };
+	};
+
+	struct AccessInfo {
+		VkPipelineStageFlags mStages;
+		VkAccessFlags mAccess;
+		VkImageLayout mLayout;
+	};
+	static AccessInfo getAccessInfo(RGAccess access, bool write);
+	static VkImageUsageFlags getImageUsage(RGAccess access);
+
+	uint32_t addResource(const std::string& name, bool isImage, bool imported);
+	void cullPasses();
+	bool sortPasses();
+	void computeLifetimes();
+	void createTransientImages();
+	void createRenderPass(Pass& pass);
+	VkFramebuffer getFramebuffer(Pass& pass);
+	void destroyResources();
+
+	// Adds whatever the pass at position (in execution order) needs before it runs to the batch, and updates the resource states.
+	void addBarriers(const Pass& pass, uint32_t position, FrameVector<VkImageMemoryBarrier>& imageBarriers, VkMemoryBarrier& memoryBarrier,
+		VkPipelineStageFlags& srcStages, VkPipelineStageFlags& dstStages);
+	void flushBarriers(VkCommandBuffer cmd, FrameVector<VkImageMemoryBarrier>& imageBarriers, VkMemoryBarrier& memoryBarrier,
+		VkPipelineStageFlags& srcStages, VkPipelineStageFlags& dstStages);
+	VkImageAspectFlags getBarrierAspect(const Resource& resource) const;
+
+	VDevice& mDevice;
+	std::vector<Resource> mResources;
+	std::vector<Pass> mPasses;
+	// Indices into mPasses in execution order, culled passes left out.
+	std::vector<uint32_t> mExecutionOrder;
+	std::vector<MemorySlot> mMemorySlots;
+	// getFramebuffer's lookup key. Kept around so finding a framebuffer doesn't allocate every frame.
+	std::vector<VkImageView> mFramebufferViews;
+	bool mCompiled{ false };
+	GpuProfiler* mProfiler{ nullptr };
+
+	RenderGraphStats mStats;
+};
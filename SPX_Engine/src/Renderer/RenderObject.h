@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../pch.h"
+#include "VulkanWrapper/DataStructures.h"
 
 // For now this is just a struct to hold the mesh and texture data for each object to be drawn.
 // Later it will be a component added to an actor to control it's rendering
@@ -23,24 +24,38 @@ public:
 	RenderObject(std::string meshLoc, std::string textureLoc);
 	~RenderObject();
 
-	void drawObject(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, uint32_t currentImage);
-	void updateUniformBuffers(VkExtent2D extent, uint32_t currentImage, glm::mat4 cameraViewMatrix);
+	void drawObject(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, uint32_t currentFrame);
+	// Binds the vertex/index buffers and descriptor set ready for a draw.
+	void bindObject(VkCommandBuffer cmd, VkPipelineLayout pipelineLayout, uint32_t currentFrame);
+	void updateUniformBuffers(uint32_t currentFrame, const glm::mat4& cameraViewMatrix, const glm::mat4& projectionMatrix);
 
-	// Loads buffers, textures and descriptors.
-	void init(VCommandPool commandPool, uint32_t swapchainImages);
+	// Loads buffers, textures and descriptors. Uniform buffers and descriptor sets are made per frame in flight.
+	// If mMesh or mTexture is already set (the renderer shares them between objects using the same files) it isn't loaded again.
+	void init(VCommandPool commandPool, uint32_t framesInFlight);
 
 	// Loads the vertex and index information
 	void loadBuffers();
 
+	// One uniform buffer per frame in flight. The renderer only writes a frame's buffer after the GPU has finished the
+	// last frame that used it, so a buffer is never updated while it's being read.
+	void createUniformBuffers(uint32_t framesInFlight);
+
 	// Loads the objects descriptors
-	void loadDescriptorInfo(uint32_t swapchainImages);
-	void createDescriptorPool(uint32_t swapchainImages);
-	void createDescriptorSetLayout(VDevice& device);
-	void createDescriptorSets(uint32_t swapchainImages);
+	void loadDescriptorInfo(uint32_t framesInFlight);
+	void createDescriptorPool(uint32_t framesInFlight);
+	// The layout is owned by the device's VLayoutCache.
+	void setDescriptorSetLayout(VDevice& device, VkDescriptorSetLayout layout);
+	void createDescriptorSets(uint32_t framesInFlight);
+	// Rewrites the texture in one frame's descriptor set from mTexture->mDescriptor, after the texture has moved. Only
+	// while the GPU isn't using that frame's set.
+	void updateTextureDescriptor(uint32_t currentFrame);
 
 	// Change from pointers later.
-	Mesh* mMesh;
-	Texture* mTexture;
+	Mesh* mMesh{ nullptr };
+	Texture* mTexture{ nullptr };
+
+	// These belong to the object, the mesh can be shared.
+	std::vector<AllocatedBuffer> mUniformBuffers;
 
 	VkDescriptorPool mDescriptorPool;
 	VkDescriptorSetLayout mDescriptorSetLayout;
@@ -52,4 +67,14 @@ public:
 
 	std::string mMeshFileLocation;
 	std::string mTextureFileLocation;
+
+	// Set by the renderer when the object is loaded. Objects using the same files share an ID, which is what the
+	// render queue sorts by to keep draws with the same state together.
+	uint32_t mMeshID{ 0 };
+	uint32_t mMaterialID{ 0 };
+
+	// Occluders are rasterized into the CPU depth buffer used for occlusion culling.
+	// If an occluder file is set, that low poly mesh is used instead of the full render mesh.
+	bool mIsOccluder{ false };
+	std::string mOccluderFileLocation;
 };
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "RenderQueue.h"
+#include "../SPX/Profiler.h"
+#include "RenderObject.h"
+#include "Mesh.h"
+
+uint64_t RenderQueue::makeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float normalizedDepth) {
+	// IDs are masked so an out of range ID can't bleed into the field above it.
+	uint64_t depth = static_cast<uint64_t>(glm::clamp(normalizedDepth, 0.0f, 1.0f) * ((1 << DEPTH_BITS) - 1));
+
+	uint64_t key = 0;
+	key |= static_cast<uint64_t>(pass & ((1u << PASS_BITS) - 1)) << (PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS);
+	key |= static_cast<uint64_t>(pipeline & ((1u << PIPELINE_BITS) - 1)) << (MATERIAL_BITS + MESH_BITS + DEPTH_BITS);
+	key |= static_cast<uint64_t>(material & ((1u << MATERIAL_BITS) - 1)) << (MESH_BITS + DEPTH_BITS);
+	key |= static_cast<uint64_t>(mesh & ((1u << MESH_BITS) - 1)) << DEPTH_BITS;
+	key |= depth;
+	return key;
+}
+
+void RenderQueue::clear() {
+	mCommands.clear();
+	mStats = RenderQueueStats{};
+}
+
+void RenderQueue::push(uint64_t sortKey, uint32_t objectIndex) {
+	mCommands.push_back({ sortKey, objectIndex });
+}
+
+void RenderQueue::sort() {
+	SPX_PROFILE_ZONE("Sort render queue");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	size_t count = mCommands.size();
+	if (count < 2)
+		return;
+	mScratch.resize(count);
+
+	std::vector<RenderCommand>* src = &mCommands;
+	std::vector<RenderCommand>* dst = &mScratch;
+
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		size_t histogram[256] = {};
+		for (const auto& command : *src)
+			histogram[(command.mSortKey >> shift) & 0xFF]++;
+
+		// Every key has the same byte here, so this pass wouldn't move anything.
+		if (histogram[((*src)[0].mSortKey >> shift) & 0xFF] == count)
+			continue;
+
+		// Histogram to starting offsets.
+		size_t offset = 0;
+		for (auto& bucket : histogram) {
+			size_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		// Stable scatter. LSD only works because each pass keeps the order of the previous one for equal bytes.
+		for (const auto& command : *src)
+			(*dst)[histogram[(command.mSortKey >> shift) & 0xFF]++] = command;
+
+		std::swap(src, dst);
+	}
+
+	// An odd number of passes leaves the result in the scratch buffer.
+	if (src != &mCommands)
+		mCommands.swap(mScratch);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	mStats.mSortTimeMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void RenderQueue::record(VkCommandBuffer cmd, const std::vector<RenderObject>& objects, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+	uint32_t currentFrame, const std::function<void(VkCommandBuffer, uint32_t)>& drawFunction) {
+	recordRange(cmd, 0, mCommands.size(), objects, pipeline, pipelineLayout, currentFrame, drawFunction, mStats);
+}
+
+void RenderQueue::recordRange(VkCommandBuffer cmd, size_t begin, size_t end, const std::vector<RenderObject>& objects, VkPipeline pipeline,
+	VkPipelineLayout pipelineLayout, uint32_t currentFrame, const std::function<void(VkCommandBuffer, uint32_t)>& drawFunction,
+	RenderQueueStats& stats) const {
+	SPX_PROFILE_ZONE("Record draws");
+	// Bound state is unknown at the start of every command buffer or render pass, so always bind once.
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+
+	for (size_t i = begin; i < end; i++) {
+		const RenderCommand& command = mCommands[i];
+		const RenderObject& obj = objects.at(command.mObjectIndex);
+
+		if (pipeline != boundPipeline) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+			stats.mPipelineBinds++;
+		}
+
+		VkDescriptorSet descriptorSet = obj.mDescriptorSets[currentFrame];
+		if (descriptorSet != boundDescriptorSet) {
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			boundDescriptorSet = descriptorSet;
+			stats.mDescriptorBinds++;
+		}
+
+		if (obj.mMesh->mVertexBuffer.mBuffer != boundVertexBuffer) {
+			VkBuffer vertexBuffers[] = { obj.mMesh->mVertexBuffer.mBuffer };
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(cmd, 0, 1, vertexBuffers, offsets);
+			boundVertexBuffer = obj.mMesh->mVertexBuffer.mBuffer;
+			stats.mVertexBufferBinds++;
+		}
+
+		if (obj.mMesh->mIndexBuffer.mBuffer != boundIndexBuffer) {
+			vkCmdBindIndexBuffer(cmd, obj.mMesh->mIndexBuffer.mBuffer, 0, VK_INDEX_TYPE_UINT32);
+			boundIndexBuffer = obj.mMesh->mIndexBuffer.mBuffer;
+			stats.mIndexBufferBinds++;
+		}
+
+		if (drawFunction)
+			drawFunction(cmd, command.mObjectIndex);
+		else
+			vkCmdDrawIndexed(cmd, static_cast<uint32_t>(obj.mMesh->mIndices.size()), 1, 0, 0, 0);
+
+		stats.mDrawCalls++;
+	}
+}
+
+void RenderQueue::addStats(const RenderQueueStats& stats) {
+	mStats.mDrawCalls += stats.mDrawCalls;
+	mStats.mPipelineBinds += stats.mPipelineBinds;
+	mStats.mDescriptorBinds += stats.mDescriptorBinds;
+	mStats.mVertexBufferBinds += stats.mVertexBufferBinds;
+	mStats.mIndexBufferBinds += stats.mIndexBufferBinds;
+}
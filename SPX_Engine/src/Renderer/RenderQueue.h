@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../pch.h"
+
+// ******************************************************************************************************************************
+//															RENDER QUEUE
+// Every visible draw gets a 64 bit sort key. Sorting the keys groups draws by the state they need, so when recording
+// the binds that didn't change between two draws can be skipped. The bits from most to least significant:
+//
+//   63-60 Pass		  Which pass the draw belongs to. Passes never interleave.
+//   59-48 Pipeline	  Pipeline changes are the most expensive, so they're grouped first.
+//   47-32 Material	  Texture/descriptor set.
+//   31-16 Mesh		  Vertex and index buffers.
+//   15-0  Depth	  View distance quantized to 16 bits. Front to back so early-Z throws away hidden fragments.
+//
+// Keys are sorted with an LSD radix sort (8 bits per pass). It's O(n), and passes where every key has the same byte,
+// which is common since most bits are IDs shared by many draws, are skipped.
+// ******************************************************************************************************************************
+
+class RenderObject;
+
+struct RenderCommand {
+	uint64_t mSortKey{ 0 };
+	uint32_t mObjectIndex{ 0 };
+};
+
+// Binds and draws issued by the last record. Reset every frame.
+struct RenderQueueStats {
+	uint32_t mDrawCalls{ 0 };
+	uint32_t mPipelineBinds{ 0 };
+	uint32_t mDescriptorBinds{ 0 };
+	uint32_t mVertexBufferBinds{ 0 };
+	uint32_t mIndexBufferBinds{ 0 };
+	double mSortTimeMs{ 0.0 };
+	// CPU time spent recording the draws, filled in by the renderer.
+	double mRecordTimeMs{ 0.0 };
+};
+
+class RenderQueue {
+public:
+	static uint64_t makeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float normalizedDepth);
+
+	void clear();
+	void push(uint64_t sortKey, uint32_t objectIndex);
+	void sort();
+
+	// Records every command in sorted order, skipping binds that match the previous draw. Without a draw function each object
+	// gets a vkCmdDrawIndexed. Anything else (indirect draws) passes its own draw function, which is called after the binds.
+	void record(VkCommandBuffer cmd, const std::vector<RenderObject>& objects, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+		uint32_t currentFrame, const std::function<void(VkCommandBuffer, uint32_t)>& drawFunction = nullptr);
+
+	// Records commands [begin, end) and counts into stats instead of mStats. Doesn't touch the queue, so worker threads can
+	// each record their own range into their own command buffer at the same time. Merge the counts with addStats afterwards.
+	void recordRange(VkCommandBuffer cmd, size_t begin, size_t end, const std::vector<RenderObject>& objects, VkPipeline pipeline,
+		VkPipelineLayout pipelineLayout, uint32_t currentFrame, const std::function<void(VkCommandBuffer, uint32_t)>& drawFunction,
+		RenderQueueStats& stats) const;
+	void addStats(const RenderQueueStats& stats);
+
+	const std::vector<RenderCommand>& getCommands() const { return mCommands; }
+
+	RenderQueueStats mStats;
+
+	static const uint32_t PASS_BITS = 4;
+	static const uint32_t PIPELINE_BITS = 12;
+	static const uint32_t MATERIAL_BITS = 16;
+	static const uint32_t MESH_BITS = 16;
+	static const uint32_t DEPTH_BITS = 16;
+
+private:
+	std::vector<RenderCommand> mCommands;
+	// Ping pong buffer for the radix sort. Kept around so sorting doesn't allocate every frame.
+	std::vector<RenderCommand> mScratch;
+};
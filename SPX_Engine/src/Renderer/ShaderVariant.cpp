@@ -0,0 +1,10 @@
+#include "ShaderVariant.h"
+#include "VulkanWrapper/VGraphicsPipeline.h"
+
+void MeshShaderVariant::apply(GraphicsPipelineDescription& description) const {
+	// Only the fragment shader declares these.
+	description.setBool(MESH_USE_TEXTURE, mUseTexture, VK_SHADER_STAGE_FRAGMENT_BIT);
+	description.setBool(MESH_USE_VERTEX_COLOR, mUseVertexColor, VK_SHADER_STAGE_FRAGMENT_BIT);
+	description.setBool(MESH_ALPHA_TEST, mAlphaTest, VK_SHADER_STAGE_FRAGMENT_BIT);
+	description.setFloat(MESH_ALPHA_CUTOFF, mAlphaCutoff, VK_SHADER_STAGE_FRAGMENT_BIT);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../pch.h"
+
+// ******************************************************************************************************************************
+//															SHADER VARIANTS
+// shader.vert/shader.frag are one program with a few features that can be switched off, instead of a separate .spv for
+// every combination. The switches are specialization constants, so a variant is just a different set of values in the
+// pipeline description. The driver folds the constants in when it builds the pipeline, so a switched off feature costs
+// nothing at runtime, and the PipelineStateCache keys on the values so every variant is only compiled once.
+// ******************************************************************************************************************************
+
+struct GraphicsPipelineDescription;
+
+// constant_id values declared in shader.frag. These have to match the GLSL.
+enum MeshShaderConstant {
+	MESH_USE_TEXTURE = 0,
+	MESH_USE_VERTEX_COLOR = 1,
+	MESH_ALPHA_TEST = 2,
+	MESH_ALPHA_CUTOFF = 3
+};
+
+struct MeshShaderVariant {
+	// Sample the texture. Off gives flat vertex color (or white).
+	bool mUseTexture{ true };
+	// Multiply by the vertex color.
+	bool mUseVertexColor{ false };
+	// Discard fragments with alpha below mAlphaCutoff. Only set this where it's needed, discard turns off early-Z.
+	bool mAlphaTest{ false };
+	float mAlphaCutoff{ 0.5f };
+
+	// Writes the variant's constants into description.
+	void apply(GraphicsPipelineDescription& description) const;
+};
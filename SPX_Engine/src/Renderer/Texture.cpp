@@ -1,5 +1,10 @@
 #include "Texture.h"
+#include "../SPX/AllocationCounter.h"
 
+// stb_image's own buffers (the decoded pixels, mostly) go through the allocation counter like everything else.
+#define STBI_MALLOC(size) AllocationCounter::allocateMemory(size)
+#define STBI_REALLOC(ptr, size) AllocationCounter::reallocateMemory(ptr, size)
+#define STBI_FREE(ptr) AllocationCounter::freeMemory(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include "../ThirdParty/stb_image.h"
 #include "VulkanWrapper/DataStructures.h"
@@ -8,14 +13,22 @@
 #include "VulkanWrapper/VCommandPool.h"
 #include "VulkanWrapper/VCommandBuffer.h"
 #include "VulkanWrapper/VImage.h"
+#include "VulkanWrapper/VMemoryTracker.h"
+#include "../SPX/Profiler.h"
 
 Texture::Texture(std::string texturePath, VDevice& device)
 	:mDevice(device), mFileLocation(texturePath) {}
 
 
 void Texture::init(VCommandPool commandPool) {
+	SPX_PROFILE_ZONE("Load texture");
+	SPX_ALLOCATION_SCOPE(AllocationTag::Textures);
 	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(mFileLocation.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	stbi_uc* pixels;
+	{
+		SPX_PROFILE_ZONE("Decode texture");
+		pixels = stbi_load(mFileLocation.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	}
 
 	if (!pixels)
 		CORE_ERROR("Failed to load texture image.");
@@ -35,7 +48,8 @@ void Texture::init(VCommandPool commandPool) {
 
 	VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
 
-	AllocatedBuffer stagingBuffer = VHF::VulkanHelperFunctions::createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, mDevice);
+	AllocatedBuffer stagingBuffer = VHF::VulkanHelperFunctions::createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY,
+		mDevice, MemoryCategory::Staging);
 
 	void* data;
 	vmaMapMemory(mDevice.mAllocator, stagingBuffer.mAlloc, &data);
@@ -44,7 +58,14 @@ void Texture::init(VCommandPool commandPool) {
 
 	stbi_image_free(pixels);
 
-	mTextureImage = new VImage(mDevice, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, "", imageExtent);
+	mWidth = imageExtent.width;
+	mHeight = imageExtent.height;
+	mMipLevels = 1;
+	mLayerCount = 1;
+
+	// Transfer source too so defragmentation can copy it somewhere else.
+	mTextureImage = new VImage(mDevice, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, mFileLocation, imageExtent,
+		1, MemoryCategory::Texture);
 
 	// Start the command buffer single time to transition the image to transfer-reciever
 	VkCommandBuffer cmd = VCommandBuffer::beginSingleTimeCommands(commandPool.mCommandPool, mDevice.mLogicalDevice);
@@ -95,9 +116,20 @@ void Texture::init(VCommandPool commandPool) {
 
 	VCommandBuffer::endSingleTimeCommands(commandPool.mCommandPool, cmd, mDevice.mGraphicsQueue, mDevice.mLogicalDevice);
 
+	// endSingleTimeCommands waits for the copy, so the staging buffer can go.
+	mDevice.mMemoryTracker->untrack(stagingBuffer.mAlloc);
+	vmaDestroyBuffer(mDevice.mAllocator, stagingBuffer.mBuffer, stagingBuffer.mAlloc);
+
 	CORE_INFO("Texture loaded.");
 
 	createTextureSampler();
+	updateDescriptor();
+}
+
+void Texture::updateDescriptor() {
+	mDescriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	mDescriptor.imageView = mTextureImage->mImageView;
+	mDescriptor.sampler = mTextureSampler;
 }
 
 void Texture::createTextureSampler() {
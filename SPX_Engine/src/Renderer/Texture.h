@@ -12,6 +12,8 @@ public:
 
 	void init(VCommandPool commandPool);
 	void createTextureSampler();
+	// Points mDescriptor at the current image view. Called again when defragmentation moves the image.
+	void updateDescriptor();
 
 	VDevice& mDevice;
 	VImage* mTextureImage;
@@ -22,6 +24,7 @@ public:
 	uint32_t mMipLevels;
 	uint32_t mLayerCount;
 
-	VkDescriptorImageInfo mDescriptor;
+	// What the render objects' descriptor sets are written with.
+	VkDescriptorImageInfo mDescriptor{};
 	std::string mFileLocation;
 };
\ No newline at end of file
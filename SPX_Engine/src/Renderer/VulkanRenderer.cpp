@@ -6,88 +6,193 @@
 #include "VulkanWrapper/VRenderPass.h"
 #include "VulkanWrapper/VGraphicsPipeline.h"
 #include "VulkanWrapper/VCommandPool.h"
-#include "VulkanWrapper/VFrameBuffer.h"
+#include "VulkanWrapper/VImage.h"
+#include "VulkanWrapper/VOffscreenTarget.h"
+#include "VulkanWrapper/VPipelineCache.h"
+#include "VulkanWrapper/VLayoutCache.h"
+#include "VulkanWrapper/VShader.h"
+#include "VulkanWrapper/VShaderReflection.h"
+#include "VulkanWrapper/VMemoryPools.h"
 #include "RenderObject.h"
 #include "../SPX/Window.h"
 #include "Mesh.h"
-
-
-VulkanRenderer::VulkanRenderer(Window* window)
-	:mWindow(window) {}
+#include "Texture.h"
+#include "HiZCuller.h"
+#include "GpuProfiler.h"
+#include "MemoryDefragmenter.h"
+#include "PipelineStateCache.h"
+#include "ShaderVariant.h"
+#include "../SPX/JobSystem.h"
+#include "../SPX/FrameSnapshot.h"
+#include "../SPX/FramePacer.h"
+#include "../SPX/Profiler.h"
+#include "../SPX/FrameArena.h"
+#include "../SPX/AllocationCounter.h"
+
+
+VulkanRenderer::VulkanRenderer(Window* window, JobSystem* jobSystem)
+	:mWindow(window), mJobSystem(jobSystem) {}
 
 VulkanRenderer::~VulkanRenderer() {}
 
 void VulkanRenderer::init(std::string appName, std::string engineName, bool enableValLayers) {
+	SPX_PROFILE_ZONE("Renderer init");
+	SPX_ALLOCATION_SCOPE(AllocationTag::Renderer);
+	auto initStart = std::chrono::high_resolution_clock::now();
+
 	// When a new model is loaded during runtime, I have to remake some stuff. Especially once I've changed descriptors and pipeline.
-	mInstance = new VInstance(appName, engineName, enableValLayers);
-	mSurface = new VSurface(mInstance->get(), mWindow);
-	mDevice = new VDevice(mSurface->getSurface(), *mInstance);
-	mSwapChain = new VSwapChain(*mDevice, mWindow);
-	mRenderPass = new VRenderPass(*mDevice, "", *mSwapChain);
-	mGraphicsPipeline = new VGraphicsPipeline("src/ShaderFiles/vert.spv", "src/ShaderFiles/frag.spv", *mDevice);
+	mInstance = new VInstance(appName, engineName, enableValLayers, isHeadless());
+	// Anything sized per frame (command pools, uniform buffers, descriptor sets, Hi-Z buffers) uses this count.
+	mFramesInFlight = std::min(std::max(mFramesInFlight, 1u), MAX_FRAMES_IN_FLIGHT);
+	CORE_INFO("Rendering with {} frames in flight.", mFramesInFlight);
+	for (uint32_t i = 0; i < mFramesInFlight; i++)
+		mFrameArenas.push_back(new FrameArena(mFrameArenaBytes, "Frame arena " + std::to_string(i)));
+
+	// Headless draws into offscreen images instead, no surface, swapchain or present.
+	if (!isHeadless()) {
+		mSurface = new VSurface(mInstance->get(), mWindow);
+		mDevice = new VDevice(mSurface->getSurface(), *mInstance, mVmaRecordFile);
+		mSwapChain = new VSwapChain(*mDevice, mWindow);
+		mSwapChain->createDepthResources();
+
+		mExtent = mSwapChain->mSwapChainExtent;
+		mColorFormat = mSwapChain->mSwapChainImageFormat;
+		mDepthImage = mSwapChain->mDepthImage;
+	}
+	else {
+		mDevice = new VDevice(VK_NULL_HANDLE, *mInstance, mVmaRecordFile);
+		mOffscreenTarget = new VOffscreenTarget(*mDevice, mHeadlessExtent, mFramesInFlight);
+		mPendingCaptures.assign(mFramesInFlight, -1);
+
+		mExtent = mOffscreenTarget->mExtent;
+		mColorFormat = mOffscreenTarget->mColorFormat;
+		mDepthImage = mOffscreenTarget->mDepthImage;
+	}
+
+	// The render graph creates the passes that are actually recorded. This one only has to be compatible with them
+	// (same formats) for building the pipelines.
+	mRenderPass = new VRenderPass(*mDevice, "", mColorFormat, false, false);
+	// The descriptor set and pipeline layouts come from the shaders themselves, so they can't drift out of sync with the
+	// GLSL. Stage flags are exactly the stages that use each binding.
+	const std::string vertFile = "src/ShaderFiles/vert.spv";
+	const std::string fragFile = "src/ShaderFiles/frag.spv";
+	ShaderReflection vertReflection, fragReflection;
+	VShader::reflectFile(ShaderType::VERT_SHADER, vertFile, vertReflection);
+	VShader::reflectFile(ShaderType::FRAG_SHADER, fragFile, fragReflection);
+	ShaderReflection meshReflection = ShaderReflection::merge({ vertReflection, fragReflection });
+
+	mDescriptorSetLayout = mDevice->mLayoutCache->getDescriptorSetLayout(meshReflection.getSetLayoutBindings(0));
+	mPipelineLayout = mDevice->mLayoutCache->getPipelineLayout(meshReflection);
 	// This has to be called so the descriptor sets are created.
 	for (size_t i = 0; i < mRenderObjects.size(); i++)
-		mRenderObjects.at(i).createDescriptorSetLayout(*mDevice);
+		mRenderObjects.at(i).setDescriptorSetLayout(*mDevice, mDescriptorSetLayout);
+
+	// Pipelines compile as jobs while the meshes and textures load below.
+	mPipelineStateCache = new PipelineStateCache(*mDevice, mJobSystem);
+	GraphicsPipelineDescription mainPipeline = GraphicsPipelineDescription::makeDefault(vertFile, fragFile,
+		mRenderPass->mRenderPass, mPipelineLayout, mExtent);
+	// Textured, opaque. Other variants are the same description with different constants.
+	MeshShaderVariant().apply(mainPipeline);
+	mPipelineStateCache->prepare({ mainPipeline });
 
-	mGraphicsPipeline->createGraphicsPipeline(mSwapChain->mSwapChainExtent, mRenderObjects.at(0).mDescriptorSetLayout, mRenderPass->mRenderPass);
-	mCommandPool = new VCommandPool(*mDevice, *mSurface);
-	mSwapChain->createSwapChainFrameBuffers(*mRenderPass);
+	mCommandPool = new VCommandPool(*mDevice);
 
 	// Load the textures and render objects.
 	// Adds the load descriptor info to this function.
 	loadRenderObjects();
+
+	// Everything has to be compiled before the first frame, recording should never wait on a compile.
+	mPipelineStateCache->waitForPending();
+	mGraphicsPipeline = mPipelineStateCache->getPipeline(mainPipeline);
+	if (!mGraphicsPipeline)
+		CORE_ERROR("The main graphics pipeline failed to compile, nothing will be drawn.");
+
+	if (mEnableHiZCulling) {
+		mHiZCuller = new HiZCuller(*mDevice, *mDepthImage, mExtent,
+			static_cast<uint32_t>(mRenderObjects.size()), mFramesInFlight);
+	}
+	// Before the graph, which times every pass with it.
+	mGpuProfiler = new GpuProfiler(*mDevice, mFramesInFlight);
+	mDefragmenter = new MemoryDefragmenter(*mDevice, mFramesInFlight);
+	buildRenderGraph();
+
 	// Make sure I have a command buffer for each frame. This will allow me to work on one while the other is being processed by the GPU.
 	createCommandBuffers();
-	
-	// This code is to set their intial model or local position.
-	glm::vec3 rotation1 = glm::vec3(0.0f, 0.0f, -1.0f);
-	glm::mat4 modelMatrix1 = glm::mat4(1.0f);
-	glm::mat4 currentTransform1 = glm::rotate(modelMatrix1, glm::radians(90.0f), rotation1);
-	rotation1 = glm::vec3(0.0f, 1.0f, 0.0f);
-	currentTransform1 = glm::rotate(currentTransform1, glm::radians(90.0f), rotation1);
-	glm::vec3 move1 = glm::vec3(0.0f, -1.5f, 0.0f);
-	currentTransform1 = glm::translate(currentTransform1, move1);
-	mRenderObjects.at(0).mTransformMatrix = currentTransform1;
-
-	glm::vec3 scale = glm::vec3(0.05f, 0.05f, 0.05f);
-	glm::mat4 modelMatrix = glm::mat4(1.0f);
-	glm::mat4 currentTransform = glm::scale(modelMatrix, scale);
-	glm::vec3 rotation = glm::vec3(1.0f, 0.0f, 0.0f);
-	currentTransform = glm::rotate(currentTransform, glm::radians(180.0f), rotation);
-	rotation = glm::vec3(0.0f, 1.0f, 0.0f);
-	currentTransform = glm::rotate(currentTransform, glm::radians(180.0f), rotation);
-	glm::vec3 move = glm::vec3(-30.0f, 5.0f, 10.0f);
-	currentTransform = glm::translate(currentTransform, move);
-	mRenderObjects.at(1).mTransformMatrix = currentTransform;
-
+	createThreadCommandPools();
+	createProjectionMatrix();
 	createSyncObjects();
+
+	// Startup cost with and without the pipeline cache from the last run.
+	auto initEnd = std::chrono::high_resolution_clock::now();
+	mDevice->mPipelineCache->logStats();
+	mDevice->mLayoutCache->logStats();
+	PipelineStateCacheStats psoStats = mPipelineStateCache->getStats();
+	CORE_INFO("Pipeline state cache: {} pipelines, {} compiled in the background, {} stalls.", psoStats.mPipelines,
+		psoStats.mCompiledInBackground, psoStats.mStalls);
+	CORE_INFO("Renderer init took {:.3f} ms.", std::chrono::duration<double, std::milli>(initEnd - initStart).count());
 }
 
 void VulkanRenderer::addRenderObject(RenderObject& renderObj) {
 	mRenderObjects.push_back(renderObj);
 }
 
-void VulkanRenderer::addRenderObjects(std::vector<RenderObject> renderObjs) {
-	for (size_t i = 0; i < renderObjs.size(); i++) 
-		mRenderObjects.push_back(renderObjs.at(i));
+void VulkanRenderer::addRenderObjects(const std::vector<RenderObject>& renderObjs) {
+	mRenderObjects.insert(mRenderObjects.end(), renderObjs.begin(), renderObjs.end());
 }
 
 void VulkanRenderer::draw(glm::mat4 cameraViewMatrix) {
-
-	// Wait to make sure the frame is finished. No timeout set for now.
-	vkWaitForFences(mDevice->mLogicalDevice, 1, &mInFlightFences[mCurrentFrame], VK_TRUE, std::numeric_limits<uint32_t>::max());
-	
-
-	// Since commands are finished executing, I can safely reset the command buffer to begin recording again.
-	vkResetCommandBuffer(mMainCommandBuffers[mCurrentFrame], 0);
-
-	// Request Image from the swap chain.
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(mDevice->mLogicalDevice, mSwapChain->mSwapChain,
-		std::numeric_limits<uint32_t>::max(), mImageAvailableSemaphores[mCurrentFrame], VK_NULL_HANDLE, &imageIndex);
+	SPX_ALLOCATION_SCOPE(AllocationTag::Renderer);
+	auto drawStart = std::chrono::high_resolution_clock::now();
+	// Only this thread's. In pipelined mode the update thread and the workers allocate at the same time, counting the
+	// whole process would blame their allocations on the frame.
+	AllocationCounts allocationsBefore = AllocationCounter::getThreadCounts();
+	mFrameReported = false;
+
+	// Wait until the GPU has finished the last frame that used this frame's resources. That's the timeline value it
+	// signaled, mFramesInFlight submissions ago. No timeout set for now.
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &mFrameTimeline;
+	waitInfo.pValues = &mFrameTimelineValues[mCurrentFrame];
+	{
+		SPX_PROFILE_ZONE("Wait for frame");
+		vkWaitSemaphores(mDevice->mLogicalDevice, &waitInfo, std::numeric_limits<uint64_t>::max());
+	}
+	// When this thread saw the frame finish. Late by however long waking up took, the GPU profiler's time replaces it below
+	// when it has one.
+	auto frameFinished = std::chrono::steady_clock::now();
+	// Groups the calls by frame in a VMA recording. Also what VMA counts lost allocations by, which the engine doesn't use.
+	vmaSetCurrentFrameIndex(mDevice->mAllocator, static_cast<uint32_t>(mFrameNumber));
+	mFrameStats.mWaitTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - drawStart).count();
+
+	// Nothing from the last time this slot was drawn is used anymore.
+	FrameArena& arena = *mFrameArenas[mCurrentFrame];
+	arena.reset();
+
+	// Since commands are finished executing, I can safely reset this frame's pools to begin recording again.
+	mFrameCommandPools[mCurrentFrame]->reset();
+	for (VCommandPool* pool : mThreadCommandPools[mCurrentFrame])
+		pool->reset();
+
+	// Request Image from the swap chain. Headless has one offscreen image per frame, and the frame that last drew into
+	// it is done now, so its capture can be written out.
+	uint32_t imageIndex = mCurrentFrame;
+	VkResult result = VK_SUCCESS;
+	if (!isHeadless()) {
+		SPX_PROFILE_ZONE("Acquire");
+		result = vkAcquireNextImageKHR(mDevice->mLogicalDevice, mSwapChain->mSwapChain,
+			std::numeric_limits<uint32_t>::max(), mImageAvailableSemaphores[mCurrentFrame], VK_NULL_HANDLE, &imageIndex);
+	}
+	else
+		writePendingCapture(mCurrentFrame);
 
 	VkCommandBuffer cmd = mMainCommandBuffers[mCurrentFrame];
 
+	// Cull before recording so only visible objects reach the command buffer.
+	cullRenderObjects(cameraViewMatrix);
+	buildRenderQueue(cameraViewMatrix);
+
 
 	// Begin command buffer recording. Using this command buffer once.
 	VkCommandBufferBeginInfo cmdBeginInfo{};
@@ -96,51 +201,88 @@ void VulkanRenderer::draw(glm::mat4 cameraViewMatrix) {
 
 
 	vkBeginCommandBuffer(cmd, &cmdBeginInfo);
+	// The frame this slot last drew is finished, so its GPU times are read back here without waiting.
+	uint64_t lastGpuFrame = mGpuProfiler->getLatestFrame().mFrameNumber;
+	mGpuProfiler->beginFrame(cmd, mCurrentFrame, mFrameNumber);
+	const GpuFrameResult& gpuFrame = mGpuProfiler->getLatestFrame();
+	if (!gpuFrame.mScopes.empty())
+		mFrameStats.mGpuTimeMs = gpuFrame.getFrameMs();
+	if (mFramePacer) {
+		// With calibrated timestamps the end of the frame that was just read back is when the GPU really finished it.
+		if (gpuFrame.mCalibrated && !gpuFrame.mScopes.empty() && gpuFrame.mFrameNumber != lastGpuFrame)
+			frameFinished = gpuFrame.mCpuStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double, std::milli>(gpuFrame.getFrameMs()));
+		mFramePacer->notifyFenceComplete(frameFinished);
+	}
+
+	// Defragmentation copies go in before anything draws, so this frame already draws from the new places. This slot's
+	// descriptor sets aren't in use anymore, so any texture that moved since they were written is rewritten now.
+	if (mDefragmentRequested.exchange(false))
+		mDefragmenter->begin(mMeshes, mTextures);
+	mDefragmenter->update(cmd, mCurrentFrame, mFrameNumber, mGpuProfiler);
+	mDefragmenter->takeStaleTextures(mCurrentFrame, mStaleTextures);
+	if (!mStaleTextures.empty()) {
+		for (RenderObject& obj : mRenderObjects) {
+			if (std::find(mStaleTextures.begin(), mStaleTextures.end(), obj.mTexture) != mStaleTextures.end())
+				obj.updateTextureDescriptor(mCurrentFrame);
+		}
+	}
 
 	// Set clear color.
 	VkClearValue clearValue;
 	float flash = abs(sin(imageIndex / 120.0f));
 	clearValue.color = { {0.0f, 0.0f, flash, 1.0f} };
+	mRenderGraph->setClearValue(mBackBuffer, clearValue);
+	if (!isHeadless())
+		mRenderGraph->setImportedImage(mBackBuffer, mSwapChain->mSwapChainImages[imageIndex], mSwapChain->mSwapChainImageViews[imageIndex]);
+	else {
+		VImage* target = mOffscreenTarget->mColorImages[imageIndex];
+		mRenderGraph->setImportedImage(mBackBuffer, target->mImage, target->mImageView);
+		if (mReadback.isValid()) {
+			mRenderGraph->setImportedBuffer(mReadback, mOffscreenTarget->getReadbackBuffer(imageIndex));
+			mPendingCaptures[mCurrentFrame] = static_cast<int64_t>(mFrameNumber);
+		}
+	}
 
-	VkClearValue depthClear;
-	depthClear.depthStencil.depth = 1.f;
-
-	std::array<VkClearValue, 2> clearValues{clearValue, depthClear};
-
-	// Begin the main render pass.
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = mRenderPass->mRenderPass;
-	renderPassInfo.framebuffer = mSwapChain->mSwapChainFrameBuffers[imageIndex]->mFrameBuffer;
-	renderPassInfo.renderArea.offset = { 0,0 };
-	renderPassInfo.renderArea.extent = mSwapChain->mSwapChainExtent;
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
-
-	vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mGraphicsPipeline->mGraphicsPipeline);
-
-	for (size_t i = 0; i < mRenderObjects.size(); i++)
-		mRenderObjects.at(i).drawObject(cmd, mGraphicsPipeline->mPipelineLayout, imageIndex);
+	// Frustum culled objects are still skipped on the CPU. Everything else in the render queue gets an indirect draw in
+	// each phase and the compute shader decides how many instances (0 or 1) it actually draws.
+	if (mHiZCuller)
+		mHiZCuller->updateObjects(mCurrentFrame, mFrustumCuller, mRenderObjects, cameraViewMatrix);
 
-	vkCmdEndRenderPass(cmd);
+	// Every pass and every barrier between them.
+	{
+		SPX_PROFILE_ZONE("Record");
+		mRenderGraph->execute(cmd, arena);
+	}
 
+	mGpuProfiler->endFrame(cmd);
 	vkEndCommandBuffer(cmd);
 
-	// Update the Uniform Buffers after receiving the current swapchain image.
-	for (size_t i = 0; i < mRenderObjects.size(); i++)
-		mRenderObjects.at(i).updateUniformBuffers(mSwapChain->mSwapChainExtent, imageIndex, cameraViewMatrix);
+	// Update this frame's Uniform Buffers. They belong to the frame rather than the swapchain image, so the timeline wait
+	// above already guarantees the GPU is done reading them. Every object has its own buffers and VMA's map is
+	// internally synchronized, so big scenes can do this as jobs.
+	const std::vector<uint32_t>& visible = mFrustumCuller.mVisibleIndices;
+	uint32_t frameIndex = mCurrentFrame;
+	auto updateRange = [this, &visible, frameIndex, &cameraViewMatrix](size_t begin, size_t end) {
+		SPX_PROFILE_ZONE("Update uniforms");
+		for (size_t i = begin; i < end; i++)
+			mRenderObjects.at(visible[i]).updateUniformBuffers(frameIndex, cameraViewMatrix, mProjectionMatrix);
+	};
+	if (mJobSystem && visible.size() >= FrustumCuller::PARALLEL_CULL_THRESHOLD)
+		mJobSystem->parallelFor(visible.size(), 0, updateRange, &arena);
+	else
+		updateRange(0, visible.size());
 
 	// Queue submission and synchonization is configured through parameters in the VkSubmitInfo struct
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
 	// First specify which semaphores to wait on before execution begins and in which stages of the pipeilne to wait.
-	VkSemaphore waitSemaphores[] = { mImageAvailableSemaphores[mCurrentFrame] };
+	VkSemaphore waitSemaphores[] = { isHeadless() ? VK_NULL_HANDLE : mImageAvailableSemaphores[mCurrentFrame] };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
-	submitInfo.waitSemaphoreCount = 1;
+	// Headless has no acquire to wait for.
+	submitInfo.waitSemaphoreCount = isHeadless() ? 0 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
@@ -150,90 +292,688 @@ void VulkanRenderer::draw(glm::mat4 cameraViewMatrix) {
 	submitInfo.pCommandBuffers = &cmd;
 
 	// These specify which semaphores to signal once the command buffer have finished execution.
-	VkSemaphore signalSemaphores[] = { mRenderFinishedSemaphores[mCurrentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-
-	vkResetFences(mDevice->mLogicalDevice, 1, &mInFlightFences[mCurrentFrame]);
+	// The binary one is for present, which can't wait on a timeline. It belongs to the image since present is still
+	// waiting on it after this frame slot comes back around. The timeline gets this frame's value.
+	mFrameTimelineValue++;
+	mFrameTimelineValues[mCurrentFrame] = mFrameTimelineValue;
+
+	// Headless only signals the timeline, nothing is presented.
+	VkSemaphore signalSemaphores[] = { isHeadless() ? VK_NULL_HANDLE : mRenderFinishedSemaphores[imageIndex], mFrameTimeline };
+	uint64_t signalValues[] = { 0, mFrameTimelineValue };
+	uint32_t firstSignal = isHeadless() ? 1 : 0;
+	submitInfo.signalSemaphoreCount = 2 - firstSignal;
+	submitInfo.pSignalSemaphores = signalSemaphores + firstSignal;
+
+	// Binary semaphores ignore their value, but every semaphore in the submit needs an entry.
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 2 - firstSignal;
+	timelineInfo.pSignalSemaphoreValues = signalValues + firstSignal;
+	submitInfo.pNext = &timelineInfo;
 
 	// now submit the command buffer to the graphics queue using vkQueueSubmit.
 	// It takes and array of VkSubmitInfo structs as arguments for efficiency when the workload is much larger.
-	// The last param references an optional fence that will be signaled with the command buffers finish execution.
-	// Because I'm using semaphores, I pass VK_NULL_HANDLE.
-	// CHANGED to include fences between GPU and CPU
-	if (vkQueueSubmit(mDevice->mGraphicsQueue, 1, &submitInfo, mInFlightFences[mCurrentFrame]) != VK_SUCCESS)
-		CORE_ERROR("Error: Failed to submit draw command buffer.");
+	// No fence, the timeline semaphore is what the CPU waits on.
+	{
+		SPX_PROFILE_ZONE("Submit");
+		if (vkQueueSubmit(mDevice->mGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			CORE_ERROR("Error: Failed to submit draw command buffer.");
+	}
 
 	// Last step of drawing a frame is submitting the result back to the swap chain to have it eventually show up on screen.
-	VkPresentInfoKHR presentInfo{};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	// Specifies which semaphores to wait on before presentation can happen.
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	if (!isHeadless()) {
+		VkPresentInfoKHR presentInfo{};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		// Specifies which semaphores to wait on before presentation can happen.
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &mRenderFinishedSemaphores[imageIndex];
+
+		// These specify the swap chins to present iamges to and the index of the iamge for each swap chain.
+		// This will almost always be a single one.
+		VkSwapchainKHR swapChains[] = { mSwapChain->mSwapChain };
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = swapChains;
+		presentInfo.pImageIndices = &imageIndex;
+
+		{
+			SPX_PROFILE_ZONE("Present");
+			result = vkQueuePresentKHR(mDevice->mPresentQueue, &presentInfo);
+		}
+		if (mFramePacer)
+			mFramePacer->notifyPresent(std::chrono::steady_clock::now());
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || mFrameBufferResized) {
+			mFrameBufferResized = false;
+			//recreateSwapChain();
+		}
+		else if (result != VK_SUCCESS)
+			CORE_ERROR("Failed to present swap chain image in draw frame.");
+	}
 
-	// These specify the swap chins to present iamges to and the index of the iamge for each swap chain.
-	// This will almost always be a single one.
-	VkSwapchainKHR swapChains[] = { mSwapChain->mSwapChain };
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageIndex;
+	// Pipelines created while running (or skipped saving at startup) make it to disk even if the app later crashes.
+	mDevice->mPipelineCache->saveIfDue();
 
-	result = vkQueuePresentKHR(mDevice->mPresentQueue, &presentInfo);
+	if (mMemoryDumpRequested.exchange(false)) {
+		dumpMemoryMap(mMemoryDumpFile);
+		mFrameReported = true;
+	}
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || mFrameBufferResized) {
-		mFrameBufferResized = false;
-		//recreateSwapChain();
+	mFrameStats.mDrawCalls = mRenderQueue.mStats.mDrawCalls;
+	mFrameStats.mCpuTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - drawStart).count()
+		- mFrameStats.mWaitTimeMs;
+
+	mFrameStats.mHeapAllocations = (AllocationCounter::getThreadCounts() - allocationsBefore).mAllocations;
+	if (!mFrameReported) {
+		mCountedFrames++;
+		if (mFrameStats.mHeapAllocations > 0)
+			mAllocatingFrames++;
+		mMostFrameAllocations = std::max(mMostFrameAllocations, mFrameStats.mHeapAllocations);
 	}
-	else if (result != VK_SUCCESS)
-		CORE_ERROR("Failed to present swap chain image in draw frame.");
 
 	// Advance to the next frame
-	mCurrentFrame = (mCurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	mCurrentFrame = (mCurrentFrame + 1) % mFramesInFlight;
+	mFrameNumber++;
+}
+
+void VulkanRenderer::draw(const FrameSnapshot& snapshot) {
+	size_t count = std::min(snapshot.mObjectTransforms.size(), mRenderObjects.size());
+	for (size_t i = 0; i < count; i++)
+		mRenderObjects.at(i).mTransformMatrix = snapshot.mObjectTransforms[i];
+
+	draw(snapshot.mViewMatrix);
+}
+
+std::vector<glm::mat4> VulkanRenderer::getObjectTransforms() const {
+	std::vector<glm::mat4> transforms(mRenderObjects.size());
+	for (size_t i = 0; i < mRenderObjects.size(); i++)
+		transforms[i] = mRenderObjects.at(i).mTransformMatrix;
+	return transforms;
+}
+
+void VulkanRenderer::waitIdle() {
+	if (mDevice)
+		vkDeviceWaitIdle(mDevice->mLogicalDevice);
+}
+
+void VulkanRenderer::shutdown() {
+	waitIdle();
+	if (mDefragmenter)
+		mDefragmenter->cancel();
+	if (mDevice)
+		mDevice->mPipelineCache->save();
+
+	// The last frames are still waiting to be written.
+	for (uint32_t frame = 0; frame < mPendingCaptures.size(); frame++)
+		writePendingCapture(frame);
+}
+
+void VulkanRenderer::writePendingCapture(uint32_t frame) {
+	if (!mOffscreenTarget || mPendingCaptures[frame] < 0)
+		return;
+
+	std::string number = std::to_string(mPendingCaptures[frame]);
+	number.insert(0, number.size() < 5 ? 5 - number.size() : 0, '0');
+	std::string file = mCaptureDirectory + "/frame_" + number + ".ppm";
+
+	if (mOffscreenTarget->writeReadback(frame, file))
+		CORE_TRACE("Wrote {}", file);
+	mPendingCaptures[frame] = -1;
+}
+
+void VulkanRenderer::buildRenderGraph() {
+	mRenderGraph = new RenderGraph(*mDevice);
+	mRenderGraph->setProfiler(mGpuProfiler);
+
+	// The swapchain image is waited on at color output (the acquire semaphore's stage), and handed back ready to present.
+	// Offscreen images are left in whatever layout the last pass used.
+	RGImageDesc colorDesc;
+	colorDesc.mFormat = mColorFormat;
+	colorDesc.mExtent = mExtent;
+	RGImportInfo backBufferInfo;
+	if (!isHeadless()) {
+		backBufferInfo.mInitialStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		backBufferInfo.mFinalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	}
+	mBackBuffer = mRenderGraph->importImage("Back buffer", colorDesc, backBufferInfo);
+	RGResource color;
+
+	RGImageDesc depthDesc;
+	depthDesc.mFormat = mDepthImage->mFormat;
+	depthDesc.mExtent = mExtent;
+	depthDesc.mAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+	VkClearValue depthClear;
+	depthClear.depthStencil.depth = 1.f;
+	depthClear.depthStencil.stencil = 0;
+
+	if (!mHiZCuller) {
+		// Nothing reads the depth after the pass, so it's a transient that's never stored.
+		RGResource depth = mRenderGraph->createImage("Depth", depthDesc);
+		mRenderGraph->setClearValue(depth, depthClear);
+
+		RGPassBuilder forward = mRenderGraph->addPass("Forward");
+		color = forward.writeColor(mBackBuffer, true);
+		forward.writeDepth(depth, true);
+		// Only objects that survived culling are in the queue, sorted by state then front to back.
+		forward.setExecute([this](const RGPassContext& context) {
+			recordRenderPass(context.mCmd, context.mRenderPassInfo, 0);
+		});
+	}
+	else {
+		// The depth buffer is sampled to build the pyramid, so it's the swapchain's own image rather than a transient.
+		RGImportInfo persistentInfo;
+		persistentInfo.mPersistent = true;
+		RGResource depth = mRenderGraph->importImage("Depth", depthDesc, persistentInfo);
+		mRenderGraph->setImportedImage(depth, mDepthImage->mImage, mDepthImage->mImageView);
+		mRenderGraph->setClearValue(depth, depthClear);
+
+		const VImage& pyramidImage = mHiZCuller->getPyramid();
+		RGImageDesc pyramidDesc;
+		pyramidDesc.mFormat = pyramidImage.mFormat;
+		pyramidDesc.mExtent = mHiZCuller->getPyramidExtent();
+		pyramidDesc.mMipLevels = mHiZCuller->getPyramidLevels();
+		RGResource pyramid = mRenderGraph->importImage("Depth pyramid", pyramidDesc, persistentInfo);
+		mRenderGraph->setImportedImage(pyramid, pyramidImage.mImage, pyramidImage.mImageView);
+
+		RGResource visibility = mRenderGraph->importBuffer("Visibility", persistentInfo);
+		mRenderGraph->setImportedBuffer(visibility, mHiZCuller->getVisibilityBuffer());
+		RGResource draws = mRenderGraph->importBuffer("Indirect draws", persistentInfo);
+		mRenderGraph->setImportedBuffer(draws, mHiZCuller->getDrawBuffer());
+
+		// instanceCount is 0 if the culling shader decided the object is hidden, so a hidden draw costs almost nothing on the GPU.
+		VkBuffer drawBuffer = mHiZCuller->getDrawBuffer();
+		HiZCuller* hiZCuller = mHiZCuller;
+
+		RGPassBuilder earlyCull = mRenderGraph->addPass("Hi-Z early cull");
+		earlyCull.read(visibility, RGAccess::COMPUTE_STORAGE);
+		draws = earlyCull.write(draws, RGAccess::COMPUTE_STORAGE);
+		earlyCull.setExecute([this](const RGPassContext& context) {
+			mHiZCuller->cullEarly(context.mCmd, mCurrentFrame, mProjectionMatrix);
+		});
+
+		// Early phase: what was visible last frame.
+		RGPassBuilder earlyForward = mRenderGraph->addPass("Early forward");
+		earlyForward.read(draws, RGAccess::INDIRECT_ARGUMENTS);
+		color = earlyForward.writeColor(mBackBuffer, true);
+		depth = earlyForward.writeDepth(depth, true);
+		earlyForward.setExecute([this, drawBuffer, hiZCuller](const RGPassContext& context) {
+			recordRenderPass(context.mCmd, context.mRenderPassInfo, 0, [drawBuffer, hiZCuller](VkCommandBuffer cmd, uint32_t index) {
+				vkCmdDrawIndexedIndirect(cmd, drawBuffer, hiZCuller->getEarlyDrawOffset(index), 1, sizeof(VkDrawIndexedIndirectCommand));
+			});
+		});
+
+		RGPassBuilder reduce = mRenderGraph->addPass("Depth pyramid");
+		reduce.read(depth, RGAccess::COMPUTE_SAMPLED);
+		pyramid = reduce.write(pyramid, RGAccess::COMPUTE_STORAGE);
+		reduce.setExecute([this](const RGPassContext& context) {
+			mHiZCuller->buildPyramid(context.mCmd);
+		});
+
+		RGPassBuilder lateCull = mRenderGraph->addPass("Hi-Z late cull");
+		lateCull.read(pyramid, RGAccess::COMPUTE_STORAGE);
+		visibility = lateCull.write(visibility, RGAccess::COMPUTE_STORAGE);
+		draws = lateCull.write(draws, RGAccess::COMPUTE_STORAGE);
+		lateCull.setExecute([this](const RGPassContext& context) {
+			mHiZCuller->cullLate(context.mCmd, mCurrentFrame, mProjectionMatrix);
+		});
+
+		// Late phase: objects that just came into view. Loads the color and depth from the early phase.
+		RGPassBuilder lateForward = mRenderGraph->addPass("Late forward");
+		lateForward.read(draws, RGAccess::INDIRECT_ARGUMENTS);
+		color = lateForward.writeColor(color, false);
+		lateForward.writeDepth(depth, false);
+		lateForward.setExecute([this, drawBuffer, hiZCuller](const RGPassContext& context) {
+			recordRenderPass(context.mCmd, context.mRenderPassInfo, 1, [drawBuffer, hiZCuller](VkCommandBuffer cmd, uint32_t index) {
+				vkCmdDrawIndexedIndirect(cmd, drawBuffer, hiZCuller->getLateDrawOffset(index), 1, sizeof(VkDrawIndexedIndirectCommand));
+			});
+		});
+	}
+
+	// Headless frames can be copied out and written to disk once the GPU is done with them.
+	if (mOffscreenTarget && !mCaptureDirectory.empty()) {
+		mReadback = mRenderGraph->importBuffer("Readback", RGImportInfo{});
+
+		RGPassBuilder capture = mRenderGraph->addPass("Capture");
+		capture.read(color, RGAccess::TRANSFER_SRC);
+		capture.write(mReadback, RGAccess::TRANSFER_DST);
+		capture.setExecute([this](const RGPassContext& context) {
+			mOffscreenTarget->recordReadback(context.mCmd, mCurrentFrame);
+		});
+		CORE_INFO("Writing every frame to {}.", mCaptureDirectory);
+	}
+
+	if (!mRenderGraph->compile())
+		CORE_ERROR("Failed to compile the render graph.");
+}
+
+void VulkanRenderer::recordRenderPass(VkCommandBuffer cmd, const VkRenderPassBeginInfo& renderPassInfo, uint32_t passSlot,
+	const std::function<void(VkCommandBuffer, uint32_t)>& drawFunction) {
+	SPX_PROFILE_FUNCTION();
+	// The pipeline failed to compile (logged at init). The pass still begins and ends so its clears and layout
+	// transitions happen, it just draws nothing.
+	if (!mGraphicsPipeline) {
+		vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdEndRenderPass(cmd);
+		return;
+	}
+
+	VkPipeline pipeline = mGraphicsPipeline->mGraphicsPipeline;
+	VkPipelineLayout pipelineLayout = mGraphicsPipeline->mPipelineLayout;
+	size_t drawCount = mRenderQueue.getCommands().size();
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Small scenes record faster on one thread than it takes to hand the work out.
+	if (!mEnableParallelRecording || mRecordThreadCount < 2 || drawCount < PARALLEL_RECORD_THRESHOLD) {
+		vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		// Draw groups are runs of the sorted queue with the same pass, pipeline and material (the top 32 bits of the key).
+		FrameVector<size_t> groupStarts(getFrameArena());
+		groupStarts.reserve(MAX_DRAW_GROUP_SCOPES + 2);
+		if (mEnableDrawGroupTimings && mGpuProfiler->isEnabled()) {
+			const std::vector<RenderCommand>& commands = mRenderQueue.getCommands();
+			for (size_t i = 0; i < drawCount && groupStarts.size() <= MAX_DRAW_GROUP_SCOPES; i++) {
+				if (i == 0 || (commands[i].mSortKey >> 32) != (commands[i - 1].mSortKey >> 32))
+					groupStarts.push_back(i);
+			}
+		}
+
+		if (!groupStarts.empty() && groupStarts.size() <= MAX_DRAW_GROUP_SCOPES) {
+			groupStarts.push_back(drawCount);
+			for (size_t group = 0; group + 1 < groupStarts.size(); group++) {
+				uint32_t material = static_cast<uint32_t>(mRenderQueue.getCommands()[groupStarts[group]].mSortKey >> 32) &
+					((1u << RenderQueue::MATERIAL_BITS) - 1);
+				GpuScope scope(mGpuProfiler, cmd, "Material " + std::to_string(material));
+				mRenderQueue.recordRange(cmd, groupStarts[group], groupStarts[group + 1], mRenderObjects, pipeline, pipelineLayout,
+					mCurrentFrame, drawFunction, mRenderQueue.mStats);
+			}
+		}
+		else {
+			GpuScope scope(mGpuProfiler, cmd, "Draws");
+			mRenderQueue.record(cmd, mRenderObjects, pipeline, pipelineLayout, mCurrentFrame, drawFunction);
+		}
+		vkCmdEndRenderPass(cmd);
+
+		auto end = std::chrono::high_resolution_clock::now();
+		mRenderQueue.mStats.mRecordTimeMs += std::chrono::duration<double, std::milli>(end - start).count();
+		return;
+	}
+
+	// The pass contents come entirely from secondary command buffers now. Nothing can be recorded inline until it ends.
+	vkCmdBeginRenderPass(cmd, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	// Secondaries that run inside a render pass have to know which pass, subpass and framebuffer they'll be executed in.
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPassInfo.renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+
+	// One contiguous chunk of the sorted queue per thread so each chunk's state stays grouped.
+	size_t chunk = (drawCount + mRecordThreadCount - 1) / mRecordThreadCount;
+	uint32_t chunkCount = static_cast<uint32_t>((drawCount + chunk - 1) / chunk);
+	FrameArena& arena = getFrameArena();
+	FrameVector<VkCommandBuffer> secondaries(chunkCount, arena);
+	FrameVector<RenderQueueStats> stats(chunkCount, arena);
+
+	// Each chunk is its own draw group. The scopes are made here, the worker only writes its chunk's timestamps.
+	FrameVector<uint32_t> chunkScopes(chunkCount, UINT32_MAX, arena);
+	if (mEnableDrawGroupTimings) {
+		for (uint32_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+			chunkScopes[chunkIndex] = mGpuProfiler->addScope("Draw chunk " + std::to_string(chunkIndex));
+	}
+
+	// Every chunk has its own command pool, and only the job recording that chunk touches it.
+	auto recordChunk = [&](uint32_t chunkIndex) {
+		SPX_PROFILE_ZONE("Record chunk");
+		VkCommandBuffer secondary = mSecondaryCommandBuffers[mCurrentFrame][chunkIndex * SECONDARY_PASS_SLOTS + passSlot];
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		vkBeginCommandBuffer(secondary, &beginInfo);
+		mGpuProfiler->writeScopeBegin(secondary, chunkScopes[chunkIndex]);
+		size_t begin = chunkIndex * chunk;
+		mRenderQueue.recordRange(secondary, begin, std::min(begin + chunk, drawCount), mRenderObjects, pipeline, pipelineLayout,
+			mCurrentFrame, drawFunction, stats[chunkIndex]);
+		mGpuProfiler->writeScopeEnd(secondary, chunkScopes[chunkIndex]);
+		vkEndCommandBuffer(secondary);
+
+		secondaries[chunkIndex] = secondary;
+	};
+
+	// One job per chunk. The calling thread records the first chunk instead of waiting.
+	mJobSystem->parallelFor(chunkCount, 1, [&recordChunk](size_t begin, size_t end) {
+		for (size_t chunkIndex = begin; chunkIndex < end; chunkIndex++)
+			recordChunk(static_cast<uint32_t>(chunkIndex));
+	}, &arena);
+
+	// Executed in chunk order, so the draws still happen in sorted order.
+	vkCmdExecuteCommands(cmd, chunkCount, secondaries.data());
+	vkCmdEndRenderPass(cmd);
+
+	for (const auto& threadStats : stats)
+		mRenderQueue.addStats(threadStats);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	mRenderQueue.mStats.mRecordTimeMs += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void VulkanRenderer::createThreadCommandPools() {
+	mRecordThreadCount = mJobSystem ? mJobSystem->getThreadCount() : 1;
+
+	mThreadCommandPools.resize(mFramesInFlight);
+	mSecondaryCommandBuffers.resize(mFramesInFlight);
+
+	for (size_t frame = 0; frame < mFramesInFlight; frame++) {
+		for (uint32_t chunkIndex = 0; chunkIndex < mRecordThreadCount; chunkIndex++) {
+			// Transient since the whole pool is reset every time the frame comes around again.
+			VCommandPool* pool = new VCommandPool(*mDevice, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			mThreadCommandPools[frame].push_back(pool);
+
+			std::vector<VkCommandBuffer> buffers = pool->allocateCommandBuffers(SECONDARY_PASS_SLOTS, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			mSecondaryCommandBuffers[frame].insert(mSecondaryCommandBuffers[frame].end(), buffers.begin(), buffers.end());
+		}
+	}
+
+	CORE_INFO("Created command pools for {} recording chunks.", mRecordThreadCount);
 }
 
-void VulkanRenderer::calculateMemoryBudget() {}
+void VulkanRenderer::calculateMemoryBudget() {
+	MemoryBudgetReport report = getMemoryBudget();
+
+	for (const auto& heap : report.mHeaps) {
+		// Heaps nothing has touched are just noise.
+		if (heap.mUsage == 0 && heap.mBlockBytes == 0)
+			continue;
+
+		CORE_TRACE("GPU memory heap {} ({}): {:.1f} of {:.1f} MB budget ({:.0f}%), VMA blocks {:.1f} MB, {:.1f} MB allocated.",
+			heap.mHeapIndex, heap.mDeviceLocal ? "device local" : "host", heap.mUsage / 1048576.0, heap.mBudget / 1048576.0,
+			heap.getUsageFraction() * 100.0, heap.mBlockBytes / 1048576.0, heap.mAllocationBytes / 1048576.0);
+		if (heap.getUsageFraction() >= mMemoryWarningFraction) {
+			CORE_WARN("GPU memory heap {} is at {:.0f}% of its budget ({:.1f} of {:.1f} MB).", heap.mHeapIndex,
+				heap.getUsageFraction() * 100.0, heap.mUsage / 1048576.0, heap.mBudget / 1048576.0);
+		}
+	}
+
+	std::string categories;
+	for (size_t i = 0; i < report.mCategories.size(); i++) {
+		categories += (i == 0 ? "" : ", ") + std::string(getMemoryCategoryName(static_cast<MemoryCategory>(i))) + " " +
+			std::to_string(report.mCategories[i].mBytes / 1048576) + " MB (" + std::to_string(report.mCategories[i].mAllocations) + ")";
+	}
+	CORE_TRACE("GPU memory by category: {}.", categories);
+	mDevice->mMemoryPools->logStats();
+	// CPU memory alongside it, per subsystem when built with SPX_TRACK_ALLOCATIONS.
+	AllocationCounter::logStats();
+
+	VkDeviceSize freeBytes = 0;
+	double fragmentation = MemoryDefragmenter::getFragmentation(mDevice->mAllocator, &freeBytes);
+	CORE_TRACE("GPU memory fragmentation {:.0f}% of {:.1f} MB free in VMA blocks.", fragmentation * 100.0, freeBytes / 1048576.0);
+	if (mEnableAutoDefragmentation && fragmentation >= mDefragmentFragmentationThreshold &&
+		freeBytes >= mDefragmentMinFreeBytes && !mDefragmenter->isRunning()) {
+		CORE_INFO("GPU memory is {:.0f}% fragmented, defragmenting.", fragmentation * 100.0);
+		requestDefragmentation();
+	}
+}
+
+MemoryBudgetReport VulkanRenderer::getMemoryBudget() const {
+	return mDevice->mMemoryTracker->getReport();
+}
+
+bool VulkanRenderer::dumpMemoryMap(const std::string& file) {
+	return mDevice->mMemoryTracker->writeJson(file);
+}
+
+void VulkanRenderer::updateMemoryStats() {
+	VmaStats stats;
+	vmaCalculateStats(mDevice->mAllocator, &stats);
+	mFrameStats.mMemoryUsedBytes = stats.total.usedBytes;
+	mFrameStats.mMemoryAllocatedBytes = stats.total.usedBytes + stats.total.unusedBytes;
+}
+
+void VulkanRenderer::createProjectionMatrix() {
+	// Perspective projection with 45 degree vertial field of view.
+	// Next param is aspect ratio, near and far view planes.
+	// Important to use current swapchain extent incase the window is resized.
+	VkExtent2D extent = mExtent;
+	mProjectionMatrix = glm::perspective(glm::radians(45.0f), extent.width / (float)extent.height, mNearPlane, mFarPlane);
+	// GLM has the Y coordinate flipped, so I have to flip it or it will be rendered upsidedown
+	mProjectionMatrix[1][1] *= -1;
+}
+
+void VulkanRenderer::cullRenderObjects(const glm::mat4& cameraViewMatrix) {
+	SPX_PROFILE_FUNCTION();
+	if (mRenderObjects.size() != mFrustumCuller.getObjectCount())
+		mFrustumCuller.resize(mRenderObjects.size());
+
+	// Transforms can change every frame, so the world space bounds are refreshed before each cull. Each object only
+	// writes its own slot in the SoA arrays, so the refresh splits into jobs the same way the cull does.
+	auto updateRange = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const RenderObject& obj = mRenderObjects.at(i);
+			mFrustumCuller.updateBounds(i, obj.mMesh->mBoundingSphere, obj.mMesh->mBoundingBox, obj.mTransformMatrix);
+		}
+	};
+	if (mJobSystem && mRenderObjects.size() >= FrustumCuller::PARALLEL_CULL_THRESHOLD)
+		mJobSystem->parallelFor(mRenderObjects.size(), FrustumCuller::CULL_BATCH_SIZE, updateRange, &getFrameArena());
+	else
+		updateRange(0, mRenderObjects.size());
+
+	glm::mat4 viewProj = mProjectionMatrix * cameraViewMatrix;
+	mFrustumCuller.cull(Frustum::fromMatrix(viewProj), mJobSystem, &getFrameArena());
+	// The GPU tests occlusion itself with Hi-Z, the CPU pass would only be redundant work.
+	if (!mHiZCuller)
+		occlusionCullRenderObjects(viewProj);
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - mLastCullReport >= std::chrono::seconds(1)) {
+		const CullingStats& stats = mFrustumCuller.mStats;
+		CORE_TRACE("Culling: {} of {} objects visible, {} frustum culled in {:.3f} ms, {} occluded in {:.3f} ms.",
+			stats.mVisibleObjects, stats.mTotalObjects, stats.mCulledObjects - stats.mOccludedObjects, stats.mCullTimeMs,
+			stats.mOccludedObjects, stats.mOcclusionTimeMs);
+		const RenderQueueStats& queueStats = mRenderQueue.mStats;
+		CORE_TRACE("Render queue: {} draws, {} pipeline binds, {} descriptor binds, {} vertex buffer binds, {} index buffer binds, sorted in {:.3f} ms, recorded in {:.3f} ms on {} threads.",
+			queueStats.mDrawCalls, queueStats.mPipelineBinds, queueStats.mDescriptorBinds, queueStats.mVertexBufferBinds,
+			queueStats.mIndexBufferBinds, queueStats.mSortTimeMs, queueStats.mRecordTimeMs,
+			queueStats.mDrawCalls >= PARALLEL_RECORD_THRESHOLD && mEnableParallelRecording ? mRecordThreadCount : 1);
+		if (!mGpuProfiler->getLatestFrame().mScopes.empty())
+			GpuProfiler::logFrame(mGpuProfiler->getLatestFrame());
+		const FrameArena& arena = getFrameArena();
+		CORE_TRACE("Heap allocations on the drawing thread: {} of {} frames allocated, at most {} in one. Frame arena high water mark {} of {} KB.",
+			mAllocatingFrames, mCountedFrames, mMostFrameAllocations, arena.getHighWaterMark() / 1024, arena.getCapacity() / 1024);
+		mAllocatingFrames = 0;
+		mCountedFrames = 0;
+		mMostFrameAllocations = 0;
+		mLastCullReport = now;
+		mFrameReported = true;
+	}
+
+	if (now - mLastMemoryReport >= std::chrono::seconds(mMemoryReportSeconds)) {
+		calculateMemoryBudget();
+		mLastMemoryReport = now;
+		mFrameReported = true;
+	}
+}
+
+void VulkanRenderer::occlusionCullRenderObjects(const glm::mat4& viewProj) {
+	SPX_PROFILE_FUNCTION();
+	CullingStats& stats = mFrustumCuller.mStats;
+	stats.mOccludedObjects = 0;
+	stats.mOcclusionTimeMs = 0.0;
+
+	if (!mEnableOcclusionCulling || mOccluders.empty())
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < mOccluders.size(); i++)
+		mOccluders[i].mTransform = mRenderObjects.at(mOccluderObjects[i]).mTransformMatrix;
+
+	mOcclusionCuller.renderOccluders(mOccluders, viewProj, mJobSystem, &getFrameArena());
+
+	// Compact the visible list in place, dropping everything hidden behind the occluders.
+	// Occluders themselves are never tested since they would be compared against their own depth.
+	std::vector<uint32_t>& visible = mFrustumCuller.mVisibleIndices;
+	size_t kept = 0;
+	for (size_t i = 0; i < visible.size(); i++) {
+		const RenderObject& obj = mRenderObjects.at(visible[i]);
+
+		if (obj.mIsOccluder || mOcclusionCuller.isVisible(FrustumCuller::transformAABB(obj.mMesh->mBoundingBox, obj.mTransformMatrix)))
+			visible[kept++] = visible[i];
+	}
+
+	stats.mOccludedObjects = static_cast<uint32_t>(visible.size() - kept);
+	visible.resize(kept);
+
+	stats.mVisibleObjects = static_cast<uint32_t>(kept);
+	stats.mCulledObjects = stats.mTotalObjects - stats.mVisibleObjects;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	stats.mOcclusionTimeMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
 
 void VulkanRenderer::createSyncObjects() {
-	// Resize to how many frames I want to be worked on at the end of drawFrame()
-	mImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	mRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	mInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-	mImagesInFlight.resize(mSwapChain->mSwapChainImages.size(), VK_NULL_HANDLE);
+	// Acquire can only signal binary semaphores, one per frame. Present waits on a binary one too, one per swapchain image.
+	// Headless has neither.
+	mImageAvailableSemaphores.resize(isHeadless() ? 0 : mFramesInFlight);
+	mRenderFinishedSemaphores.resize(isHeadless() ? 0 : mSwapChain->mSwapChainImages.size());
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	// Create fence info struct
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	// NEEDED since fences are created in an unsignaled state. It will wait forever if this is not set freezing the program
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-	// Loop to build all the semaphores needed so each frame has it's own
+	for (size_t i = 0; i < mImageAvailableSemaphores.size(); i++) {
+		if (vkCreateSemaphore(mDevice->mLogicalDevice, &semaphoreInfo, nullptr, &mImageAvailableSemaphores[i]) != VK_SUCCESS)
+			CORE_ERROR("Failed to create image available semaphore for a frame.");
+	}
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		if (vkCreateSemaphore(mDevice->mLogicalDevice, &semaphoreInfo, nullptr, &mImageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(mDevice->mLogicalDevice, &semaphoreInfo, nullptr, &mRenderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(mDevice->mLogicalDevice, &fenceInfo, nullptr, &mInFlightFences[i]) != VK_SUCCESS)
-			CORE_ERROR("Failed to create synchronization objects for a frame.");
+	for (size_t i = 0; i < mRenderFinishedSemaphores.size(); i++) {
+		if (vkCreateSemaphore(mDevice->mLogicalDevice, &semaphoreInfo, nullptr, &mRenderFinishedSemaphores[i]) != VK_SUCCESS)
+			CORE_ERROR("Failed to create render finished semaphore for a swapchain image.");
 	}
+
+	// Everything else is one timeline semaphore for the graphics queue. Every submit signals the next value, so a
+	// frame's resources are free once the timeline reaches the value that frame last signaled. Starting at 0 with every
+	// frame waiting on 0 means the first pass through the frames doesn't wait at all.
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	timelineInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(mDevice->mLogicalDevice, &timelineInfo, nullptr, &mFrameTimeline) != VK_SUCCESS)
+		CORE_ERROR("Failed to create the frame timeline semaphore.");
+
+	mFrameTimelineValue = 0;
+	mFrameTimelineValues.assign(mFramesInFlight, 0);
 }
 
 void VulkanRenderer::createCommandBuffers() {
-	mMainCommandBuffers.resize(mSwapChain->mSwapChainImages.size());
+	// Each frame gets its own pool holding just its primary command buffer, so the whole pool is reset once the frame's
+	// timeline value is reached instead of resetting buffers one at a time.
+	mMainCommandBuffers.resize(mFramesInFlight);
+
+	for (uint32_t frame = 0; frame < mFramesInFlight; frame++) {
+		VCommandPool* pool = new VCommandPool(*mDevice, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		mFrameCommandPools.push_back(pool);
+		mMainCommandBuffers[frame] = pool->allocateCommandBuffers(1).at(0);
+	}
+}
 
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = mCommandPool->mCommandPool;
-	allocInfo.commandBufferCount = (uint32_t)mMainCommandBuffers.size();
+void VulkanRenderer::loadRenderObjects() {
+	SPX_PROFILE_FUNCTION();
+	// Each file is loaded and uploaded once no matter how many objects use it. Only the uniform buffers and descriptor
+	// sets are per object.
+	for (auto& obj : mRenderObjects) {
+		auto mesh = mMeshes.find(obj.mMeshFileLocation);
+		if (mesh != mMeshes.end())
+			obj.mMesh = mesh->second;
+		auto texture = mTextures.find(obj.mTextureFileLocation);
+		if (texture != mTextures.end())
+			obj.mTexture = texture->second;
+
+		obj.init(*mCommandPool, mFramesInFlight);
+
+		mMeshes.emplace(obj.mMeshFileLocation, obj.mMesh);
+		mTextures.emplace(obj.mTextureFileLocation, obj.mTexture);
+	}
+	CORE_INFO("Loaded {} render objects using {} meshes and {} textures.", mRenderObjects.size(), mMeshes.size(), mTextures.size());
 
-	if (vkAllocateCommandBuffers(mDevice->mLogicalDevice, &allocInfo, mMainCommandBuffers.data()) != VK_SUCCESS)
-		CORE_ERROR("Error: Failed to allocate main command buffers");
+	assignRenderIDs();
+	createOccluders();
 }
 
-void VulkanRenderer::loadRenderObjects() {
-	for (size_t i = 0; i < mRenderObjects.size(); i++)
-		mRenderObjects.at(i).init(*mCommandPool, static_cast<uint32_t>(mSwapChain->mSwapChainImages.size()));
+void VulkanRenderer::assignRenderIDs() {
+	std::unordered_map<std::string, uint32_t> meshIDs;
+	std::unordered_map<std::string, uint32_t> materialIDs;
+
+	for (auto& obj : mRenderObjects) {
+		// emplace only inserts if the file hasn't been seen, so the first object using a file picks its ID.
+		obj.mMeshID = meshIDs.emplace(obj.mMeshFileLocation, static_cast<uint32_t>(meshIDs.size())).first->second;
+		obj.mMaterialID = materialIDs.emplace(obj.mTextureFileLocation, static_cast<uint32_t>(materialIDs.size())).first->second;
+	}
+}
+
+void VulkanRenderer::buildRenderQueue(const glm::mat4& cameraViewMatrix) {
+	SPX_PROFILE_FUNCTION();
+	mRenderQueue.clear();
+
+	// Only one pass and one pipeline so far. They get real IDs once there is more than one of each.
+	const uint32_t pass = 0;
+	const uint32_t pipeline = 0;
+
+	mFrameStats.mTriangles = 0;
+	for (uint32_t index : mFrustumCuller.mVisibleIndices) {
+		const RenderObject& obj = mRenderObjects.at(index);
+		mFrameStats.mTriangles += obj.mMesh->mIndices.size() / 3;
+
+		// Distance to the object's center along the view direction, mapped to 0-1 between the clip planes.
+		BoundingSphere sphere = mFrustumCuller.getWorldSphere(index);
+		float viewDepth = -(cameraViewMatrix * glm::vec4(sphere.center, 1.0f)).z;
+		float normalizedDepth = (viewDepth - mNearPlane) / (mFarPlane - mNearPlane);
+
+		mRenderQueue.push(RenderQueue::makeSortKey(pass, pipeline, obj.mMaterialID, obj.mMeshID, normalizedDepth), index);
+	}
+
+	mRenderQueue.sort();
+}
+
+void VulkanRenderer::createOccluders() {
+	mOccluders.clear();
+	mOccluderObjects.clear();
+
+	for (size_t i = 0; i < mRenderObjects.size(); i++) {
+		const RenderObject& obj = mRenderObjects.at(i);
+		if (!obj.mIsOccluder)
+			continue;
+
+		Occluder occluder;
+		if (!obj.mOccluderFileLocation.empty()) {
+			try {
+				Mesh::loadPositions(obj.mOccluderFileLocation, occluder.mPositions, occluder.mIndices);
+			}
+			catch (const std::runtime_error& e) {
+				// A missing occluder only costs some culling, it's not worth failing init over.
+				CORE_ERROR("Failed to load occluder {}, using the render mesh instead. {}", obj.mOccluderFileLocation, e.what());
+				occluder.mPositions.clear();
+				occluder.mIndices.clear();
+			}
+		}
+		if (occluder.mPositions.empty()) {
+			// No dedicated occluder, so use the render mesh. Fine for big simple meshes like walls and floors.
+			occluder.mPositions.reserve(obj.mMesh->mVertices.size());
+			for (const auto& vertex : obj.mMesh->mVertices)
+				occluder.mPositions.push_back(vertex.pos);
+			occluder.mIndices = obj.mMesh->mIndices;
+		}
+
+		mOccluders.push_back(occluder);
+		mOccluderObjects.push_back(static_cast<uint32_t>(i));
+	}
+
+	CORE_INFO("{} occluders created for occlusion culling.", mOccluders.size());
 }
 
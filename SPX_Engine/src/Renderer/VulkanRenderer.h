@@ -10,8 +10,12 @@
 
 #include "../pch.h"
 #include "VulkanWrapper/DataStructures.h"
-
-const int MAX_FRAMES_IN_FLIGHT = 2; // Used at the end of draw frame to limit work pile up from the cpu to the gpu
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
+#include "RenderGraph.h"
+#include "VulkanWrapper/VMemoryTracker.h"
+#include <atomic>
 
 class Window;
 class VCommandPool;
@@ -22,26 +26,113 @@ class VSwapChain;
 class RenderObject;
 class VRenderPass;
 class VGraphicsPipeline;
+class HiZCuller;
+class PipelineStateCache;
+class JobSystem;
+struct FrameSnapshot;
+class FramePacer;
+class VOffscreenTarget;
+class VImage;
+class Mesh;
+class Texture;
+class GpuProfiler;
+class MemoryDefragmenter;
+class FrameArena;
+
+// What the last draw cost. Everything but the GPU time is for the frame draw just recorded. The GPU time is read back
+// once a frame's timeline value is reached, so it's for the frame mFramesInFlight draws ago.
+struct RendererFrameStats {
+	uint32_t mDrawCalls{ 0 };
+	// Triangles in the draws submitted. With Hi-Z culling the GPU can still skip some of them.
+	uint64_t mTriangles{ 0 };
+	// Time spent in draw, not counting mWaitTimeMs.
+	double mCpuTimeMs{ 0.0 };
+	// Time draw spent blocked on the GPU before it could reuse the frame's resources.
+	double mWaitTimeMs{ 0.0 };
+	// The GPU profiler's frame scope. Negative until the first frame comes back.
+	double mGpuTimeMs{ -1.0 };
+	// Only filled in by updateMemoryStats, it walks every VMA allocation.
+	VkDeviceSize mMemoryUsedBytes{ 0 };
+	VkDeviceSize mMemoryAllocatedBytes{ 0 };
+	// Heap allocations made during draw by the thread that draws, jobs it runs itself while waiting included. Jobs run
+	// on the workers aren't counted. Should be 0 once the frame arenas and scratch buffers have grown to fit, apart from
+	// frames that log a report.
+	uint64_t mHeapAllocations{ 0 };
+};
 
 
 class VulkanRenderer {
 public:
-	VulkanRenderer(Window* window);
+	// The job system is optional. Without it culling and recording stay on the calling thread.
+	// With no window the renderer is headless: it draws into offscreen images of mHeadlessExtent and never touches
+	// GLFW, a surface or a swapchain.
+	VulkanRenderer(Window* window, JobSystem* jobSystem = nullptr);
 	~VulkanRenderer();
 
 	void init(std::string appName, std::string engineName, bool enableValLayers);
 
 	void addRenderObject(RenderObject& renderObj);
-	void addRenderObjects(std::vector<RenderObject> renderObjs);
+	void addRenderObjects(const std::vector<RenderObject>& renderObjs);
 
 	void draw(glm::mat4 cameraViewMatrix);
+	// Pipelined mode. Copies the snapshot's transforms into the render objects and draws with its view matrix.
+	// Only the render thread calls this, the snapshot is never written while it's being read.
+	void draw(const FrameSnapshot& snapshot);
+	// Starting transforms for the update thread's copy of the scene.
+	std::vector<glm::mat4> getObjectTransforms() const;
+	// Blocks until the GPU has finished everything submitted.
+	void waitIdle();
+	// Called once the frame loop has stopped. Waits for the GPU and saves the pipeline cache.
+	void shutdown();
 
-	// Run VMA memory stats
+	bool isHeadless() const { return mWindow == nullptr; }
+
+	// Logs every heap's usage against its budget and what each category uses, warning about any heap past
+	// mMemoryWarningFraction of its budget, then the CPU side from AllocationCounter. Runs every mMemoryReportSeconds on its own.
 	void calculateMemoryBudget();
+	MemoryBudgetReport getMemoryBudget() const;
+	// Writes the detailed allocation map as JSON. Only call from the thread that draws, requestMemoryDump is safe from anywhere.
+	bool dumpMemoryMap(const std::string& file);
+	// The next draw writes mMemoryDumpFile.
+	void requestMemoryDump() { mMemoryDumpRequested = true; }
+	// The next draw starts compacting mesh and texture memory over the following frames. Safe from anywhere.
+	void requestDefragmentation() { mDefragmentRequested = true; }
 	void createSyncObjects();
 	void createCommandBuffers();
 	// Loads the Mesh and Texture data from the RenderObject to the GPU.
 	void loadRenderObjects();
+	// Builds the perspective projection from the swapchain extent. Shared by culling and the uniform buffers.
+	void createProjectionMatrix();
+	// Updates the world space bounds of every object and culls them against the camera frustum.
+	// Objects that pass are then tested against the CPU occlusion buffer.
+	void cullRenderObjects(const glm::mat4& cameraViewMatrix);
+	// Collects the occluder geometry of every RenderObject flagged as an occluder.
+	void createOccluders();
+	void occlusionCullRenderObjects(const glm::mat4& viewProj);
+	// Builds a sort key for every visible object and sorts them so recording can skip redundant binds.
+	void buildRenderQueue(const glm::mat4& cameraViewMatrix);
+	// Gives every distinct mesh and texture file an ID for the sort keys.
+	void assignRenderIDs();
+	// Per chunk, per frame command pools and the secondary command buffers recorded from them.
+	void createThreadCommandPools();
+	// Begins the pass, records the render queue (split across threads into secondary command buffers once there are
+	// enough draws) and ends the pass. passSlot picks which secondary buffers to use when a frame has more than one pass.
+	void recordRenderPass(VkCommandBuffer cmd, const VkRenderPassBeginInfo& renderPassInfo, uint32_t passSlot,
+		const std::function<void(VkCommandBuffer, uint32_t)>& drawFunction = nullptr);
+	// Declares the frame's passes and compiles the graph. With Hi-Z culling that's the two phase cull and draw,
+	// otherwise a single forward pass.
+	void buildRenderGraph();
+
+	const CullingStats& getCullingStats() const { return mFrustumCuller.mStats; }
+	const RenderQueueStats& getRenderQueueStats() const { return mRenderQueue.mStats; }
+	const RendererFrameStats& getFrameStats() const { return mFrameStats; }
+	// Fills in the memory part of the frame stats. Too slow to do every frame with big scenes unless you're measuring it.
+	void updateMemoryStats();
+	// nullptr until init.
+	GpuProfiler* getGpuProfiler() const { return mGpuProfiler; }
+	// The arena of the frame being drawn. It's reset once that frame slot comes around again, so only use it for data
+	// that's done with by the end of draw. Only valid on the thread that draws.
+	FrameArena& getFrameArena() const { return *mFrameArenas[mCurrentFrame]; }
 
 	bool mWindowResized{ false };
 	bool mTimePassed{ 0.0f };
@@ -49,29 +140,118 @@ public:
 
 	std::vector<VkCommandBuffer> mMainCommandBuffers;
 
+	// How many frames the CPU can record ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT. Set before init. 1 has the least
+	// latency but the CPU and GPU take turns, more keeps both busy at the cost of a frame of latency each.
+	uint32_t mFramesInFlight{ 2 };
+	static const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+	// Which set of per frame resources is being recorded, 0 to mFramesInFlight - 1.
 	uint32_t mCurrentFrame{ 0 };
 	bool mFrameBufferResized{ false };
 
+	glm::mat4 mProjectionMatrix{ 1.0f };
+	float mNearPlane{ 0.1f };
+	float mFarPlane{ 100.0f };
+
+	bool mEnableOcclusionCulling{ true };
+	// GPU occlusion culling against a depth pyramid. Has to be set before init since it changes the render passes.
+	// Off by default, --hiz turns it on.
+	// When it's on the CPU occlusion culler is skipped, the GPU does a better job with the real depth buffer.
+	bool mEnableHiZCulling{ false };
+
+	// Time each draw group (run of draws sharing a material) on the GPU when there are at most MAX_DRAW_GROUP_SCOPES of
+	// them. Each group is recorded separately, so its state is bound again at the start of every group.
+	bool mEnableDrawGroupTimings{ true };
+	static const uint32_t MAX_DRAW_GROUP_SCOPES = 32;
+
+	// Record draws as jobs into secondary command buffers once the queue has PARALLEL_RECORD_THRESHOLD draws.
+	bool mEnableParallelRecording{ true };
+	static const size_t PARALLEL_RECORD_THRESHOLD = 1024;
+	// Most passes recorded in one frame (Hi-Z has two), each needs its own secondary buffer per chunk.
+	static const uint32_t SECONDARY_PASS_SLOTS = 2;
+
+	// A heap using more than this much of its budget is warned about in the memory report. Over budget the driver starts
+	// moving memory to system RAM or failing allocations.
+	double mMemoryWarningFraction{ 0.9 };
+	uint32_t mMemoryReportSeconds{ 10 };
+	std::string mMemoryDumpFile{ "memory_map.json" };
+	// The memory report starts a defragmentation on its own once this much of the free space in VMA's blocks is
+	// scattered (see MemoryDefragmenter::getFragmentation) and there's at least mDefragmentMinFreeBytes to win back.
+	bool mEnableAutoDefragmentation{ true };
+	double mDefragmentFragmentationThreshold{ 0.5 };
+	VkDeviceSize mDefragmentMinFreeBytes{ 64 * 1024 * 1024 };
+	// Starting size of each frame's arena. A frame that needs more grows it (see FrameArena).
+	size_t mFrameArenaBytes{ 1024 * 1024 };
+	// Set before init to record every VMA call to this file (see VmaReplay.h). Empty doesn't record.
+	std::string mVmaRecordFile;
+
+	// Optional. Told when each frame's fence signals and when each present returns.
+	FramePacer* mFramePacer{ nullptr };
+
+	// Headless only, set before init. With a capture directory every frame is written there as frame_NNNNN.ppm.
+	VkExtent2D mHeadlessExtent{ 1920, 1080 };
+	std::string mCaptureDirectory;
+
 private:
 	// Camera class
 	// glfwContext
 	Window* mWindow{ nullptr };
+	JobSystem* mJobSystem{ nullptr };
 	VInstance* mInstance{ nullptr };
 	VDevice* mDevice{ nullptr };
 	VSurface* mSurface{ nullptr };
 	VSwapChain* mSwapChain{ nullptr };
+	// Replaces the surface and swapchain when headless.
+	VOffscreenTarget* mOffscreenTarget{ nullptr };
+	// What's drawn into, from the swapchain or the offscreen target.
+	VkExtent2D mExtent{ 0, 0 };
+	VkFormat mColorFormat{ VK_FORMAT_UNDEFINED };
+	VImage* mDepthImage{ nullptr };
 	VRenderPass* mRenderPass{ nullptr };
+	// Used for uploads. Each frame records from its own pool in mFrameCommandPools.
 	VCommandPool* mCommandPool{ nullptr };
+	std::vector<VCommandPool*> mFrameCommandPools;
+	// Owned by mPipelineStateCache.
 	VGraphicsPipeline* mGraphicsPipeline{ nullptr };
+	PipelineStateCache* mPipelineStateCache{ nullptr };
+	VkPipelineLayout mPipelineLayout{ VK_NULL_HANDLE };
+	HiZCuller* mHiZCuller{ nullptr };
 	std::vector<RenderObject> mRenderObjects;
+	// Every object using the same file shares one mesh or texture, keyed by the file.
+	std::unordered_map<std::string, Mesh*> mMeshes;
+	std::unordered_map<std::string, Texture*> mTextures;
 	// TODO: imGUI overlay
 
+	FrustumCuller mFrustumCuller;
+	OcclusionCuller mOcclusionCuller;
+	std::vector<Occluder> mOccluders;
+	// Index into mRenderObjects for each entry in mOccluders.
+	std::vector<uint32_t> mOccluderObjects;
+	RenderQueue mRenderQueue;
+
+	// The queue is split into this many chunks, one per job system thread.
+	uint32_t mRecordThreadCount{ 1 };
+	// [frame][chunk]
+	std::vector<std::vector<VCommandPool*>> mThreadCommandPools;
+	// [frame][chunk * SECONDARY_PASS_SLOTS + pass slot]
+	std::vector<std::vector<VkCommandBuffer>> mSecondaryCommandBuffers;
+
+	// Culling stats are logged once a second rather than every frame.
+	std::chrono::steady_clock::time_point mLastCullReport;
+	std::chrono::steady_clock::time_point mLastMemoryReport;
+	std::atomic<bool> mMemoryDumpRequested{ false };
+	std::atomic<bool> mDefragmentRequested{ false };
+
 
 	// Move to sync class
+	// [frame]
 	std::vector<VkSemaphore> mImageAvailableSemaphores;
+	// [swapchain image]
 	std::vector<VkSemaphore> mRenderFinishedSemaphores;
-	std::vector<VkFence> mInFlightFences;
-	std::vector<VkFence> mImagesInFlight;
+	// Timeline semaphore signaled by every graphics submit. mFrameTimelineValue is the last value submitted and
+	// mFrameTimelineValues[frame] the value that frame's last submit signals.
+	VkSemaphore mFrameTimeline{ VK_NULL_HANDLE };
+	uint64_t mFrameTimelineValue{ 0 };
+	std::vector<uint64_t> mFrameTimelineValues;
 
 
 	// Move these to a descriptor class
@@ -79,5 +259,30 @@ private:
 	VkDescriptorPool mDescriptorPool;
 	std::vector<VkDescriptorSet> mDescriptorSets;
 
-	// RenderGraph?
+	// Every pass of the frame. The swapchain image is swapped in before each execute.
+	RenderGraph* mRenderGraph{ nullptr };
+	RGResource mBackBuffer;
+	// Only in the graph when headless frames are captured.
+	RGResource mReadback;
+
+	RendererFrameStats mFrameStats;
+	// Frames since the last culling report that made heap allocations, out of how many were counted, and the most
+	// allocations one of them made. Frames that log a report allocate for the log and aren't counted.
+	uint32_t mAllocatingFrames{ 0 };
+	uint32_t mCountedFrames{ 0 };
+	uint64_t mMostFrameAllocations{ 0 };
+	bool mFrameReported{ false };
+	// [frame] Scratch for everything a frame needs only while it's recorded.
+	std::vector<FrameArena*> mFrameArenas;
+	GpuProfiler* mGpuProfiler{ nullptr };
+	MemoryDefragmenter* mDefragmenter{ nullptr };
+	// Textures the defragmenter moved that this frame's descriptor sets still point at. Kept around so it doesn't allocate every frame.
+	std::vector<Texture*> mStaleTextures;
+
+	// Frames drawn since init.
+	uint64_t mFrameNumber{ 0 };
+	// [frame] The frame number whose readback is waiting in that frame's buffer, -1 for none. Written once the frame's
+	// timeline value is reached.
+	std::vector<int64_t> mPendingCaptures;
+	void writePendingCapture(uint32_t frame);
 };
\ No newline at end of file
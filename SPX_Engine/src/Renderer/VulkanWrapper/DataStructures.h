@@ -93,6 +93,20 @@ struct UniformBufferObject {
 	glm::mat4 proj;
 };
 
+// Bounding volumes used for visibility culling. Both are computed in model space when a mesh is loaded and
+// transformed into world space by the object's transform matrix every frame before culling.
+// Sphere: center and radius. Cheap to test and rotation invariant.
+// AABB:   center and half extents along each axis. Tighter than the sphere for long thin or boxy meshes.
+struct BoundingSphere {
+	glm::vec3 center{ 0.0f };
+	float radius{ 0.0f };
+};
+
+struct AABB {
+	glm::vec3 center{ 0.0f };
+	glm::vec3 extents{ 0.0f };
+};
+
 namespace std {
 	template<> struct hash<Vertex> {
 		size_t operator()(Vertex const& vertex) const {
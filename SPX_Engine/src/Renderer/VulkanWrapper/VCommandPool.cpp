@@ -1,16 +1,16 @@
 #include "VCommandPool.h"
 #include "VDevice.h"
-#include "VSurface.h"
 
-VCommandPool::VCommandPool(VDevice& device, VSurface surface)
+VCommandPool::VCommandPool(VDevice& device, VkCommandPoolCreateFlags flags)
 	:mDevice(device) {
-	// Using VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT to allow for resetting of individual command buffers.
-	QueueFamilyIndices queueFamilyIndices = VDevice::findQueueFamilies(mDevice.mPhysicalDevice, surface.getSurface());
+	// Defaults to VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT to allow for resetting of individual command buffers.
+	// Per frame pools that are reset as a whole use VK_COMMAND_POOL_CREATE_TRANSIENT_BIT instead.
+	QueueFamilyIndices queueFamilyIndices = VDevice::findQueueFamilies(mDevice.mPhysicalDevice, mDevice.mSurface);
 
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.flags = flags;
 
 	if (vkCreateCommandPool(mDevice.mLogicalDevice, &poolInfo, nullptr, &mCommandPool) != VK_SUCCESS)
 		CORE_ERROR("Failed to create Command Pool");
@@ -21,3 +21,23 @@ VCommandPool::VCommandPool(VDevice& device, VSurface surface)
 VCommandPool::~VCommandPool() {
 	//vkDestroyCommandPool(mDevice.mLogicalDevice, mCommandPool, nullptr);
 }
+
+std::vector<VkCommandBuffer> VCommandPool::allocateCommandBuffers(uint32_t count, VkCommandBufferLevel level) {
+	std::vector<VkCommandBuffer> commandBuffers(count);
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = level;
+	allocInfo.commandPool = mCommandPool;
+	allocInfo.commandBufferCount = count;
+
+	if (vkAllocateCommandBuffers(mDevice.mLogicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+		CORE_ERROR("Failed to allocate {} command buffers.", count);
+
+	return commandBuffers;
+}
+
+void VCommandPool::reset() {
+	if (vkResetCommandPool(mDevice.mLogicalDevice, mCommandPool, 0) != VK_SUCCESS)
+		CORE_ERROR("Failed to reset Command Pool.");
+}
@@ -3,15 +3,20 @@
 #include "../../pch.h"
 
 class VDevice;
-class VSurface;
 
 // So far just a command pool for graphics queue family.
 // Need to change later to get command pools with different queueFamilyIndex's.
+// A pool can only be used by one thread at a time, so multithreaded recording needs a pool per thread (and per frame
+// in flight, so a pool is never reset while the GPU is still using its buffers).
 class VCommandPool {
 public:
-	VCommandPool(VDevice& device, VSurface surface);
+	VCommandPool(VDevice& device, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 	~VCommandPool();
 
+	std::vector<VkCommandBuffer> allocateCommandBuffers(uint32_t count, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	// Resets every command buffer allocated from the pool at once. Cheaper than resetting them one by one.
+	void reset();
+
 	VkCommandPool mCommandPool;
 	VDevice& mDevice;
-};
\ No newline at end of file
+};
@@ -0,0 +1,52 @@
+#include "VComputePipeline.h"
+#include "VShader.h"
+#include "VDevice.h"
+#include "VPipelineCache.h"
+
+VComputePipeline::VComputePipeline(const std::string& compFile, VDevice& device, VkDescriptorSetLayout descriptorSetLayout, uint32_t pushConstantSize)
+	:mDevice(device) {
+	VShader shader(ShaderType::COMP_SHADER, compFile, mDevice);
+
+	// Push constants are only ever read by the compute stage.
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = pushConstantSize;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantSize > 0 ? &pushConstantRange : nullptr;
+
+	if (vkCreatePipelineLayout(mDevice.mLogicalDevice, &pipelineLayoutInfo, nullptr, &mPipelineLayout) != VK_SUCCESS)
+		CORE_ERROR("Failed to create compute Pipeline Layout for {}.", compFile);
+
+	VkPipelineShaderStageCreateInfo shaderInfo{};
+	shaderInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	shaderInfo.module = shader.mShaderModule;
+	shaderInfo.pName = "main";
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = shaderInfo;
+	pipelineInfo.layout = mPipelineLayout;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (vkCreateComputePipelines(mDevice.mLogicalDevice, mDevice.mPipelineCache->get(), 1, &pipelineInfo, nullptr, &mPipeline) != VK_SUCCESS)
+		CORE_ERROR("Failed to create Compute Pipeline for {}.", compFile);
+	else
+		CORE_INFO("Compute Pipeline created successfully for {}.", compFile);
+	auto end = std::chrono::high_resolution_clock::now();
+	mDevice.mPipelineCache->recordPipelineCreation(std::chrono::duration<double, std::milli>(end - start).count());
+
+	// The module is baked into the pipeline now, so it isn't needed anymore.
+	vkDestroyShaderModule(mDevice.mLogicalDevice, shader.mShaderModule, nullptr);
+}
+
+VComputePipeline::~VComputePipeline() {
+	vkDestroyPipeline(mDevice.mLogicalDevice, mPipeline, nullptr);
+	vkDestroyPipelineLayout(mDevice.mLogicalDevice, mPipelineLayout, nullptr);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../../pch.h"
+
+class VDevice;
+
+// A compute pipeline is a lot simpler than a graphics pipeline. It is just one shader stage and a pipeline layout,
+// no fixed function state or render pass.
+class VComputePipeline {
+public:
+	VComputePipeline(const std::string& compFile, VDevice& device, VkDescriptorSetLayout descriptorSetLayout, uint32_t pushConstantSize = 0);
+	~VComputePipeline();
+
+	VkPipelineLayout mPipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline mPipeline{ VK_NULL_HANDLE };
+
+private:
+	VDevice& mDevice;
+};
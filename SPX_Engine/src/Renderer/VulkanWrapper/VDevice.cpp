@@ -1,14 +1,57 @@
 #include "VDevice.h"
 #include "VulkanValidationLayers.h"
 #include "VInstance.h"
+#include "VPipelineCache.h"
+#include "VLayoutCache.h"
+#include "VMemoryTracker.h"
+#include "VMemoryPools.h"
 #include "../../ThirdParty/vk_mem_alloc.h"
 
-VDevice::VDevice(VkSurfaceKHR surface, VInstance instance)
-	: mSurface(surface) {
+VDevice::VDevice(VkSurfaceKHR surface, VInstance instance, const std::string& vmaRecordFile)
+	: mSurface(surface), mInstance(instance.get()), mVmaRecordFile(vmaRecordFile) {
+	if (!isHeadless())
+		mDeviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	else
+		CORE_INFO("Creating a headless device, nothing will be presented.");
+
 	pickPhysicalDevice(instance);
+	enableOptionalExtensions();
 	createLogicalDevice(instance);
 }
 
+bool VDevice::isExtensionEnabled(const std::string& name) const {
+	for (const char* extension : mDeviceExtensions) {
+		if (name == extension)
+			return true;
+	}
+	return false;
+}
+
+void VDevice::enableOptionalExtensions() {
+	// Nice to have, nothing breaks without them.
+	const std::vector<const char*> optionalExtensions = {
+		// Correlates GPU timestamps with CPU time in the GPU profiler.
+		VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+		// The driver's real per heap usage and budget, instead of VMA's estimate.
+		VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+	};
+
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExt(extensionCount);
+	vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &extensionCount, availableExt.data());
+
+	for (const char* optional : optionalExtensions) {
+		for (const auto& extension : availableExt) {
+			if (std::string(optional) == extension.extensionName) {
+				mDeviceExtensions.push_back(optional);
+				CORE_INFO("Optional device extension {} enabled.", optional);
+				break;
+			}
+		}
+	}
+}
+
 void VDevice::pickPhysicalDevice(VInstance instance) {
 	// List all available GPUs
 	uint32_t deviceCount = 0;
@@ -55,8 +98,14 @@ void VDevice::createLogicalDevice(VInstance instance) {
 	VkPhysicalDeviceFeatures feats{};
 	feats.samplerAnisotropy = VK_TRUE;
 
+	// Timeline semaphores are core in 1.2 but still have to be turned on. isDeviceSuitable checks for them.
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeats{};
+	timelineFeats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	timelineFeats.timelineSemaphore = VK_TRUE;
+
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &timelineFeats;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &feats;
@@ -89,10 +138,35 @@ void VDevice::createLogicalDevice(VInstance instance) {
 	vamCreateInfo.physicalDevice = mPhysicalDevice;
 	vamCreateInfo.instance = instance.get();
 	vamCreateInfo.device = mLogicalDevice;
-
+	// The budget extension needs vkGetPhysicalDeviceMemoryProperties2, which is core from 1.1.
+	vamCreateInfo.vulkanApiVersion = VK_API_VERSION_1_2;
+	bool budgetExtension = isExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (budgetExtension)
+		vamCreateInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
+	// VMA's recorder writes every call as a line of CSV. Flushing after each call is slower, but the recording is
+	// still usable if the engine crashes, which is often when it's wanted.
+	// The recorder is only compiled into the Debug configurations, which define VMA_RECORDING_ENABLED. Without it VMA
+	// refuses to create an allocator that has record settings, so they're left off.
+	VmaRecordSettings recordSettings{};
+	if (!mVmaRecordFile.empty()) {
+#if VMA_RECORDING_ENABLED
+		recordSettings.flags = VMA_RECORD_FLUSH_AFTER_CALL_BIT;
+		recordSettings.pFilePath = mVmaRecordFile.c_str();
+		vamCreateInfo.pRecordSettings = &recordSettings;
+		CORE_INFO("Recording VMA calls to {}.", mVmaRecordFile);
+#else
+		CORE_WARN("--record-vma: built without VMA_RECORDING_ENABLED (Debug builds define it), nothing will be recorded.");
+#endif
+	}
 
 	if (vmaCreateAllocator(&vamCreateInfo, &mAllocator) != VK_SUCCESS)
 		CORE_ERROR("Error: vmaCreateAllocator failed.");
+	mMemoryTracker = new VMemoryTracker(mAllocator, budgetExtension);
+	mMemoryPools = new VMemoryPools(mLogicalDevice, mAllocator);
+
+	mPipelineCache = new VPipelineCache(mLogicalDevice, mPhysicalDevice, PIPELINE_CACHE_FILE);
+	mLayoutCache = new VLayoutCache(mLogicalDevice);
 }
 
 void VDevice::printPhysicalDeviceName() {
@@ -142,11 +216,16 @@ QueueFamilyIndices VDevice::findQueueFamilies(VkPhysicalDevice device, VkSurface
 		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
 			indices.graphicsFamily = i;
 
+		// Headless there's nothing to present to. The graphics queue stands in for the present queue so the rest of
+		// the device setup doesn't have to care.
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		if (surface != VK_NULL_HANDLE)
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
 		if (presentSupport)
 			indices.presentFamily = i;
+		else if (surface == VK_NULL_HANDLE && indices.graphicsFamily.has_value())
+			indices.presentFamily = indices.graphicsFamily;
 
 		if (indices.isComplete())
 			break;
@@ -190,8 +269,9 @@ int VDevice::rateDeviceSuitability(VkPhysicalDevice device) {
 
 	score += props.limits.maxImageDimension2D;
 
-	// Can't function without a geometry shader.
-	if (!feats.geometryShader)
+	// Can't function without a geometry shader. Headless skips this, nothing draws with one and CI machines often
+	// only have a software implementation.
+	if (!feats.geometryShader && !isHeadless())
 		return 0;
 	else if (!isDeviceSuitable(device))
 		return 0;
@@ -205,8 +285,9 @@ bool VDevice::isDeviceSuitable(VkPhysicalDevice device) {
 
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	// Headless renders into offscreen images, there's no swapchain to check.
+	bool swapChainAdequate = isHeadless();
+	if (extensionsSupported && !isHeadless()) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device, mSurface);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentMode.empty();
 	}
@@ -215,7 +296,20 @@ bool VDevice::isDeviceSuitable(VkPhysicalDevice device) {
 	VkPhysicalDeviceFeatures supportedFeatures;
 	vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+	// The device has to be 1.2 with timeline semaphores for the renderer's frame synchronization.
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(device, &props);
+
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeats{};
+	timelineFeats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	VkPhysicalDeviceFeatures2 feats2{};
+	feats2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	feats2.pNext = &timelineFeats;
+	if (props.apiVersion >= VK_API_VERSION_1_2)
+		vkGetPhysicalDeviceFeatures2(device, &feats2);
+
+	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy &&
+		timelineFeats.timelineSemaphore;
 }
 
 bool VDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
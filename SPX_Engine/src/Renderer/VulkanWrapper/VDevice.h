@@ -14,6 +14,10 @@
 // TODO: Add transfer queue for data to GPU
 
 class VInstance;
+class VPipelineCache;
+class VLayoutCache;
+class VMemoryTracker;
+class VMemoryPools;
 
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
@@ -34,7 +38,14 @@ struct SwapChainSupportDetails {
 
 class VDevice {
 public:
-	VDevice(VkSurfaceKHR surface, VInstance instance);
+	// surface is VK_NULL_HANDLE for headless rendering. Then nothing is presented, so the device doesn't need a present
+	// queue or the swapchain extension and any device that can draw is suitable (including CPU ones like lavapipe).
+	// With vmaRecordFile set every VMA call is recorded to it, for replaying with --vma-replay.
+	VDevice(VkSurfaceKHR surface, VInstance instance, const std::string& vmaRecordFile = "");
+
+	bool isHeadless() const { return mSurface == VK_NULL_HANDLE; }
+	// Required extensions are always enabled. Optional ones only when the device has them.
+	bool isExtensionEnabled(const std::string& name) const;
 	
 	// Selected a GPU to use
 	void pickPhysicalDevice(VInstance instance);
@@ -53,11 +64,26 @@ public:
 	// TODO: Look up transfer queue and implement it
 	// VkQueue mTransferQueue{ VK_NULL_HANDLE };
 
-	// List of required device extensions
-	const std::vector<const char*> mDeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	// List of required device extensions. Empty when headless. Supported optional extensions are added before the
+	// logical device is created.
+	std::vector<const char*> mDeviceExtensions;
+	// Needed to load instance level extension functions for this device.
+	VkInstance mInstance{ VK_NULL_HANDLE };
 
 	// Vma Info
 	VmaAllocator mAllocator{ VK_NULL_HANDLE };
+	// Empty when the allocator isn't recording.
+	std::string mVmaRecordFile;
+	// Every allocation made from mAllocator is tracked here by category.
+	VMemoryTracker* mMemoryTracker{ nullptr };
+	// Where each kind of resource is allocated from (see VMemoryPools.h). Everything made with mAllocator goes through it.
+	VMemoryPools* mMemoryPools{ nullptr };
+
+	// Shared by every pipeline created on this device. Loaded from PIPELINE_CACHE_FILE when the device is created.
+	VPipelineCache* mPipelineCache{ nullptr };
+	static constexpr const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+	// Descriptor set and pipeline layouts, shared between every shader that declares the same ones.
+	VLayoutCache* mLayoutCache{ nullptr };
 
 
 private:
@@ -67,4 +93,6 @@ private:
 	int rateDeviceSuitability(VkPhysicalDevice device);
 	bool isDeviceSuitable(VkPhysicalDevice device);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+	// Enables whichever optional extensions the picked device supports.
+	void enableOptionalExtensions();
 };
\ No newline at end of file
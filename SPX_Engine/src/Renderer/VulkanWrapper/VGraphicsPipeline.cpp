@@ -1,39 +1,209 @@
 #include "VGraphicsPipeline.h"
 #include "VShader.h"
 #include "VDevice.h"
+#include "VPipelineCache.h"
+#include "VShaderReflection.h"
+#include <cstring>
+
+
+namespace {
+	// FNV-1a, 64 bit.
+	const uint64_t FNV_OFFSET = 14695981039346656037ull;
+	const uint64_t FNV_PRIME = 1099511628211ull;
+
+	void hashBytes(uint64_t& hash, const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+	}
+
+	template<typename T>
+	void hashValue(uint64_t& hash, const T& value) {
+		hashBytes(hash, &value, sizeof(T));
+	}
+
+	void hashString(uint64_t& hash, const std::string& value) {
+		// Length first so "ab" + "c" and "a" + "bc" don't hash the same.
+		hashValue(hash, value.size());
+		hashBytes(hash, value.data(), value.size());
+	}
+}
+
+GraphicsPipelineDescription GraphicsPipelineDescription::makeDefault(const std::string& vertFile, const std::string& fragFile,
+	VkRenderPass renderPass, VkPipelineLayout pipelineLayout, VkExtent2D extent) {
+	GraphicsPipelineDescription description;
+	description.mVertexShader = vertFile;
+	description.mFragmentShader = fragFile;
+	description.mVertexBindings = { Vertex::getBindingDescription() };
+	auto attributes = Vertex::getAttributeDescriptions();
+	description.mVertexAttributes.assign(attributes.begin(), attributes.end());
+	description.mRenderPass = renderPass;
+	description.mPipelineLayout = pipelineLayout;
+	description.mExtent = extent;
+	return description;
+}
+
+uint64_t GraphicsPipelineDescription::hash() const {
+	uint64_t hash = FNV_OFFSET;
+	hashString(hash, mVertexShader);
+	hashString(hash, mFragmentShader);
+
+	// Field by field rather than whole structs so padding bytes never end up in the hash.
+	hashValue(hash, mVertexBindings.size());
+	for (const auto& binding : mVertexBindings) {
+		hashValue(hash, binding.binding);
+		hashValue(hash, binding.stride);
+		hashValue(hash, binding.inputRate);
+	}
+	hashValue(hash, mVertexAttributes.size());
+	for (const auto& attribute : mVertexAttributes) {
+		hashValue(hash, attribute.location);
+		hashValue(hash, attribute.binding);
+		hashValue(hash, attribute.format);
+		hashValue(hash, attribute.offset);
+	}
+	hashValue(hash, mTopology);
+
+	hashValue(hash, mRenderPass);
+	hashValue(hash, mSubpass);
+	hashValue(hash, mPipelineLayout);
+	hashValue(hash, mExtent.width);
+	hashValue(hash, mExtent.height);
+
+	hashValue(hash, mPolygonMode);
+	hashValue(hash, mCullMode);
+	hashValue(hash, mFrontFace);
+	hashValue(hash, mDepthBiasEnable);
+
+	hashValue(hash, mDepthTestEnable);
+	hashValue(hash, mDepthWriteEnable);
+	hashValue(hash, mDepthCompareOp);
+
+	hashValue(hash, mBlendEnable);
+	hashValue(hash, mSrcColorBlendFactor);
+	hashValue(hash, mDstColorBlendFactor);
+	hashValue(hash, mColorBlendOp);
+	hashValue(hash, mSrcAlphaBlendFactor);
+	hashValue(hash, mDstAlphaBlendFactor);
+	hashValue(hash, mAlphaBlendOp);
+	hashValue(hash, mColorWriteMask);
+
+	hashValue(hash, mSpecializationConstants.size());
+	for (const auto& constant : mSpecializationConstants) {
+		hashValue(hash, constant.mID);
+		hashValue(hash, constant.mValue);
+		hashValue(hash, constant.mStages);
+	}
+	return hash;
+}
+
+bool GraphicsPipelineDescription::operator==(const GraphicsPipelineDescription& other) const {
+	auto bindingsEqual = [](const VkVertexInputBindingDescription& a, const VkVertexInputBindingDescription& b) {
+		return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+	};
+	auto attributesEqual = [](const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b) {
+		return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+	};
+
+	return mVertexShader == other.mVertexShader && mFragmentShader == other.mFragmentShader &&
+		std::equal(mVertexBindings.begin(), mVertexBindings.end(), other.mVertexBindings.begin(), other.mVertexBindings.end(), bindingsEqual) &&
+		std::equal(mVertexAttributes.begin(), mVertexAttributes.end(), other.mVertexAttributes.begin(), other.mVertexAttributes.end(), attributesEqual) &&
+		mTopology == other.mTopology &&
+		mRenderPass == other.mRenderPass && mSubpass == other.mSubpass && mPipelineLayout == other.mPipelineLayout &&
+		mExtent.width == other.mExtent.width && mExtent.height == other.mExtent.height &&
+		mPolygonMode == other.mPolygonMode && mCullMode == other.mCullMode && mFrontFace == other.mFrontFace &&
+		mDepthBiasEnable == other.mDepthBiasEnable &&
+		mDepthTestEnable == other.mDepthTestEnable && mDepthWriteEnable == other.mDepthWriteEnable && mDepthCompareOp == other.mDepthCompareOp &&
+		mBlendEnable == other.mBlendEnable &&
+		mSrcColorBlendFactor == other.mSrcColorBlendFactor && mDstColorBlendFactor == other.mDstColorBlendFactor &&
+		mColorBlendOp == other.mColorBlendOp &&
+		mSrcAlphaBlendFactor == other.mSrcAlphaBlendFactor && mDstAlphaBlendFactor == other.mDstAlphaBlendFactor &&
+		mAlphaBlendOp == other.mAlphaBlendOp && mColorWriteMask == other.mColorWriteMask &&
+		mSpecializationConstants == other.mSpecializationConstants;
+}
 
+namespace {
+	void setConstantBits(std::vector<SpecializationConstant>& constants, uint32_t id, uint32_t bits, VkShaderStageFlags stages) {
+		auto it = std::lower_bound(constants.begin(), constants.end(), id,
+			[](const SpecializationConstant& constant, uint32_t value) { return constant.mID < value; });
+
+		if (it != constants.end() && it->mID == id) {
+			it->mValue = bits;
+			it->mStages = stages;
+		}
+		else
+			constants.insert(it, SpecializationConstant{ id, bits, stages });
+	}
+}
+
+void GraphicsPipelineDescription::setBool(uint32_t id, bool value, VkShaderStageFlags stages) {
+	// GLSL bools are 32 bit VkBool32s.
+	setConstantBits(mSpecializationConstants, id, value ? VK_TRUE : VK_FALSE, stages);
+}
+
+void GraphicsPipelineDescription::setInt(uint32_t id, int32_t value, VkShaderStageFlags stages) {
+	setConstantBits(mSpecializationConstants, id, static_cast<uint32_t>(value), stages);
+}
 
-VGraphicsPipeline::VGraphicsPipeline(std::string vertFile, std::string fragFile, VDevice& device)
-	:mDevice(device) {
-	mShaders.push_back(VShader(ShaderType::VERT_SHADER, vertFile, mDevice));
-	mShaders.push_back(VShader(ShaderType::FRAG_SHADER, fragFile, mDevice));
+void GraphicsPipelineDescription::setUInt(uint32_t id, uint32_t value, VkShaderStageFlags stages) {
+	setConstantBits(mSpecializationConstants, id, value, stages);
+}
+
+void GraphicsPipelineDescription::setFloat(uint32_t id, float value, VkShaderStageFlags stages) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	setConstantBits(mSpecializationConstants, id, bits, stages);
+}
+
+VGraphicsPipeline::VGraphicsPipeline(VDevice& device, const GraphicsPipelineDescription& description)
+	:mDescription(description), mPipelineLayout(description.mPipelineLayout), mDevice(device) {
+	createGraphicsPipeline();
 }
 
 VGraphicsPipeline::~VGraphicsPipeline() {
-	vkDestroyPipelineLayout(mDevice.mLogicalDevice, mPipelineLayout, nullptr);
 	vkDestroyPipeline(mDevice.mLogicalDevice, mGraphicsPipeline, nullptr);
 }
 
-void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSetLayout descriptorSetLayout, VkRenderPass renderPass) {
+void VGraphicsPipeline::createGraphicsPipeline() {
+	const GraphicsPipelineDescription& desc = mDescription;
+	VkExtent2D extent = desc.mExtent;
+
 	// **********************************************************************************************************************
 	// SHADER
 	// **********************************************************************************************************************
+	// The modules are only needed until the pipeline is built.
+	VShader vertShader(ShaderType::VERT_SHADER, desc.mVertexShader, mDevice);
+	VShader fragShader(ShaderType::FRAG_SHADER, desc.mFragmentShader, mDevice);
+	validateVertexInputs(vertShader);
+
+	// Each stage only gets the constants meant for it.
+	std::vector<VkSpecializationMapEntry> vertSpecializationEntries, fragSpecializationEntries;
+	std::vector<uint32_t> vertSpecializationData, fragSpecializationData;
+	VkSpecializationInfo vertSpecializationInfo{}, fragSpecializationInfo{};
+	bool vertSpecialized = buildSpecializationInfo(VK_SHADER_STAGE_VERTEX_BIT, vertSpecializationEntries, vertSpecializationData, vertSpecializationInfo);
+	bool fragSpecialized = buildSpecializationInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragSpecializationEntries, fragSpecializationData, fragSpecializationInfo);
+
 	VkPipelineShaderStageCreateInfo vertShaderInfo{};
 	vertShaderInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertShaderInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
 
 	// Specify the shader module and which function to set as the entry point.
 	// IMPORTANT: This lets me write multiple shaders in one file and change the functions to get different results.
-	vertShaderInfo.module = mShaders.at(VERT).mShaderModule;
+	vertShaderInfo.module = vertShader.mShaderModule;
 	vertShaderInfo.pName = "main";
-	// OPTIONAL MEMBER: pSpecializationInfo. Allows me to specify values for shader constants. LOOK INTO LATER
+	// pSpecializationInfo fixes the shader's constant_id values when the pipeline is built. The driver compiles with them as
+	// real constants, so branches on them are folded away instead of being checked per vertex/fragment.
+	vertShaderInfo.pSpecializationInfo = vertSpecialized ? &vertSpecializationInfo : nullptr;
 
 
 	VkPipelineShaderStageCreateInfo fragShaderInfo{};
 	fragShaderInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragShaderInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderInfo.module = mShaders.at(FRAG).mShaderModule;
+	fragShaderInfo.module = fragShader.mShaderModule;
 	fragShaderInfo.pName = "main";
+	fragShaderInfo.pSpecializationInfo = fragSpecialized ? &fragSpecializationInfo : nullptr;
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderInfo, fragShaderInfo };
 
@@ -48,12 +218,10 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 	// Attribute Descriptions: Type of the attributes passed to the vertex shader, which binding to load them from and at which offset
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	auto bindingDescript = Vertex::getBindingDescription();
-	auto attributeDescript = Vertex::getAttributeDescriptions();
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescript;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescript.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescript.data();
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.mVertexBindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = desc.mVertexBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.mVertexAttributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = desc.mVertexAttributes.data();
 
 
 
@@ -71,10 +239,10 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 	// If I setup primitiveRestartEnable to VK_TRUE, this I can break up lines and triangles in the _STRIP topology by
 	// using a special index of 0xFFFF or 0xFFFFFFFF.
 
-	// For now I intend to draw triangles throughout, so I'll use the following
+	// Triangle lists unless the description says otherwise.
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
 	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.topology = desc.mTopology;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
 
@@ -131,18 +299,18 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 	// VK_POLYGON_MODE_LINE: Polygon edges are drawn as lines
 	// VK_POLYGON_MODE_POINT: Polygon vertices are drawn as points
 	// Using any other mode than fill requires enabling a GPU feature
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.polygonMode = desc.mPolygonMode;
 	// Linewidth describes the thickness of lines in terms of number of fragments. Max that is supported is dependant
 	// on the hardware and any line thicker than 1.0f requires me to enable the wideLines GPU feature
 	rasterizer.lineWidth = 1.0f;
 	// Cullmode variable defines the type of face culling to use. I can disable face culling, cull the font faces, 
 	// cull the back faces or both. The frontFace variable specifies the vertex orer for faces to be considered front-facing
 	// and can be clockwise or counterclockwise
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.cullMode = desc.mCullMode;
+	rasterizer.frontFace = desc.mFrontFace;
 	// The rasterizer can alter the depth values by adding a constant value or biasing them based on fragements slope.
 	// This is sometimes used for shadow mapping, but I won't be using it here
-	rasterizer.depthBiasEnable = VK_FALSE;
+	rasterizer.depthBiasEnable = desc.mDepthBiasEnable ? VK_TRUE : VK_FALSE;
 	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
 	rasterizer.depthBiasClamp = 0.0f;
 	rasterizer.depthBiasSlopeFactor = 0.0f;
@@ -174,9 +342,9 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 	// to such a struct.
 	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
 	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthTestEnable = desc.mDepthTestEnable ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = desc.mDepthWriteEnable ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = desc.mDepthCompareOp;
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.minDepthBounds = 0.0f; // Optional
 	depthStencil.maxDepthBounds = 1.0f; // Optional
@@ -198,16 +366,14 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 	// the global color blending settings. For thie I only have one framebuffer, // This per-frame buffer struct allows me to 
 	// configure the first way of color blending. pg 111 for more info:
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-		VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
-		VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.colorWriteMask = desc.mColorWriteMask;
+	colorBlendAttachment.blendEnable = desc.mBlendEnable ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = desc.mSrcColorBlendFactor;
+	colorBlendAttachment.dstColorBlendFactor = desc.mDstColorBlendFactor;
+	colorBlendAttachment.colorBlendOp = desc.mColorBlendOp;
+	colorBlendAttachment.srcAlphaBlendFactor = desc.mSrcAlphaBlendFactor;
+	colorBlendAttachment.dstAlphaBlendFactor = desc.mDstAlphaBlendFactor;
+	colorBlendAttachment.alphaBlendOp = desc.mAlphaBlendOp;
 
 	VkPipelineColorBlendStateCreateInfo colorBlending = {};
 	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -240,30 +406,6 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 
 
 
-	// **********************************************************************************************************************
-	// PIPELINE LAYOUT
-	// **********************************************************************************************************************
-	// I can use uniform values in shaders, which are globals similar to dynamic state variables that can be changed at
-	// drawing time to alter the behavior of my shaders without having to recreate them. They are commonly used to pass
-	// the transformation matrix to the vertex shader, or to create texture samplers in the fragment shader.
-	// These uniform values need to be specified during pipeline creation by creating a VkPipelineLayout object.
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	// Checks if there is a descriptor set layout available. If not ignore these. Otherwise fill them in.
-	if (descriptorSetLayout != VK_NULL_HANDLE) {
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout; // For now all my objects have the same descriptor set layouts.
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
-	}
-
-	if (vkCreatePipelineLayout(mDevice.mLogicalDevice, &pipelineLayoutInfo, nullptr, &mPipelineLayout) != VK_SUCCESS)
-		CORE_ERROR("Failed to create Pipeline Layout.");
-	else
-		CORE_INFO("Pipeline Layout created successfully.");
-
-
-
 	// **********************************************************************************************************************
 	// GRAPHICS PIPELINE
 	// **********************************************************************************************************************
@@ -281,8 +423,8 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 	pipelineInfo.pColorBlendState = &colorBlending;
 	pipelineInfo.pDynamicState = nullptr; // Optional
 	pipelineInfo.layout = mPipelineLayout;
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0; // INDEX OF SUBPASS
+	pipelineInfo.renderPass = desc.mRenderPass;
+	pipelineInfo.subpass = desc.mSubpass; // INDEX OF SUBPASS
 	// Vulkan allows me to create a new grpahics pipeline by deriving from an exisiting pipeline. The idea is that it is
 	// less expensive than creating a brand new one. I can specify the handle of an exisiting pipeline or reference
 	// LOOK ON PAGE 121 FOR HOW TO DO THAT, kinda how to it
@@ -294,9 +436,61 @@ void VGraphicsPipeline::createGraphicsPipeline(VkExtent2D extent, VkDescriptorSe
 	// Second parameter referecnes an optional VkPipelineCache object. A pipeline cache cam be used to store and reuse data
 	// relevant to pipeline creation across multiple calls to vkCreateGraphicsPipelines and even across program
 	// executions if the cache is stored to a file. This makes it possible to significalntly speed up pipeline creation
-	// at a later time.
-	if (vkCreateGraphicsPipelines(mDevice.mLogicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mGraphicsPipeline) != VK_SUCCESS)
+	// at a later time. The device's cache is saved to disk, so after the first launch this is mostly a lookup.
+	auto start = std::chrono::high_resolution_clock::now();
+	if (vkCreateGraphicsPipelines(mDevice.mLogicalDevice, mDevice.mPipelineCache->get(), 1, &pipelineInfo, nullptr, &mGraphicsPipeline) != VK_SUCCESS)
 		CORE_ERROR("Failed to create Graphics Pipeline.");
 	else
 		CORE_INFO("Graphics Pipeline created successfully.");
+	auto end = std::chrono::high_resolution_clock::now();
+	mDevice.mPipelineCache->recordPipelineCreation(std::chrono::duration<double, std::milli>(end - start).count());
+
+	// The modules are baked into the pipeline now.
+	vkDestroyShaderModule(mDevice.mLogicalDevice, vertShader.mShaderModule, nullptr);
+	vkDestroyShaderModule(mDevice.mLogicalDevice, fragShader.mShaderModule, nullptr);
+}
+
+bool VGraphicsPipeline::buildSpecializationInfo(VkShaderStageFlagBits stage, std::vector<VkSpecializationMapEntry>& entries,
+	std::vector<uint32_t>& data, VkSpecializationInfo& info) const {
+	// Packed one after another, 4 bytes each.
+	for (const auto& constant : mDescription.mSpecializationConstants) {
+		if (!(constant.mStages & stage))
+			continue;
+
+		VkSpecializationMapEntry entry{};
+		entry.constantID = constant.mID;
+		entry.offset = static_cast<uint32_t>(data.size() * sizeof(uint32_t));
+		entry.size = sizeof(uint32_t);
+		entries.push_back(entry);
+		data.push_back(constant.mValue);
+	}
+
+	if (entries.empty())
+		return false;
+
+	info.mapEntryCount = static_cast<uint32_t>(entries.size());
+	info.pMapEntries = entries.data();
+	info.dataSize = data.size() * sizeof(uint32_t);
+	info.pData = data.data();
+	return true;
+}
+
+void VGraphicsPipeline::validateVertexInputs(const VShader& vertShader) const {
+	// A vertex layout that doesn't match the shader doesn't fail pipeline creation, it just draws garbage. Catch it here
+	// instead, where it's obvious which description is wrong.
+	ShaderReflection reflection;
+	if (!vertShader.reflect(reflection))
+		return;
+
+	for (const auto& input : reflection.mVertexInputs) {
+		auto it = std::find_if(mDescription.mVertexAttributes.begin(), mDescription.mVertexAttributes.end(),
+			[&input](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.mLocation; });
+
+		if (it == mDescription.mVertexAttributes.end())
+			CORE_ERROR("{}: vertex input {} (location {}) has no attribute in the pipeline description.", mDescription.mVertexShader,
+				input.mName, input.mLocation);
+		else if (it->format != input.mFormat)
+			CORE_ERROR("{}: vertex input {} (location {}) doesn't match the attribute format in the pipeline description.",
+				mDescription.mVertexShader, input.mName, input.mLocation);
+	}
 }
@@ -10,20 +10,98 @@ enum ShaderLocation { VERT, FRAG };
 
 // Depending on how I do things, the renderer won't have one graphics pipeline. It could be attached to models, IDK yet.
 
+// A 4 byte shader constant (layout(constant_id = X) in GLSL) fixed when the pipeline is built. The value is stored as raw
+// bits so ints, uints, floats and bools (VkBool32) all fit. Use the typed setters on GraphicsPipelineDescription instead
+// of filling in the bits by hand.
+struct SpecializationConstant {
+	uint32_t mID{ 0 };
+	uint32_t mValue{ 0 };
+	// Which stages get the constant.
+	VkShaderStageFlags mStages{ VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT };
+
+	bool operator==(const SpecializationConstant& other) const { return mID == other.mID && mValue == other.mValue && mStages == other.mStages; }
+};
+
+// Everything that makes one pipeline different from another. Two equal descriptions always build the same pipeline,
+// which is what lets the PipelineStateCache hand out one pipeline for both. The defaults are the engine's standard
+// opaque, depth tested, back face culled triangle pipeline using the Vertex layout.
+struct GraphicsPipelineDescription {
+	std::string mVertexShader;
+	std::string mFragmentShader;
+
+	// Vertex layout
+	std::vector<VkVertexInputBindingDescription> mVertexBindings;
+	std::vector<VkVertexInputAttributeDescription> mVertexAttributes;
+	VkPrimitiveTopology mTopology{ VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST };
+
+	// Where it draws. The layout isn't owned by the pipeline, it's just part of what the pipeline is compatible with.
+	VkRenderPass mRenderPass{ VK_NULL_HANDLE };
+	uint32_t mSubpass{ 0 };
+	VkPipelineLayout mPipelineLayout{ VK_NULL_HANDLE };
+	VkExtent2D mExtent{ 0, 0 };
+
+	// Raster state
+	VkPolygonMode mPolygonMode{ VK_POLYGON_MODE_FILL };
+	VkCullModeFlags mCullMode{ VK_CULL_MODE_BACK_BIT };
+	VkFrontFace mFrontFace{ VK_FRONT_FACE_COUNTER_CLOCKWISE };
+	bool mDepthBiasEnable{ false };
+
+	// Depth state
+	bool mDepthTestEnable{ true };
+	bool mDepthWriteEnable{ true };
+	VkCompareOp mDepthCompareOp{ VK_COMPARE_OP_LESS };
+
+	// Blend state, for the single color attachment.
+	bool mBlendEnable{ false };
+	VkBlendFactor mSrcColorBlendFactor{ VK_BLEND_FACTOR_ONE };
+	VkBlendFactor mDstColorBlendFactor{ VK_BLEND_FACTOR_ZERO };
+	VkBlendOp mColorBlendOp{ VK_BLEND_OP_ADD };
+	VkBlendFactor mSrcAlphaBlendFactor{ VK_BLEND_FACTOR_ONE };
+	VkBlendFactor mDstAlphaBlendFactor{ VK_BLEND_FACTOR_ZERO };
+	VkBlendOp mAlphaBlendOp{ VK_BLEND_OP_ADD };
+	VkColorComponentFlags mColorWriteMask{ VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT };
+
+	// Kept sorted by ID by the setters below, so the same values set in a different order still hash the same. A stage that
+	// doesn't declare a constant ID ignores it.
+	std::vector<SpecializationConstant> mSpecializationConstants;
+
+	// Typed setters for the constants. Setting an ID again replaces its value. The type has to match the GLSL declaration,
+	// the driver reinterprets the bits, it doesn't convert them.
+	void setBool(uint32_t id, bool value, VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	void setInt(uint32_t id, int32_t value, VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	void setUInt(uint32_t id, uint32_t value, VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	void setFloat(uint32_t id, float value, VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+	// The standard pipeline for meshes using Vertex.
+	static GraphicsPipelineDescription makeDefault(const std::string& vertFile, const std::string& fragFile, VkRenderPass renderPass,
+		VkPipelineLayout pipelineLayout, VkExtent2D extent);
+
+	// FNV-1a over every field. Equal descriptions always hash the same, the cache still compares with == on a match.
+	uint64_t hash() const;
+	bool operator==(const GraphicsPipelineDescription& other) const;
+};
+
+// Builds one pipeline from a description. Usually created through the PipelineStateCache so identical descriptions
+// share a pipeline instead of being compiled twice.
 class VGraphicsPipeline {
 public:
-	VGraphicsPipeline(std::string vertFile, std::string fragFile, VDevice& device);
+	VGraphicsPipeline(VDevice& device, const GraphicsPipelineDescription& description);
 	~VGraphicsPipeline();
 
-	void createGraphicsPipeline(VkExtent2D extent,
-		VkDescriptorSetLayout descriptorSetLayout,
-		VkRenderPass renderPass);
+	GraphicsPipelineDescription mDescription;
 
 	// Might have to move this to somewhere else
-	VkPipelineLayout mPipelineLayout;
-	VkPipeline mGraphicsPipeline;
+	// Not owned, this is mDescription.mPipelineLayout. Layouts come from the device's VLayoutCache.
+	VkPipelineLayout mPipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline mGraphicsPipeline{ VK_NULL_HANDLE };
 
 private:
+	void createGraphicsPipeline();
+	// Fills entries/data with the constants meant for stage. Returns false if there are none.
+	bool buildSpecializationInfo(VkShaderStageFlagBits stage, std::vector<VkSpecializationMapEntry>& entries, std::vector<uint32_t>& data,
+		VkSpecializationInfo& info) const;
+	// Logs any vertex shader input the description's vertex attributes don't cover with the right format.
+	void validateVertexInputs(const VShader& vertShader) const;
+
 	VDevice& mDevice;
-	std::vector<VShader> mShaders;
-};
\ No newline at end of file
+};
@@ -1,5 +1,6 @@
 #include "VImage.h"
 #include "VDevice.h"
+#include "VMemoryPools.h"
 
 
 // TODO: Allow for changing of tiling
@@ -11,52 +12,82 @@ VImage::VImage(
 	VkImageAspectFlags aspectFlags,
 	VkSampleCountFlagBits sampleCount, 
 	const std::string& name, 
-	VkExtent2D imageExtent)
-	: mDevice(device), mFormat(format), mName(name) {
+	VkExtent2D imageExtent,
+	uint32_t mipLevels,
+	MemoryCategory category)
+	: mDevice(device), mFormat(format), mName(name), mMipLevels(mipLevels), mExtent(imageExtent), mUsage(imageUsage),
+	mAspectFlags(aspectFlags), mSampleCount(sampleCount), mCategory(category) {
+	VkImageCreateInfo createInfo = getCreateInfo();
+
+	// GPU only, so it's never mapped. Textures go in the texture pool, anything rendered to is a render target.
+	VmaAllocationCreateInfo VmaAlloc{};
+	VmaAlloc.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	VMemoryTracker::tag(VmaAlloc, mCategory);
+
+	MemoryClass memoryClass = mCategory == MemoryCategory::Texture ? MemoryClass::Texture : MemoryClass::RenderTarget;
+	if (mDevice.mMemoryPools->createImage(createInfo, VmaAlloc, memoryClass, mImage, mAllocation, &mAllocationInfo) != VK_SUCCESS)
+		CORE_ERROR("ERROR: vmaCreateImage failed for image {}.", mName);
+	mDevice.mMemoryTracker->track(mAllocation, mCategory);
+
+	// Now create ImageView for this image.
+	mImageView = createImageView(mImage);
+}
+
+VImage::~VImage() {
+	vkDestroyImageView(mDevice.mLogicalDevice, mImageView, nullptr);
+	mDevice.mMemoryTracker->untrack(mAllocation);
+	vmaDestroyImage(mDevice.mAllocator, mImage, mAllocation);
+}
+
+void VImage::createAt(VkDeviceMemory memory, VkDeviceSize offset, VkImage& image, VkImageView& imageView) const {
+	VkImageCreateInfo createInfo = getCreateInfo();
+	if (vkCreateImage(mDevice.mLogicalDevice, &createInfo, nullptr, &image) != VK_SUCCESS) {
+		CORE_ERROR("Error: vkCreateImage failed moving image {}.", mName);
+		return;
+	}
+	vkBindImageMemory(mDevice.mLogicalDevice, image, memory, offset);
+	imageView = createImageView(image);
+}
+
+void VImage::swapImage(VkImage& image, VkImageView& imageView) {
+	std::swap(mImage, image);
+	std::swap(mImageView, imageView);
+}
+
+VkImageCreateInfo VImage::getCreateInfo() const {
 	VkImageCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	createInfo.imageType = VK_IMAGE_TYPE_2D;
-	createInfo.extent.width = imageExtent.width;
-	createInfo.extent.height = imageExtent.height;
+	createInfo.extent.width = mExtent.width;
+	createInfo.extent.height = mExtent.height;
 	createInfo.extent.depth = 1;
-	createInfo.mipLevels = 1;
+	createInfo.mipLevels = mMipLevels;
 	createInfo.arrayLayers = 1;
-	createInfo.format = format;
+	createInfo.format = mFormat;
 	createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	createInfo.usage = imageUsage;
+	createInfo.usage = mUsage;
 
 	// This is for MSAA/multisampling.
-	createInfo.samples = sampleCount;
+	createInfo.samples = mSampleCount;
 	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	return createInfo;
+}
 
-	VmaAllocationCreateInfo VmaAlloc{};
-	VmaAlloc.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-	// TODO: Can add here to record the memory allocation to check it
-	// SEE inexor Vulkan Renderer under Image for example
-	VmaAlloc.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
-
-	if (vmaCreateImage(mDevice.mAllocator, &createInfo, &VmaAlloc, &mImage, &mAllocation, &mAllocationInfo) != VK_SUCCESS)
-		CORE_ERROR("ERROR: vmaCreateImage failed for image {}.", mName);
-
-	// Now create ImageView for this image.
+VkImageView VImage::createImageView(VkImage image) const {
 	VkImageViewCreateInfo createViewInfo{};
 	createViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	createViewInfo.image = mImage;
+	createViewInfo.image = image;
 	createViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	createViewInfo.format = format;
-	createViewInfo.subresourceRange.aspectMask = aspectFlags;
+	createViewInfo.format = mFormat;
+	createViewInfo.subresourceRange.aspectMask = mAspectFlags;
 	createViewInfo.subresourceRange.baseMipLevel = 0;
-	createViewInfo.subresourceRange.levelCount = 1;
+	createViewInfo.subresourceRange.levelCount = mMipLevels;
 	createViewInfo.subresourceRange.baseArrayLayer = 0;
 	createViewInfo.subresourceRange.layerCount = 1;
 
-	if (vkCreateImageView(mDevice.mLogicalDevice, &createViewInfo, nullptr, &mImageView) != VK_SUCCESS)
+	VkImageView imageView = VK_NULL_HANDLE;
+	if (vkCreateImageView(mDevice.mLogicalDevice, &createViewInfo, nullptr, &imageView) != VK_SUCCESS)
 		CORE_ERROR("Error: vkCreateImageView failed for image view {}.", mName);
+	return imageView;
 }
-
-VImage::~VImage() {
-	vkDestroyImageView(mDevice.mLogicalDevice, mImageView, nullptr);
-	vmaDestroyImage(mDevice.mAllocator, mImage, mAllocation);
-}
\ No newline at end of file
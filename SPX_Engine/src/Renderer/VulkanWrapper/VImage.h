@@ -2,6 +2,7 @@
 
 #include "../../pch.h"
 #include "../../ThirdParty/vk_mem_alloc.h"
+#include "VMemoryTracker.h"
 
 class VDevice;
 
@@ -15,10 +16,19 @@ public:
 		VkImageAspectFlags aspectFlags,
 		VkSampleCountFlagBits sampleCount,
 		const std::string& name,
-		VkExtent2D imageExtent);
+		VkExtent2D imageExtent,
+		uint32_t mipLevels = 1,
+		MemoryCategory category = MemoryCategory::Attachment);
 
 	~VImage();
 
+	// For defragmentation. Creates an image and view exactly like this one, but bound to memory at offset instead of
+	// through VMA. The caller copies the contents over and swaps them in with swapImage.
+	void createAt(VkDeviceMemory memory, VkDeviceSize offset, VkImage& image, VkImageView& imageView) const;
+	// Takes image and imageView and hands back the old ones, which the GPU may still be using. The allocation stays, it's
+	// moved rather than freed.
+	void swapImage(VkImage& image, VkImageView& imageView);
+
 	static void transitionImageLayout(
 		VkImage image,
 		VkFormat format,
@@ -48,5 +58,18 @@ public:
 	VkImage mImage{ VK_NULL_HANDLE };
 	VkFormat mFormat{ VK_FORMAT_UNDEFINED };
 	VkImageView mImageView{ VK_NULL_HANDLE };
+	// The view covers every mip level. Anything that needs a single level (like writing a mip from a compute shader)
+	// creates its own view.
+	uint32_t mMipLevels{ 1 };
+	// Kept so the image can be made again somewhere else.
+	VkExtent2D mExtent{ 0, 0 };
+	VkImageUsageFlags mUsage{ 0 };
+	VkImageAspectFlags mAspectFlags{ 0 };
+	VkSampleCountFlagBits mSampleCount{ VK_SAMPLE_COUNT_1_BIT };
+	MemoryCategory mCategory{ MemoryCategory::Attachment };
 	std::string mName; // ?? Idk about keeping this.
+
+private:
+	VkImageCreateInfo getCreateInfo() const;
+	VkImageView createImageView(VkImage image) const;
 };
\ No newline at end of file
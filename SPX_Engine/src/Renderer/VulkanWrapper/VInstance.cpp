@@ -5,7 +5,7 @@
 
 
 
-VInstance::VInstance(std::string& appName, std::string& engineName, bool enableValidationLayers)
+VInstance::VInstance(std::string& appName, std::string& engineName, bool enableValidationLayers, bool headless)
 	:mValLayers(new VulkanValidationLayers(enableValidationLayers)) {
 	if (enableValidationLayers && !mValLayers->checkValidationLayerSupport())
 		CORE_ERROR("ERROR: Validation layers requested, but they are not supported.");
@@ -16,13 +16,17 @@ VInstance::VInstance(std::string& appName, std::string& engineName, bool enableV
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0); // Change when farther along
 	appInfo.pEngineName = "SPX Engine";
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0); // Change when farther along
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	// 1.2 for timeline semaphores, which the renderer's frame synchronization is built on.
+	appInfo.apiVersion = VK_API_VERSION_1_2;
 
 
-	// Get extension info for the glfwWindow
-	uint32_t glfwExtensionsCount = 0;
-	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+	// Get extension info for the glfwWindow. GLFW isn't initialized at all when headless.
+	std::vector<const char*> extensions;
+	if (!headless) {
+		uint32_t glfwExtensionsCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionsCount);
+	}
 
 	// IF I DONT DO THIS DEBUG DIES AND WONT LOAD
 	if (enableValidationLayers)
@@ -6,7 +6,8 @@ class VulkanValidationLayers;
 
 class VInstance {
 public:
-	VInstance(std::string& appName, std::string& engineName, bool enableValidationLayers);
+	// Headless leaves out the window system extensions GLFW asks for, so no display is needed.
+	VInstance(std::string& appName, std::string& engineName, bool enableValidationLayers, bool headless = false);
 	~VInstance();
 
 	// Getter
@@ -0,0 +1,104 @@
+#include "VLayoutCache.h"
+#include "VShaderReflection.h"
+
+VLayoutCache::VLayoutCache(VkDevice device)
+	:mDevice(device) {
+}
+
+VLayoutCache::~VLayoutCache() {
+	for (auto& entry : mPipelineLayouts)
+		vkDestroyPipelineLayout(mDevice, entry.second, nullptr);
+	for (auto& entry : mSetLayouts)
+		vkDestroyDescriptorSetLayout(mDevice, entry.second, nullptr);
+}
+
+VkDescriptorSetLayout VLayoutCache::getDescriptorSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings) {
+	std::sort(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+		return a.binding < b.binding;
+	});
+
+	// Immutable samplers aren't used anywhere yet, so they aren't part of the key.
+	std::vector<uint64_t> key;
+	key.reserve(bindings.size() * 4);
+	for (const auto& binding : bindings) {
+		key.push_back(binding.binding);
+		key.push_back(binding.descriptorType);
+		key.push_back(binding.descriptorCount);
+		key.push_back(binding.stageFlags);
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mSetLayouts.find(key);
+	if (it != mSetLayouts.end()) {
+		mHits++;
+		return it->second;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	if (vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+		CORE_ERROR("Failed to create descriptor set layout.");
+		return VK_NULL_HANDLE;
+	}
+
+	mSetLayouts[key] = layout;
+	return layout;
+}
+
+VkPipelineLayout VLayoutCache::getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstants) {
+	// Set layouts are already deduplicated, so their handles are enough to tell them apart.
+	std::vector<uint64_t> key;
+	key.push_back(setLayouts.size());
+	for (auto setLayout : setLayouts)
+		key.push_back(reinterpret_cast<uint64_t>(setLayout));
+	for (const auto& range : pushConstants) {
+		key.push_back(range.stageFlags);
+		key.push_back(range.offset);
+		key.push_back(range.size);
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mPipelineLayouts.find(key);
+	if (it != mPipelineLayouts.end()) {
+		mHits++;
+		return it->second;
+	}
+
+	// I can use uniform values in shaders, which are globals similar to dynamic state variables that can be changed at
+	// drawing time to alter the behavior of my shaders without having to recreate them. These uniform values (and the
+	// push constants) need to be specified during pipeline creation by creating a VkPipelineLayout object.
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.empty() ? nullptr : setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstants.empty() ? nullptr : pushConstants.data();
+
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	if (vkCreatePipelineLayout(mDevice, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+		CORE_ERROR("Failed to create Pipeline Layout.");
+		return VK_NULL_HANDLE;
+	}
+
+	CORE_INFO("Pipeline Layout created successfully ({} sets, {} push constant ranges).", setLayouts.size(), pushConstants.size());
+	mPipelineLayouts[key] = layout;
+	return layout;
+}
+
+VkPipelineLayout VLayoutCache::getPipelineLayout(const ShaderReflection& reflection) {
+	std::vector<VkDescriptorSetLayout> setLayouts;
+	for (uint32_t set = 0; set < reflection.getSetCount(); set++)
+		setLayouts.push_back(getDescriptorSetLayout(reflection.getSetLayoutBindings(set)));
+
+	return getPipelineLayout(setLayouts, reflection.mPushConstants);
+}
+
+void VLayoutCache::logStats() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	CORE_INFO("Layout cache: {} descriptor set layouts, {} pipeline layouts, {} lookups shared an existing layout.",
+		mSetLayouts.size(), mPipelineLayouts.size(), mHits);
+}
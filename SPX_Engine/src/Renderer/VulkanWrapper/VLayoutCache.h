@@ -0,0 +1,41 @@
+#pragma once
+
+#include "../../pch.h"
+#include <mutex>
+
+// ******************************************************************************************************************************
+//															LAYOUT CACHE
+// Descriptor set layouts and pipeline layouts, shared by everything on the device. Shaders that declare the same bindings
+// (usually built from reflection) get the same VkDescriptorSetLayout, and the same set layouts plus push constant ranges
+// get the same VkPipelineLayout. Sharing matters beyond saving memory: descriptor sets bound under one pipeline layout
+// stay valid when switching to another pipeline that uses the same handle.
+//
+// Keys are the layout's fields flattened into a vector and compared exactly, so there are no hash collisions to worry
+// about. The cache owns everything it hands out, callers never destroy the layouts.
+// ******************************************************************************************************************************
+
+struct ShaderReflection;
+
+class VLayoutCache {
+public:
+	VLayoutCache(VkDevice device);
+	~VLayoutCache();
+
+	// Binding order doesn't matter, they're sorted before lookup.
+	VkDescriptorSetLayout getDescriptorSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings);
+	VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstants);
+	// Set layouts for every set the shaders use (empty sets included so set numbers line up) and their push constants.
+	VkPipelineLayout getPipelineLayout(const ShaderReflection& reflection);
+
+	void logStats();
+
+private:
+	VkDevice mDevice{ VK_NULL_HANDLE };
+
+	// Pipelines are compiled on worker threads and may ask for layouts, so every lookup locks.
+	std::mutex mMutex;
+	std::map<std::vector<uint64_t>, VkDescriptorSetLayout> mSetLayouts;
+	std::map<std::vector<uint64_t>, VkPipelineLayout> mPipelineLayouts;
+
+	uint32_t mHits{ 0 };
+};
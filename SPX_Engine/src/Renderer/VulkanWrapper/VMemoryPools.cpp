@@ -0,0 +1,236 @@
+#include "VMemoryPools.h"
+
+const char* getMemoryClassName(MemoryClass memoryClass) {
+	switch (memoryClass) {
+	case MemoryClass::Upload:		return "Upload";
+	case MemoryClass::Geometry:		return "Geometry";
+	case MemoryClass::Texture:		return "Texture";
+	case MemoryClass::RenderTarget: return "Render target";
+	default:						return "General";
+	}
+}
+
+MemoryClass getDefaultMemoryClass(MemoryCategory category) {
+	switch (category) {
+	case MemoryCategory::Mesh:		 return MemoryClass::Geometry;
+	case MemoryCategory::Texture:	 return MemoryClass::Texture;
+	case MemoryCategory::Attachment: return MemoryClass::RenderTarget;
+	case MemoryCategory::Staging:	 return MemoryClass::Upload;
+	default:						 return MemoryClass::General;
+	}
+}
+
+VMemoryPools::VMemoryPools(VkDevice device, VmaAllocator allocator)
+	:mDevice(device), mAllocator(allocator) {
+	mPools.fill(VK_NULL_HANDLE);
+	mPoolMemoryTypes.fill(0);
+	for (auto& fallbacks : mFallbacks)
+		fallbacks = 0;
+
+	// Each pool's memory type is whatever VMA would pick for a typical resource of its class, made the same way the
+	// engine makes them.
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = 1024;
+	VmaAllocationCreateInfo createInfo{};
+	uint32_t memoryTypeIndex;
+
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	createInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	if (vmaFindMemoryTypeIndexForBufferInfo(mAllocator, &bufferInfo, &createInfo, &memoryTypeIndex) == VK_SUCCESS)
+		createPool(MemoryClass::Upload, memoryTypeIndex, UPLOAD_BLOCK_BYTES, VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT);
+
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	createInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	if (vmaFindMemoryTypeIndexForBufferInfo(mAllocator, &bufferInfo, &createInfo, &memoryTypeIndex) == VK_SUCCESS)
+		createPool(MemoryClass::Geometry, memoryTypeIndex, GEOMETRY_BLOCK_BYTES, 0);
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+	imageInfo.extent = { 1024, 1024, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	createInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	if (vmaFindMemoryTypeIndexForImageInfo(mAllocator, &imageInfo, &createInfo, &memoryTypeIndex) == VK_SUCCESS)
+		createPool(MemoryClass::Texture, memoryTypeIndex, TEXTURE_BLOCK_BYTES, 0);
+}
+
+VMemoryPools::~VMemoryPools() {
+	for (VmaPool pool : mPools) {
+		if (pool != VK_NULL_HANDLE)
+			vmaDestroyPool(mAllocator, pool);
+	}
+}
+
+void VMemoryPools::createPool(MemoryClass memoryClass, uint32_t memoryTypeIndex, VkDeviceSize blockSize, VmaPoolCreateFlags flags) {
+	// No blocks until something's allocated, and no limit on how many.
+	VmaPoolCreateInfo poolInfo{};
+	poolInfo.memoryTypeIndex = memoryTypeIndex;
+	poolInfo.flags = flags;
+	poolInfo.blockSize = blockSize;
+
+	mPoolMemoryTypes[static_cast<size_t>(memoryClass)] = memoryTypeIndex;
+	VmaPool& pool = mPools[static_cast<size_t>(memoryClass)];
+	if (vmaCreatePool(mAllocator, &poolInfo, &pool) != VK_SUCCESS) {
+		CORE_ERROR("Failed to create the {} memory pool, its allocations go to the default pools.", getMemoryClassName(memoryClass));
+		pool = VK_NULL_HANDLE;
+		return;
+	}
+	// Shows up in the JSON memory map.
+	vmaSetPoolName(mAllocator, pool, getMemoryClassName(memoryClass));
+	CORE_TRACE("{} memory pool: memory type {}, {} MB blocks.", getMemoryClassName(memoryClass), memoryTypeIndex,
+		blockSize / (1024 * 1024));
+}
+
+void VMemoryPools::apply(VmaAllocationCreateInfo& createInfo, MemoryClass memoryClass, VkDeviceSize size) const {
+	createInfo.flags &= ~VMA_ALLOCATION_CREATE_STRATEGY_MASK;
+	createInfo.pool = mPools[static_cast<size_t>(memoryClass)];
+
+	switch (memoryClass) {
+	case MemoryClass::Geometry:
+		createInfo.flags |= VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT;
+		break;
+	case MemoryClass::Texture:
+		createInfo.flags |= VMA_ALLOCATION_CREATE_STRATEGY_MIN_FRAGMENTATION_BIT;
+		break;
+	case MemoryClass::RenderTarget:
+		if (size >= DEDICATED_RENDER_TARGET_BYTES)
+			createInfo.flags |= VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+		else
+			createInfo.flags |= VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT;
+		break;
+	case MemoryClass::General:
+		createInfo.flags |= VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT;
+		break;
+	default:
+		// Linear doesn't take a strategy.
+		break;
+	}
+}
+
+void VMemoryPools::fallback(MemoryClass memoryClass, VkResult result) {
+	// Warned about once per class, an oversized texture would otherwise log every time one's loaded.
+	if (mFallbacks[static_cast<size_t>(memoryClass)]++ == 0) {
+		CORE_WARN("An allocation didn't fit the {} memory pool ({}), using the default pools.", getMemoryClassName(memoryClass),
+			static_cast<int>(result));
+	}
+}
+
+bool VMemoryPools::fitsPool(MemoryClass memoryClass, uint32_t memoryTypeBits) {
+	// VMA doesn't check a pool's memory type against the resource, binding it to the wrong type would just fail later.
+	if ((memoryTypeBits & (1u << mPoolMemoryTypes[static_cast<size_t>(memoryClass)])) != 0)
+		return true;
+	fallback(memoryClass, VK_ERROR_FEATURE_NOT_PRESENT);
+	return false;
+}
+
+VkResult VMemoryPools::createBuffer(const VkBufferCreateInfo& bufferInfo, VmaAllocationCreateInfo createInfo, MemoryClass memoryClass,
+	VkBuffer& buffer, VmaAllocation& allocation, VmaAllocationInfo* allocationInfo) {
+	apply(createInfo, memoryClass, bufferInfo.size);
+	if (createInfo.pool == VK_NULL_HANDLE)
+		return vmaCreateBuffer(mAllocator, &bufferInfo, &createInfo, &buffer, &allocation, allocationInfo);
+
+	// What vmaCreateBuffer does, with a look at the memory types in between.
+	VkResult result = vkCreateBuffer(mDevice, &bufferInfo, nullptr, &buffer);
+	if (result != VK_SUCCESS)
+		return result;
+	allocation = VK_NULL_HANDLE;
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(mDevice, buffer, &requirements);
+	if (!fitsPool(memoryClass, requirements.memoryTypeBits))
+		createInfo.pool = VK_NULL_HANDLE;
+
+	result = vmaAllocateMemoryForBuffer(mAllocator, buffer, &createInfo, &allocation, allocationInfo);
+	if (result != VK_SUCCESS && createInfo.pool != VK_NULL_HANDLE) {
+		fallback(memoryClass, result);
+		createInfo.pool = VK_NULL_HANDLE;
+		result = vmaAllocateMemoryForBuffer(mAllocator, buffer, &createInfo, &allocation, allocationInfo);
+	}
+	if (result == VK_SUCCESS)
+		result = vmaBindBufferMemory(mAllocator, allocation, buffer);
+
+	if (result != VK_SUCCESS) {
+		if (allocation != VK_NULL_HANDLE)
+			vmaFreeMemory(mAllocator, allocation);
+		vkDestroyBuffer(mDevice, buffer, nullptr);
+		buffer = VK_NULL_HANDLE;
+		allocation = VK_NULL_HANDLE;
+	}
+	return result;
+}
+
+VkResult VMemoryPools::createImage(const VkImageCreateInfo& imageInfo, VmaAllocationCreateInfo createInfo, MemoryClass memoryClass,
+	VkImage& image, VmaAllocation& allocation, VmaAllocationInfo* allocationInfo) {
+	// Only used to decide if a render target is big enough to be dedicated, so 4 bytes a texel is close enough.
+	VkDeviceSize size = static_cast<VkDeviceSize>(imageInfo.extent.width) * imageInfo.extent.height * imageInfo.extent.depth *
+		imageInfo.arrayLayers * imageInfo.samples * 4;
+	apply(createInfo, memoryClass, size);
+	if (createInfo.pool == VK_NULL_HANDLE)
+		return vmaCreateImage(mAllocator, &imageInfo, &createInfo, &image, &allocation, allocationInfo);
+
+	VkResult result = vkCreateImage(mDevice, &imageInfo, nullptr, &image);
+	if (result != VK_SUCCESS)
+		return result;
+	allocation = VK_NULL_HANDLE;
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(mDevice, image, &requirements);
+	if (!fitsPool(memoryClass, requirements.memoryTypeBits))
+		createInfo.pool = VK_NULL_HANDLE;
+
+	result = vmaAllocateMemoryForImage(mAllocator, image, &createInfo, &allocation, allocationInfo);
+	if (result != VK_SUCCESS && createInfo.pool != VK_NULL_HANDLE) {
+		fallback(memoryClass, result);
+		createInfo.pool = VK_NULL_HANDLE;
+		result = vmaAllocateMemoryForImage(mAllocator, image, &createInfo, &allocation, allocationInfo);
+	}
+	if (result == VK_SUCCESS)
+		result = vmaBindImageMemory(mAllocator, allocation, image);
+
+	if (result != VK_SUCCESS) {
+		if (allocation != VK_NULL_HANDLE)
+			vmaFreeMemory(mAllocator, allocation);
+		vkDestroyImage(mDevice, image, nullptr);
+		image = VK_NULL_HANDLE;
+		allocation = VK_NULL_HANDLE;
+	}
+	return result;
+}
+
+VkResult VMemoryPools::allocateMemory(const VkMemoryRequirements& requirements, VmaAllocationCreateInfo createInfo,
+	MemoryClass memoryClass, VmaAllocation& allocation, VmaAllocationInfo* allocationInfo) {
+	apply(createInfo, memoryClass, requirements.size);
+	if (createInfo.pool != VK_NULL_HANDLE && !fitsPool(memoryClass, requirements.memoryTypeBits))
+		createInfo.pool = VK_NULL_HANDLE;
+
+	VkResult result = vmaAllocateMemory(mAllocator, &requirements, &createInfo, &allocation, allocationInfo);
+	if (result != VK_SUCCESS && createInfo.pool != VK_NULL_HANDLE) {
+		fallback(memoryClass, result);
+		createInfo.pool = VK_NULL_HANDLE;
+		result = vmaAllocateMemory(mAllocator, &requirements, &createInfo, &allocation, allocationInfo);
+	}
+	return result;
+}
+
+void VMemoryPools::logStats() const {
+	for (size_t i = 0; i < mPools.size(); i++) {
+		uint32_t fallbacks = mFallbacks[i];
+		if (mPools[i] == VK_NULL_HANDLE) {
+			if (fallbacks > 0)
+				CORE_TRACE("{} memory pool: none, {} fallbacks.", getMemoryClassName(static_cast<MemoryClass>(i)), fallbacks);
+			continue;
+		}
+
+		VmaPoolStats stats;
+		vmaGetPoolStats(mAllocator, mPools[i], &stats);
+		CORE_TRACE("{} memory pool: {} blocks, {:.1f} of {:.1f} MB used by {} allocations, largest free range {:.1f} MB, {} fallbacks.",
+			getMemoryClassName(static_cast<MemoryClass>(i)), stats.blockCount, (stats.size - stats.unusedSize) / 1048576.0,
+			stats.size / 1048576.0, stats.allocationCount, stats.unusedRangeSizeMax / 1048576.0, fallbacks);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "../../pch.h"
+#include "../../ThirdParty/vk_mem_alloc.h"
+#include "VMemoryTracker.h"
+#include <atomic>
+
+// ******************************************************************************************************************************
+//															MEMORY POOLS
+// Every allocation used to go through VMA's default pools, so short lived staging buffers ended up in the same blocks as
+// meshes and textures that live for the whole run. Once freed they left holes the long lived blocks could never close.
+// Now each kind of resource gets its own place and strategy:
+//
+//	Upload		 Linear pool. Staging data is made, copied and freed in order, so it's just a bump of the pointer and
+//				 freeing the last allocation in a block resets it. Linear ignores the strategy flags.
+//	Geometry	 Block pool for vertex and index buffers. Best fit (MIN_MEMORY), lots of small buffers that stay around.
+//	Texture		 Block pool with bigger blocks. Worst fit (MIN_FRAGMENTATION), textures are all big so what's left over
+//				 should stay big enough for the next one.
+//	RenderTarget Dedicated VkDeviceMemory from DEDICATED_RENDER_TARGET_BYTES up, drivers can place those better and
+//				 they're only freed on resize. Smaller ones go to the default pools, first fit (MIN_TIME).
+//	General		 Everything else (uniforms, culling buffers, readback). Default pools, best fit.
+//
+// A pool only has one memory type, picked when it's made from the usage its resources are made with. If a resource
+// can't go in its pool (the type isn't allowed for it, or it's bigger than a block) it falls back to the default pools
+// and that's counted in the stats.
+// ******************************************************************************************************************************
+
+enum class MemoryClass : uint32_t {
+	Upload,
+	Geometry,
+	Texture,
+	RenderTarget,
+	General,
+	Count
+};
+
+const char* getMemoryClassName(MemoryClass memoryClass);
+// The class a category goes in unless the caller knows better (readback buffers are Staging but live as long as the target).
+MemoryClass getDefaultMemoryClass(MemoryCategory category);
+
+class VMemoryPools {
+public:
+	VMemoryPools(VkDevice device, VmaAllocator allocator);
+	~VMemoryPools();
+
+	// Same as the vma functions, but the allocation goes in memoryClass's pool with its strategy. createInfo.usage is
+	// only used if it falls back to the default pools.
+	VkResult createBuffer(const VkBufferCreateInfo& bufferInfo, VmaAllocationCreateInfo createInfo, MemoryClass memoryClass,
+		VkBuffer& buffer, VmaAllocation& allocation, VmaAllocationInfo* allocationInfo = nullptr);
+	VkResult createImage(const VkImageCreateInfo& imageInfo, VmaAllocationCreateInfo createInfo, MemoryClass memoryClass,
+		VkImage& image, VmaAllocation& allocation, VmaAllocationInfo* allocationInfo = nullptr);
+	VkResult allocateMemory(const VkMemoryRequirements& requirements, VmaAllocationCreateInfo createInfo, MemoryClass memoryClass,
+		VmaAllocation& allocation, VmaAllocationInfo* allocationInfo = nullptr);
+
+	// One line per pool with its blocks and how full they are, plus the fallbacks.
+	void logStats() const;
+
+	static const VkDeviceSize UPLOAD_BLOCK_BYTES = 64 * 1024 * 1024;
+	static const VkDeviceSize GEOMETRY_BLOCK_BYTES = 64 * 1024 * 1024;
+	static const VkDeviceSize TEXTURE_BLOCK_BYTES = 256 * 1024 * 1024;
+	// 1080p with 4 bytes a pixel is about 8 MB.
+	static const VkDeviceSize DEDICATED_RENDER_TARGET_BYTES = 4 * 1024 * 1024;
+
+private:
+	// Sets the pool, strategy and dedicated flag. size is only looked at for render targets.
+	void apply(VmaAllocationCreateInfo& createInfo, MemoryClass memoryClass, VkDeviceSize size) const;
+	// Counts an allocation that couldn't go in its class's pool.
+	void fallback(MemoryClass memoryClass, VkResult result);
+	bool fitsPool(MemoryClass memoryClass, uint32_t memoryTypeBits);
+	void createPool(MemoryClass memoryClass, uint32_t memoryTypeIndex, VkDeviceSize blockSize, VmaPoolCreateFlags flags);
+
+	VkDevice mDevice;
+	VmaAllocator mAllocator;
+	// [class] VK_NULL_HANDLE for the classes without one, or when no memory type fit.
+	std::array<VmaPool, static_cast<size_t>(MemoryClass::Count)> mPools;
+	std::array<uint32_t, static_cast<size_t>(MemoryClass::Count)> mPoolMemoryTypes;
+	std::array<std::atomic<uint32_t>, static_cast<size_t>(MemoryClass::Count)> mFallbacks;
+};
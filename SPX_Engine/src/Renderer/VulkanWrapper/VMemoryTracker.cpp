@@ -0,0 +1,109 @@
+#include "VMemoryTracker.h"
+
+const char* getMemoryCategoryName(MemoryCategory category) {
+	switch (category) {
+	case MemoryCategory::Mesh:		 return "Mesh";
+	case MemoryCategory::Texture:	 return "Texture";
+	case MemoryCategory::Uniform:	 return "Uniform";
+	case MemoryCategory::Attachment: return "Attachment";
+	case MemoryCategory::Staging:	 return "Staging";
+	default:						 return "Other";
+	}
+}
+
+VMemoryTracker::VMemoryTracker(VmaAllocator allocator, bool budgetExtension)
+	:mAllocator(allocator), mBudgetExtension(budgetExtension) {
+	CORE_INFO("Memory budget {}.", mBudgetExtension ? "from VK_EXT_memory_budget" : "estimated by VMA (no VK_EXT_memory_budget)");
+}
+
+void VMemoryTracker::tag(VmaAllocationCreateInfo& createInfo, MemoryCategory category) {
+	// VMA copies the string, so it's fine that the names are shared.
+	createInfo.flags |= VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
+	createInfo.pUserData = const_cast<char*>(getMemoryCategoryName(category));
+}
+
+void VMemoryTracker::track(VmaAllocation allocation, MemoryCategory category) {
+	if (allocation == VK_NULL_HANDLE)
+		return;
+
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(mAllocator, allocation, &info);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mAllocations[allocation] = { category, info.size };
+	CategoryUsage& usage = mCategories[static_cast<size_t>(category)];
+	usage.mBytes += info.size;
+	usage.mAllocations++;
+}
+
+void VMemoryTracker::untrack(VmaAllocation allocation) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto tracked = mAllocations.find(allocation);
+	if (tracked == mAllocations.end())
+		return;
+
+	CategoryUsage& usage = mCategories[static_cast<size_t>(tracked->second.first)];
+	usage.mBytes -= tracked->second.second;
+	usage.mAllocations--;
+	mAllocations.erase(tracked);
+}
+
+MemoryBudgetReport VMemoryTracker::getReport() const {
+	MemoryBudgetReport report;
+	report.mFromExtension = mBudgetExtension;
+
+	const VkPhysicalDeviceMemoryProperties* properties;
+	vmaGetMemoryProperties(mAllocator, &properties);
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetBudget(mAllocator, budgets);
+
+	for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+		HeapBudget heap;
+		heap.mHeapIndex = i;
+		heap.mDeviceLocal = (properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		heap.mHeapSize = properties->memoryHeaps[i].size;
+		heap.mUsage = budgets[i].usage;
+		heap.mBudget = budgets[i].budget;
+		heap.mBlockBytes = budgets[i].blockBytes;
+		heap.mAllocationBytes = budgets[i].allocationBytes;
+		report.mHeaps.push_back(heap);
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	report.mCategories = mCategories;
+	return report;
+}
+
+bool VMemoryTracker::writeJson(const std::string& file) const {
+	std::ofstream out(file);
+	if (!out.is_open()) {
+		CORE_ERROR("Couldn't open {} to write the memory map.", file);
+		return false;
+	}
+
+	MemoryBudgetReport report = getReport();
+
+	out << "{\n  \"budgetFromExtension\": " << (report.mFromExtension ? "true" : "false") << ",\n";
+	out << "  \"heaps\": [\n";
+	for (size_t i = 0; i < report.mHeaps.size(); i++) {
+		const HeapBudget& heap = report.mHeaps[i];
+		out << "    { \"index\": " << heap.mHeapIndex << ", \"deviceLocal\": " << (heap.mDeviceLocal ? "true" : "false")
+			<< ", \"size\": " << heap.mHeapSize << ", \"usage\": " << heap.mUsage << ", \"budget\": " << heap.mBudget
+			<< ", \"blockBytes\": " << heap.mBlockBytes << ", \"allocationBytes\": " << heap.mAllocationBytes << " }"
+			<< (i + 1 < report.mHeaps.size() ? "," : "") << "\n";
+	}
+	out << "  ],\n  \"categories\": {\n";
+	for (size_t i = 0; i < report.mCategories.size(); i++) {
+		out << "    \"" << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << "\": { \"bytes\": " << report.mCategories[i].mBytes
+			<< ", \"allocations\": " << report.mCategories[i].mAllocations << " }" << (i + 1 < report.mCategories.size() ? "," : "") << "\n";
+	}
+
+	// VMA's map already is JSON, it goes in as it is. Every allocation's UserData is its category.
+	char* vmaStats = nullptr;
+	vmaBuildStatsString(mAllocator, &vmaStats, VK_TRUE);
+	out << "  },\n  \"vma\": " << vmaStats << "\n}\n";
+	vmaFreeStatsString(mAllocator, vmaStats);
+
+	CORE_INFO("Wrote the GPU memory map to {}.", file);
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../../pch.h"
+#include "../../ThirdParty/vk_mem_alloc.h"
+#include <mutex>
+
+// ******************************************************************************************************************************
+//															MEMORY TRACKER
+// Where the GPU memory goes. VMA knows how much of each heap is used, the tracker adds what it's used for: every
+// allocation is tagged with a category when it's made and untagged when it's freed.
+//
+// Per heap numbers come from vmaGetBudget. With VK_EXT_memory_budget that's the driver's own usage and budget, which
+// counts everything the process has on the heap (swapchain, pipelines, other allocators) and shrinks when other apps
+// need memory. Without it VMA estimates the budget as 80% of the heap and the usage as what it allocated itself.
+//
+// The category is also stored as the allocation's user data string, so the JSON dump names every allocation.
+// ******************************************************************************************************************************
+
+enum class MemoryCategory : uint32_t {
+	Mesh,
+	Texture,
+	Uniform,
+	// Depth, colour and any other image rendered to, including the render graph's transient images.
+	Attachment,
+	// CPU side copies on their way to or from the GPU.
+	Staging,
+	Other,
+	Count
+};
+
+const char* getMemoryCategoryName(MemoryCategory category);
+
+struct HeapBudget {
+	uint32_t mHeapIndex{ 0 };
+	bool mDeviceLocal{ false };
+	VkDeviceSize mHeapSize{ 0 };
+	// Everything on the heap, see the banner for what that includes.
+	VkDeviceSize mUsage{ 0 };
+	VkDeviceSize mBudget{ 0 };
+	// VMA's own blocks, and how much of them is handed out.
+	VkDeviceSize mBlockBytes{ 0 };
+	VkDeviceSize mAllocationBytes{ 0 };
+
+	double getUsageFraction() const { return mBudget > 0 ? static_cast<double>(mUsage) / mBudget : 0.0; }
+};
+
+struct CategoryUsage {
+	VkDeviceSize mBytes{ 0 };
+	uint32_t mAllocations{ 0 };
+};
+
+struct MemoryBudgetReport {
+	std::vector<HeapBudget> mHeaps;
+	std::array<CategoryUsage, static_cast<size_t>(MemoryCategory::Count)> mCategories;
+	// False when the usage and budget are VMA's estimates.
+	bool mFromExtension{ false };
+};
+
+class VMemoryTracker {
+public:
+	VMemoryTracker(VmaAllocator allocator, bool budgetExtension);
+
+	// Call on the create info before creating the allocation, so the category ends up in the JSON dump.
+	static void tag(VmaAllocationCreateInfo& createInfo, MemoryCategory category);
+	// Call after creating and before freeing every allocation. Safe from any thread.
+	void track(VmaAllocation allocation, MemoryCategory category);
+	void untrack(VmaAllocation allocation);
+
+	MemoryBudgetReport getReport() const;
+	// VMA's detailed map (every block and allocation) plus the report, as JSON. Returns false if the file couldn't be opened.
+	bool writeJson(const std::string& file) const;
+
+private:
+	VmaAllocator mAllocator;
+	bool mBudgetExtension;
+
+	mutable std::mutex mMutex;
+	std::unordered_map<VmaAllocation, std::pair<MemoryCategory, VkDeviceSize>> mAllocations;
+	std::array<CategoryUsage, static_cast<size_t>(MemoryCategory::Count)> mCategories;
+};
@@ -0,0 +1,105 @@
+#include "VOffscreenTarget.h"
+#include "VDevice.h"
+#include "VImage.h"
+#include "VulkanHelperFunctions.h"
+#include "VMemoryTracker.h"
+#include "VMemoryPools.h"
+
+VOffscreenTarget::VOffscreenTarget(VDevice& device, VkExtent2D extent, uint32_t imageCount, VkFormat colorFormat)
+	:mDevice(device), mExtent(extent), mColorFormat(colorFormat) {
+	// TRANSFER_SRC so frames can be copied out for writing to disk.
+	for (uint32_t i = 0; i < imageCount; i++) {
+		mColorImages.push_back(new VImage(mDevice, mColorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, "Offscreen colour " + std::to_string(i), mExtent));
+	}
+
+	// Same as the swapchain's depth image, sampled for the Hi-Z culler.
+	VkFormat depthFormat = VHF::VulkanHelperFunctions::findDepthFormat(mDevice.mPhysicalDevice);
+	mDepthImage = new VImage(mDevice, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_IMAGE_ASPECT_DEPTH_BIT, VK_SAMPLE_COUNT_1_BIT, "Offscreen depth", mExtent);
+
+	// 4 bytes a pixel for every format the target is used with.
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = static_cast<VkDeviceSize>(mExtent.width) * mExtent.height * 4;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+	VMemoryTracker::tag(allocInfo, MemoryCategory::Staging);
+
+	mReadbackBuffers.resize(imageCount);
+	for (auto& buffer : mReadbackBuffers) {
+		// Staging, but they live as long as the target, so not in the linear upload pool.
+		if (mDevice.mMemoryPools->createBuffer(bufferInfo, allocInfo, MemoryClass::General, buffer.mBuffer, buffer.mAlloc) != VK_SUCCESS)
+			CORE_ERROR("Failed to create an offscreen readback buffer.");
+		mDevice.mMemoryTracker->track(buffer.mAlloc, MemoryCategory::Staging);
+	}
+
+	CORE_INFO("Offscreen target created: {}x{}, {} colour images.", mExtent.width, mExtent.height, imageCount);
+}
+
+VOffscreenTarget::~VOffscreenTarget() {
+	for (auto& buffer : mReadbackBuffers) {
+		mDevice.mMemoryTracker->untrack(buffer.mAlloc);
+		vmaDestroyBuffer(mDevice.mAllocator, buffer.mBuffer, buffer.mAlloc);
+	}
+	for (VImage* image : mColorImages)
+		delete image;
+	delete mDepthImage;
+}
+
+void VOffscreenTarget::recordReadback(VkCommandBuffer cmd, uint32_t index) {
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0;
+	// Tightly packed.
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { mExtent.width, mExtent.height, 1 };
+
+	vkCmdCopyImageToBuffer(cmd, mColorImages[index]->mImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mReadbackBuffers[index].mBuffer, 1, &region);
+
+	// The timeline wait alone doesn't make the copy visible to the CPU.
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+bool VOffscreenTarget::writeReadback(uint32_t index, const std::string& file) const {
+	std::ofstream out(file, std::ios::binary);
+	if (!out.is_open()) {
+		CORE_ERROR("Failed to open {} to write a frame.", file);
+		return false;
+	}
+
+	void* data = nullptr;
+	if (vmaMapMemory(mDevice.mAllocator, mReadbackBuffers[index].mAlloc, &data) != VK_SUCCESS) {
+		CORE_ERROR("Failed to map the readback buffer for {}.", file);
+		return false;
+	}
+	// GPU_TO_CPU memory isn't always coherent.
+	vmaInvalidateAllocation(mDevice.mAllocator, mReadbackBuffers[index].mAlloc, 0, VK_WHOLE_SIZE);
+
+	// PPM is just a header and the raw RGB bytes, anything can open it and it needs no image library.
+	out << "P6\n" << mExtent.width << " " << mExtent.height << "\n255\n";
+
+	bool bgr = mColorFormat == VK_FORMAT_B8G8R8A8_UNORM || mColorFormat == VK_FORMAT_B8G8R8A8_SRGB;
+	const uint8_t* pixels = static_cast<const uint8_t*>(data);
+	std::vector<uint8_t> row(static_cast<size_t>(mExtent.width) * 3);
+	for (uint32_t y = 0; y < mExtent.height; y++) {
+		for (uint32_t x = 0; x < mExtent.width; x++) {
+			const uint8_t* pixel = pixels + (static_cast<size_t>(y) * mExtent.width + x) * 4;
+			row[x * 3 + 0] = bgr ? pixel[2] : pixel[0];
+			row[x * 3 + 1] = pixel[1];
+			row[x * 3 + 2] = bgr ? pixel[0] : pixel[2];
+		}
+		out.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+
+	vmaUnmapMemory(mDevice.mAllocator, mReadbackBuffers[index].mAlloc);
+	return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../../pch.h"
+#include "DataStructures.h"
+
+// ******************************************************************************************************************************
+//															OFFSCREEN TARGET
+// Stands in for the swapchain when rendering headless. There's no window, surface or present, the frame is drawn into
+// plain VImages and can be copied back to the CPU and written to disk.
+//
+// There's one colour image per frame in flight, so a frame that's still on the GPU is never drawn over by the next one.
+// The depth image is shared like the swapchain's, every frame clears it.
+// ******************************************************************************************************************************
+
+class VDevice;
+class VImage;
+
+class VOffscreenTarget {
+public:
+	VOffscreenTarget(VDevice& device, VkExtent2D extent, uint32_t imageCount, VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM);
+	~VOffscreenTarget();
+
+	// Copies colour image index into its readback buffer. The image has to be in TRANSFER_SRC_OPTIMAL.
+	void recordReadback(VkCommandBuffer cmd, uint32_t index);
+	// Writes what the last readback of index copied as a binary PPM. Only call once the GPU has finished that frame.
+	bool writeReadback(uint32_t index, const std::string& file) const;
+
+	VkBuffer getReadbackBuffer(uint32_t index) const { return mReadbackBuffers[index].mBuffer; }
+
+	VDevice& mDevice;
+	VkExtent2D mExtent{ 0, 0 };
+	VkFormat mColorFormat{ VK_FORMAT_UNDEFINED };
+	std::vector<VImage*> mColorImages;
+	VImage* mDepthImage{ nullptr };
+
+private:
+	// Host visible, one per colour image.
+	std::vector<AllocatedBuffer> mReadbackBuffers;
+};
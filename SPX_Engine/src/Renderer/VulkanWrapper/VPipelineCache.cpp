@@ -0,0 +1,132 @@
+#include "VPipelineCache.h"
+#include <filesystem>
+
+const std::chrono::seconds VPipelineCache::SAVE_INTERVAL = std::chrono::seconds(60);
+
+VPipelineCache::VPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& filePath)
+	:mDevice(device), mFilePath(filePath) {
+	vkGetPhysicalDeviceProperties(physicalDevice, &mProperties);
+
+	std::vector<char> data;
+	std::ifstream file(mFilePath, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		file.close();
+
+		if (!isHeaderValid(data)) {
+			CORE_INFO("Pipeline cache {} was written by a different GPU or driver, starting with an empty cache.", mFilePath);
+			data.clear();
+		}
+	}
+	else
+		CORE_INFO("No pipeline cache found at {}, starting with an empty cache.", mFilePath);
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(mDevice, &cacheInfo, nullptr, &mPipelineCache) != VK_SUCCESS) {
+		// The header matched but the driver still didn't like the data. An empty cache is always accepted.
+		CORE_ERROR("Failed to create Pipeline Cache from {}, retrying empty.", mFilePath);
+		data.clear();
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		if (vkCreatePipelineCache(mDevice, &cacheInfo, nullptr, &mPipelineCache) != VK_SUCCESS)
+			CORE_ERROR("Failed to create Pipeline Cache.");
+	}
+
+	mLoadedFromDisk = !data.empty();
+	mSavedSize = getDataSize();
+	mLastSave = std::chrono::steady_clock::now();
+
+	if (mLoadedFromDisk)
+		CORE_INFO("Loaded {} bytes of pipeline cache from {}.", data.size(), mFilePath);
+}
+
+VPipelineCache::~VPipelineCache() {
+	vkDestroyPipelineCache(mDevice, mPipelineCache, nullptr);
+}
+
+void VPipelineCache::save() {
+	mLastSave = std::chrono::steady_clock::now();
+
+	size_t size = getDataSize();
+	if (size == 0 || size == mSavedSize)
+		return;
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(mDevice, mPipelineCache, &size, data.data()) != VK_SUCCESS) {
+		CORE_ERROR("Failed to read Pipeline Cache data.");
+		return;
+	}
+	data.resize(size);
+
+	std::string tempPath = mFilePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			CORE_ERROR("Failed to open {} to save the Pipeline Cache.", tempPath);
+			return;
+		}
+		file.write(data.data(), data.size());
+		if (!file) {
+			CORE_ERROR("Failed to write the Pipeline Cache to {}.", tempPath);
+			return;
+		}
+	}
+
+	// Replaces the old cache in one step. Readers see either the whole old file or the whole new one.
+	std::error_code error;
+	std::filesystem::rename(tempPath, mFilePath, error);
+	if (error) {
+		CORE_ERROR("Failed to replace {} with the new Pipeline Cache: {}", mFilePath, error.message());
+		return;
+	}
+
+	mSavedSize = data.size();
+	CORE_TRACE("Saved {} bytes of pipeline cache to {}.", data.size(), mFilePath);
+}
+
+void VPipelineCache::saveIfDue() {
+	if (std::chrono::steady_clock::now() - mLastSave >= SAVE_INTERVAL)
+		save();
+}
+
+void VPipelineCache::recordPipelineCreation(double milliseconds) {
+	std::lock_guard<std::mutex> lock(mStatsMutex);
+	mPipelinesCreated++;
+	mCreationTimeMs += milliseconds;
+}
+
+void VPipelineCache::logStats() const {
+	std::lock_guard<std::mutex> lock(mStatsMutex);
+	CORE_INFO("{} start: created {} pipelines in {:.3f} ms.", mLoadedFromDisk ? "Warm" : "Cold", mPipelinesCreated, mCreationTimeMs);
+}
+
+bool VPipelineCache::isHeaderValid(const std::vector<char>& data) const {
+	// Version one header: header size, header version, vendor ID, device ID, then the 16 byte UUID.
+	const size_t headerSize = 16 + VK_UUID_SIZE;
+	if (data.size() < headerSize)
+		return false;
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+	uint8_t uuid[VK_UUID_SIZE];
+	memcpy(uuid, data.data() + 16, VK_UUID_SIZE);
+
+	return header[0] >= headerSize &&
+		header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header[2] == mProperties.vendorID &&
+		header[3] == mProperties.deviceID &&
+		memcmp(uuid, mProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+size_t VPipelineCache::getDataSize() const {
+	size_t size = 0;
+	if (mPipelineCache == VK_NULL_HANDLE || vkGetPipelineCacheData(mDevice, mPipelineCache, &size, nullptr) != VK_SUCCESS)
+		return 0;
+	return size;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "../../pch.h"
+#include <mutex>
+
+// ******************************************************************************************************************************
+//															PIPELINE CACHE
+// One VkPipelineCache shared by every pipeline the device creates, saved to disk so the driver doesn't have to compile
+// the same shaders again on the next launch.
+//
+// Cache data is only valid for the exact GPU and driver that wrote it. Drivers are supposed to reject data that doesn't
+// match, but not all of them do it safely, so the header is checked against this device's vendor ID, device ID and
+// pipelineCacheUUID (the UUID changes with the driver version) before it's ever handed to Vulkan. Anything that doesn't
+// match starts an empty cache instead.
+//
+// Saving writes to a temporary file and renames it over the old one, so a crash halfway through a save can never leave
+// a truncated cache behind.
+// ******************************************************************************************************************************
+
+class VPipelineCache {
+public:
+	VPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& filePath);
+	~VPipelineCache();
+
+	// Writes the cache to disk if it changed since it was loaded or last saved.
+	void save();
+	// Saves at most once every SAVE_INTERVAL so pipelines created while running aren't lost to a crash.
+	void saveIfDue();
+
+	// Called by the pipeline classes after each create so startup cost can be reported. Pipelines can be compiled on
+	// worker threads, so this locks.
+	void recordPipelineCreation(double milliseconds);
+	void logStats() const;
+
+	VkPipelineCache get() const { return mPipelineCache; }
+	// True when valid cache data was found on disk at startup (a warm start).
+	bool wasLoadedFromDisk() const { return mLoadedFromDisk; }
+
+	static const std::chrono::seconds SAVE_INTERVAL;
+
+private:
+	// Returns true if data has a version one header written by this exact device and driver.
+	bool isHeaderValid(const std::vector<char>& data) const;
+	size_t getDataSize() const;
+
+	VkDevice mDevice{ VK_NULL_HANDLE };
+	VkPhysicalDeviceProperties mProperties{};
+	VkPipelineCache mPipelineCache{ VK_NULL_HANDLE };
+	std::string mFilePath;
+
+	bool mLoadedFromDisk{ false };
+	// Size of the cache data when it was last loaded or saved. The cache only grows, so a different size means new data.
+	size_t mSavedSize{ 0 };
+	std::chrono::steady_clock::time_point mLastSave;
+
+	mutable std::mutex mStatsMutex;
+	uint32_t mPipelinesCreated{ 0 };
+	double mCreationTimeMs{ 0.0 };
+};
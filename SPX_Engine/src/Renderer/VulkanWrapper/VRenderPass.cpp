@@ -1,6 +1,5 @@
 #include "VRenderPass.h"
 #include "VDevice.h"
-#include "VSwapChain.h"
 #include "VulkanHelperFunctions.h"
 
 VRenderPass::VRenderPass(
@@ -9,7 +8,9 @@ VRenderPass::VRenderPass(
    // const std::vector<VkSubpassDependency>& dependencies,
    // VkSubpassDescription subpassDescription, 
     const std::string& name,
-	VSwapChain swapChain) // Remove swapchain variable once I sent the attachments and dependencies and subpass.
+	VkFormat colorFormat, // The swapchain format, or the offscreen target's when headless.
+	bool loadContents,
+	bool storeDepth)
     : mDevice(device), mName(name) {
 	// This is to tell Vulkan about the framebuffer attachments that I will be using during rendering. I need
 	// to specify how many color and depth buffers there will be, how many samples to use for each of them and how
@@ -18,7 +19,7 @@ VRenderPass::VRenderPass(
 	// In this case I'll have just a single color buffer attachment represented by one of the images from the swap chain
 	// This has a lot of settings that I will need to dynamically change once I actually begin an engine.
 	VkAttachmentDescription colorAttach{};
-	colorAttach.format = swapChain.mSwapChainImageFormat;
+	colorAttach.format = colorFormat;
 	// With no multisampling yet, setting it to one sample
 	colorAttach.samples = VK_SAMPLE_COUNT_1_BIT;
 	// Determines what to do with data in the attachment before rendering and after rendering.
@@ -29,6 +30,12 @@ VRenderPass::VRenderPass(
 	colorAttach.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	// InitalLayout specifies which layout the image will have before render pass
 	colorAttach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// A pass that continues an earlier one has to load its results, and the image is coming out of that pass as present src.
+	if (loadContents) {
+		colorAttach.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		colorAttach.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	}
 	// FinalLayout specifies the layout to automatically transition to when the render pass finishes.
 	// I want the image to be ready for presentation using the swapchain after rendering.
 	colorAttach.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
@@ -43,6 +50,13 @@ VRenderPass::VRenderPass(
 	depthAttach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	depthAttach.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	if (storeDepth)
+		depthAttach.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	if (loadContents) {
+		depthAttach.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		depthAttach.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	}
+
 	// pg 238
 	VkAttachmentReference depthAttachRef = {};
 	depthAttachRef.attachment = 1;
@@ -80,6 +94,13 @@ VRenderPass::VRenderPass(
 	depend.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	depend.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+	// Loading means reading what the previous pass wrote, so wait on those writes too.
+	if (loadContents) {
+		depend.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depend.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depend.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	}
+
 	// Now that the attachment and basic subpass referencing have been described, I can create the render pass.
 	// The render pass object can be created by filling out the below structure with what I've created before.
 	std::array<VkAttachmentDescription, 2> attachments = { colorAttach, depthAttach }; // Here I add depthAttach once I've done that.
@@ -3,15 +3,18 @@
 #include "../../pch.h"
 
 class VDevice;
-class VSwapChain;
 
+// loadContents keeps what an earlier pass drew this frame instead of clearing it. Used by the second Hi-Z phase.
+// storeDepth keeps the depth buffer after the pass so it can be read afterwards (depth pyramid).
 class VRenderPass
 {
 public:
 	VRenderPass(
 		const VDevice& device,
 		const std::string& name,
-		VSwapChain swapChain);
+		VkFormat colorFormat,
+		bool loadContents = false,
+		bool storeDepth = false);
 
 	~VRenderPass();
 
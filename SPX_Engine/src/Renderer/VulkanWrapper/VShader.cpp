@@ -1,5 +1,6 @@
 #include "VShader.h"
 #include "VDevice.h"
+#include "VShaderReflection.h"
 
 #include "../../ThirdParty/stb_image.h"
 
@@ -15,6 +16,10 @@ VShader::~VShader() {
 }
 
 void VShader::readFile(std::string fileName) {
+	mShaderCode = readCode(fileName);
+}
+
+std::vector<char> VShader::readCode(const std::string& fileName) {
 	// ate startes reading at the end. This is important so I can use read position to determine the
 	// file size and allocate a buffer
 	std::ifstream file(fileName, std::ios::ate | std::ios::binary);
@@ -33,7 +38,7 @@ void VShader::readFile(std::string fileName) {
 	// Close the file and return the bytes
 	file.close();
 
-	mShaderCode = buffer;
+	return buffer;
 }
 
 void VShader::createShaderModule() {
@@ -49,3 +54,21 @@ void VShader::createShaderModule() {
 	else
 		CORE_INFO("Shader created successfully");
 }
+
+bool VShader::reflect(ShaderReflection& reflection) const {
+	return ShaderReflection::reflect(reinterpret_cast<const uint32_t*>(mShaderCode.data()), mShaderCode.size() / sizeof(uint32_t),
+		getStage(mType), reflection);
+}
+
+bool VShader::reflectFile(ShaderType type, const std::string& fileName, ShaderReflection& reflection) {
+	std::vector<char> code = readCode(fileName);
+	return ShaderReflection::reflect(reinterpret_cast<const uint32_t*>(code.data()), code.size() / sizeof(uint32_t), getStage(type), reflection);
+}
+
+VkShaderStageFlagBits VShader::getStage(ShaderType type) {
+	if (type == ShaderType::FRAG_SHADER)
+		return VK_SHADER_STAGE_FRAGMENT_BIT;
+	if (type == ShaderType::COMP_SHADER)
+		return VK_SHADER_STAGE_COMPUTE_BIT;
+	return VK_SHADER_STAGE_VERTEX_BIT;
+}
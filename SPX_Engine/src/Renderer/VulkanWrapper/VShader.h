@@ -2,11 +2,12 @@
 
 #include "../../pch.h"
 
-enum class ShaderType { NONE, VERT_SHADER, FRAG_SHADER };
+enum class ShaderType { NONE, VERT_SHADER, FRAG_SHADER, COMP_SHADER };
 
 // TODO: Add shader compiler so I can send the shader file instead of the spv file.
 
 class VDevice;
+struct ShaderReflection;
 
 class VShader {
 public:
@@ -16,10 +17,18 @@ public:
 	void readFile(std::string fileName);
 	void createShaderModule();
 
+	// Reads the bindings, push constants and vertex inputs out of the loaded SPIR-V.
+	bool reflect(ShaderReflection& reflection) const;
+	// Same, straight from a .spv file without creating a shader module.
+	static bool reflectFile(ShaderType type, const std::string& fileName, ShaderReflection& reflection);
+
 	VkShaderModule mShaderModule{ VK_NULL_HANDLE };
 	ShaderType mType;
 
 private:
+	static std::vector<char> readCode(const std::string& fileName);
+	static VkShaderStageFlagBits getStage(ShaderType type);
+
 	std::vector<char> mShaderCode;
 	VDevice& mDevice;
 };
\ No newline at end of file
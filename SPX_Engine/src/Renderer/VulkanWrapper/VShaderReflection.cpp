@@ -0,0 +1,437 @@
+#include "VShaderReflection.h"
+
+namespace {
+	const uint32_t SPIRV_MAGIC = 0x07230203;
+	const size_t SPIRV_HEADER_WORDS = 5;
+
+	// The opcodes, decorations and enums used below. Values are from the SPIR-V spec (spirv.h).
+	enum SpirvOp {
+		OP_NAME = 5,
+		OP_TYPE_BOOL = 20,
+		OP_TYPE_INT = 21,
+		OP_TYPE_FLOAT = 22,
+		OP_TYPE_VECTOR = 23,
+		OP_TYPE_MATRIX = 24,
+		OP_TYPE_IMAGE = 25,
+		OP_TYPE_SAMPLER = 26,
+		OP_TYPE_SAMPLED_IMAGE = 27,
+		OP_TYPE_ARRAY = 28,
+		OP_TYPE_RUNTIME_ARRAY = 29,
+		OP_TYPE_STRUCT = 30,
+		OP_TYPE_POINTER = 32,
+		OP_CONSTANT = 43,
+		OP_FUNCTION = 54,
+		OP_VARIABLE = 59,
+		OP_DECORATE = 71,
+		OP_MEMBER_DECORATE = 72
+	};
+
+	enum SpirvDecoration {
+		DECORATION_BLOCK = 2,
+		DECORATION_BUFFER_BLOCK = 3,
+		DECORATION_ARRAY_STRIDE = 6,
+		DECORATION_MATRIX_STRIDE = 7,
+		DECORATION_BUILT_IN = 11,
+		DECORATION_LOCATION = 30,
+		DECORATION_BINDING = 33,
+		DECORATION_DESCRIPTOR_SET = 34,
+		DECORATION_OFFSET = 35
+	};
+
+	enum SpirvStorageClass {
+		STORAGE_UNIFORM_CONSTANT = 0,
+		STORAGE_INPUT = 1,
+		STORAGE_UNIFORM = 2,
+		STORAGE_PUSH_CONSTANT = 9,
+		STORAGE_STORAGE_BUFFER = 12
+	};
+
+	const uint32_t DIM_BUFFER = 5;
+	const uint32_t DIM_SUBPASS_DATA = 6;
+
+	// Everything learned about one SPIR-V result ID.
+	struct SpirvId {
+		uint32_t mOpcode{ 0 };
+		// The instruction's words after the result ID. For OpVariable mOperands[0] is the type.
+		std::vector<uint32_t> mOperands;
+		std::string mName;
+
+		bool mHasSet{ false };
+		bool mHasBinding{ false };
+		bool mHasLocation{ false };
+		bool mBuiltIn{ false };
+		bool mBlock{ false };
+		bool mBufferBlock{ false };
+		uint32_t mSet{ 0 };
+		uint32_t mBinding{ 0 };
+		uint32_t mLocation{ 0 };
+		uint32_t mArrayStride{ 0 };
+		uint32_t mConstantValue{ 0 };
+
+		// Struct members, from OpMemberDecorate.
+		std::vector<uint32_t> mMemberOffsets;
+		std::vector<uint32_t> mMemberMatrixStrides;
+	};
+
+	std::string readString(const uint32_t* words, size_t wordCount) {
+		// Strings are nul terminated and packed 4 chars per word, little endian.
+		const char* chars = reinterpret_cast<const char*>(words);
+		size_t maxLength = wordCount * sizeof(uint32_t);
+		size_t length = 0;
+		while (length < maxLength && chars[length] != '\0')
+			length++;
+		return std::string(chars, length);
+	}
+
+	void setMemberDecoration(std::vector<uint32_t>& values, uint32_t member, uint32_t value) {
+		if (values.size() <= member)
+			values.resize(member + 1, 0);
+		values[member] = value;
+	}
+
+	// Size in bytes of a type in a push constant block. Matrices and arrays use their stride decorations when they have one.
+	uint32_t typeSize(const std::vector<SpirvId>& ids, uint32_t typeID, uint32_t matrixStride = 0) {
+		const SpirvId& type = ids[typeID];
+		switch (type.mOpcode) {
+		case OP_TYPE_BOOL:
+			return 4;
+		case OP_TYPE_INT:
+		case OP_TYPE_FLOAT:
+			return type.mOperands[0] / 8;
+		case OP_TYPE_VECTOR:
+			return typeSize(ids, type.mOperands[0]) * type.mOperands[1];
+		case OP_TYPE_MATRIX: {
+			// Columns of a vec3 are padded out to a vec4 in both std140 and std430.
+			uint32_t columnSize = matrixStride;
+			if (columnSize == 0) {
+				const SpirvId& column = ids[type.mOperands[0]];
+				columnSize = typeSize(ids, column.mOperands[0]) * (column.mOperands[1] == 3 ? 4 : column.mOperands[1]);
+			}
+			return columnSize * type.mOperands[1];
+		}
+		case OP_TYPE_ARRAY: {
+			uint32_t length = ids[type.mOperands[1]].mConstantValue;
+			uint32_t stride = type.mArrayStride ? type.mArrayStride : typeSize(ids, type.mOperands[0]);
+			return stride * length;
+		}
+		case OP_TYPE_STRUCT: {
+			uint32_t size = 0;
+			for (size_t i = 0; i < type.mOperands.size(); i++) {
+				uint32_t offset = i < type.mMemberOffsets.size() ? type.mMemberOffsets[i] : 0;
+				uint32_t stride = i < type.mMemberMatrixStrides.size() ? type.mMemberMatrixStrides[i] : 0;
+				size = std::max(size, offset + typeSize(ids, type.mOperands[i], stride));
+			}
+			return size;
+		}
+		default:
+			return 0;
+		}
+	}
+
+	VkFormat vertexInputFormat(const std::vector<SpirvId>& ids, uint32_t typeID) {
+		const SpirvId& type = ids[typeID];
+		uint32_t componentCount = 1;
+		const SpirvId* component = &type;
+		if (type.mOpcode == OP_TYPE_VECTOR) {
+			componentCount = type.mOperands[1];
+			component = &ids[type.mOperands[0]];
+		}
+
+		// Only 32 bit inputs. That's all the Vertex struct uses.
+		if ((component->mOpcode != OP_TYPE_FLOAT && component->mOpcode != OP_TYPE_INT) || component->mOperands[0] != 32 ||
+			componentCount < 1 || componentCount > 4)
+			return VK_FORMAT_UNDEFINED;
+
+		static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+		static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+		static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+		if (component->mOpcode == OP_TYPE_FLOAT)
+			return floatFormats[componentCount - 1];
+		// OpTypeInt's second operand is signedness.
+		return component->mOperands[1] ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+	}
+
+	VkDescriptorType descriptorType(const std::vector<SpirvId>& ids, uint32_t storageClass, const SpirvId& type) {
+		if (storageClass == STORAGE_STORAGE_BUFFER)
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+		if (storageClass == STORAGE_UNIFORM) {
+			// Older GLSL compilers mark storage buffers as Uniform + BufferBlock.
+			if (type.mBufferBlock)
+				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		}
+
+		switch (type.mOpcode) {
+		case OP_TYPE_SAMPLED_IMAGE:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case OP_TYPE_SAMPLER:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case OP_TYPE_IMAGE: {
+			// Operands: sampled type, dim, depth, arrayed, multisampled, sampled (1 = sampled, 2 = storage), format.
+			uint32_t dim = type.mOperands[1];
+			bool sampled = type.mOperands[5] == 1;
+			if (dim == DIM_BUFFER)
+				return sampled ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+			if (dim == DIM_SUBPASS_DATA)
+				return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			return sampled ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		}
+		default:
+			return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+		}
+	}
+}
+
+bool ShaderReflection::reflect(const uint32_t* code, size_t wordCount, VkShaderStageFlagBits stage, ShaderReflection& reflection) {
+	reflection = ShaderReflection{};
+	reflection.mStages = stage;
+
+	if (wordCount < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+		CORE_ERROR("Shader reflection: not a SPIR-V module.");
+		return false;
+	}
+
+	// Word 3 of the header is the ID bound, every result ID is below it.
+	uint32_t idBound = code[3];
+	std::vector<SpirvId> ids(idBound);
+	std::vector<uint32_t> variables;
+
+	// First pass collects the declarations. They all come before the first function.
+	size_t offset = SPIRV_HEADER_WORDS;
+	while (offset < wordCount) {
+		uint32_t opcode = code[offset] & 0xFFFF;
+		uint32_t instructionWords = code[offset] >> 16;
+		if (instructionWords == 0 || offset + instructionWords > wordCount) {
+			CORE_ERROR("Shader reflection: malformed instruction at word {}.", offset);
+			return false;
+		}
+
+		const uint32_t* words = code + offset;
+		if (opcode == OP_FUNCTION)
+			break;
+
+		switch (opcode) {
+		case OP_NAME:
+			if (words[1] < idBound)
+				ids[words[1]].mName = readString(words + 2, instructionWords - 2);
+			break;
+		case OP_TYPE_BOOL:
+		case OP_TYPE_INT:
+		case OP_TYPE_FLOAT:
+		case OP_TYPE_VECTOR:
+		case OP_TYPE_MATRIX:
+		case OP_TYPE_IMAGE:
+		case OP_TYPE_SAMPLER:
+		case OP_TYPE_SAMPLED_IMAGE:
+		case OP_TYPE_ARRAY:
+		case OP_TYPE_RUNTIME_ARRAY:
+		case OP_TYPE_STRUCT:
+		case OP_TYPE_POINTER:
+			// Types have their result ID first.
+			if (words[1] < idBound) {
+				ids[words[1]].mOpcode = opcode;
+				ids[words[1]].mOperands.assign(words + 2, words + instructionWords);
+			}
+			break;
+		case OP_CONSTANT:
+			// Result type, result ID, value. Only the low word matters for array lengths.
+			if (words[2] < idBound && instructionWords > 3) {
+				ids[words[2]].mOpcode = opcode;
+				ids[words[2]].mConstantValue = words[3];
+			}
+			break;
+		case OP_VARIABLE:
+			// Result type, result ID, storage class.
+			if (words[2] < idBound) {
+				ids[words[2]].mOpcode = opcode;
+				ids[words[2]].mOperands = { words[1], words[3] };
+				variables.push_back(words[2]);
+			}
+			break;
+		case OP_DECORATE: {
+			if (words[1] >= idBound || instructionWords < 3)
+				break;
+			SpirvId& target = ids[words[1]];
+			uint32_t value = instructionWords > 3 ? words[3] : 0;
+			switch (words[2]) {
+			case DECORATION_BLOCK: target.mBlock = true; break;
+			case DECORATION_BUFFER_BLOCK: target.mBufferBlock = true; break;
+			case DECORATION_ARRAY_STRIDE: target.mArrayStride = value; break;
+			case DECORATION_BUILT_IN: target.mBuiltIn = true; break;
+			case DECORATION_LOCATION: target.mHasLocation = true; target.mLocation = value; break;
+			case DECORATION_BINDING: target.mHasBinding = true; target.mBinding = value; break;
+			case DECORATION_DESCRIPTOR_SET: target.mHasSet = true; target.mSet = value; break;
+			}
+			break;
+		}
+		case OP_MEMBER_DECORATE: {
+			// Struct, member, decoration, value.
+			if (words[1] >= idBound || instructionWords < 5)
+				break;
+			SpirvId& target = ids[words[1]];
+			if (words[3] == DECORATION_OFFSET)
+				setMemberDecoration(target.mMemberOffsets, words[2], words[4]);
+			else if (words[3] == DECORATION_MATRIX_STRIDE)
+				setMemberDecoration(target.mMemberMatrixStrides, words[2], words[4]);
+			else if (words[3] == DECORATION_BUILT_IN)
+				target.mBuiltIn = true;
+			break;
+		}
+		}
+
+		offset += instructionWords;
+	}
+
+	// Second pass turns the interesting variables into bindings, push constants and vertex inputs.
+	for (uint32_t variableID : variables) {
+		const SpirvId& variable = ids[variableID];
+		const SpirvId& pointer = ids[variable.mOperands[0]];
+		uint32_t storageClass = variable.mOperands[1];
+		if (pointer.mOpcode != OP_TYPE_POINTER)
+			continue;
+
+		// OpTypePointer's operands are storage class, pointee type.
+		uint32_t typeID = pointer.mOperands[1];
+
+		if (storageClass == STORAGE_PUSH_CONSTANT) {
+			const SpirvId& block = ids[typeID];
+			uint32_t start = block.mMemberOffsets.empty() ? 0 : *std::min_element(block.mMemberOffsets.begin(), block.mMemberOffsets.end());
+			uint32_t end = typeSize(ids, typeID);
+
+			VkPushConstantRange range{};
+			range.stageFlags = stage;
+			range.offset = start;
+			range.size = end - start;
+			reflection.mPushConstants.push_back(range);
+			continue;
+		}
+
+		if (storageClass == STORAGE_INPUT) {
+			if (stage != VK_SHADER_STAGE_VERTEX_BIT || variable.mBuiltIn || !variable.mHasLocation || ids[typeID].mBuiltIn)
+				continue;
+
+			ReflectedVertexInput input;
+			input.mLocation = variable.mLocation;
+			input.mFormat = vertexInputFormat(ids, typeID);
+			input.mName = variable.mName;
+			if (input.mFormat == VK_FORMAT_UNDEFINED)
+				CORE_ERROR("Shader reflection: vertex input {} at location {} has a type I don't handle.", input.mName, input.mLocation);
+			reflection.mVertexInputs.push_back(input);
+			continue;
+		}
+
+		if (storageClass != STORAGE_UNIFORM_CONSTANT && storageClass != STORAGE_UNIFORM && storageClass != STORAGE_STORAGE_BUFFER)
+			continue;
+		if (!variable.mHasBinding)
+			continue;
+
+		// Arrays of descriptors. Each dimension multiplies the count.
+		uint32_t count = 1;
+		while (ids[typeID].mOpcode == OP_TYPE_ARRAY || ids[typeID].mOpcode == OP_TYPE_RUNTIME_ARRAY) {
+			if (ids[typeID].mOpcode == OP_TYPE_ARRAY)
+				count *= ids[ids[typeID].mOperands[1]].mConstantValue;
+			else
+				CORE_ERROR("Shader reflection: {} is an unsized descriptor array, reflecting it as a single descriptor.", variable.mName);
+			typeID = ids[typeID].mOperands[0];
+		}
+
+		ReflectedBinding binding;
+		binding.mSet = variable.mHasSet ? variable.mSet : 0;
+		binding.mBinding = variable.mBinding;
+		binding.mType = descriptorType(ids, storageClass, ids[typeID]);
+		binding.mCount = count;
+		binding.mStages = stage;
+		// Blocks are usually named by their type (UniformBufferObject), the variable (ubo) is clearer when it has a name.
+		binding.mName = variable.mName.empty() ? ids[typeID].mName : variable.mName;
+
+		if (binding.mType == VK_DESCRIPTOR_TYPE_MAX_ENUM) {
+			CORE_ERROR("Shader reflection: couldn't work out the descriptor type of {} (set {}, binding {}).", binding.mName, binding.mSet, binding.mBinding);
+			continue;
+		}
+		reflection.mBindings.push_back(binding);
+	}
+
+	std::sort(reflection.mBindings.begin(), reflection.mBindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+		return a.mSet != b.mSet ? a.mSet < b.mSet : a.mBinding < b.mBinding;
+	});
+	std::sort(reflection.mVertexInputs.begin(), reflection.mVertexInputs.end(), [](const ReflectedVertexInput& a, const ReflectedVertexInput& b) {
+		return a.mLocation < b.mLocation;
+	});
+
+	return true;
+}
+
+ShaderReflection ShaderReflection::merge(const std::vector<ShaderReflection>& stages) {
+	ShaderReflection merged;
+
+	for (const auto& stage : stages) {
+		merged.mStages |= stage.mStages;
+
+		for (const auto& binding : stage.mBindings) {
+			auto it = std::find_if(merged.mBindings.begin(), merged.mBindings.end(), [&binding](const ReflectedBinding& existing) {
+				return existing.mSet == binding.mSet && existing.mBinding == binding.mBinding;
+			});
+
+			if (it == merged.mBindings.end()) {
+				merged.mBindings.push_back(binding);
+				continue;
+			}
+
+			// Same slot in another stage. It has to be the same descriptor or the layout can't satisfy both.
+			if (it->mType != binding.mType || it->mCount != binding.mCount)
+				CORE_ERROR("Shader reflection: set {} binding {} is declared differently by two stages ({} and {}).",
+					binding.mSet, binding.mBinding, it->mName, binding.mName);
+			it->mStages |= binding.mStages;
+		}
+
+		for (const auto& range : stage.mPushConstants) {
+			if (merged.mPushConstants.empty()) {
+				merged.mPushConstants.push_back(range);
+				continue;
+			}
+
+			VkPushConstantRange& existing = merged.mPushConstants[0];
+			uint32_t start = std::min(existing.offset, range.offset);
+			uint32_t end = std::max(existing.offset + existing.size, range.offset + range.size);
+			existing.offset = start;
+			existing.size = end - start;
+			existing.stageFlags |= range.stageFlags;
+		}
+
+		if (stage.mStages & VK_SHADER_STAGE_VERTEX_BIT)
+			merged.mVertexInputs = stage.mVertexInputs;
+	}
+
+	std::sort(merged.mBindings.begin(), merged.mBindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+		return a.mSet != b.mSet ? a.mSet < b.mSet : a.mBinding < b.mBinding;
+	});
+
+	return merged;
+}
+
+std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::getSetLayoutBindings(uint32_t set) const {
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	for (const auto& binding : mBindings) {
+		if (binding.mSet != set)
+			continue;
+
+		VkDescriptorSetLayoutBinding layoutBinding{};
+		layoutBinding.binding = binding.mBinding;
+		layoutBinding.descriptorType = binding.mType;
+		layoutBinding.descriptorCount = binding.mCount;
+		// Exactly the stages that use it, nothing more.
+		layoutBinding.stageFlags = binding.mStages;
+		layoutBinding.pImmutableSamplers = nullptr;
+		bindings.push_back(layoutBinding);
+	}
+	return bindings;
+}
+
+uint32_t ShaderReflection::getSetCount() const {
+	uint32_t count = 0;
+	for (const auto& binding : mBindings)
+		count = std::max(count, binding.mSet + 1);
+	return count;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../../pch.h"
+
+// ******************************************************************************************************************************
+//														SHADER REFLECTION
+// Reads the descriptor bindings, push constant ranges and vertex inputs straight out of a SPIR-V module, so the layouts
+// never have to be written by hand to match the GLSL.
+//
+// SPIR-V is a flat list of 32 bit words. After a 5 word header every instruction starts with one word holding its
+// length (high 16 bits) and opcode (low 16 bits). Everything needed here is in the declarations at the top of the
+// module: OpDecorate gives set/binding/location, OpVariable gives the storage class, and the OpType* instructions
+// give the type. Function bodies are skipped.
+//
+// Only the parts of the spec the engine's shaders use are handled. Anything unknown is skipped by its word count.
+// ******************************************************************************************************************************
+
+struct ReflectedBinding {
+	uint32_t mSet{ 0 };
+	uint32_t mBinding{ 0 };
+	VkDescriptorType mType{ VK_DESCRIPTOR_TYPE_MAX_ENUM };
+	// Array size. 1 for a single descriptor.
+	uint32_t mCount{ 1 };
+	VkShaderStageFlags mStages{ 0 };
+	std::string mName;
+};
+
+struct ReflectedVertexInput {
+	uint32_t mLocation{ 0 };
+	VkFormat mFormat{ VK_FORMAT_UNDEFINED };
+	std::string mName;
+};
+
+struct ShaderReflection {
+	VkShaderStageFlags mStages{ 0 };
+	// Sorted by set, then binding.
+	std::vector<ReflectedBinding> mBindings;
+	std::vector<VkPushConstantRange> mPushConstants;
+	// Only filled for vertex shaders. Sorted by location, built ins (gl_VertexIndex etc) aren't included.
+	std::vector<ReflectedVertexInput> mVertexInputs;
+
+	// Returns false (and logs why) if code isn't a SPIR-V module it can read.
+	static bool reflect(const uint32_t* code, size_t wordCount, VkShaderStageFlagBits stage, ShaderReflection& reflection);
+
+	// Combines the stages of one pipeline. Bindings declared by several stages are merged into one with both stage flags,
+	// and the push constant ranges are merged into one range covering all of them (GLSL only allows one push constant
+	// block per stage, and the engine's shaders share it).
+	static ShaderReflection merge(const std::vector<ShaderReflection>& stages);
+
+	// The layout bindings for one set, ready for vkCreateDescriptorSetLayout.
+	std::vector<VkDescriptorSetLayoutBinding> getSetLayoutBindings(uint32_t set) const;
+	// One past the highest set used, 0 if there are no descriptors.
+	uint32_t getSetCount() const;
+};
@@ -141,7 +141,8 @@ void VSwapChain::createSwapChainFrameBuffers(VRenderPass renderPass) {
 void VSwapChain::createDepthResources() {
 	VkFormat depthFormat = VHF::VulkanHelperFunctions::findDepthFormat(mDevice.mPhysicalDevice);
 
-	mDepthImage = new VImage(mDevice, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
+	// Sampled so the Hi-Z culler can build its depth pyramid straight from the depth buffer.
+	mDepthImage = new VImage(mDevice, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
 		VK_IMAGE_ASPECT_DEPTH_BIT, VK_SAMPLE_COUNT_1_BIT, "bleh", mSwapChainExtent);
 }
 
@@ -4,6 +4,8 @@
 #include "DataStructures.h"
 #include "VDevice.h"
 #include "../../ThirdParty/vk_mem_alloc.h"
+#include "VMemoryTracker.h"
+#include "VMemoryPools.h"
 
 
 namespace VHF {
@@ -36,7 +38,9 @@ namespace VHF {
 			);
 		}
 
-		static AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VDevice device) {
+		// Tracked under category and allocated from its default memory class. Untrack it before destroying it.
+		static AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VDevice& device,
+			MemoryCategory category = MemoryCategory::Other) {
 			VkBufferCreateInfo bufferInfo{};
 			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 			bufferInfo.size = allocSize;
@@ -45,11 +49,13 @@ namespace VHF {
 			// Let the VMA library know that this data should be writeable by the CPU, but also readable by GPU
 			VmaAllocationCreateInfo vmaInfo{};
 			vmaInfo.usage = memoryUsage;
+			VMemoryTracker::tag(vmaInfo, category);
 
 			AllocatedBuffer newBuffer;
 
-			if (vmaCreateBuffer(device.mAllocator, &bufferInfo, &vmaInfo, &newBuffer.mBuffer, &newBuffer.mAlloc, nullptr) != VK_SUCCESS)
+			if (device.mMemoryPools->createBuffer(bufferInfo, vmaInfo, getDefaultMemoryClass(category), newBuffer.mBuffer, newBuffer.mAlloc) != VK_SUCCESS)
 				CORE_ERROR("Error: Failed to create buffer.");
+			device.mMemoryTracker->track(newBuffer.mAlloc, category);
 
 			return newBuffer;
 		}
@@ -0,0 +1,466 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <thread>
+
+namespace {
+	const size_t TAG_COUNT = static_cast<size_t>(AllocationTag::Count);
+
+	std::atomic<uint64_t> gAllocations{ 0 };
+	std::atomic<uint64_t> gFrees{ 0 };
+	std::atomic<uint64_t> gBytes{ 0 };
+	std::atomic<uint32_t> gFrame{ 0 };
+	thread_local AllocationTag tTag = AllocationTag::Untagged;
+	// Plain counters, only ever touched by their own thread.
+	thread_local AllocationCounts tCounts;
+
+#ifdef SPX_TRACK_ALLOCATIONS
+	struct AllocationHeader {
+		AllocationHeader* mPrev;
+		AllocationHeader* mNext;
+		uint64_t mSize;
+		uint32_t mFrame;
+		uint16_t mTag;
+		// False for what the leak report allocates while it walks the lists. Counted, but never in a list.
+		bool mListed;
+	};
+	// The pointer handed out is right after the header, so it has to keep malloc's alignment.
+	static_assert(sizeof(AllocationHeader) % alignof(std::max_align_t) == 0, "The header would misalign allocations.");
+
+	struct alignas(64) LiveList {
+		std::atomic<bool> mLocked{ false };
+		AllocationHeader* mHead{ nullptr };
+
+		void lock() {
+			while (mLocked.exchange(true, std::memory_order_acquire)) {
+				while (mLocked.load(std::memory_order_relaxed))
+					std::this_thread::yield();
+			}
+		}
+		void unlock() { mLocked.store(false, std::memory_order_release); }
+	};
+
+	struct TagCounters {
+		std::atomic<uint64_t> mLiveBytes{ 0 };
+		std::atomic<uint64_t> mLiveAllocations{ 0 };
+		std::atomic<uint64_t> mPeakBytes{ 0 };
+		std::atomic<uint64_t> mTotalAllocations{ 0 };
+		std::atomic<uint64_t> mTotalBytes{ 0 };
+		// Only markFrame writes these.
+		std::atomic<uint64_t> mMarkedAllocations{ 0 };
+		std::atomic<uint64_t> mMarkedBytes{ 0 };
+		std::atomic<uint64_t> mFrameAllocations{ 0 };
+		std::atomic<uint64_t> mFrameBytes{ 0 };
+	};
+
+	const size_t LIVE_LIST_COUNT = 64;
+	// Most groups the leak report writes out.
+	const size_t MAX_REPORT_GROUPS = 200;
+
+	LiveList gLiveLists[LIVE_LIST_COUNT];
+	TagCounters gTags[TAG_COUNT];
+	std::atomic<uint64_t> gLiveBytes{ 0 };
+	std::atomic<uint64_t> gPeakBytes{ 0 };
+	// Set while this thread walks the lists, so its own allocations don't wait on a lock it's holding.
+	thread_local bool tUnlisted = false;
+
+	LiveList& getLiveList(const AllocationHeader* header) {
+		// The low bits are the same for every block malloc hands out, a multiplicative hash spreads the rest.
+		uint64_t address = reinterpret_cast<uintptr_t>(header) >> 4;
+		return gLiveLists[(address * 0x9E3779B97F4A7C15ull) >> 58];
+	}
+
+	void raisePeak(std::atomic<uint64_t>& peak, uint64_t value) {
+		uint64_t current = peak.load(std::memory_order_relaxed);
+		while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+	}
+
+	void track(AllocationHeader* header, size_t size) {
+		header->mSize = size;
+		header->mFrame = gFrame.load(std::memory_order_relaxed);
+		header->mTag = static_cast<uint16_t>(tTag);
+		header->mListed = !tUnlisted;
+		header->mPrev = nullptr;
+		header->mNext = nullptr;
+
+		if (header->mListed) {
+			LiveList& list = getLiveList(header);
+			list.lock();
+			header->mNext = list.mHead;
+			if (list.mHead)
+				list.mHead->mPrev = header;
+			list.mHead = header;
+			list.unlock();
+		}
+
+		TagCounters& counters = gTags[header->mTag];
+		counters.mTotalAllocations.fetch_add(1, std::memory_order_relaxed);
+		counters.mTotalBytes.fetch_add(size, std::memory_order_relaxed);
+		counters.mLiveAllocations.fetch_add(1, std::memory_order_relaxed);
+		raisePeak(counters.mPeakBytes, counters.mLiveBytes.fetch_add(size, std::memory_order_relaxed) + size);
+		raisePeak(gPeakBytes, gLiveBytes.fetch_add(size, std::memory_order_relaxed) + size);
+	}
+
+	void untrack(AllocationHeader* header) {
+		if (header->mListed) {
+			LiveList& list = getLiveList(header);
+			list.lock();
+			if (header->mPrev)
+				header->mPrev->mNext = header->mNext;
+			else
+				list.mHead = header->mNext;
+			if (header->mNext)
+				header->mNext->mPrev = header->mPrev;
+			list.unlock();
+		}
+
+		// The tag it was made under, not the one open now.
+		TagCounters& counters = gTags[header->mTag];
+		counters.mLiveAllocations.fetch_sub(1, std::memory_order_relaxed);
+		counters.mLiveBytes.fetch_sub(header->mSize, std::memory_order_relaxed);
+		gLiveBytes.fetch_sub(header->mSize, std::memory_order_relaxed);
+	}
+#endif
+
+	void* countedAllocate(size_t size) {
+		gAllocations.fetch_add(1, std::memory_order_relaxed);
+		gBytes.fetch_add(size, std::memory_order_relaxed);
+		tCounts.mAllocations++;
+		tCounts.mBytes += size;
+#ifdef SPX_TRACK_ALLOCATIONS
+		AllocationHeader* header = static_cast<AllocationHeader*>(std::malloc(sizeof(AllocationHeader) + size));
+		if (!header)
+			return nullptr;
+		track(header, size);
+		return header + 1;
+#else
+		// malloc(0) can return null, new never can.
+		return std::malloc(size ? size : 1);
+#endif
+	}
+
+	void countedFree(void* ptr) {
+		if (!ptr)
+			return;
+		gFrees.fetch_add(1, std::memory_order_relaxed);
+		tCounts.mFrees++;
+#ifdef SPX_TRACK_ALLOCATIONS
+		AllocationHeader* header = static_cast<AllocationHeader*>(ptr) - 1;
+		untrack(header);
+		std::free(header);
+#else
+		std::free(ptr);
+#endif
+	}
+}
+
+const char* getAllocationTagName(AllocationTag tag) {
+	switch (tag) {
+	case AllocationTag::Untagged:		return "Untagged";
+	case AllocationTag::Engine:			return "Engine";
+	case AllocationTag::Renderer:		return "Renderer";
+	case AllocationTag::Meshes:			return "Meshes";
+	case AllocationTag::Textures:		return "Textures";
+	case AllocationTag::RenderGraph:	return "RenderGraph";
+	case AllocationTag::Culling:		return "Culling";
+	case AllocationTag::Jobs:			return "Jobs";
+	case AllocationTag::Events:			return "Events";
+	case AllocationTag::Profiling:		return "Profiling";
+	case AllocationTag::Benchmark:		return "Benchmark";
+	default:							return "Unknown";
+	}
+}
+
+AllocationCounts AllocationCounter::getCounts() {
+	AllocationCounts counts;
+	counts.mAllocations = gAllocations.load(std::memory_order_relaxed);
+	counts.mFrees = gFrees.load(std::memory_order_relaxed);
+	counts.mBytes = gBytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+AllocationCounts AllocationCounter::getThreadCounts() {
+	return tCounts;
+}
+
+bool AllocationCounter::isTracking() {
+#ifdef SPX_TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+AllocationTagStats AllocationCounter::getTagStats(AllocationTag tag) {
+	AllocationTagStats stats;
+#ifdef SPX_TRACK_ALLOCATIONS
+	const TagCounters& counters = gTags[static_cast<size_t>(tag)];
+	stats.mLiveBytes = counters.mLiveBytes.load(std::memory_order_relaxed);
+	stats.mLiveAllocations = counters.mLiveAllocations.load(std::memory_order_relaxed);
+	stats.mPeakBytes = counters.mPeakBytes.load(std::memory_order_relaxed);
+	stats.mTotalAllocations = counters.mTotalAllocations.load(std::memory_order_relaxed);
+	stats.mTotalBytes = counters.mTotalBytes.load(std::memory_order_relaxed);
+	stats.mFrameAllocations = counters.mFrameAllocations.load(std::memory_order_relaxed);
+	stats.mFrameBytes = counters.mFrameBytes.load(std::memory_order_relaxed);
+#endif
+	return stats;
+}
+
+uint64_t AllocationCounter::getLiveBytes() {
+#ifdef SPX_TRACK_ALLOCATIONS
+	return gLiveBytes.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+
+uint64_t AllocationCounter::getPeakBytes() {
+#ifdef SPX_TRACK_ALLOCATIONS
+	return gPeakBytes.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+
+AllocationTag AllocationCounter::getThreadTag() {
+	return tTag;
+}
+
+void AllocationCounter::setThreadTag(AllocationTag tag) {
+	tTag = tag;
+}
+
+void AllocationCounter::markFrame() {
+#ifdef SPX_TRACK_ALLOCATIONS
+	for (auto& counters : gTags) {
+		uint64_t allocations = counters.mTotalAllocations.load(std::memory_order_relaxed);
+		uint64_t bytes = counters.mTotalBytes.load(std::memory_order_relaxed);
+		counters.mFrameAllocations.store(allocations - counters.mMarkedAllocations.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		counters.mFrameBytes.store(bytes - counters.mMarkedBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		counters.mMarkedAllocations.store(allocations, std::memory_order_relaxed);
+		counters.mMarkedBytes.store(bytes, std::memory_order_relaxed);
+	}
+#endif
+	gFrame.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t AllocationCounter::getFrameNumber() {
+	return gFrame.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::logStats() {
+	if (!isTracking()) {
+		AllocationCounts counts = getCounts();
+		CORE_TRACE("CPU allocations: {} made, {} freed, {:.1f} MB requested.", counts.mAllocations, counts.mFrees,
+			counts.mBytes / 1048576.0);
+		return;
+	}
+
+	std::string live;
+	std::string frame;
+	uint64_t frameAllocations = 0;
+	for (size_t i = 0; i < TAG_COUNT; i++) {
+		AllocationTag tag = static_cast<AllocationTag>(i);
+		AllocationTagStats stats = getTagStats(tag);
+		if (stats.mLiveAllocations > 0) {
+			live += (live.empty() ? "" : ", ") + std::string(getAllocationTagName(tag)) + " " +
+				std::to_string(stats.mLiveBytes / 1024) + " KB (" + std::to_string(stats.mLiveAllocations) + ")";
+		}
+		if (stats.mFrameAllocations > 0) {
+			frame += (frame.empty() ? "" : ", ") + std::string(getAllocationTagName(tag)) + " " + std::to_string(stats.mFrameAllocations);
+			frameAllocations += stats.mFrameAllocations;
+		}
+	}
+	CORE_TRACE("CPU memory by subsystem: {}.", live);
+	CORE_TRACE("CPU memory {:.1f} MB live, {:.1f} MB peak. Last frame made {} allocations{}{}.", getLiveBytes() / 1048576.0,
+		getPeakBytes() / 1048576.0, frameAllocations, frame.empty() ? "" : ": ", frame);
+}
+
+bool AllocationCounter::writeLeakReport(const std::string& file) {
+#ifndef SPX_TRACK_ALLOCATIONS
+	CORE_WARN("Allocation leak report: built without SPX_TRACK_ALLOCATIONS, nothing was tracked.");
+	return false;
+#else
+	struct LiveAllocation {
+		uint64_t mSize;
+		uint32_t mFrame;
+		uint16_t mTag;
+	};
+	struct Group {
+		uint16_t mTag{ 0 };
+		uint64_t mSize{ 0 };
+		uint64_t mCount{ 0 };
+		uint32_t mFirstFrame{ UINT32_MAX };
+		uint32_t mLastFrame{ 0 };
+	};
+
+	// Nothing this thread allocates from here on goes in a list. The lists are locked one at a time while they're walked,
+	// and growing the vector mid walk would otherwise wait on the lock this thread holds.
+	tUnlisted = true;
+
+	uint64_t liveAllocations = 0;
+	for (const auto& counters : gTags)
+		liveAllocations += counters.mLiveAllocations.load(std::memory_order_relaxed);
+	std::vector<LiveAllocation> live;
+	live.reserve(liveAllocations + 1024);
+	for (auto& list : gLiveLists) {
+		list.lock();
+		for (AllocationHeader* header = list.mHead; header; header = header->mNext)
+			live.push_back({ header->mSize, header->mFrame, header->mTag });
+		list.unlock();
+	}
+
+	// Lots of allocations of one size from one subsystem are usually the same thing, so they're reported together.
+	// Startup (frame 0) is only counted. Init makes plenty the renderer never hands back before exit, listing it would
+	// bury the allocations that outlived the frame that made them.
+	std::map<std::pair<uint16_t, uint64_t>, Group> groupMap;
+	std::array<uint64_t, TAG_COUNT> tagBytes{}, tagCounts{}, tagRuntimeBytes{}, tagRuntimeCounts{};
+	uint64_t totalBytes = 0, runtimeBytes = 0, runtimeCount = 0;
+	for (const LiveAllocation& allocation : live) {
+		tagBytes[allocation.mTag] += allocation.mSize;
+		tagCounts[allocation.mTag]++;
+		totalBytes += allocation.mSize;
+		if (allocation.mFrame == 0)
+			continue;
+
+		Group& group = groupMap[{ allocation.mTag, allocation.mSize }];
+		group.mTag = allocation.mTag;
+		group.mSize = allocation.mSize;
+		group.mCount++;
+		group.mFirstFrame = std::min(group.mFirstFrame, allocation.mFrame);
+		group.mLastFrame = std::max(group.mLastFrame, allocation.mFrame);
+
+		tagRuntimeBytes[allocation.mTag] += allocation.mSize;
+		tagRuntimeCounts[allocation.mTag]++;
+		runtimeBytes += allocation.mSize;
+		runtimeCount++;
+	}
+
+	// Biggest total first.
+	std::vector<Group> groups;
+	groups.reserve(groupMap.size());
+	for (const auto& entry : groupMap)
+		groups.push_back(entry.second);
+	std::sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) { return a.mSize * a.mCount > b.mSize * b.mCount; });
+
+	std::ofstream out(file);
+	if (!out.is_open()) {
+		CORE_ERROR("Couldn't open {} to write the allocation leak report.", file);
+		tUnlisted = false;
+		return false;
+	}
+
+	out << "{\n  \"frames\": " << getFrameNumber() << ",\n";
+	out << "  \"liveAllocations\": " << live.size() << ",\n  \"liveBytes\": " << totalBytes << ",\n";
+	out << "  \"peakBytes\": " << getPeakBytes() << ",\n";
+	out << "  \"runtimeAllocations\": " << runtimeCount << ",\n  \"runtimeBytes\": " << runtimeBytes << ",\n";
+	out << "  \"tags\": {\n";
+	for (size_t i = 0; i < TAG_COUNT; i++) {
+		out << "    \"" << getAllocationTagName(static_cast<AllocationTag>(i)) << "\": { \"liveAllocations\": " << tagCounts[i]
+			<< ", \"liveBytes\": " << tagBytes[i] << ", \"peakBytes\": " << gTags[i].mPeakBytes.load(std::memory_order_relaxed)
+			<< ", \"runtimeAllocations\": " << tagRuntimeCounts[i] << ", \"runtimeBytes\": " << tagRuntimeBytes[i] << " }"
+			<< (i + 1 < TAG_COUNT ? "," : "") << "\n";
+	}
+	out << "  },\n  \"groups\": [\n";
+	size_t groupCount = std::min(groups.size(), MAX_REPORT_GROUPS);
+	for (size_t i = 0; i < groupCount; i++) {
+		const Group& group = groups[i];
+		out << "    { \"tag\": \"" << getAllocationTagName(static_cast<AllocationTag>(group.mTag)) << "\", \"size\": " << group.mSize
+			<< ", \"count\": " << group.mCount << ", \"firstFrame\": "
+			<< group.mFirstFrame << ", \"lastFrame\": " << group.mLastFrame << " }" << (i + 1 < groupCount ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+
+	CORE_INFO("Wrote the allocation leak report to {}: {} allocations ({:.1f} MB) still live, {} of them from startup.", file,
+		live.size(), totalBytes / 1048576.0, live.size() - runtimeCount);
+	if (runtimeCount > 0)
+		CORE_WARN("{} of the live allocations ({:.1f} MB) were made after the first frame.", runtimeCount, runtimeBytes / 1048576.0);
+
+	tUnlisted = false;
+	return true;
+#endif
+}
+
+void* AllocationCounter::allocateMemory(size_t size) {
+	return countedAllocate(size);
+}
+
+void* AllocationCounter::reallocateMemory(void* ptr, size_t size) {
+	if (!ptr)
+		return countedAllocate(size);
+	if (size == 0) {
+		countedFree(ptr);
+		return nullptr;
+	}
+
+#ifdef SPX_TRACK_ALLOCATIONS
+	// A new block and a copy, the header has to be tracked again wherever it ends up anyway.
+	void* moved = countedAllocate(size);
+	if (!moved)
+		return nullptr;
+	std::memcpy(moved, ptr, std::min<uint64_t>(size, (static_cast<AllocationHeader*>(ptr) - 1)->mSize));
+	countedFree(ptr);
+	return moved;
+#else
+	// Counted as the old block freed and a new one made, whether or not it moved.
+	gAllocations.fetch_add(1, std::memory_order_relaxed);
+	gFrees.fetch_add(1, std::memory_order_relaxed);
+	gBytes.fetch_add(size, std::memory_order_relaxed);
+	tCounts.mAllocations++;
+	tCounts.mFrees++;
+	tCounts.mBytes += size;
+	return std::realloc(ptr, size);
+#endif
+}
+
+void AllocationCounter::freeMemory(void* ptr) {
+	countedFree(ptr);
+}
+
+// The replacements. Only the plain and nothrow forms, over aligned types still use the default ones.
+void* operator new(size_t size) {
+	void* ptr = countedAllocate(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size) {
+	void* ptr = countedAllocate(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return countedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return countedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	countedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	countedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	countedFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+	countedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+	countedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+	countedFree(ptr);
+}
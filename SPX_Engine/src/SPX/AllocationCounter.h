@@ -0,0 +1,129 @@
+#pragma once
+
+#include "../pch.h"
+
+// ******************************************************************************************************************************
+//														ALLOCATION COUNTER
+// Global operator new and delete are replaced so every heap allocation the program makes is counted, including the ones
+// inside the standard library and third party code. The counters are relaxed atomics, so it costs about as much as the
+// allocation's own bookkeeping and can stay on all the time.
+//
+// To count what some code allocates, take the counts before and after and subtract them. getCounts includes other threads
+// allocating at the same time, getThreadCounts only has the calling thread.
+//
+// With SPX_TRACK_ALLOCATIONS (defined in the Debug configurations only) it also keeps track of where the memory is:
+//   - Every allocation gets a 32 byte header in front of it with its size, the subsystem that made it and the frame it
+//     was made in. The subsystem is whatever AllocationScope is open on the allocating thread (jobs inherit the scope
+//     of the thread that scheduled them). Frees look at the header, so they go back to the right subsystem.
+//   - Live bytes, live allocations and the peak are kept per subsystem and overall. markFrame() once a frame turns the
+//     running totals into per frame counts.
+//   - Every live allocation is in one of 64 lists picked by its address, each with its own spin lock, so two threads
+//     rarely touch the same one. writeLeakReport walks them once the engine is destroyed. Everything still allocated is
+//     counted per subsystem, but only what was made after the first frame is listed, grouped by subsystem and size.
+//     Startup allocations the renderer never frees are expected, ones made while running shouldn't outlive the engine.
+// That's a lock, a few more relaxed atomics and 32 bytes per allocation, fine for Debug or a staging build that adds the
+// define, but not free. Without it the header, scopes and lists are compiled out and only the totals above are kept.
+//
+// Third party code that takes malloc style hooks (stb_image's STBI_MALLOC) can use allocateMemory, reallocateMemory and
+// freeMemory so its allocations are tracked too.
+// ******************************************************************************************************************************
+
+enum class AllocationTag : uint16_t {
+	Untagged,
+	Engine,
+	Renderer,
+	Meshes,
+	Textures,
+	RenderGraph,
+	Culling,
+	Jobs,
+	Events,
+	Profiling,
+	Benchmark,
+	Count
+};
+
+const char* getAllocationTagName(AllocationTag tag);
+
+struct AllocationCounts {
+	uint64_t mAllocations{ 0 };
+	uint64_t mFrees{ 0 };
+	// Bytes requested by every allocation. Frees don't know their size, so this only ever goes up.
+	uint64_t mBytes{ 0 };
+
+	AllocationCounts operator-(const AllocationCounts& other) const {
+		return { mAllocations - other.mAllocations, mFrees - other.mFrees, mBytes - other.mBytes };
+	}
+};
+
+// One subsystem. Everything but the totals is 0 without SPX_TRACK_ALLOCATIONS.
+struct AllocationTagStats {
+	uint64_t mLiveBytes{ 0 };
+	uint64_t mLiveAllocations{ 0 };
+	// Most live bytes at any one time.
+	uint64_t mPeakBytes{ 0 };
+	// Since the program started.
+	uint64_t mTotalAllocations{ 0 };
+	uint64_t mTotalBytes{ 0 };
+	// Between the last two markFrame calls.
+	uint64_t mFrameAllocations{ 0 };
+	uint64_t mFrameBytes{ 0 };
+};
+
+class AllocationCounter {
+public:
+	// Totals since the program started.
+	static AllocationCounts getCounts();
+	// The same, but only what the calling thread allocated and freed. Other threads allocating at the same time don't show up.
+	static AllocationCounts getThreadCounts();
+
+	// True when built with SPX_TRACK_ALLOCATIONS.
+	static bool isTracking();
+	static AllocationTagStats getTagStats(AllocationTag tag);
+	static uint64_t getLiveBytes();
+	static uint64_t getPeakBytes();
+
+	// The subsystem the calling thread's allocations are put under. AllocationScope sets it.
+	static AllocationTag getThreadTag();
+	static void setThreadTag(AllocationTag tag);
+
+	// Ends a frame: the per frame counts become everything since the last call, and allocations after this are stamped
+	// with the next frame number. Call it from one thread only, once a frame.
+	static void markFrame();
+	static uint32_t getFrameNumber();
+
+	// One line of live memory per subsystem, the peak, and what the last frame allocated.
+	static void logStats();
+	// Live memory per subsystem and every allocation made after the first frame that's still live, as JSON. Returns false
+	// without SPX_TRACK_ALLOCATIONS or if the file couldn't be opened.
+	static bool writeLeakReport(const std::string& file);
+
+	// malloc, realloc and free, but counted and tagged like new and delete.
+	static void* allocateMemory(size_t size);
+	static void* reallocateMemory(void* ptr, size_t size);
+	static void freeMemory(void* ptr);
+};
+
+// Puts everything the thread allocates until the end of the scope under tag, then goes back to the tag before it.
+class AllocationScope {
+public:
+	AllocationScope(AllocationTag tag)
+		:mPrevious(AllocationCounter::getThreadTag()) {
+		AllocationCounter::setThreadTag(tag);
+	}
+	~AllocationScope() {
+		AllocationCounter::setThreadTag(mPrevious);
+	}
+
+private:
+	AllocationTag mPrevious;
+};
+
+#define SPX_ALLOCATION_CONCAT_INNER(a, b) a##b
+#define SPX_ALLOCATION_CONCAT(a, b) SPX_ALLOCATION_CONCAT_INNER(a, b)
+
+#ifdef SPX_TRACK_ALLOCATIONS
+	#define SPX_ALLOCATION_SCOPE(tag) AllocationScope SPX_ALLOCATION_CONCAT(allocationScope, __LINE__)(tag)
+#else
+	#define SPX_ALLOCATION_SCOPE(tag)
+#endif
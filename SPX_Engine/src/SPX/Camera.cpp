@@ -18,7 +18,7 @@ Camera::Camera() {
 
 Camera::~Camera() {}
 
-void Camera::handleEvents(std::vector<Event*> events) {
+void Camera::handleEvents(const std::vector<Event*>& events) {
 	for (size_t i = 0; i < events.size(); i++) {
 		if (events.at(i)->getType() == EventType::KeyPressed) {
 			if (events.at(i)->getKeycode() == GLFW_KEY_D) {
@@ -78,6 +78,12 @@ void Camera::updateCamera()
 	mView = glm::lookAt(mCameraPos, glm::vec3(0.0f, 0.0f, 0.0f), mUp);
 }
 
+void Camera::setLookAt(const glm::vec3& position, const glm::vec3& target) {
+	mCameraPos = position;
+	mCameraTarget = target;
+	mView = glm::lookAt(mCameraPos, mCameraTarget, mUp);
+}
+
 glm::mat4 Camera::getViewMatrix() {
 	return mView;
 }
\ No newline at end of file
@@ -11,8 +11,10 @@ public:
 	~Camera();
 
 	void updateCamera();
-	void handleEvents(std::vector<Event*> events);
+	void handleEvents(const std::vector<Event*>& events);
 	glm::mat4 getViewMatrix();
+	// Places the camera directly, for scripted paths. The next updateCamera goes back to looking at the origin.
+	void setLookAt(const glm::vec3& position, const glm::vec3& target);
 
 
 	glm::vec4 mCameraTransformMatrix;
@@ -4,66 +4,232 @@
 #include "../Renderer/VulkanRenderer.h"
 #include "../Renderer/RenderObject.h"
 #include "Camera.h"
+#include "JobSystem.h"
+#include "FrameSnapshot.h"
+#include "FramePacer.h"
+#include "Profiler.h"
+#include "AllocationCounter.h"
 #define VMA_IMPLEMENTATION
 #include "../ThirdParty/vk_mem_alloc.h"
 #include <GLFW/glfw3.h>
-#include <chrono>
 #include <thread>
 
 
-Engine::Engine(uint32_t width, uint32_t height, std::string title)
-	:mWindow(Window(width, height, title)), mRenderer(new VulkanRenderer(&mWindow)), mCamera(new Camera()) {}
+Engine::Engine(uint32_t width, uint32_t height, std::string title, bool headless)
+	:mWindow(headless ? nullptr : new Window(width, height, title)), mJobSystem(new JobSystem()),
+	mRenderer(new VulkanRenderer(mWindow, mJobSystem)), mCamera(new Camera()) {
+	SPX_ALLOCATION_SCOPE(AllocationTag::Engine);
+	mFramePacer = new FramePacer(144.0);
+	mRenderer->mFramePacer = mFramePacer;
+	mRenderer->mHeadlessExtent = { width, height };
+}
 
-Engine::~Engine() {}
+Engine::~Engine() {
+	// run has already shut the renderer down, so the GPU is done with everything. The renderer goes first since it holds
+	// the window, job system and pacer. Deleting the job system runs whatever is still queued and joins the workers.
+	delete mRenderer;
+	delete mJobSystem;
+	delete mFramePacer;
+	delete mCamera;
+	delete mWindow;
+}
 
 void Engine::init() {
+	loadDefaultScene();
+	initRenderer();
+}
+
+void Engine::loadDefaultScene() {
+	SPX_ALLOCATION_SCOPE(AllocationTag::Engine);
+	// This code is to set their intial model or local position.
 	RenderObject tmp("Media/Obj/chalet.obj", "Media/Textures/chalet.jpg");
+	glm::vec3 rotation1 = glm::vec3(0.0f, 0.0f, -1.0f);
+	glm::mat4 modelMatrix1 = glm::mat4(1.0f);
+	glm::mat4 currentTransform1 = glm::rotate(modelMatrix1, glm::radians(90.0f), rotation1);
+	rotation1 = glm::vec3(0.0f, 1.0f, 0.0f);
+	currentTransform1 = glm::rotate(currentTransform1, glm::radians(90.0f), rotation1);
+	glm::vec3 move1 = glm::vec3(0.0f, -1.5f, 0.0f);
+	currentTransform1 = glm::translate(currentTransform1, move1);
+	tmp.mTransformMatrix = currentTransform1;
+	// Both models are big enough to hide a lot behind them, so they're drawn into the occlusion buffer too.
+	tmp.mIsOccluder = true;
 	mRenderer->addRenderObject(tmp);
+
 	tmp = RenderObject("Media/Obj/viking.obj", "Media/Textures/viking.png");
+	glm::vec3 scale = glm::vec3(0.05f, 0.05f, 0.05f);
+	glm::mat4 modelMatrix = glm::mat4(1.0f);
+	glm::mat4 currentTransform = glm::scale(modelMatrix, scale);
+	glm::vec3 rotation = glm::vec3(1.0f, 0.0f, 0.0f);
+	currentTransform = glm::rotate(currentTransform, glm::radians(180.0f), rotation);
+	rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+	currentTransform = glm::rotate(currentTransform, glm::radians(180.0f), rotation);
+	glm::vec3 move = glm::vec3(-30.0f, 5.0f, 10.0f);
+	currentTransform = glm::translate(currentTransform, move);
+	tmp.mTransformMatrix = currentTransform;
+	tmp.mIsOccluder = true;
 	mRenderer->addRenderObject(tmp);
+}
+
+void Engine::initRenderer() {
+	SPX_PROFILE_FUNCTION();
 	mRenderer->init("Test App", "SPX_ENGINE", true);
+	mObjectTransforms = mRenderer->getObjectTransforms();
 }
 
 void Engine::run() {
-	// Find cleaner wait to limit the fps. This works for now to prevent excessive loops and placing strain on the GPU.
-	std::chrono::time_point<std::chrono::system_clock> start, end = std::chrono::system_clock::now();
-	std::chrono::duration<double, std::milli> passedTime;
-	
-	while (!glfwWindowShouldClose(mWindow.getContext())) {
-		// Frame limiter
-		start = std::chrono::system_clock::now();
-		passedTime = end - start;
-		// 7ms =~ 144 fps
-		if (passedTime.count() < 7) {
-			std::chrono::duration<double, std::milli> deltaMs(7 - passedTime.count());
-			auto deltaMsDuration = std::chrono::duration_cast<std::chrono::milliseconds>(deltaMs);
-			std::this_thread::sleep_for(std::chrono::milliseconds(deltaMsDuration.count()));
+	if (mPipelinedRendering)
+		runPipelined();
+	else
+		runSerial();
+
+	// Nothing can be destroyed while the GPU is still using it.
+	mRenderer->shutdown();
+}
+
+bool Engine::shouldClose() const {
+	if (mFrameLimit != 0 && mFrameCount >= mFrameLimit)
+		return true;
+	return mWindow && glfwWindowShouldClose(mWindow->getContext());
+}
+
+void Engine::runSerial() {
+	while (!shouldClose()) {
+		{
+			SPX_PROFILE_ZONE("Frame");
+			mFramePacer->beginFrame();
+			mFrameCount++;
+
+			// Actual engine code.
+			{
+				SPX_PROFILE_ZONE("Events");
+				if (mWindow)
+					mWindow->pollEvents();
+				handleEvents();
+			}
+			{
+				SPX_PROFILE_ZONE("Update");
+				update();
+			}
+			{
+				SPX_PROFILE_ZONE("Render");
+				mRenderer->draw(mCamera->getViewMatrix());
+			}
+
+			SPX_PROFILE_ZONE("Pace");
+			mFramePacer->endFrame();
 		}
-		end = std::chrono::system_clock::now();	
-		// End frame limiter code
+		SPX_PROFILE_COLLECT();
+		AllocationCounter::markFrame();
+	}
+}
+
+void Engine::runPipelined() {
+	mSnapshotQueue = new FrameSnapshotQueue(mSnapshotDepth);
+	CORE_INFO("Pipelined rendering with {} frame snapshots.", mSnapshotQueue->getDepth());
+
+	std::thread renderThread(&Engine::renderThreadLoop, this);
 
+	auto lastReport = std::chrono::steady_clock::now();
+	uint64_t frameNumber = 0;
 
-		// Actual engine code.
-		mWindow.pollEvents();
-		handleEvents();
-		update();
-		mRenderer->draw(mCamera->getViewMatrix());
+	while (!shouldClose()) {
+		// Paces the update thread. The render thread can't get ahead of it, so that paces the whole pipeline.
+		mFramePacer->beginFrame();
+		mFrameCount++;
+
+		auto updateStart = std::chrono::steady_clock::now();
+		{
+			SPX_PROFILE_ZONE("Events");
+			if (mWindow)
+				mWindow->pollEvents();
+			handleEvents();
+		}
+		{
+			SPX_PROFILE_ZONE("Update");
+			update();
+		}
+		mUpdateTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - updateStart).count();
+		mUpdatedFrames++;
+
+		// Blocks when the render thread is a full queue behind, which keeps the update thread from running away.
+		FrameSnapshot* snapshot;
+		{
+			SPX_PROFILE_ZONE("Wait for snapshot");
+			snapshot = mSnapshotQueue->beginWrite();
+		}
+		if (!snapshot)
+			break;
+		snapshot->mFrameNumber = frameNumber++;
+		snapshot->mViewMatrix = mCamera->getViewMatrix();
+		snapshot->mObjectTransforms = mObjectTransforms;
+		mSnapshotQueue->endWrite();
+		{
+			SPX_PROFILE_ZONE("Pace");
+			mFramePacer->endFrame();
+		}
+		// The update thread collects for every thread, the render thread included. It ends the allocation frame for
+		// both too, so a frame's counts are one update and whatever the render thread did meanwhile.
+		SPX_PROFILE_COLLECT();
+		AllocationCounter::markFrame();
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastReport >= std::chrono::seconds(1)) {
+			uint32_t updated = std::max(1u, mUpdatedFrames.exchange(0));
+			uint32_t rendered = mRenderedFrames.exchange(0);
+			double updateMs = mUpdateTimeNs.exchange(0) / 1000000.0 / updated;
+			double renderMs = mRenderTimeNs.exchange(0) / 1000000.0 / std::max(1u, rendered);
+			CORE_TRACE("Pipelined frame: update {:.3f} ms, render {:.3f} ms, {} frames rendered.", updateMs, renderMs, rendered);
+			lastReport = now;
+		}
+	}
+
+	// The render thread draws the snapshots that are already published, then sees the shutdown and returns.
+	mSnapshotQueue->shutdown();
+	renderThread.join();
+
+	delete mSnapshotQueue;
+	mSnapshotQueue = nullptr;
+}
+
+void Engine::renderThreadLoop() {
+	SPX_PROFILE_THREAD("Render thread");
+	while (FrameSnapshot* snapshot = mSnapshotQueue->beginRead()) {
+		auto renderStart = std::chrono::steady_clock::now();
+		{
+			SPX_PROFILE_ZONE("Render");
+			mRenderer->draw(*snapshot);
+		}
+		mSnapshotQueue->endRead();
+
+		mRenderTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - renderStart).count();
+		mRenderedFrames++;
 	}
 }
 
 // Update this over time with more events. (These events are the events the engine wants to handle.
 // The rest it sends to other objects to handle the events as they want.
 void Engine::handleEvents() {
-	for (size_t i = 0; i < mWindow.mEventsQueue.size(); i++) {
-		// Delete handled events. This may change later depending on if multiple objects want to handle the event before it is deleted.
-		if (mWindow.mEventsQueue.at(i)->getIsHandled()) {
-			mWindow.mEventsQueue.erase(mWindow.mEventsQueue.begin() + i);
+	// No window, no events.
+	if (!mWindow)
+		return;
+
+	for (Event* event : mWindow->mEventsQueue) {
+		// Events I want the engine to specifically handle.
+		// M writes the GPU memory map and F defragments GPU memory. The renderer does both on its next draw,
+		// whichever thread that's on.
+		if (event->getType() == EventType::KeyPressed && event->getKeycode() == GLFW_KEY_M) {
+			mRenderer->requestMemoryDump();
+			event->setIsHandled(true);
 		}
-		else {
-			// Events I want the engine to specifically handle.
+		else if (event->getType() == EventType::KeyPressed && event->getKeycode() == GLFW_KEY_F) {
+			mRenderer->requestDefragmentation();
+			event->setIsHandled(true);
 		}
 	}
-	mCamera->handleEvents(mWindow.mEventsQueue);
+	mCamera->handleEvents(mWindow->mEventsQueue);
+
+	// Everything has seen this frame's events, handled or not. They're only ever a frame's worth, so they don't pile up.
+	mWindow->clearEvents();
 }
 
 // This is used to update any number of things.
@@ -3,26 +3,73 @@
 // This class is the control class. It runs and intializes everything.
 #include "../pch.h"
 #include "Window.h"
+#include <atomic>
 
 class VulkanRenderer;
 class Camera;
+class JobSystem;
+class FrameSnapshotQueue;
+class FramePacer;
 
 class Engine {
 public:
 	// Currently allowing for dynamic creation of window from intializing the engine class.
 	// Later it will have to be implicitly called to create the window and give the user
 	// better control.
-	Engine(uint32_t width, uint32_t height, std::string title);
+	// Headless skips GLFW and the window entirely and renders width x height offscreen. Set mFrameLimit too, there's
+	// no window to close.
+	Engine(uint32_t width, uint32_t height, std::string title, bool headless = false);
+	// Deletes the window, job system, renderer, camera and pacer. Shut the renderer down first (run does).
 	~Engine();
+	// Loads the default scene and initializes the renderer.
 	void init();
+	// The two models the engine has always opened with.
+	void loadDefaultScene();
+	// Everything added to the renderer so far is loaded. Call this instead of init to use a different scene.
+	void initRenderer();
 	void run();
 	void handleEvents();
 	void update();
 
-	Window mWindow;
+	// Pipelined mode runs the renderer on its own thread. The update thread simulates frame N+1 while the render thread
+	// draws frame N, so a frame costs max(update, render) instead of update + render. Set both before run.
+	bool mPipelinedRendering{ true };
+	// How many frame snapshots exist at once, 2 (double buffered) to 4. Each one past 2 adds a frame of latency.
+	uint32_t mSnapshotDepth{ 2 };
+
+	// Caps the update loop. mFramePacer->setTargetFrameRate(0) uncaps it.
+	FramePacer* mFramePacer;
+
+	// Stops after this many frames. 0 runs until the window is closed.
+	uint64_t mFrameLimit{ 0 };
+
+	// The update thread's copy of every render object's transform. The renderer only sees these through snapshots.
+	std::vector<glm::mat4> mObjectTransforms;
+
+	// nullptr when headless.
+	Window* mWindow;
+	// Declared before the renderer since the renderer is handed the job system when it's created.
+	JobSystem* mJobSystem;
 	VulkanRenderer* mRenderer;
 	Camera* mCamera;
 
 private:
+	bool shouldClose() const;
+
+	// Everything on the main thread, update then draw.
+	void runSerial();
+	// Update on the main thread (GLFW events have to be polled there), draw on a render thread.
+	void runPipelined();
+	void renderThreadLoop();
+
+	FrameSnapshotQueue* mSnapshotQueue{ nullptr };
+
+	// Written by both threads, logged once a second by the update thread.
+	std::atomic<uint64_t> mUpdateTimeNs{ 0 };
+	std::atomic<uint64_t> mRenderTimeNs{ 0 };
+	std::atomic<uint32_t> mUpdatedFrames{ 0 };
+	std::atomic<uint32_t> mRenderedFrames{ 0 };
+	// Frames updated since run started, for mFrameLimit.
+	uint64_t mFrameCount{ 0 };
 };
 
@@ -0,0 +1,58 @@
+#include "FrameArena.h"
+
+FrameArena::FrameArena(size_t capacity, const std::string& name)
+	:mName(name), mCapacity(capacity) {
+	mBlock = static_cast<char*>(::operator new(mCapacity));
+}
+
+FrameArena::~FrameArena() {
+	reset();
+	::operator delete(mBlock);
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+	// Aligned relative to the block, which is aligned to max_align_t like anything from new.
+	size_t offset = mOffset.load(std::memory_order_relaxed);
+	size_t aligned;
+	do {
+		aligned = (offset + alignment - 1) & ~(alignment - 1);
+		if (aligned + size > mCapacity)
+			return allocateOverflow(size, alignment);
+	} while (!mOffset.compare_exchange_weak(offset, aligned + size, std::memory_order_relaxed));
+
+	return mBlock + aligned;
+}
+
+void* FrameArena::allocateOverflow(size_t size, size_t alignment) {
+	// Over aligned types don't come up in frame data, new's alignment is enough.
+	if (alignment > alignof(std::max_align_t))
+		CORE_ERROR("{}: alignment of {} isn't supported for overflow allocations.", mName, alignment);
+
+	void* memory = ::operator new(size);
+	std::lock_guard<std::mutex> lock(mOverflowMutex);
+	mOverflow.push_back(memory);
+	mOverflowBytes += size;
+	mOverflowCount++;
+	return memory;
+}
+
+void FrameArena::reset() {
+	size_t used = getUsedBytes();
+	mHighWaterMark = std::max(mHighWaterMark, used);
+
+	if (!mOverflow.empty()) {
+		for (void* memory : mOverflow)
+			::operator delete(memory);
+		mOverflow.clear();
+		mOverflowBytes = 0;
+
+		// Half as much again so a frame that's a little bigger next time doesn't overflow straight away.
+		size_t capacity = mHighWaterMark + mHighWaterMark / 2;
+		CORE_WARN("{}: a frame needed {} KB, growing it from {} KB to {} KB.", mName, used / 1024, mCapacity / 1024, capacity / 1024);
+		::operator delete(mBlock);
+		mCapacity = capacity;
+		mBlock = static_cast<char*>(::operator new(mCapacity));
+	}
+
+	mOffset.store(0, std::memory_order_relaxed);
+}
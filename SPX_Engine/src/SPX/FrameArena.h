@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../pch.h"
+#include <atomic>
+#include <mutex>
+
+// ******************************************************************************************************************************
+//															FRAME ARENA
+// A linear allocator for memory that only lives for one frame. Allocating bumps an offset into one big block and freeing
+// does nothing. reset() takes the whole frame back at once. The renderer has one per frame in flight and resets it after
+// waiting for that frame's timeline value, so anything a frame hands the GPU or another thread stays valid until then.
+//
+// Allocating is a compare exchange on the offset, so jobs can allocate from the same arena as the thread that owns it.
+// Only reset from the owning thread, and never while something still uses the memory.
+//
+// A frame that doesn't fit gets the rest from the heap. Those allocations are freed at the next reset, and the block
+// grows to the frame's high water mark so the frames after it fit again.
+//
+// FrameAllocator is the standard allocator adapter, so std containers can use the arena. Their destructors and
+// deallocate calls are free, the memory goes back with the reset.
+// ******************************************************************************************************************************
+
+class FrameArena {
+public:
+	FrameArena(size_t capacity = DEFAULT_CAPACITY, const std::string& name = "Frame arena");
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	// Constructs a T in the arena. Its destructor is never called, so only trivially destructible types.
+	template<typename T, typename... Args>
+	T* create(Args&&... args) {
+		static_assert(std::is_trivially_destructible<T>::value, "Frame arena objects are never destroyed.");
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+	// Everything allocated since the last reset is gone.
+	void reset();
+
+	size_t getCapacity() const { return mCapacity; }
+	// Since the last reset, overflow included.
+	size_t getUsedBytes() const { return std::min(mOffset.load(std::memory_order_relaxed), mCapacity) + mOverflowBytes; }
+	// Highest getUsedBytes seen at a reset.
+	size_t getHighWaterMark() const { return mHighWaterMark; }
+	// Heap allocations made because a frame didn't fit, since the arena was made.
+	uint64_t getOverflowCount() const { return mOverflowCount; }
+
+	static const size_t DEFAULT_CAPACITY = 1024 * 1024;
+
+private:
+	void* allocateOverflow(size_t size, size_t alignment);
+
+	std::string mName;
+	char* mBlock{ nullptr };
+	size_t mCapacity{ 0 };
+	std::atomic<size_t> mOffset{ 0 };
+
+	std::mutex mOverflowMutex;
+	std::vector<void*> mOverflow;
+	size_t mOverflowBytes{ 0 };
+	uint64_t mOverflowCount{ 0 };
+	size_t mHighWaterMark{ 0 };
+};
+
+template<typename T>
+class FrameAllocator {
+public:
+	using value_type = T;
+
+	FrameAllocator(FrameArena& arena) noexcept : mArena(&arena) {}
+	template<typename U>
+	FrameAllocator(const FrameAllocator<U>& other) noexcept : mArena(other.mArena) {}
+
+	T* allocate(size_t count) { return static_cast<T*>(mArena->allocate(count * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) noexcept {}
+
+	template<typename U>
+	bool operator==(const FrameAllocator<U>& other) const noexcept { return mArena == other.mArena; }
+	template<typename U>
+	bool operator!=(const FrameAllocator<U>& other) const noexcept { return mArena != other.mArena; }
+
+	FrameArena* mArena;
+};
+
+// The usual per frame container. Reserve what's known up front, growing leaves the old storage behind until the reset.
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -0,0 +1,131 @@
+#include "FramePacer.h"
+#include <immintrin.h>
+#include <thread>
+#include <cmath>
+
+FramePacer::FramePacer(double targetFrameRate) {
+	setTargetFrameRate(targetFrameRate);
+	mNextDeadline = std::chrono::steady_clock::now();
+	mFrameStart = mNextDeadline;
+	mLastReport = mNextDeadline;
+}
+
+void FramePacer::setTargetFrameRate(double targetFrameRate) {
+	mTargetFrameRate = std::max(0.0, targetFrameRate);
+	if (mTargetFrameRate > 0.0)
+		mFramePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / mTargetFrameRate));
+	else
+		mFramePeriod = std::chrono::steady_clock::duration::zero();
+}
+
+void FramePacer::beginFrame() {
+	auto now = std::chrono::steady_clock::now();
+
+	if (mTargetFrameRate > 0.0) {
+		if (mPaceFromFence) {
+			int64_t fenceNs = mLastFenceNs.load(std::memory_order_acquire);
+			if (fenceNs != 0) {
+				std::chrono::steady_clock::time_point fenceTime{ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(fenceNs)) };
+				// Never earlier than the normal schedule, but pushed back when the GPU is the one falling behind.
+				mNextDeadline = std::max(mNextDeadline, fenceTime + mFramePeriod);
+			}
+		}
+
+		// More than a whole frame late (a hitch, a breakpoint). Start the schedule over instead of rushing out
+		// a burst of frames to catch up.
+		if (now > mNextDeadline + mFramePeriod)
+			mNextDeadline = now;
+
+		waitUntil(mNextDeadline);
+		mNextDeadline += mFramePeriod;
+	}
+
+	mFrameStart = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(mHistoryMutex);
+	mWaitTimes.add(std::chrono::duration<double, std::milli>(mFrameStart - now).count());
+}
+
+void FramePacer::endFrame() {
+	auto now = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(mHistoryMutex);
+		mCpuTimes.add(std::chrono::duration<double, std::milli>(now - mFrameStart).count());
+	}
+
+	if (now - mLastReport >= std::chrono::seconds(1)) {
+		FramePacingStats stats = getStats();
+		CORE_TRACE("Frame pacing: cpu p50 {:.3f} / p99 {:.3f} ms, wait p50 {:.3f} / p99 {:.3f} ms, present p50 {:.3f} / p99 {:.3f} ms.",
+			stats.mCpuP50Ms, stats.mCpuP99Ms, stats.mWaitP50Ms, stats.mWaitP99Ms, stats.mPresentP50Ms, stats.mPresentP99Ms);
+		mLastReport = now;
+	}
+}
+
+void FramePacer::notifyFenceComplete(std::chrono::steady_clock::time_point time) {
+	int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	mLastFenceNs.store(ns, std::memory_order_release);
+}
+
+void FramePacer::notifyPresent(std::chrono::steady_clock::time_point time) {
+	std::lock_guard<std::mutex> lock(mHistoryMutex);
+	if (mHasPresented)
+		mPresentIntervals.add(std::chrono::duration<double, std::milli>(time - mLastPresent).count());
+	mLastPresent = time;
+	mHasPresented = true;
+}
+
+FramePacingStats FramePacer::getStats() const {
+	std::lock_guard<std::mutex> lock(mHistoryMutex);
+
+	FramePacingStats stats;
+	stats.mFrameCount = static_cast<uint32_t>(mCpuTimes.mSamples.size());
+	stats.mCpuP50Ms = mCpuTimes.percentile(0.5);
+	stats.mCpuP99Ms = mCpuTimes.percentile(0.99);
+	stats.mWaitP50Ms = mWaitTimes.percentile(0.5);
+	stats.mWaitP99Ms = mWaitTimes.percentile(0.99);
+	stats.mPresentP50Ms = mPresentIntervals.percentile(0.5);
+	stats.mPresentP99Ms = mPresentIntervals.percentile(0.99);
+	return stats;
+}
+
+void FramePacer::waitUntil(std::chrono::steady_clock::time_point deadline) {
+	// Sleep in 1ms steps while there's clearly time for another one.
+	while (true) {
+		auto now = std::chrono::steady_clock::now();
+		double remainingMs = std::chrono::duration<double, std::milli>(deadline - now).count();
+		double sleepEstimateMs = mSleepMeanMs + std::sqrt(mSleepM2 / mSleepCount);
+		if (remainingMs <= sleepEstimateMs)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		double sleptMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - now).count();
+		mSleepCount++;
+		double delta = sleptMs - mSleepMeanMs;
+		mSleepMeanMs += delta / mSleepCount;
+		mSleepM2 += delta * (sleptMs - mSleepMeanMs);
+	}
+
+	// Spin the rest. _mm_pause keeps the spin from starving the other hyperthread on the core.
+	while (std::chrono::steady_clock::now() < deadline)
+		_mm_pause();
+}
+
+void FramePacer::History::add(double sample) {
+	if (mSamples.size() < HISTORY_SIZE)
+		mSamples.push_back(sample);
+	else
+		mSamples[mNext] = sample;
+	mNext = (mNext + 1) % HISTORY_SIZE;
+}
+
+double FramePacer::History::percentile(double p) const {
+	if (mSamples.empty())
+		return 0.0;
+
+	std::vector<double> sorted = mSamples;
+	size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	return sorted[index];
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../pch.h"
+#include <atomic>
+#include <mutex>
+
+// ******************************************************************************************************************************
+//															FRAME PACER
+// Holds every frame to a fixed period on the steady (monotonic) clock. Frames are scheduled against a deadline that moves
+// forward by exactly one period each frame, so small late wake ups don't add up into drift.
+//
+// Waiting is a hybrid. OS sleeps only wake up to within a millisecond or so (worse on Windows without timeBeginPeriod),
+// so the pacer sleeps 1ms at a time while the time left is more than a sleep has been seen to take, then spins for the
+// rest. The sleep estimate is the mean plus one standard deviation of every sleep so far, so it adapts to the platform.
+//
+// With mPaceFromFence the deadline is anchored to when the GPU last finished a frame instead of to the previous deadline.
+// This keeps the CPU from running ahead of a GPU that can't keep up with the target rate.
+//
+// Every frame's CPU time, wait time and present to present interval is kept for the last HISTORY_SIZE frames so the
+// percentiles can be read back.
+// ******************************************************************************************************************************
+
+struct FramePacingStats {
+	uint32_t mFrameCount{ 0 };
+	double mCpuP50Ms{ 0.0 };
+	double mCpuP99Ms{ 0.0 };
+	double mWaitP50Ms{ 0.0 };
+	double mWaitP99Ms{ 0.0 };
+	double mPresentP50Ms{ 0.0 };
+	double mPresentP99Ms{ 0.0 };
+};
+
+class FramePacer {
+public:
+	// 0 is uncapped.
+	FramePacer(double targetFrameRate = 144.0);
+
+	void setTargetFrameRate(double targetFrameRate);
+	double getTargetFrameRate() const { return mTargetFrameRate; }
+
+	// Waits until the next frame is due. Call at the top of the frame loop.
+	void beginFrame();
+	// Marks the end of the frame's CPU work. Logs the stats once a second.
+	void endFrame();
+
+	// Called by the render thread, so these are safe to call from a different thread than begin/endFrame.
+	// time is when the GPU finished the frame. The renderer passes the calibrated GPU time when the GPU profiler has one.
+	// Otherwise it's when the render thread saw the fence signaled, which is late by the thread's wake up time.
+	void notifyFenceComplete(std::chrono::steady_clock::time_point time);
+	// time is right after vkQueuePresentKHR returned.
+	void notifyPresent(std::chrono::steady_clock::time_point time);
+
+	FramePacingStats getStats() const;
+
+	bool mPaceFromFence{ false };
+
+	static const uint32_t HISTORY_SIZE = 1024;
+
+private:
+	// Sleeps then spins until deadline. Returns once it has passed.
+	void waitUntil(std::chrono::steady_clock::time_point deadline);
+
+	struct History {
+		std::vector<double> mSamples;
+		uint32_t mNext{ 0 };
+
+		void add(double sample);
+		// p in [0, 1]
+		double percentile(double p) const;
+	};
+
+	double mTargetFrameRate{ 0.0 };
+	std::chrono::steady_clock::duration mFramePeriod{ 0 };
+
+	std::chrono::steady_clock::time_point mNextDeadline;
+	std::chrono::steady_clock::time_point mFrameStart;
+	std::chrono::steady_clock::time_point mLastReport;
+
+	// Running mean and variance of how long a 1ms sleep really takes (Welford's method).
+	double mSleepMeanMs{ 1.0 };
+	double mSleepM2{ 0.0 };
+	uint64_t mSleepCount{ 1 };
+
+	// Nanoseconds since the steady clock's epoch, 0 if no fence has been reported yet.
+	std::atomic<int64_t> mLastFenceNs{ 0 };
+
+	mutable std::mutex mHistoryMutex;
+	History mCpuTimes;
+	History mWaitTimes;
+	History mPresentIntervals;
+	std::chrono::steady_clock::time_point mLastPresent;
+	bool mHasPresented{ false };
+};
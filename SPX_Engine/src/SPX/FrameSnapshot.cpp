@@ -0,0 +1,55 @@
+#include "FrameSnapshot.h"
+
+FrameSnapshotQueue::FrameSnapshotQueue(uint32_t depth) {
+	mSnapshots.resize(std::min(std::max(depth, 2u), 4u));
+}
+
+FrameSnapshot* FrameSnapshotQueue::beginWrite() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	// Every snapshot is either waiting to be read or being read, so the update thread is too far ahead.
+	mCanWrite.wait(lock, [this]() { return mShutdown || mPublished < mSnapshots.size(); });
+
+	if (mShutdown)
+		return nullptr;
+	return &mSnapshots[mWriteIndex];
+}
+
+void FrameSnapshotQueue::endWrite() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mSnapshots[mWriteIndex].mPublishTime = std::chrono::steady_clock::now();
+		mWriteIndex = (mWriteIndex + 1) % mSnapshots.size();
+		mPublished++;
+	}
+	mCanRead.notify_one();
+}
+
+FrameSnapshot* FrameSnapshotQueue::beginRead() {
+	std::unique_lock<std::mutex> lock(mMutex);
+	mCanRead.wait(lock, [this]() { return mShutdown || mPublished > 0; });
+
+	// Snapshots published before the shutdown are still drawn, so the last simulated frames aren't dropped. There's only
+	// one reader and it has given its last snapshot back, so everything counted here is waiting to be read.
+	if (mPublished == 0)
+		return nullptr;
+
+	return &mSnapshots[mReadIndex];
+}
+
+void FrameSnapshotQueue::endRead() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mReadIndex = (mReadIndex + 1) % mSnapshots.size();
+		mPublished--;
+	}
+	mCanWrite.notify_one();
+}
+
+void FrameSnapshotQueue::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mShutdown = true;
+	}
+	mCanWrite.notify_all();
+	mCanRead.notify_all();
+}
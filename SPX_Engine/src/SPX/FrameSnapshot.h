@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../pch.h"
+#include <mutex>
+#include <condition_variable>
+
+// ******************************************************************************************************************************
+//															FRAME SNAPSHOTS
+// Everything the renderer needs from the simulation to draw one frame. The update thread fills a snapshot for frame N+1
+// while the render thread is still recording and submitting frame N from an older one, so neither thread ever reads
+// state the other is writing.
+//
+// FrameSnapshotQueue is a small ring of snapshots. depth is how many can exist at once: 2 lets the update thread run one
+// frame ahead of the render thread, 3 lets it run two ahead to absorb uneven frame times at the cost of a frame of latency.
+// Snapshots are handed over in order and reused, so after the first few frames no memory is allocated.
+// ******************************************************************************************************************************
+
+struct FrameSnapshot {
+	uint64_t mFrameNumber{ 0 };
+	glm::mat4 mViewMatrix{ 1.0f };
+	// One per render object, same order as the renderer's objects.
+	std::vector<glm::mat4> mObjectTransforms;
+	// When the update thread finished writing this snapshot. Used to measure how long frames wait in the queue.
+	std::chrono::steady_clock::time_point mPublishTime;
+};
+
+class FrameSnapshotQueue {
+public:
+	// depth is clamped to [2, 4]. One snapshot is always being read, so less than 2 would serialize the threads again.
+	FrameSnapshotQueue(uint32_t depth = 2);
+
+	// Update thread. Blocks until a snapshot is free to write and returns it, or nullptr once the queue is shut down.
+	// The snapshot still has whatever the last frame written into it, so vectors keep their capacity.
+	FrameSnapshot* beginWrite();
+	// Hands the snapshot from beginWrite to the render thread.
+	void endWrite();
+
+	// Render thread. Blocks until a snapshot is published and returns the oldest one. After shutdown it keeps returning
+	// the snapshots that were already published, then nullptr.
+	FrameSnapshot* beginRead();
+	// Gives the snapshot from beginRead back so the update thread can reuse it.
+	void endRead();
+
+	// Wakes both threads. beginWrite returns nullptr from now on, beginRead once the published snapshots are drained.
+	void shutdown();
+
+	uint32_t getDepth() const { return static_cast<uint32_t>(mSnapshots.size()); }
+
+private:
+	std::vector<FrameSnapshot> mSnapshots;
+	// Next snapshot to write and next to read.
+	uint32_t mWriteIndex{ 0 };
+	uint32_t mReadIndex{ 0 };
+	// Written and not yet given back by endRead, so this includes the one being read.
+	uint32_t mPublished{ 0 };
+	bool mShutdown{ false };
+
+	std::mutex mMutex;
+	std::condition_variable mCanWrite;
+	std::condition_variable mCanRead;
+};
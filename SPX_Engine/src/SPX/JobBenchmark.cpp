@@ -0,0 +1,110 @@
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+#include "../Renderer/FrustumCuller.h"
+
+namespace {
+	struct BenchmarkTransform {
+		glm::vec3 mPosition;
+		glm::vec3 mRotationAxis;
+		float mAngle;
+		float mScale;
+	};
+
+	double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+std::vector<JobBenchmarkResult> runJobScalingBenchmark(size_t objectCount, uint32_t iterations, uint32_t maxThreads) {
+	if (maxThreads == 0)
+		maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	iterations = std::max(1u, iterations);
+
+	// Same scene for every thread count. Objects are scattered in a cube around the camera so roughly a quarter are visible.
+	std::vector<BenchmarkTransform> transforms(objectCount);
+	std::vector<glm::mat4> matrices(objectCount);
+	uint32_t seed = 12345;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+	};
+	for (auto& transform : transforms) {
+		transform.mPosition = glm::vec3(random() * 200.0f - 100.0f, random() * 200.0f - 100.0f, random() * 200.0f - 100.0f);
+		transform.mRotationAxis = glm::normalize(glm::vec3(random(), random(), random()) + glm::vec3(0.01f));
+		transform.mAngle = random() * 6.28318f;
+		transform.mScale = 0.5f + random();
+	}
+
+	BoundingSphere sphere{ glm::vec3(0.0f), 1.0f };
+	AABB box{ glm::vec3(-1.0f), glm::vec3(1.0f) };
+
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	Frustum frustum = Frustum::fromMatrix(proj * view);
+
+	FrustumCuller culler;
+	culler.resize(objectCount);
+
+	auto updateTransforms = [&transforms, &matrices](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const BenchmarkTransform& transform = transforms[i];
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), transform.mPosition);
+			model = glm::rotate(model, transform.mAngle, transform.mRotationAxis);
+			matrices[i] = glm::scale(model, glm::vec3(transform.mScale));
+		}
+	};
+
+	CORE_INFO("Job scaling benchmark: {} objects, {} iterations, 1 to {} threads.", objectCount, iterations, maxThreads);
+
+	std::vector<JobBenchmarkResult> results;
+	for (uint32_t threads = 1; threads <= maxThreads; threads++) {
+		JobSystem jobSystem(threads);
+		JobBenchmarkResult result;
+		result.mThreadCount = threads;
+
+		// Warm up once so page faults and thread start up don't land in the first measurement.
+		jobSystem.parallelFor(objectCount, 0, updateTransforms);
+		jobSystem.resetStats();
+
+		for (uint32_t i = 0; i < iterations; i++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			jobSystem.parallelFor(objectCount, 0, updateTransforms);
+			result.mTransformMs += elapsedMs(start);
+
+			jobSystem.parallelFor(objectCount, FrustumCuller::CULL_BATCH_SIZE, [&culler, &sphere, &box, &matrices](size_t begin, size_t end) {
+				for (size_t object = begin; object < end; object++)
+					culler.updateBounds(object, sphere, box, matrices[object]);
+			});
+
+			start = std::chrono::high_resolution_clock::now();
+			culler.cull(frustum, &jobSystem);
+			result.mCullMs += elapsedMs(start);
+		}
+
+		result.mTransformMs /= iterations;
+		result.mCullMs /= iterations;
+
+		std::vector<WorkerStats> workerStats = jobSystem.getWorkerStats();
+		for (const auto& stats : workerStats)
+			result.mAverageUtilization += stats.mUtilization;
+		result.mAverageUtilization /= workerStats.size();
+
+		// Speedup and efficiency are relative to the single threaded run.
+		const JobBenchmarkResult& baseline = results.empty() ? result : results.front();
+		double transformSpeedup = baseline.mTransformMs / result.mTransformMs;
+		double cullSpeedup = baseline.mCullMs / result.mCullMs;
+
+		CORE_INFO("{:2} threads | transforms {:8.3f} ms ({:5.2f}x, {:5.1f}% eff) | cull {:8.3f} ms ({:5.2f}x, {:5.1f}% eff) | {} visible",
+			threads, result.mTransformMs, transformSpeedup, transformSpeedup / threads * 100.0,
+			result.mCullMs, cullSpeedup, cullSpeedup / threads * 100.0, culler.mVisibleIndices.size());
+
+		for (uint32_t worker = 0; worker < workerStats.size(); worker++) {
+			CORE_INFO("    worker {:2}: {:7} jobs, {:9.3f} ms busy, {:5.1f}% utilization", worker, workerStats[worker].mJobsExecuted,
+				workerStats[worker].mBusyMs, workerStats[worker].mUtilization * 100.0);
+		}
+
+		results.push_back(result);
+	}
+
+	return results;
+}
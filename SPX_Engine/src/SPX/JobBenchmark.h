@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../pch.h"
+
+// ******************************************************************************************************************************
+//														JOB SYSTEM BENCHMARK
+// Runs the same CPU workloads on a job system with 1, 2, ... N threads and logs how the time scales, so it's easy to
+// see where adding threads stops paying off. Started with --job-benchmark instead of opening the engine.
+//
+// Workloads:
+//   Transforms  Builds a model matrix for every object from a position, rotation and scale.
+//   Culling	 The SIMD frustum culler over a large scene.
+// ******************************************************************************************************************************
+
+struct JobBenchmarkResult {
+	uint32_t mThreadCount{ 1 };
+	double mTransformMs{ 0.0 };
+	double mCullMs{ 0.0 };
+	// Average worker busy time over wall time for the whole run at this thread count.
+	double mAverageUtilization{ 0.0 };
+};
+
+// objectCount objects, each workload repeated iterations times and averaged. maxThreads of 0 goes up to one thread
+// per hardware thread.
+std::vector<JobBenchmarkResult> runJobScalingBenchmark(size_t objectCount = 1000000, uint32_t iterations = 10, uint32_t maxThreads = 0);
@@ -0,0 +1,360 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "FrameArena.h"
+
+namespace {
+	// Which job system (if any) the current thread is a worker of, and its index there.
+	thread_local JobSystem* tJobSystem = nullptr;
+	thread_local uint32_t tWorkerIndex = 0;
+	// Cheap per thread random number for picking a steal victim.
+	thread_local uint32_t tRandomState = 0x9E3779B9u;
+
+	uint32_t nextRandom() {
+		// xorshift32
+		tRandomState ^= tRandomState << 13;
+		tRandomState ^= tRandomState >> 17;
+		tRandomState ^= tRandomState << 5;
+		return tRandomState;
+	}
+}
+
+// ******************************************************************************************************************************
+//														WORK STEALING QUEUE
+// ******************************************************************************************************************************
+
+bool WorkStealingQueue::push(Job* job) {
+	int64_t bottom = mBottom.load(std::memory_order_relaxed);
+	int64_t top = mTop.load(std::memory_order_acquire);
+
+	if (bottom - top >= CAPACITY)
+		return false;
+
+	mJobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	// The job has to be visible before a thief can see the new bottom.
+	std::atomic_thread_fence(std::memory_order_release);
+	mBottom.store(bottom + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* WorkStealingQueue::pop() {
+	int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+	mBottom.store(bottom, std::memory_order_relaxed);
+	// Full fence so the bottom store can't be reordered with the top load. This is what makes pop race safely with steal.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = mTop.load(std::memory_order_relaxed);
+
+	if (top > bottom) {
+		// Empty
+		mBottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = mJobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+	if (top == bottom) {
+		// Last job, a thief might be taking it at the same time. Whoever moves top first wins.
+		if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		mBottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* WorkStealingQueue::steal() {
+	int64_t top = mTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = mBottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+		return nullptr;
+
+	Job* job = mJobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+	// Lost the race against the owner or another thief.
+	if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+
+	return job;
+}
+
+// ******************************************************************************************************************************
+//																JOB SYSTEM
+// ******************************************************************************************************************************
+
+JobSystem::JobSystem(uint32_t threadCount) {
+	mThreadCount = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < mThreadCount; i++)
+		mWorkers.push_back(new WorkerData());
+
+	// The creating thread is worker 0.
+	tJobSystem = this;
+	tWorkerIndex = 0;
+
+	for (uint32_t i = 1; i < mThreadCount; i++)
+		mThreads.emplace_back(&JobSystem::workerLoop, this, i);
+
+	mStatsStart = std::chrono::steady_clock::now();
+	CORE_INFO("Job system started with {} threads.", mThreadCount);
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mRunning = false;
+	}
+	mSleepCondition.notify_all();
+
+	for (auto& thread : mThreads)
+		thread.join();
+
+	// Jobs still queued were scheduled but never run. Nothing else can touch the queues now, so this thread runs them,
+	// which frees them and releases anything that was waiting on their counters.
+	for (;;) {
+		Job* job = takeInjectedJob();
+		for (uint32_t i = 0; i < mThreadCount && !job; i++) {
+			job = mWorkers[i]->mQueue.steal();
+			if (job)
+				mQueuedJobs.fetch_sub(1);
+		}
+		if (!job)
+			break;
+		execute(job, NOT_A_WORKER);
+	}
+
+	if (tJobSystem == this)
+		tJobSystem = nullptr;
+
+	for (auto worker : mWorkers)
+		delete worker;
+}
+
+void JobSystem::run(std::function<void()> function, JobCounter* counter, JobCounter* dependency) {
+	AllocationTag tag = AllocationCounter::getThreadTag();
+	Job* job;
+	{
+		SPX_ALLOCATION_SCOPE(AllocationTag::Jobs);
+		job = new Job{ std::move(function), counter };
+	}
+	job->mTag = tag;
+
+	if (counter)
+		counter->mValue.fetch_add(1, std::memory_order_relaxed);
+
+	if (dependency) {
+		// Checked under the lock so the counter can't reach zero and release its waiters between the check and the push_back.
+		std::lock_guard<std::mutex> lock(dependency->mWaitMutex);
+		if (!dependency->isDone()) {
+			dependency->mWaitingJobs.push_back(job);
+			return;
+		}
+	}
+
+	pushJob(job);
+}
+
+void JobSystem::wait(JobCounter& counter) {
+	bool isWorker = tJobSystem == this;
+
+	while (!counter.isDone()) {
+		// Help out instead of blocking. Non worker threads (the render thread) have no deque to pop from or be stolen
+		// from, but they can still take injected jobs. Otherwise a job system with a single worker that's busy elsewhere
+		// would never run them.
+		Job* job = isWorker ? findJob(tWorkerIndex) : takeInjectedJob();
+		if (job)
+			execute(job, isWorker ? tWorkerIndex : NOT_A_WORKER);
+		else
+			std::this_thread::yield();
+	}
+
+	// The thread that finished the last job may still be unlocking the counter.
+	std::lock_guard<std::mutex> lock(counter.mWaitMutex);
+}
+
+void JobSystem::parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& function, FrameArena* arena) {
+	if (count == 0)
+		return;
+
+	if (batchSize == 0)
+		batchSize = std::max<size_t>(1, count / (static_cast<size_t>(mThreadCount) * 4));
+
+	AllocationTag tag = AllocationCounter::getThreadTag();
+	JobCounter counter;
+	for (size_t begin = batchSize; begin < count; begin += batchSize) {
+		Job* job;
+		{
+			SPX_ALLOCATION_SCOPE(AllocationTag::Jobs);
+			job = arena ? new (arena->allocate(sizeof(Job), alignof(Job))) Job() : new Job();
+		}
+		job->mRangeFunction = &function;
+		job->mBegin = begin;
+		job->mEnd = std::min(begin + batchSize, count);
+		job->mCounter = &counter;
+		job->mFromArena = arena != nullptr;
+		job->mTag = tag;
+
+		counter.mValue.fetch_add(1, std::memory_order_relaxed);
+		pushJob(job);
+	}
+
+	// Counted as the caller's busy time when it's a worker, otherwise worker 0 would look idle in the stats.
+	auto start = std::chrono::high_resolution_clock::now();
+	function(0, std::min(batchSize, count));
+	if (tJobSystem == this) {
+		auto end = std::chrono::high_resolution_clock::now();
+		mWorkers[tWorkerIndex]->mBusyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+	}
+
+	wait(counter);
+}
+
+std::vector<WorkerStats> JobSystem::getWorkerStats() const {
+	double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStatsStart).count();
+
+	std::vector<WorkerStats> stats(mThreadCount);
+	for (uint32_t i = 0; i < mThreadCount; i++) {
+		stats[i].mJobsExecuted = mWorkers[i]->mJobsExecuted.load(std::memory_order_relaxed);
+		stats[i].mBusyMs = mWorkers[i]->mBusyNs.load(std::memory_order_relaxed) / 1000000.0;
+		stats[i].mUtilization = wallMs > 0.0 ? stats[i].mBusyMs / wallMs : 0.0;
+	}
+	return stats;
+}
+
+void JobSystem::resetStats() {
+	for (auto worker : mWorkers) {
+		worker->mJobsExecuted.store(0, std::memory_order_relaxed);
+		worker->mBusyNs.store(0, std::memory_order_relaxed);
+	}
+	mStatsStart = std::chrono::steady_clock::now();
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex) {
+	tJobSystem = this;
+	tWorkerIndex = workerIndex;
+	tRandomState ^= (workerIndex + 1) * 0x85EBCA6Bu;
+	SPX_PROFILE_THREAD("Worker " + std::to_string(workerIndex));
+
+	while (mRunning.load(std::memory_order_relaxed)) {
+		Job* job = findJob(workerIndex);
+		if (job) {
+			execute(job, workerIndex);
+			continue;
+		}
+
+		// Nothing to do anywhere, sleep until a job is queued. mSleepingWorkers is raised before the check inside wait,
+		// and pushJob raises mQueuedJobs before reading mSleepingWorkers, so one of the two always sees the other.
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mSleepingWorkers.fetch_add(1);
+		mSleepCondition.wait(lock, [this]() { return mQueuedJobs.load() > 0 || !mRunning.load(); });
+		mSleepingWorkers.fetch_sub(1);
+	}
+}
+
+void JobSystem::pushJob(Job* job) {
+	mQueuedJobs.fetch_add(1);
+
+	// Workers use their own deque. Anyone else, or a worker whose deque is full, goes through the injection queue.
+	if (tJobSystem != this || !mWorkers[tWorkerIndex]->mQueue.push(job)) {
+		std::lock_guard<std::mutex> lock(mInjectionMutex);
+		mInjectionQueue.push_back(job);
+		mInjectedJobs.fetch_add(1, std::memory_order_release);
+	}
+
+	wakeWorker();
+}
+
+void JobSystem::wakeWorker() {
+	if (mSleepingWorkers.load() == 0)
+		return;
+
+	// Taking the lock makes sure a worker that's about to sleep has either seen the new job or is already waiting.
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mSleepCondition.notify_one();
+}
+
+Job* JobSystem::findJob(uint32_t workerIndex) {
+	Job* job = mWorkers[workerIndex]->mQueue.pop();
+	if (job) {
+		mQueuedJobs.fetch_sub(1);
+		return job;
+	}
+
+	job = takeInjectedJob();
+	if (job)
+		return job;
+
+	if (mThreadCount > 1) {
+		// Start at a random victim so thieves don't all pile onto the same worker.
+		uint32_t start = nextRandom() % mThreadCount;
+		for (uint32_t i = 0; i < mThreadCount && !job; i++) {
+			uint32_t victim = (start + i) % mThreadCount;
+			if (victim != workerIndex)
+				job = mWorkers[victim]->mQueue.steal();
+		}
+	}
+
+	if (job)
+		mQueuedJobs.fetch_sub(1);
+
+	return job;
+}
+
+Job* JobSystem::takeInjectedJob() {
+	if (mInjectedJobs.load(std::memory_order_acquire) == 0)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(mInjectionMutex);
+	if (mInjectionQueue.empty())
+		return nullptr;
+
+	Job* job = mInjectionQueue.back();
+	mInjectionQueue.pop_back();
+	mInjectedJobs.fetch_sub(1, std::memory_order_relaxed);
+	mQueuedJobs.fetch_sub(1);
+	return job;
+}
+
+void JobSystem::execute(Job* job, uint32_t workerIndex) {
+	auto start = std::chrono::high_resolution_clock::now();
+	{
+		SPX_PROFILE_ZONE("Job");
+		SPX_ALLOCATION_SCOPE(job->mTag);
+		if (job->mRangeFunction)
+			(*job->mRangeFunction)(job->mBegin, job->mEnd);
+		else
+			job->mFunction();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	// Jobs run by a non worker thread while it waits don't show up in the per worker stats.
+	if (workerIndex != NOT_A_WORKER) {
+		WorkerData* worker = mWorkers[workerIndex];
+		worker->mJobsExecuted.fetch_add(1, std::memory_order_relaxed);
+		worker->mBusyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+	}
+
+	JobCounter* counter = job->mCounter;
+	if (job->mFromArena)
+		job->~Job();
+	else
+		delete job;
+
+	if (!counter)
+		return;
+
+	// Decremented under the lock, and wait() takes the same lock before returning, so the counter (usually on the
+	// waiting thread's stack) can't be destroyed while this thread is still touching it.
+	std::vector<Job*> released;
+	{
+		std::lock_guard<std::mutex> lock(counter->mWaitMutex);
+		// Last job of the group releases everything that was waiting on it.
+		if (counter->mValue.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			released.swap(counter->mWaitingJobs);
+	}
+
+	for (Job* waiting : released)
+		pushJob(waiting);
+}
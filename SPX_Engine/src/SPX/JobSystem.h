@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../pch.h"
+#include "AllocationCounter.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ******************************************************************************************************************************
+//																JOB SYSTEM
+// One worker thread per core, each with its own work stealing deque (Chase-Lev). A worker pushes and pops jobs at the bottom
+// of its own deque without locking, and when it runs out it steals from the top of another worker's deque. The thread that
+// creates the job system is worker 0, so it runs jobs too while it waits on them.
+//
+// Threads that aren't workers (like a render thread) can still schedule jobs. Those go into a small locked injection
+// queue the workers check before stealing.
+//
+// Counters track groups of jobs. run() increments the counter and finishing the job decrements it, so waiting on a
+// counter waits for the whole group. A job can depend on a counter, then it isn't queued until that counter hits zero.
+// ******************************************************************************************************************************
+
+struct Job;
+class FrameArena;
+
+class JobCounter {
+public:
+	bool isDone() const { return mValue.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int32_t> mValue{ 0 };
+	// Jobs that depend on this counter. Only locked when scheduling a dependent job or when the counter hits zero.
+	std::mutex mWaitMutex;
+	std::vector<Job*> mWaitingJobs;
+};
+
+struct Job {
+	std::function<void()> mFunction;
+	JobCounter* mCounter{ nullptr };
+	// parallelFor batches call the loop body with their range directly instead of wrapping it in mFunction.
+	const std::function<void(size_t, size_t)>* mRangeFunction{ nullptr };
+	size_t mBegin{ 0 };
+	size_t mEnd{ 0 };
+	// Made in a FrameArena, so it's destroyed in place instead of deleted.
+	bool mFromArena{ false };
+	// The allocation scope open where the job was scheduled, the job runs under it on whichever thread picks it up.
+	AllocationTag mTag{ AllocationTag::Untagged };
+};
+
+// Chase-Lev deque. "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al. 2013.
+// push/pop are only ever called by the owning worker, steal by everyone else.
+class WorkStealingQueue {
+public:
+	// Returns false if the queue is full.
+	bool push(Job* job);
+	Job* pop();
+	Job* steal();
+
+	// Power of two so the index wraps with a mask.
+	static const int64_t CAPACITY = 4096;
+
+private:
+	std::atomic<int64_t> mTop{ 0 };
+	std::atomic<int64_t> mBottom{ 0 };
+	std::atomic<Job*> mJobs[CAPACITY];
+};
+
+struct WorkerStats {
+	uint64_t mJobsExecuted{ 0 };
+	double mBusyMs{ 0.0 };
+	// Busy time divided by the wall time since the stats were last reset.
+	double mUtilization{ 0.0 };
+};
+
+class JobSystem {
+public:
+	// threadCount includes the calling thread. 0 uses one thread per hardware thread.
+	JobSystem(uint32_t threadCount = 0);
+	// Stops the workers, then runs whatever is still queued on the calling thread.
+	~JobSystem();
+
+	// Schedules function. counter is optional and lets the caller wait on it. If dependency is given the job is held
+	// back until that counter reaches zero.
+	void run(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Blocks until the counter reaches zero. Workers (including the main thread) run other jobs while they wait,
+	// other threads only run jobs from the injection queue.
+	void wait(JobCounter& counter);
+
+	// Splits [0, count) into batches of batchSize and calls function(begin, end) for each batch as a job. The calling
+	// thread takes the first batch itself and the call returns once every batch is done. A batchSize of 0 picks one
+	// that gives each thread a few batches to balance uneven work.
+	// With an arena the batches' jobs are made in it instead of on the heap. It has to outlive the call, which a frame's
+	// arena always does.
+	void parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& function, FrameArena* arena = nullptr);
+
+	uint32_t getThreadCount() const { return mThreadCount; }
+
+	std::vector<WorkerStats> getWorkerStats() const;
+	void resetStats();
+
+private:
+	static const uint32_t NOT_A_WORKER = UINT32_MAX;
+
+	struct alignas(64) WorkerData {
+		WorkStealingQueue mQueue;
+		std::atomic<uint64_t> mJobsExecuted{ 0 };
+		std::atomic<uint64_t> mBusyNs{ 0 };
+	};
+
+	void workerLoop(uint32_t workerIndex);
+	void pushJob(Job* job);
+	Job* findJob(uint32_t workerIndex);
+	Job* takeInjectedJob();
+	// workerIndex is NOT_A_WORKER when a non worker thread runs the job while waiting.
+	void execute(Job* job, uint32_t workerIndex);
+	void wakeWorker();
+
+	uint32_t mThreadCount{ 1 };
+	std::vector<WorkerData*> mWorkers;
+	std::vector<std::thread> mThreads;
+	std::atomic<bool> mRunning{ true };
+
+	// Jobs scheduled by threads that aren't workers.
+	std::mutex mInjectionMutex;
+	std::vector<Job*> mInjectionQueue;
+	std::atomic<uint32_t> mInjectedJobs{ 0 };
+
+	// Idle workers sleep instead of spinning. mQueuedJobs is every job sitting in a queue.
+	std::mutex mSleepMutex;
+	std::condition_variable mSleepCondition;
+	std::atomic<int32_t> mQueuedJobs{ 0 };
+	std::atomic<uint32_t> mSleepingWorkers{ 0 };
+
+	std::chrono::steady_clock::time_point mStatsStart;
+};
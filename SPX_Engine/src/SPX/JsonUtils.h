@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../pch.h"
+
+// Escapes text for a JSON string. Good enough for what the engine writes: names, paths (Windows ones are full of
+// backslashes) and the odd newline.
+inline std::string escapeJson(const std::string& text) {
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if (c == '\n')
+			escaped += "\\n";
+		else if (c == '\t')
+			escaped += "\\t";
+		else if (static_cast<unsigned char>(c) < 0x20)
+			escaped += ' ';
+		else
+			escaped += c;
+	}
+	return escaped;
+}
@@ -0,0 +1,266 @@
+#include "MicroBenchmark.h"
+#include "AllocationCounter.h"
+#include "../Renderer/Mesh.h"
+#include "../Renderer/Texture.h"
+#include "../Renderer/RenderObject.h"
+#include "../Renderer/RenderQueue.h"
+#include "../Renderer/PipelineStateCache.h"
+#include "../Renderer/ShaderVariant.h"
+#include "../Renderer/VulkanWrapper/VInstance.h"
+#include "../Renderer/VulkanWrapper/VDevice.h"
+#include "../Renderer/VulkanWrapper/VCommandPool.h"
+#include "../Renderer/VulkanWrapper/VImage.h"
+#include "../Renderer/VulkanWrapper/VRenderPass.h"
+#include "../Renderer/VulkanWrapper/VGraphicsPipeline.h"
+#include "../Renderer/VulkanWrapper/VLayoutCache.h"
+#include "../Renderer/VulkanWrapper/VShader.h"
+#include "../Renderer/VulkanWrapper/VShaderReflection.h"
+#include "../ThirdParty/stb_image.h"
+
+namespace {
+	const std::string GENERATED_MESH = "micro_benchmark_grid.obj";
+	const std::string GENERATED_TEXTURE = "micro_benchmark_texture.ppm";
+
+	bool fileExists(const std::string& file) {
+		return std::ifstream(file).is_open();
+	}
+
+	size_t fileSize(const std::string& file) {
+		std::ifstream in(file, std::ios::binary | std::ios::ate);
+		return in.is_open() ? static_cast<size_t>(in.tellg()) : 0;
+	}
+
+	// A flat grid with UVs, written as OBJ text so it goes through the same parser as the real models.
+	void writeGridMesh(const std::string& file, uint32_t gridSize) {
+		std::ofstream out(file);
+		uint32_t side = gridSize + 1;
+		for (uint32_t y = 0; y < side; y++) {
+			for (uint32_t x = 0; x < side; x++)
+				out << "v " << x / static_cast<float>(gridSize) << " " << y / static_cast<float>(gridSize) << " 0\n";
+		}
+		for (uint32_t y = 0; y < side; y++) {
+			for (uint32_t x = 0; x < side; x++)
+				out << "vt " << x / static_cast<float>(gridSize) << " " << y / static_cast<float>(gridSize) << "\n";
+		}
+		// OBJ indices start at 1.
+		for (uint32_t y = 0; y < gridSize; y++) {
+			for (uint32_t x = 0; x < gridSize; x++) {
+				uint32_t a = y * side + x + 1;
+				uint32_t b = a + 1;
+				uint32_t c = a + side;
+				uint32_t d = c + 1;
+				out << "f " << a << "/" << a << " " << b << "/" << b << " " << d << "/" << d << "\n";
+				out << "f " << a << "/" << a << " " << d << "/" << d << " " << c << "/" << c << "\n";
+			}
+		}
+	}
+
+	// Binary PPM, which stb_image reads. There's no image writer in the repo and the format doesn't matter much for
+	// upload, decode is measured on the Media textures too.
+	void writeTexture(const std::string& file, uint32_t size) {
+		std::ofstream out(file, std::ios::binary);
+		out << "P6\n" << size << " " << size << "\n255\n";
+		std::vector<uint8_t> row(static_cast<size_t>(size) * 3);
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				row[x * 3 + 0] = static_cast<uint8_t>(x);
+				row[x * 3 + 1] = static_cast<uint8_t>(y);
+				row[x * 3 + 2] = static_cast<uint8_t>(x ^ y);
+			}
+			out.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+	}
+
+	// Runs body once to warm up, then iterations times. cleanup runs after each run of body, outside the timing and
+	// the allocation counts. work and bytes are what one run of body processes.
+	MicroBenchmarkResult measure(const std::string& name, uint32_t iterations, const std::function<void()>& body,
+		const std::function<void()>& cleanup, double work, const std::string& unit, double bytes) {
+		body();
+		if (cleanup)
+			cleanup();
+
+		double totalMs = 0.0;
+		AllocationCounts allocations;
+		for (uint32_t i = 0; i < iterations; i++) {
+			// This thread only. Every fixture runs on the calling thread, and the engine's threads are left out.
+			AllocationCounts before = AllocationCounter::getThreadCounts();
+			auto start = std::chrono::high_resolution_clock::now();
+			body();
+			auto end = std::chrono::high_resolution_clock::now();
+			AllocationCounts used = AllocationCounter::getThreadCounts() - before;
+
+			totalMs += std::chrono::duration<double, std::milli>(end - start).count();
+			allocations.mAllocations += used.mAllocations;
+			allocations.mBytes += used.mBytes;
+			if (cleanup)
+				cleanup();
+		}
+
+		MicroBenchmarkResult result;
+		result.mName = name;
+		result.mMsPerIteration = totalMs / iterations;
+		double seconds = result.mMsPerIteration / 1000.0;
+		result.mThroughput = seconds > 0.0 ? work / seconds : 0.0;
+		result.mThroughputUnit = unit;
+		result.mMBPerSecond = seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+		result.mAllocationsPerIteration = static_cast<double>(allocations.mAllocations) / iterations;
+		result.mAllocatedBytesPerIteration = static_cast<double>(allocations.mBytes) / iterations;
+
+		CORE_INFO("{:<44} | {:10.3f} ms | {:14.0f} {:<10} | {:9.1f} MB/s | {:10.1f} allocs | {:12.0f} bytes", result.mName,
+			result.mMsPerIteration, result.mThroughput, result.mThroughputUnit, result.mMBPerSecond,
+			result.mAllocationsPerIteration, result.mAllocatedBytesPerIteration);
+		return result;
+	}
+}
+
+std::vector<MicroBenchmarkResult> runMicroBenchmarks(const MicroBenchmarkSettings& settings) {
+	uint32_t iterations = std::max(1u, settings.mIterations);
+	uint32_t objectCount = std::max(1u, settings.mObjectCount);
+
+	// No validation layers, they'd be most of what's measured.
+	std::string appName = "SPX Micro Benchmark";
+	std::string engineName = "SPX_ENGINE";
+	VInstance* instance = new VInstance(appName, engineName, false, true);
+	VDevice* device = new VDevice(VK_NULL_HANDLE, *instance);
+	VCommandPool* commandPool = new VCommandPool(*device);
+
+	writeGridMesh(GENERATED_MESH, settings.mMeshGridSize);
+	writeTexture(GENERATED_TEXTURE, settings.mTextureSize);
+
+	CORE_INFO("Micro benchmarks: {} iterations, {}x{} generated grid, {}x{} generated texture, {} objects.", iterations,
+		settings.mMeshGridSize, settings.mMeshGridSize, settings.mTextureSize, settings.mTextureSize, objectCount);
+
+	std::vector<MicroBenchmarkResult> results;
+
+	// OBJ parse and vertex dedup.
+	for (const std::string& file : { std::string("Media/Obj/chalet.obj"), std::string("Media/Obj/viking.obj"), GENERATED_MESH }) {
+		if (!fileExists(file)) {
+			CORE_INFO("Skipping {}, it doesn't exist.", file);
+			continue;
+		}
+
+		// The triangle count comes from a load outside the measurement.
+		Mesh* mesh = new Mesh(file, *device);
+		double triangles = mesh->mIndices.size() / 3.0;
+		delete mesh;
+		mesh = nullptr;
+
+		results.push_back(measure("OBJ parse " + file, iterations,
+			[&]() { mesh = new Mesh(file, *device); },
+			[&]() { delete mesh; mesh = nullptr; },
+			triangles, "tris/s", static_cast<double>(fileSize(file))));
+	}
+
+	// Texture decode alone, then the whole Texture::init.
+	for (const std::string& file : { std::string("Media/Textures/chalet.jpg"), std::string("Media/Textures/viking.png"), GENERATED_TEXTURE }) {
+		if (!fileExists(file)) {
+			CORE_INFO("Skipping {}, it doesn't exist.", file);
+			continue;
+		}
+
+		int width = 0, height = 0, channels = 0;
+		stbi_info(file.c_str(), &width, &height, &channels);
+		// Always decoded to RGBA.
+		double decodedBytes = static_cast<double>(width) * height * 4;
+
+		stbi_uc* pixels = nullptr;
+		results.push_back(measure("Texture decode " + file, iterations,
+			[&]() { pixels = stbi_load(file.c_str(), &width, &height, &channels, STBI_rgb_alpha); },
+			[&]() { stbi_image_free(pixels); pixels = nullptr; },
+			1.0, "images/s", decodedBytes));
+
+		Texture* texture = nullptr;
+		results.push_back(measure("Texture upload " + file, iterations,
+			[&]() { texture = new Texture(file, *device); texture->init(*commandPool); },
+			[&]() {
+				vkDestroySampler(device->mLogicalDevice, texture->mTextureSampler, nullptr);
+				delete texture->mTextureImage;
+				delete texture;
+				texture = nullptr;
+			},
+			1.0, "images/s", decodedBytes));
+	}
+
+	// Everything below shares one small mesh and texture, it's the per object cost being measured.
+	writeGridMesh(GENERATED_MESH, 8);
+	writeTexture(GENERATED_TEXTURE, 64);
+	Mesh* mesh = new Mesh(GENERATED_MESH, *device);
+	mesh->createBuffers();
+	Texture* texture = new Texture(GENERATED_TEXTURE, *device);
+	texture->init(*commandPool);
+
+	// Same layouts and pipeline the renderer builds.
+	const std::string vertFile = "src/ShaderFiles/vert.spv";
+	const std::string fragFile = "src/ShaderFiles/frag.spv";
+	ShaderReflection vertReflection, fragReflection;
+	VShader::reflectFile(ShaderType::VERT_SHADER, vertFile, vertReflection);
+	VShader::reflectFile(ShaderType::FRAG_SHADER, fragFile, fragReflection);
+	ShaderReflection meshReflection = ShaderReflection::merge({ vertReflection, fragReflection });
+	VkDescriptorSetLayout setLayout = device->mLayoutCache->getDescriptorSetLayout(meshReflection.getSetLayoutBindings(0));
+	VkPipelineLayout pipelineLayout = device->mLayoutCache->getPipelineLayout(meshReflection);
+
+	VRenderPass* renderPass = new VRenderPass(*device, "", VK_FORMAT_R8G8B8A8_UNORM);
+	PipelineStateCache* pipelineCache = new PipelineStateCache(*device);
+	GraphicsPipelineDescription description = GraphicsPipelineDescription::makeDefault(vertFile, fragFile, renderPass->mRenderPass,
+		pipelineLayout, { 1920, 1080 });
+	MeshShaderVariant().apply(description);
+	VGraphicsPipeline* pipeline = pipelineCache->getPipeline(description);
+
+	std::vector<RenderObject> objects(objectCount, RenderObject(GENERATED_MESH, GENERATED_TEXTURE));
+	for (uint32_t i = 0; i < objectCount; i++) {
+		RenderObject& obj = objects[i];
+		obj.mMesh = mesh;
+		obj.mTexture = texture;
+		obj.mTransformMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(static_cast<float>(i % 100), 0.0f, static_cast<float>(i / 100)));
+		obj.setDescriptorSetLayout(*device, setLayout);
+		obj.init(*commandPool, 1);
+	}
+
+	glm::mat4 view = glm::lookAt(glm::vec3(50.0f, 20.0f, -20.0f), glm::vec3(50.0f, 0.0f, 50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	results.push_back(measure("Uniform update", iterations,
+		[&]() {
+			for (auto& obj : objects)
+				obj.updateUniformBuffers(0, view, proj);
+		},
+		nullptr, objectCount, "objects/s", static_cast<double>(objectCount) * sizeof(UniformBufferObject)));
+
+	// Keys vary in depth only, like a scene of one material and mesh.
+	RenderQueue queue;
+	auto buildQueue = [&]() {
+		queue.clear();
+		for (uint32_t i = 0; i < objectCount; i++)
+			queue.push(RenderQueue::makeSortKey(0, 0, 0, 0, (i * 7919 % objectCount) / static_cast<float>(objectCount)), i);
+		queue.sort();
+	};
+	results.push_back(measure("Queue build", iterations, buildQueue, nullptr, objectCount, "objects/s", 0.0));
+
+	// Recorded as draw records its secondary command buffers. Never submitted.
+	VCommandPool* recordPool = new VCommandPool(*device, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+	VkCommandBuffer cmd = recordPool->allocateCommandBuffers(1, VK_COMMAND_BUFFER_LEVEL_SECONDARY).at(0);
+	results.push_back(measure("Command record", iterations,
+		[&]() {
+			recordPool->reset();
+
+			VkCommandBufferInheritanceInfo inheritance{};
+			inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritance.renderPass = renderPass->mRenderPass;
+			inheritance.subpass = 0;
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = &inheritance;
+
+			vkBeginCommandBuffer(cmd, &beginInfo);
+			queue.record(cmd, objects, pipeline->mGraphicsPipeline, pipelineLayout, 0);
+			vkEndCommandBuffer(cmd);
+		},
+		nullptr, objectCount, "draws/s", 0.0));
+
+	vkDeviceWaitIdle(device->mLogicalDevice);
+	std::remove(GENERATED_MESH.c_str());
+	std::remove(GENERATED_TEXTURE.c_str());
+
+	return results;
+}
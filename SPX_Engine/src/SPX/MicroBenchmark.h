@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../pch.h"
+
+// ******************************************************************************************************************************
+//														MICROBENCHMARKS
+// Times the CPU hot paths one at a time, outside of a frame, so a regression in one of them shows up on its own instead
+// of being lost in the frame time. Started with --micro-benchmark instead of opening the engine. Needs a GPU (it creates
+// a headless device) but no window.
+//
+// Fixtures:
+//   OBJ parse		   Mesh::Mesh on the Media models and a generated grid. Triangles/s and MB/s of OBJ text.
+//   Texture decode	   stb_image alone on the Media textures and a generated image. MB/s of decoded pixels.
+//   Texture upload	   Texture::init: decode, staging copy, upload and sampler.
+//   Uniform update	   RenderObject::updateUniformBuffers for every object. Objects/s.
+//   Queue build	   Sort keys pushed and radix sorted for every object. Objects/s.
+//   Command record	   RenderQueue::record of every object into a secondary command buffer, as draw does. Draws/s.
+//
+// Every fixture runs once to warm up, then mIterations times. Allocations are counted with the AllocationCounter over
+// the timed part and reported per iteration. Only the calling thread's are counted, so other threads don't show up.
+// ******************************************************************************************************************************
+
+struct MicroBenchmarkSettings {
+	uint32_t mIterations{ 10 };
+	// The generated mesh is a grid of this many quads a side, two triangles each.
+	uint32_t mMeshGridSize{ 256 };
+	// The generated texture is this many pixels a side.
+	uint32_t mTextureSize{ 2048 };
+	// Objects for the uniform update, queue build and record fixtures.
+	uint32_t mObjectCount{ 10000 };
+};
+
+struct MicroBenchmarkResult {
+	std::string mName;
+	double mMsPerIteration{ 0.0 };
+	// Work per second in mThroughputUnit (triangles, objects, draws).
+	double mThroughput{ 0.0 };
+	std::string mThroughputUnit;
+	// Bytes processed per second, 0 where it doesn't mean anything.
+	double mMBPerSecond{ 0.0 };
+	double mAllocationsPerIteration{ 0.0 };
+	double mAllocatedBytesPerIteration{ 0.0 };
+};
+
+std::vector<MicroBenchmarkResult> runMicroBenchmarks(const MicroBenchmarkSettings& settings = MicroBenchmarkSettings());
@@ -0,0 +1,133 @@
+#include "../pch.h"
+#include "Profiler.h"
+#include "JsonUtils.h"
+#include "AllocationCounter.h"
+#include <mutex>
+#include <iomanip>
+
+namespace {
+	// Every thread that has recorded a zone. Buffers are never freed, a thread can exit with zones that haven't been
+	// collected yet.
+	std::mutex gBuffersMutex;
+	std::vector<ProfileThreadBuffer*> gBuffers;
+
+	// The capture so far, grouped by thread. Only touched with gBuffersMutex held.
+	std::map<uint32_t, std::vector<ProfileEvent>> gCapturedEvents;
+	uint64_t gCaptureStartNs = 0;
+
+	thread_local ProfileThreadBuffer* tBuffer = nullptr;
+}
+
+std::atomic<bool> Profiler::sCapturing{ false };
+
+bool ProfileThreadBuffer::push(const ProfileEvent& event) {
+	uint64_t write = mWrite.load(std::memory_order_relaxed);
+	// Acquire so the reader is done with the slot before it's overwritten.
+	if (write - mRead.load(std::memory_order_acquire) >= CAPACITY)
+		return false;
+
+	mEvents[write & (CAPACITY - 1)] = event;
+	// Release so the reader sees the event before the new write position.
+	mWrite.store(write + 1, std::memory_order_release);
+	return true;
+}
+
+void ProfileThreadBuffer::drain(std::vector<ProfileEvent>& events) {
+	uint64_t read = mRead.load(std::memory_order_relaxed);
+	uint64_t write = mWrite.load(std::memory_order_acquire);
+
+	for (; read < write; read++)
+		events.push_back(mEvents[read & (CAPACITY - 1)]);
+	mRead.store(read, std::memory_order_release);
+}
+
+void Profiler::beginCapture() {
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+	// Anything still in the buffers is from before this capture.
+	std::vector<ProfileEvent> stale;
+	for (auto buffer : gBuffers) {
+		buffer->drain(stale);
+		buffer->mDropped = 0;
+	}
+	gCapturedEvents.clear();
+	gCaptureStartNs = now();
+	sCapturing.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::endCapture() {
+	sCapturing.store(false, std::memory_order_relaxed);
+}
+
+void Profiler::setThreadName(const std::string& name) {
+	ProfileThreadBuffer& buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+	buffer.mThreadName = name;
+}
+
+void Profiler::collect() {
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+	for (auto buffer : gBuffers)
+		buffer->drain(gCapturedEvents[buffer->mThreadId]);
+}
+
+void Profiler::record(const char* name, uint64_t startNs, uint64_t endNs) {
+	ProfileThreadBuffer& buffer = getThreadBuffer();
+	if (!buffer.push({ name, startNs, endNs }))
+		buffer.mDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+ProfileThreadBuffer& Profiler::getThreadBuffer() {
+	// Only the first zone on each thread takes the lock.
+	if (!tBuffer) {
+		SPX_ALLOCATION_SCOPE(AllocationTag::Profiling);
+		tBuffer = new ProfileThreadBuffer();
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		tBuffer->mThreadId = static_cast<uint32_t>(gBuffers.size());
+		tBuffer->mThreadName = "Thread " + std::to_string(tBuffer->mThreadId);
+		gBuffers.push_back(tBuffer);
+	}
+	return *tBuffer;
+}
+
+bool Profiler::writeChromeTrace(const std::string& file) {
+	collect();
+
+	std::ofstream out(file);
+	if (!out.is_open()) {
+		CORE_ERROR("Couldn't open {} to write the CPU trace.", file);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+
+	// Times are in microseconds from the start of the capture. Complete ("X") events carry their own duration, so a
+	// zone is one event instead of a begin/end pair.
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	size_t eventCount = 0;
+	uint64_t dropped = 0;
+	for (auto buffer : gBuffers) {
+		out << (first ? "" : ",\n");
+		first = false;
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->mThreadId
+			<< ",\"args\":{\"name\":\"" << escapeJson(buffer->mThreadName) << "\"}}";
+		dropped += buffer->mDropped.load(std::memory_order_relaxed);
+
+		for (const auto& event : gCapturedEvents[buffer->mThreadId]) {
+			if (event.mStartNs < gCaptureStartNs)
+				continue;
+
+			out << ",\n{\"name\":\"" << escapeJson(event.mName) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->mThreadId
+				<< ",\"ts\":" << (event.mStartNs - gCaptureStartNs) / 1000.0
+				<< ",\"dur\":" << (event.mEndNs - event.mStartNs) / 1000.0 << "}";
+			eventCount++;
+		}
+	}
+	out << "\n]}\n";
+
+	if (dropped > 0)
+		CORE_WARN("CPU profiler: {} zones didn't fit in their thread's buffer and were dropped.", dropped);
+	CORE_INFO("Wrote {} CPU zones from {} threads to {}.", eventCount, gBuffers.size(), file);
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../pch.h"
+#include <atomic>
+
+// ******************************************************************************************************************************
+//																CPU PROFILER
+// Scoped zones that time a block of CPU work. SPX_PROFILE_ZONE("Name") times from that line to the end of the scope.
+// Zones on any thread end up in one trace, written in the Chrome trace event format, which chrome://tracing and
+// ui.perfetto.dev both open.
+//
+// Every thread writes its finished zones into its own ring buffer, so recording never takes a lock. Each buffer has one
+// writer (its thread) and one reader (whoever calls collect), and the read and write positions are the only shared state.
+// collect moves everything out of the buffers into the trace. It's called once per frame, so a buffer only has to hold one
+// frame of zones. Zones that don't fit are dropped and counted rather than blocking the thread.
+//
+// Timestamps are steady_clock nanoseconds. The TSC would be a little cheaper to read, but it isn't guaranteed to tick at a
+// fixed rate or agree between cores on every CPU, and steady_clock already reads it where it's safe to.
+//
+// Without SPX_ENABLE_PROFILING (defined in the Debug configurations only) every macro is empty and none of this is
+// compiled into the zones. With it, zones cost one relaxed load until a capture is started.
+// ******************************************************************************************************************************
+
+struct ProfileEvent {
+	// Has to outlive the capture, so string literals only.
+	const char* mName{ nullptr };
+	uint64_t mStartNs{ 0 };
+	uint64_t mEndNs{ 0 };
+};
+
+class ProfileThreadBuffer {
+public:
+	// Power of two so the index wraps with a mask.
+	static const uint64_t CAPACITY = 16384;
+
+	// Only the owning thread pushes. Returns false when the buffer is full.
+	bool push(const ProfileEvent& event);
+	// Only one thread at a time drains. Appends everything written so far to events.
+	void drain(std::vector<ProfileEvent>& events);
+
+	uint32_t mThreadId{ 0 };
+	std::string mThreadName;
+	std::atomic<uint64_t> mDropped{ 0 };
+
+private:
+	std::atomic<uint64_t> mWrite{ 0 };
+	std::atomic<uint64_t> mRead{ 0 };
+	ProfileEvent mEvents[CAPACITY];
+};
+
+class Profiler {
+public:
+	// Zones only record between these. Starting clears whatever was captured before.
+	static void beginCapture();
+	static void endCapture();
+	static bool isCapturing() { return sCapturing.load(std::memory_order_relaxed); }
+
+	// Names the calling thread in the trace. Threads without a name show up as "Thread N".
+	static void setThreadName(const std::string& name);
+
+	// Moves every thread's finished zones into the trace. Call it once a frame from one thread so the buffers never fill up.
+	static void collect();
+	// Collects, then writes the whole capture as Chrome trace JSON. Returns false if the file couldn't be opened.
+	static bool writeChromeTrace(const std::string& file);
+
+	static void record(const char* name, uint64_t startNs, uint64_t endNs);
+	static uint64_t now() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+private:
+	static ProfileThreadBuffer& getThreadBuffer();
+
+	static std::atomic<bool> sCapturing;
+};
+
+// Records the time between construction and destruction as a zone.
+class ProfileZone {
+public:
+	ProfileZone(const char* name)
+		:mName(name), mStartNs(Profiler::isCapturing() ? Profiler::now() : 0) {}
+	~ProfileZone() {
+		if (mStartNs != 0)
+			Profiler::record(mName, mStartNs, Profiler::now());
+	}
+
+private:
+	const char* mName;
+	uint64_t mStartNs;
+};
+
+#define SPX_PROFILE_CONCAT_INNER(a, b) a##b
+#define SPX_PROFILE_CONCAT(a, b) SPX_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef SPX_ENABLE_PROFILING
+	#define SPX_PROFILE_ZONE(name) ProfileZone SPX_PROFILE_CONCAT(profileZone, __LINE__)(name)
+	#define SPX_PROFILE_FUNCTION() SPX_PROFILE_ZONE(__FUNCTION__)
+	#define SPX_PROFILE_THREAD(name) Profiler::setThreadName(name)
+	#define SPX_PROFILE_COLLECT() Profiler::collect()
+#else
+	#define SPX_PROFILE_ZONE(name)
+	#define SPX_PROFILE_FUNCTION()
+	#define SPX_PROFILE_THREAD(name)
+	#define SPX_PROFILE_COLLECT()
+#endif
@@ -0,0 +1,345 @@
+#include "SceneBenchmark.h"
+#include "Engine.h"
+#include "JsonUtils.h"
+#include "Camera.h"
+#include "FramePacer.h"
+#include "AllocationCounter.h"
+#include "Profiler.h"
+#include "../Events/Event.h"
+#include "../Renderer/VulkanRenderer.h"
+#include <GLFW/glfw3.h>
+
+namespace {
+	double elapsedMs(std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end) {
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	BenchmarkPercentiles summarize(std::vector<double> samples) {
+		BenchmarkPercentiles result;
+		if (samples.empty())
+			return result;
+
+		std::sort(samples.begin(), samples.end());
+		// Nearest rank, same as the frame pacer's history.
+		auto percentile = [&samples](double p) {
+			return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+		};
+		result.mP50 = percentile(0.5);
+		result.mP95 = percentile(0.95);
+		result.mP99 = percentile(0.99);
+		result.mMin = samples.front();
+		result.mMax = samples.back();
+		for (double sample : samples)
+			result.mMean += sample;
+		result.mMean /= samples.size();
+		return result;
+	}
+
+	void writeJsonPercentiles(std::ofstream& out, const std::string& name, const BenchmarkPercentiles& values, bool last = false) {
+		out << "\t\t\"" << name << "\": { \"p50\": " << values.mP50 << ", \"p95\": " << values.mP95 << ", \"p99\": " << values.mP99
+			<< ", \"min\": " << values.mMin << ", \"max\": " << values.mMax << ", \"mean\": " << values.mMean << " }"
+			<< (last ? "\n" : ",\n");
+	}
+
+	void logPercentiles(const std::string& name, const BenchmarkPercentiles& values) {
+		CORE_INFO("{:>12} | p50 {:12.3f} | p95 {:12.3f} | p99 {:12.3f} | min {:12.3f} | max {:12.3f}", name, values.mP50, values.mP95,
+			values.mP99, values.mMin, values.mMax);
+	}
+
+	// Furthest object position from the center of all of them. Meshes aren't loaded yet so only the translations are known.
+	float sceneRadius(const BenchmarkScene& scene, glm::vec3& center) {
+		center = glm::vec3(0.0f);
+		if (scene.mObjects.empty())
+			return 1.0f;
+
+		for (const auto& obj : scene.mObjects)
+			center += glm::vec3(obj.mTransformMatrix[3]);
+		center /= static_cast<float>(scene.mObjects.size());
+
+		float radius = 1.0f;
+		for (const auto& obj : scene.mObjects)
+			radius = std::max(radius, glm::length(glm::vec3(obj.mTransformMatrix[3]) - center));
+		return radius;
+	}
+
+	// A closed loop around the scene looking at its center, a little above it.
+	std::vector<CameraKeyframe> makeOrbitPath(const BenchmarkScene& scene) {
+		glm::vec3 center;
+		float radius = sceneRadius(scene, center);
+		float distance = radius * 1.2f + 5.0f;
+		float height = radius * 0.6f + 2.0f;
+
+		const uint32_t steps = 16;
+		std::vector<CameraKeyframe> path(steps + 1);
+		for (uint32_t i = 0; i <= steps; i++) {
+			float angle = 6.28318f * i / steps;
+			path[i].mPosition = center + glm::vec3(std::cos(angle) * distance, height, std::sin(angle) * distance);
+			path[i].mTarget = center;
+		}
+		return path;
+	}
+
+	// t goes from 0 (first keyframe) to 1 (last keyframe), linear between them.
+	CameraKeyframe samplePath(const std::vector<CameraKeyframe>& path, float t) {
+		if (path.size() == 1)
+			return path.front();
+
+		float position = std::min(std::max(t, 0.0f), 1.0f) * (path.size() - 1);
+		size_t index = std::min(static_cast<size_t>(position), path.size() - 2);
+		float blend = position - index;
+
+		CameraKeyframe keyframe;
+		keyframe.mPosition = glm::mix(path[index].mPosition, path[index + 1].mPosition, blend);
+		keyframe.mTarget = glm::mix(path[index].mTarget, path[index + 1].mTarget, blend);
+		return keyframe;
+	}
+
+	void addGrid(BenchmarkScene& scene, const std::string& mesh, const std::string& texture, uint32_t count, float spacing) {
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+		float offset = (side - 1) * spacing * 0.5f;
+
+		scene.mObjects.reserve(scene.mObjects.size() + count);
+		for (uint32_t i = 0; i < count; i++) {
+			RenderObject obj(mesh, texture);
+			obj.mTransformMatrix = glm::translate(glm::mat4(1.0f),
+				glm::vec3((i % side) * spacing - offset, 0.0f, (i / side) * spacing - offset));
+			scene.mObjects.push_back(obj);
+		}
+	}
+}
+
+BenchmarkScene loadBenchmarkScene(const std::string& file) {
+	std::ifstream in(file);
+	if (!in.is_open())
+		throw std::runtime_error("Failed to open benchmark scene " + file);
+
+	BenchmarkScene scene;
+	scene.mName = file;
+
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(in, line)) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream words(line);
+		std::string command;
+		if (!(words >> command))
+			continue;
+
+		auto fail = [&](const std::string& reason) {
+			return std::runtime_error(file + ":" + std::to_string(lineNumber) + ": " + reason);
+		};
+
+		if (command == "object") {
+			std::string mesh, texture;
+			if (!(words >> mesh >> texture))
+				throw fail("object needs a mesh and a texture.");
+			scene.mObjects.emplace_back(mesh, texture);
+		}
+		else if (command == "translate" || command == "rotate" || command == "scale") {
+			if (scene.mObjects.empty())
+				throw fail(command + " before any object.");
+
+			glm::mat4& transform = scene.mObjects.back().mTransformMatrix;
+			float degrees = 0.0f;
+			glm::vec3 v;
+			if (command == "rotate" && !(words >> degrees))
+				throw fail("rotate needs an angle and an axis.");
+			if (!(words >> v.x >> v.y >> v.z))
+				throw fail(command + " needs x y z.");
+
+			if (command == "translate")
+				transform = glm::translate(transform, v);
+			else if (command == "rotate")
+				transform = glm::rotate(transform, glm::radians(degrees), v);
+			else
+				transform = glm::scale(transform, v);
+		}
+		else if (command == "occluder") {
+			if (scene.mObjects.empty())
+				throw fail("occluder before any object.");
+
+			// The mesh is optional, without one the object's own mesh is rasterized.
+			RenderObject& obj = scene.mObjects.back();
+			obj.mIsOccluder = true;
+			words >> obj.mOccluderFileLocation;
+		}
+		else if (command == "grid") {
+			std::string mesh, texture;
+			uint32_t count = 0;
+			float spacing = 0.0f;
+			if (!(words >> mesh >> texture >> count >> spacing))
+				throw fail("grid needs a mesh, a texture, a count and a spacing.");
+			addGrid(scene, mesh, texture, count, spacing);
+		}
+		else if (command == "camera") {
+			CameraKeyframe keyframe;
+			if (!(words >> keyframe.mPosition.x >> keyframe.mPosition.y >> keyframe.mPosition.z
+				>> keyframe.mTarget.x >> keyframe.mTarget.y >> keyframe.mTarget.z))
+				throw fail("camera needs a position and a target.");
+			scene.mCameraPath.push_back(keyframe);
+		}
+		else
+			throw fail("unknown command " + command);
+	}
+
+	if (scene.mObjects.empty())
+		throw std::runtime_error("Benchmark scene " + file + " has no objects.");
+	if (scene.mCameraPath.empty())
+		scene.mCameraPath = makeOrbitPath(scene);
+
+	return scene;
+}
+
+BenchmarkScene makeSyntheticScene(uint32_t objectCount) {
+	BenchmarkScene scene;
+	scene.mName = "synthetic:" + std::to_string(objectCount);
+	// One mesh and texture for everything, so only the object count changes between runs.
+	addGrid(scene, "Media/Obj/viking.obj", "Media/Textures/viking.png", std::max(1u, objectCount), 3.0f);
+	scene.mCameraPath = makeOrbitPath(scene);
+	return scene;
+}
+
+bool runSceneBenchmark(const SceneBenchmarkSettings& settings, SceneBenchmarkResult& result) {
+	BenchmarkScene scene;
+	try {
+		// Meshes and textures are loaded under their own tags, this is the scene description and the objects.
+		SPX_ALLOCATION_SCOPE(AllocationTag::Benchmark);
+		if (settings.mScene.rfind("synthetic:", 0) == 0)
+			scene = makeSyntheticScene(static_cast<uint32_t>(std::strtoul(settings.mScene.c_str() + 10, nullptr, 10)));
+		else
+			scene = loadBenchmarkScene(settings.mScene);
+	}
+	catch (const std::exception& e) {
+		CORE_ERROR("{}", e.what());
+		return false;
+	}
+
+	Engine engine(settings.mWidth, settings.mHeight, "SPX Engine Benchmark", settings.mHeadless);
+	engine.mRenderer->mFramesInFlight = settings.mFramesInFlight;
+	engine.mRenderer->mEnableHiZCulling = settings.mHiZCulling;
+	engine.mRenderer->mVmaRecordFile = settings.mVmaRecordFile;
+	// Measure how fast it can go, not how well it holds a frame rate.
+	engine.mFramePacer->setTargetFrameRate(0.0);
+
+	// The default far plane would cull most of a big grid before it's ever drawn.
+	glm::vec3 center;
+	engine.mRenderer->mFarPlane = std::max(engine.mRenderer->mFarPlane, sceneRadius(scene, center) * 4.0f);
+
+	engine.mRenderer->addRenderObjects(scene.mObjects);
+	engine.initRenderer();
+
+	uint32_t totalFrames = settings.mWarmupFrames + settings.mFrames;
+	CORE_INFO("Scene benchmark: {} with {} objects, {} frames after {} warm up frames, {}x{} {}.", scene.mName, scene.mObjects.size(),
+		settings.mFrames, settings.mWarmupFrames, settings.mWidth, settings.mHeight, settings.mHeadless ? "headless" : "windowed");
+
+	std::vector<double> frameTimes, cpuTimes, gpuTimes, drawCalls, triangles, memory, heapAllocations;
+	frameTimes.reserve(settings.mFrames);
+	cpuTimes.reserve(settings.mFrames);
+	gpuTimes.reserve(settings.mFrames);
+	drawCalls.reserve(settings.mFrames);
+	triangles.reserve(settings.mFrames);
+	memory.reserve(settings.mFrames);
+	heapAllocations.reserve(settings.mFrames);
+
+	auto frameStart = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < totalFrames; frame++) {
+		if (engine.mWindow) {
+			if (glfwWindowShouldClose(engine.mWindow->getContext())) {
+				CORE_ERROR("Window closed after {} of {} frames, the results only cover those.", frame, totalFrames);
+				break;
+			}
+			// The camera is scripted, input is ignored.
+			engine.mWindow->pollEvents();
+			engine.mWindow->clearEvents();
+		}
+
+		// The path is spread over every frame, warm up included, so the camera never jumps.
+		CameraKeyframe pose = samplePath(scene.mCameraPath, totalFrames > 1 ? frame / static_cast<float>(totalFrames - 1) : 0.0f);
+		engine.mCamera->setLookAt(pose.mPosition, pose.mTarget);
+		engine.mRenderer->draw(engine.mCamera->getViewMatrix());
+		auto frameEnd = std::chrono::high_resolution_clock::now();
+		// Same as the engine's loops. Without collecting, --profile only keeps the first few hundred frames.
+		SPX_PROFILE_COLLECT();
+		AllocationCounter::markFrame();
+
+		if (frame >= settings.mWarmupFrames) {
+			// Walks every allocation, so it's kept out of the frame time.
+			engine.mRenderer->updateMemoryStats();
+			const RendererFrameStats& stats = engine.mRenderer->getFrameStats();
+
+			frameTimes.push_back(elapsedMs(frameStart, frameEnd));
+			cpuTimes.push_back(stats.mCpuTimeMs);
+			// Lags by the frames in flight, but it's the same frames overall.
+			if (stats.mGpuTimeMs >= 0.0)
+				gpuTimes.push_back(stats.mGpuTimeMs);
+			drawCalls.push_back(stats.mDrawCalls);
+			triangles.push_back(static_cast<double>(stats.mTriangles));
+			memory.push_back(stats.mMemoryAllocatedBytes / (1024.0 * 1024.0));
+			heapAllocations.push_back(static_cast<double>(stats.mHeapAllocations));
+		}
+
+		frameStart = std::chrono::high_resolution_clock::now();
+	}
+
+	engine.mRenderer->shutdown();
+
+	result.mScene = scene.mName;
+	result.mObjectCount = scene.mObjects.size();
+	result.mFrames = static_cast<uint32_t>(frameTimes.size());
+	result.mFrameTimeMs = summarize(frameTimes);
+	result.mCpuTimeMs = summarize(cpuTimes);
+	result.mGpuTimeMs = summarize(gpuTimes);
+	result.mDrawCalls = summarize(drawCalls);
+	result.mTriangles = summarize(triangles);
+	result.mMemoryMB = summarize(memory);
+	result.mHeapAllocations = summarize(heapAllocations);
+
+	CORE_INFO("Scene benchmark results over {} frames:", result.mFrames);
+	logPercentiles("frame ms", result.mFrameTimeMs);
+	logPercentiles("cpu ms", result.mCpuTimeMs);
+	logPercentiles("gpu ms", result.mGpuTimeMs);
+	logPercentiles("draw calls", result.mDrawCalls);
+	logPercentiles("triangles", result.mTriangles);
+	logPercentiles("memory MB", result.mMemoryMB);
+	logPercentiles("heap allocations", result.mHeapAllocations);
+
+	if (!settings.mOutputFile.empty())
+		writeSceneBenchmarkJson(settings, result);
+	return true;
+}
+
+bool writeSceneBenchmarkJson(const SceneBenchmarkSettings& settings, const SceneBenchmarkResult& result) {
+	std::ofstream out(settings.mOutputFile);
+	if (!out.is_open()) {
+		CORE_ERROR("Failed to open {} to write the benchmark results.", settings.mOutputFile);
+		return false;
+	}
+
+	out << "{\n";
+	out << "\t\"scene\": \"" << escapeJson(result.mScene) << "\",\n";
+	out << "\t\"objects\": " << result.mObjectCount << ",\n";
+	out << "\t\"frames\": " << result.mFrames << ",\n";
+	out << "\t\"warmupFrames\": " << settings.mWarmupFrames << ",\n";
+	out << "\t\"width\": " << settings.mWidth << ",\n";
+	out << "\t\"height\": " << settings.mHeight << ",\n";
+	out << "\t\"headless\": " << (settings.mHeadless ? "true" : "false") << ",\n";
+	out << "\t\"framesInFlight\": " << settings.mFramesInFlight << ",\n";
+	out << "\t\"hizCulling\": " << (settings.mHiZCulling ? "true" : "false") << ",\n";
+	out << "\t\"metrics\": {\n";
+	writeJsonPercentiles(out, "frameTimeMs", result.mFrameTimeMs);
+	writeJsonPercentiles(out, "cpuTimeMs", result.mCpuTimeMs);
+	writeJsonPercentiles(out, "gpuTimeMs", result.mGpuTimeMs);
+	writeJsonPercentiles(out, "drawCalls", result.mDrawCalls);
+	writeJsonPercentiles(out, "triangles", result.mTriangles);
+	writeJsonPercentiles(out, "memoryMB", result.mMemoryMB);
+	writeJsonPercentiles(out, "heapAllocations", result.mHeapAllocations, true);
+	out << "\t}\n";
+	out << "}\n";
+
+	CORE_INFO("Wrote benchmark results to {}", settings.mOutputFile);
+	return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../pch.h"
+#include "../Renderer/RenderObject.h"
+
+// ******************************************************************************************************************************
+//														SCENE BENCHMARK
+// Renders a scene for a fixed number of frames with the camera on a scripted path, so two runs of the same scene on the
+// same machine draw exactly the same frames. Started with --benchmark <scene> instead of opening the engine. Every frame's
+// numbers are kept and reported as p50/p95/p99, then written as JSON so runs can be compared over time.
+//
+// A scene is a scene file or synthetic:N. Scene files are one command per line, # starts a comment:
+//   object <mesh> <texture>				  One object. Transform lines after it apply to it, in order like glm.
+//   translate <x> <y> <z>
+//   rotate <degrees> <x> <y> <z>
+//   scale <x> <y> <z>
+//   occluder [mesh]							  Makes the last object an occluder for CPU occlusion culling. The mesh is a
+//											  low poly stand in, without one the object's own mesh is used.
+//   grid <mesh> <texture> <count> <spacing>  count objects on a square grid on the XZ plane, centered on the origin.
+//   camera <x> <y> <z> <tx> <ty> <tz>		  A camera position and target. The path goes through them in order, evenly
+//											  spread over the frames. No camera lines orbits the scene instead.
+//
+// synthetic:N is a grid of N copies of the same model, so the object count can be scaled (1 to 100k) without anything
+// else changing. The camera orbits the grid.
+//
+// Renderer init can only happen once per run, so each run is one scene. Run it once per object count to get the scaling.
+// ******************************************************************************************************************************
+
+struct CameraKeyframe {
+	glm::vec3 mPosition{ 0.0f };
+	glm::vec3 mTarget{ 0.0f };
+};
+
+struct BenchmarkScene {
+	std::string mName;
+	std::vector<RenderObject> mObjects;
+	std::vector<CameraKeyframe> mCameraPath;
+};
+
+struct SceneBenchmarkSettings {
+	// A scene file or synthetic:N.
+	std::string mScene;
+	uint32_t mFrames{ 1000 };
+	// Drawn first and left out of the results. Covers the first pass through the frames in flight and anything lazily
+	// created on first use.
+	uint32_t mWarmupFrames{ 60 };
+	bool mHeadless{ false };
+	uint32_t mWidth{ 1920 };
+	uint32_t mHeight{ 1080 };
+	uint32_t mFramesInFlight{ 2 };
+	// GPU Hi-Z occlusion culling instead of the CPU occlusion culler.
+	bool mHiZCulling{ false };
+	// Where the JSON goes. Empty only logs the results.
+	std::string mOutputFile;
+	// Records the benchmark's VMA calls there for --vma-replay. Empty records nothing.
+	std::string mVmaRecordFile;
+};
+
+struct BenchmarkPercentiles {
+	double mP50{ 0.0 };
+	double mP95{ 0.0 };
+	double mP99{ 0.0 };
+	double mMin{ 0.0 };
+	double mMax{ 0.0 };
+	double mMean{ 0.0 };
+};
+
+struct SceneBenchmarkResult {
+	std::string mScene;
+	size_t mObjectCount{ 0 };
+	uint32_t mFrames{ 0 };
+	// Start of one frame to the start of the next.
+	BenchmarkPercentiles mFrameTimeMs;
+	// The renderer's CPU time, not counting waiting on the GPU.
+	BenchmarkPercentiles mCpuTimeMs;
+	BenchmarkPercentiles mGpuTimeMs;
+	BenchmarkPercentiles mDrawCalls;
+	BenchmarkPercentiles mTriangles;
+	BenchmarkPercentiles mMemoryMB;
+	// Heap allocations the drawing thread made during draw. Anything above 0 past the warm up is something the frame
+	// arenas missed.
+	BenchmarkPercentiles mHeapAllocations;
+};
+
+// Throws std::runtime_error if the file can't be read or has a bad line.
+BenchmarkScene loadBenchmarkScene(const std::string& file);
+BenchmarkScene makeSyntheticScene(uint32_t objectCount);
+
+// Returns false if the scene couldn't be loaded.
+bool runSceneBenchmark(const SceneBenchmarkSettings& settings, SceneBenchmarkResult& result);
+bool writeSceneBenchmarkJson(const SceneBenchmarkSettings& settings, const SceneBenchmarkResult& result);
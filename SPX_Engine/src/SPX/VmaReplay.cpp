@@ -0,0 +1,535 @@
+#include "VmaReplay.h"
+#include "../Renderer/VulkanWrapper/VInstance.h"
+#include "../Renderer/VulkanWrapper/VDevice.h"
+#include "../ThirdParty/vk_mem_alloc.h"
+
+namespace {
+	const std::string RECORDING_HEADER = "Vulkan Memory Allocator,Calls recording";
+
+	struct RecordedCall {
+		uint32_t mFrame{ 0 };
+		std::string mFunction;
+		// Everything after the function name, still as text.
+		std::vector<std::string> mArgs;
+	};
+
+	std::vector<std::string> split(const std::string& line) {
+		std::vector<std::string> fields;
+		std::stringstream stream(line);
+		std::string field;
+		while (std::getline(stream, field, ','))
+			fields.push_back(field);
+		// getline drops a trailing empty field, which is how an allocation without user data ends.
+		if (!line.empty() && line.back() == ',')
+			fields.push_back("");
+		return fields;
+	}
+
+	bool loadRecording(const std::string& file, std::vector<RecordedCall>& calls) {
+		std::ifstream in(file);
+		if (!in.is_open()) {
+			CORE_ERROR("VMA replay: couldn't open {}.", file);
+			return false;
+		}
+
+		std::string line;
+		std::getline(in, line);
+		if (line.rfind(RECORDING_HEADER, 0) != 0) {
+			CORE_ERROR("VMA replay: {} isn't a VMA recording.", file);
+			return false;
+		}
+		// Format version.
+		std::getline(in, line);
+
+		bool inConfig = false;
+		while (std::getline(in, line)) {
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			if (line.empty())
+				continue;
+
+			// The recording device's properties. The replay runs on whatever device it gets.
+			if (line == "Config,Begin") {
+				inConfig = true;
+				continue;
+			}
+			if (inConfig) {
+				inConfig = line != "Config,End";
+				continue;
+			}
+
+			// threadId,time,frameIndex,function,args...
+			std::vector<std::string> fields = split(line);
+			if (fields.size() < 4)
+				continue;
+
+			RecordedCall call;
+			call.mFrame = static_cast<uint32_t>(std::strtoul(fields[2].c_str(), nullptr, 10));
+			call.mFunction = fields[3];
+			call.mArgs.assign(fields.begin() + 4, fields.end());
+			calls.push_back(call);
+		}
+		return true;
+	}
+
+	// %p prints null differently depending on the C library.
+	bool isNullPointer(const std::string& pointer) {
+		if (pointer.empty() || pointer == "(nil)")
+			return true;
+		for (char c : pointer) {
+			if (c != '0' && c != 'x' && c != 'X')
+				return false;
+		}
+		return true;
+	}
+
+	uint32_t toU32(const std::string& text) { return static_cast<uint32_t>(std::strtoul(text.c_str(), nullptr, 10)); }
+	uint64_t toU64(const std::string& text) { return std::strtoull(text.c_str(), nullptr, 10); }
+
+	// One replay of the whole recording on a fresh allocator.
+	class Replayer {
+	public:
+		Replayer(VDevice& device, const VmaReplaySettings& settings)
+			:mSettings(settings) {
+			VmaAllocatorCreateInfo createInfo{};
+			createInfo.physicalDevice = device.mPhysicalDevice;
+			createInfo.device = device.mLogicalDevice;
+			createInfo.instance = device.mInstance;
+			createInfo.vulkanApiVersion = VK_API_VERSION_1_2;
+			createInfo.preferredLargeHeapBlockSize = settings.mBlockSize;
+			if (device.isExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+				createInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+			vmaCreateAllocator(&createInfo, &mAllocator);
+
+			const VkPhysicalDeviceMemoryProperties* properties;
+			vmaGetMemoryProperties(mAllocator, &properties);
+			mMemoryTypeCount = properties->memoryTypeCount;
+			mHeapCount = properties->memoryHeapCount;
+			mTypePools.assign(mMemoryTypeCount, VK_NULL_HANDLE);
+		}
+
+		~Replayer() {
+			// Anything the recording never freed, usually because the engine was closed with it still alive.
+			for (auto& resource : mResources)
+				free(resource.second);
+			for (auto& pool : mRecordedPools)
+				vmaDestroyPool(mAllocator, pool.second);
+			for (VmaPool pool : mTypePools) {
+				if (pool != VK_NULL_HANDLE)
+					vmaDestroyPool(mAllocator, pool);
+			}
+			vmaDestroyAllocator(mAllocator);
+		}
+
+		void run(const std::vector<RecordedCall>& calls, VmaReplayResult& result) {
+			uint64_t fragmentationSamples = 0;
+			double fragmentationSum = 0.0;
+			uint32_t frame = calls.empty() ? 0 : calls.front().mFrame;
+
+			for (const auto& call : calls) {
+				if (call.mFrame != frame) {
+					double fragmentation = sampleFragmentation(result);
+					fragmentationSum += fragmentation;
+					fragmentationSamples++;
+					frame = call.mFrame;
+					vmaSetCurrentFrameIndex(mAllocator, frame);
+				}
+
+				result.mCalls++;
+				replay(call, result);
+			}
+
+			fragmentationSum += sampleFragmentation(result);
+			fragmentationSamples++;
+			result.mAverageFragmentation = fragmentationSum / fragmentationSamples;
+			result.mLiveAtEnd = mResources.size();
+		}
+
+	private:
+		struct Resource {
+			VmaAllocation mAllocation{ VK_NULL_HANDLE };
+			VkBuffer mBuffer{ VK_NULL_HANDLE };
+			VkImage mImage{ VK_NULL_HANDLE };
+			uint32_t mMapCount{ 0 };
+		};
+
+		void replay(const RecordedCall& call, VmaReplayResult& result) {
+			const std::vector<std::string>& args = call.mArgs;
+			const std::string& function = call.mFunction;
+
+			if (function == "vmaCreateBuffer" && args.size() >= 11)
+				createBuffer(args, result);
+			else if (function == "vmaCreateImage" && args.size() >= 20)
+				createImage(args, result);
+			else if (function == "vmaAllocateMemory" && args.size() >= 10)
+				allocateMemory(args, 3, false, result);
+			else if ((function == "vmaAllocateMemoryForBuffer" || function == "vmaAllocateMemoryForImage") && args.size() >= 12)
+				allocateMemory(args, 5, args[3] == "1", result);
+			else if ((function == "vmaFreeMemory" || function == "vmaDestroyBuffer" || function == "vmaDestroyImage") && !args.empty())
+				freeAllocation(args[0], result);
+			else if (function == "vmaMapMemory" && !args.empty())
+				mapMemory(args[0], result);
+			else if (function == "vmaUnmapMemory" && !args.empty())
+				unmapMemory(args[0], result);
+			else if (function == "vmaCreatePool" && args.size() >= 7)
+				createPool(args);
+			else if (function == "vmaDestroyPool" && !args.empty())
+				destroyPool(args[0]);
+			// These don't change what's allocated where.
+			else if (function == "vmaCreateAllocator" || function == "vmaDestroyAllocator" || function == "vmaSetAllocationUserData" ||
+				function == "vmaTouchAllocation" || function == "vmaGetAllocationInfo" || function == "vmaFlushAllocation" ||
+				function == "vmaInvalidateAllocation" || function == "vmaSetPoolName")
+				return;
+			else
+				result.mSkippedCalls++;
+		}
+
+		// The recorded flags with the strategy swapped for the one being tried.
+		VmaAllocationCreateFlags applyStrategy(VmaAllocationCreateFlags flags) const {
+			switch (mSettings.mStrategy) {
+			case ReplayStrategy::BestFit:  return (flags & ~VMA_ALLOCATION_CREATE_STRATEGY_MASK) | VMA_ALLOCATION_CREATE_STRATEGY_BEST_FIT_BIT;
+			case ReplayStrategy::WorstFit: return (flags & ~VMA_ALLOCATION_CREATE_STRATEGY_MASK) | VMA_ALLOCATION_CREATE_STRATEGY_WORST_FIT_BIT;
+			case ReplayStrategy::FirstFit: return (flags & ~VMA_ALLOCATION_CREATE_STRATEGY_MASK) | VMA_ALLOCATION_CREATE_STRATEGY_FIRST_FIT_BIT;
+			default:					   return flags;
+			}
+		}
+
+		// flagsIndex is where the VmaAllocationCreateInfo starts in args: flags, usage, required, preferred, type bits, pool,
+		// then the allocation and its user data.
+		// Returns false if none of the recorded memory types exist on this device.
+		bool readAllocationInfo(const std::vector<std::string>& args, size_t flagsIndex, VmaAllocationCreateInfo& info) {
+			info.flags = applyStrategy(toU32(args[flagsIndex]));
+			info.usage = static_cast<VmaMemoryUsage>(toU32(args[flagsIndex + 1]));
+			info.requiredFlags = toU32(args[flagsIndex + 2]);
+			info.preferredFlags = toU32(args[flagsIndex + 3]);
+			info.memoryTypeBits = toU32(args[flagsIndex + 4]);
+			if (info.memoryTypeBits != 0) {
+				info.memoryTypeBits &= getMemoryTypeMask();
+				if (info.memoryTypeBits == 0)
+					return false;
+			}
+
+			auto pool = mRecordedPools.find(args[flagsIndex + 5]);
+			if (pool != mRecordedPools.end())
+				info.pool = pool->second;
+			// The category the engine tagged the allocation with, so it shows up if the replay's stats are dumped.
+			if (args.size() > flagsIndex + 7 && !args[flagsIndex + 7].empty()) {
+				info.flags |= VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
+				info.pUserData = const_cast<char*>(args[flagsIndex + 7].c_str());
+			}
+			return true;
+		}
+
+		// With --pools, what wasn't in a recorded pool goes into the pool for the memory type VMA would have picked.
+		void redirectToPool(VmaAllocationCreateInfo& info, uint32_t memoryTypeIndex) {
+			if (mSettings.mPools == ReplayPoolAlgorithm::None || info.pool != VK_NULL_HANDLE)
+				return;
+
+			if (mTypePools[memoryTypeIndex] == VK_NULL_HANDLE) {
+				VmaPoolCreateInfo poolInfo{};
+				poolInfo.memoryTypeIndex = memoryTypeIndex;
+				poolInfo.blockSize = mSettings.mBlockSize;
+				if (mSettings.mPools == ReplayPoolAlgorithm::Linear)
+					poolInfo.flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+				else if (mSettings.mPools == ReplayPoolAlgorithm::Buddy)
+					poolInfo.flags = VMA_POOL_CREATE_BUDDY_ALGORITHM_BIT;
+				vmaCreatePool(mAllocator, &poolInfo, &mTypePools[memoryTypeIndex]);
+			}
+
+			info.pool = mTypePools[memoryTypeIndex];
+			// Pools can't make dedicated allocations.
+			info.flags &= ~VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+		}
+
+		void createBuffer(const std::vector<std::string>& args, VmaReplayResult& result) {
+			VkBufferCreateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			bufferInfo.flags = toU32(args[0]);
+			bufferInfo.size = toU64(args[1]);
+			bufferInfo.usage = toU32(args[2]);
+			// Queue family indices aren't recorded, so a concurrent buffer can't be made as it was.
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			result.mAllocations++;
+			VmaAllocationCreateInfo allocInfo{};
+			uint32_t memoryTypeIndex;
+			if (!readAllocationInfo(args, 4, allocInfo) ||
+				vmaFindMemoryTypeIndexForBufferInfo(mAllocator, &bufferInfo, &allocInfo, &memoryTypeIndex) != VK_SUCCESS) {
+				result.mFailedAllocations++;
+				return;
+			}
+			redirectToPool(allocInfo, memoryTypeIndex);
+
+			Resource resource;
+			auto start = std::chrono::steady_clock::now();
+			VkResult created = vmaCreateBuffer(mAllocator, &bufferInfo, &allocInfo, &resource.mBuffer, &resource.mAllocation, nullptr);
+			addTime(start, result.mAllocateMs, result);
+			finishAllocation(created, args[10], resource, result);
+		}
+
+		void createImage(const std::vector<std::string>& args, VmaReplayResult& result) {
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.flags = toU32(args[0]);
+			imageInfo.imageType = static_cast<VkImageType>(toU32(args[1]));
+			imageInfo.format = static_cast<VkFormat>(toU32(args[2]));
+			imageInfo.extent = { toU32(args[3]), toU32(args[4]), toU32(args[5]) };
+			imageInfo.mipLevels = toU32(args[6]);
+			imageInfo.arrayLayers = toU32(args[7]);
+			imageInfo.samples = static_cast<VkSampleCountFlagBits>(toU32(args[8]));
+			imageInfo.tiling = static_cast<VkImageTiling>(toU32(args[9]));
+			imageInfo.usage = toU32(args[10]);
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = static_cast<VkImageLayout>(toU32(args[12]));
+
+			result.mAllocations++;
+			VmaAllocationCreateInfo allocInfo{};
+			uint32_t memoryTypeIndex;
+			if (!readAllocationInfo(args, 13, allocInfo) ||
+				vmaFindMemoryTypeIndexForImageInfo(mAllocator, &imageInfo, &allocInfo, &memoryTypeIndex) != VK_SUCCESS) {
+				result.mFailedAllocations++;
+				return;
+			}
+			redirectToPool(allocInfo, memoryTypeIndex);
+
+			Resource resource;
+			auto start = std::chrono::steady_clock::now();
+			VkResult created = vmaCreateImage(mAllocator, &imageInfo, &allocInfo, &resource.mImage, &resource.mAllocation, nullptr);
+			addTime(start, result.mAllocateMs, result);
+			finishAllocation(created, args[19], resource, result);
+		}
+
+		// The ...ForBuffer/ForImage versions are replayed as plain allocations with the recorded requirements, there's no
+		// buffer or image to bind. Same allocation, same placement.
+		void allocateMemory(const std::vector<std::string>& args, size_t flagsIndex, bool requiresDedicated, VmaReplayResult& result) {
+			VkMemoryRequirements requirements{};
+			requirements.size = toU64(args[0]);
+			requirements.alignment = toU64(args[1]);
+			requirements.memoryTypeBits = toU32(args[2]) & getMemoryTypeMask();
+
+			result.mAllocations++;
+			VmaAllocationCreateInfo allocInfo{};
+			uint32_t memoryTypeIndex;
+			if (requirements.memoryTypeBits == 0 || !readAllocationInfo(args, flagsIndex, allocInfo) ||
+				vmaFindMemoryTypeIndex(mAllocator, requirements.memoryTypeBits, &allocInfo, &memoryTypeIndex) != VK_SUCCESS) {
+				result.mFailedAllocations++;
+				return;
+			}
+			if (requiresDedicated)
+				allocInfo.flags |= VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+			redirectToPool(allocInfo, memoryTypeIndex);
+
+			Resource resource;
+			auto start = std::chrono::steady_clock::now();
+			VkResult created = vmaAllocateMemory(mAllocator, &requirements, &allocInfo, &resource.mAllocation, nullptr);
+			addTime(start, result.mAllocateMs, result);
+			finishAllocation(created, args[flagsIndex + 6], resource, result);
+		}
+
+		void finishAllocation(VkResult created, const std::string& pointer, const Resource& resource, VmaReplayResult& result) {
+			if (created != VK_SUCCESS) {
+				result.mFailedAllocations++;
+				return;
+			}
+			// A recording that was cut off can reuse a pointer without the free. The old one is freed so it doesn't leak.
+			auto existing = mResources.find(pointer);
+			if (existing != mResources.end())
+				free(existing->second);
+			mResources[pointer] = resource;
+			samplePeaks(result);
+		}
+
+		void freeAllocation(const std::string& pointer, VmaReplayResult& result) {
+			if (isNullPointer(pointer))
+				return;
+			// Also the allocations that failed to replay.
+			auto resource = mResources.find(pointer);
+			if (resource == mResources.end())
+				return;
+
+			auto start = std::chrono::steady_clock::now();
+			free(resource->second);
+			addTime(start, result.mFreeMs, result);
+			mResources.erase(resource);
+		}
+
+		void free(Resource& resource) {
+			// The recording normally unmaps first. Freeing a mapped allocation is an error in VMA.
+			for (; resource.mMapCount > 0; resource.mMapCount--)
+				vmaUnmapMemory(mAllocator, resource.mAllocation);
+
+			if (resource.mBuffer != VK_NULL_HANDLE)
+				vmaDestroyBuffer(mAllocator, resource.mBuffer, resource.mAllocation);
+			else if (resource.mImage != VK_NULL_HANDLE)
+				vmaDestroyImage(mAllocator, resource.mImage, resource.mAllocation);
+			else
+				vmaFreeMemory(mAllocator, resource.mAllocation);
+		}
+
+		void mapMemory(const std::string& pointer, VmaReplayResult& result) {
+			auto resource = mResources.find(pointer);
+			if (resource == mResources.end())
+				return;
+
+			void* data;
+			auto start = std::chrono::steady_clock::now();
+			VkResult mapped = vmaMapMemory(mAllocator, resource->second.mAllocation, &data);
+			addTime(start, result.mAllocateMs, result);
+			if (mapped == VK_SUCCESS)
+				resource->second.mMapCount++;
+		}
+
+		void unmapMemory(const std::string& pointer, VmaReplayResult& result) {
+			auto resource = mResources.find(pointer);
+			if (resource == mResources.end() || resource->second.mMapCount == 0)
+				return;
+
+			auto start = std::chrono::steady_clock::now();
+			vmaUnmapMemory(mAllocator, resource->second.mAllocation);
+			addTime(start, result.mFreeMs, result);
+			resource->second.mMapCount--;
+		}
+
+		// memoryTypeIndex,flags,blockSize,minBlockCount,maxBlockCount,frameInUseCount,pool
+		void createPool(const std::vector<std::string>& args) {
+			VmaPoolCreateInfo poolInfo{};
+			poolInfo.memoryTypeIndex = toU32(args[0]);
+			poolInfo.flags = toU32(args[1]);
+			poolInfo.blockSize = toU64(args[2]);
+			poolInfo.minBlockCount = static_cast<size_t>(toU64(args[3]));
+			poolInfo.maxBlockCount = static_cast<size_t>(toU64(args[4]));
+			poolInfo.frameInUseCount = toU32(args[5]);
+			if (poolInfo.memoryTypeIndex >= mMemoryTypeCount) {
+				CORE_WARN("VMA replay: the recording made a pool in memory type {}, this device only has {}.", poolInfo.memoryTypeIndex, mMemoryTypeCount);
+				return;
+			}
+
+			VmaPool pool;
+			if (vmaCreatePool(mAllocator, &poolInfo, &pool) == VK_SUCCESS)
+				mRecordedPools[args[6]] = pool;
+		}
+
+		void destroyPool(const std::string& pointer) {
+			auto pool = mRecordedPools.find(pointer);
+			if (pool == mRecordedPools.end())
+				return;
+			vmaDestroyPool(mAllocator, pool->second);
+			mRecordedPools.erase(pool);
+		}
+
+		uint32_t getMemoryTypeMask() const {
+			return mMemoryTypeCount >= 32 ? ~0u : (1u << mMemoryTypeCount) - 1;
+		}
+
+		void addTime(std::chrono::steady_clock::time_point start, double& bucket, VmaReplayResult& result) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			bucket += ms;
+			result.mTotalMs += ms;
+		}
+
+		// vmaGetBudget is cheap enough to call after every allocation, so the peaks aren't missed between frames.
+		void samplePeaks(VmaReplayResult& result) {
+			VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+			vmaGetBudget(mAllocator, budgets);
+			VkDeviceSize blockBytes = 0;
+			VkDeviceSize allocationBytes = 0;
+			for (uint32_t i = 0; i < mHeapCount; i++) {
+				blockBytes += budgets[i].blockBytes;
+				allocationBytes += budgets[i].allocationBytes;
+			}
+			result.mPeakBlockBytes = std::max(result.mPeakBlockBytes, blockBytes);
+			result.mPeakAllocationBytes = std::max(result.mPeakAllocationBytes, allocationBytes);
+		}
+
+		// vmaCalculateStats walks every block, so only once per recorded frame.
+		double sampleFragmentation(VmaReplayResult& result) {
+			VmaStats stats;
+			vmaCalculateStats(mAllocator, &stats);
+			result.mPeakBlockCount = std::max(result.mPeakBlockCount, stats.total.blockCount);
+
+			double fragmentation = 0.0;
+			if (stats.total.unusedBytes > 0 && stats.total.unusedRangeCount > 0)
+				fragmentation = 1.0 - static_cast<double>(stats.total.unusedRangeSizeMax) / stats.total.unusedBytes;
+			result.mPeakFragmentation = std::max(result.mPeakFragmentation, fragmentation);
+			return fragmentation;
+		}
+
+		const VmaReplaySettings& mSettings;
+		VmaAllocator mAllocator{ VK_NULL_HANDLE };
+		uint32_t mMemoryTypeCount{ 0 };
+		uint32_t mHeapCount{ 0 };
+
+		// Keyed by the pointers as the recording printed them.
+		std::unordered_map<std::string, Resource> mResources;
+		std::unordered_map<std::string, VmaPool> mRecordedPools;
+		// --pools, one per memory type, made the first time an allocation needs it.
+		std::vector<VmaPool> mTypePools;
+	};
+
+	const char* getStrategyName(ReplayStrategy strategy) {
+		switch (strategy) {
+		case ReplayStrategy::BestFit:  return "best fit";
+		case ReplayStrategy::WorstFit: return "worst fit";
+		case ReplayStrategy::FirstFit: return "first fit";
+		default:					   return "as recorded";
+		}
+	}
+
+	const char* getPoolName(ReplayPoolAlgorithm pools) {
+		switch (pools) {
+		case ReplayPoolAlgorithm::Default: return "default pools";
+		case ReplayPoolAlgorithm::Linear:  return "linear pools";
+		case ReplayPoolAlgorithm::Buddy:   return "buddy pools";
+		default:						   return "no pools";
+		}
+	}
+}
+
+bool runVmaReplay(const VmaReplaySettings& settings, VmaReplayResult& result) {
+	std::vector<RecordedCall> calls;
+	if (!loadRecording(settings.mFile, calls))
+		return false;
+
+	uint32_t iterations = std::max(1u, settings.mIterations);
+	CORE_INFO("VMA replay: {} calls from {}, {} MB blocks, {}, {}, {} iterations.", calls.size(), settings.mFile,
+		settings.mBlockSize == 0 ? 256 : settings.mBlockSize / (1024 * 1024), getStrategyName(settings.mStrategy),
+		getPoolName(settings.mPools), iterations);
+
+	// No validation layers, they'd be most of what's measured.
+	std::string appName = "SPX VMA Replay";
+	std::string engineName = "SPX_ENGINE";
+	VInstance* instance = new VInstance(appName, engineName, false, true);
+	VDevice* device = new VDevice(VK_NULL_HANDLE, *instance);
+
+	result = VmaReplayResult();
+	for (uint32_t i = 0; i < iterations; i++) {
+		// Counts and peaks are the same every iteration, only the times are added up.
+		VmaReplayResult iteration;
+		{
+			Replayer replayer(*device, settings);
+			replayer.run(calls, iteration);
+		}
+		double totalMs = result.mTotalMs + iteration.mTotalMs;
+		double allocateMs = result.mAllocateMs + iteration.mAllocateMs;
+		double freeMs = result.mFreeMs + iteration.mFreeMs;
+		result = iteration;
+		result.mTotalMs = totalMs;
+		result.mAllocateMs = allocateMs;
+		result.mFreeMs = freeMs;
+	}
+	result.mTotalMs /= iterations;
+	result.mAllocateMs /= iterations;
+	result.mFreeMs /= iterations;
+
+	const double MB = 1024.0 * 1024.0;
+	CORE_INFO("VMA replay: {:.3f} ms in VMA ({:.3f} allocating, {:.3f} freeing), {} allocations, {} failed, {} calls skipped.",
+		result.mTotalMs, result.mAllocateMs, result.mFreeMs, result.mAllocations, result.mFailedAllocations, result.mSkippedCalls);
+	CORE_INFO("VMA replay: peak {:.1f} MB in {} blocks, {:.1f} MB of it allocated. Fragmentation {:.3f} average, {:.3f} peak.",
+		result.mPeakBlockBytes / MB, result.mPeakBlockCount, result.mPeakAllocationBytes / MB, result.mAverageFragmentation,
+		result.mPeakFragmentation);
+	if (result.mLiveAtEnd > 0)
+		CORE_TRACE("VMA replay: {} allocations were still alive at the end of the recording.", result.mLiveAtEnd);
+
+	vkDeviceWaitIdle(device->mLogicalDevice);
+	return true;
+}
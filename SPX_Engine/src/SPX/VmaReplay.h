@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../pch.h"
+
+// ******************************************************************************************************************************
+//															VMA REPLAY
+// Plays back a recording of the engine's VMA calls against an allocator set up differently, to try allocation policies
+// without running the engine. Started with --vma-replay <file> instead of opening the engine. Needs a GPU (the calls are
+// made for real on a headless device) but no window.
+//
+// Recordings are VMA's own CSV format (VmaRecordSettings), written when the engine runs with --record-vma <file>. They go
+// in vma-replays/. Every buffer, image, raw allocation, pool, map and unmap is replayed in order. Thread IDs and call
+// times in the file are ignored, the calls run back to back on one thread.
+//
+// What can be changed:
+//   Block size		 The preferred size of the blocks VMA allocates from each large heap (--block-size MB).
+//   Strategy		 Which free range VMA picks: as recorded, best fit, worst fit or first fit (--strategy).
+//   Pools			 Every allocation that wasn't made from a pool in the recording goes into one custom pool per memory
+//					 type instead, with the default, linear or buddy algorithm (--pools default|linear|buddy).
+//
+// Reported: time spent in VMA calls, peak memory (VMA's blocks and what's allocated out of them) and fragmentation. The
+// fragmentation is 1 - largest free range / total free bytes, sampled every recorded frame, so 0 is all the free space in
+// one range and values near 1 mean it's scattered in small pieces.
+//
+// A recording made on another GPU still replays, but the memory types can differ, so raw allocations whose memory type
+// bits don't exist on this device are skipped and counted as failed.
+// ******************************************************************************************************************************
+
+enum class ReplayStrategy {
+	Recorded,
+	BestFit,
+	WorstFit,
+	FirstFit
+};
+
+enum class ReplayPoolAlgorithm {
+	// Allocations use the default heaps, as recorded.
+	None,
+	Default,
+	Linear,
+	Buddy
+};
+
+struct VmaReplaySettings {
+	std::string mFile;
+	// 0 keeps VMA's default (256 MB).
+	VkDeviceSize mBlockSize{ 0 };
+	ReplayStrategy mStrategy{ ReplayStrategy::Recorded };
+	ReplayPoolAlgorithm mPools{ ReplayPoolAlgorithm::None };
+	// The whole recording is replayed this many times, each on a fresh allocator. Times are averaged.
+	uint32_t mIterations{ 1 };
+};
+
+struct VmaReplayResult {
+	uint64_t mCalls{ 0 };
+	uint64_t mAllocations{ 0 };
+	uint64_t mFailedAllocations{ 0 };
+	// Calls the replay doesn't handle (defragmentation, lost allocations and so on).
+	uint64_t mSkippedCalls{ 0 };
+	// Allocations the recording never freed. Usually everything alive when the engine was closed.
+	size_t mLiveAtEnd{ 0 };
+	// Spent inside VMA, per iteration.
+	double mTotalMs{ 0.0 };
+	double mAllocateMs{ 0.0 };
+	double mFreeMs{ 0.0 };
+	VkDeviceSize mPeakBlockBytes{ 0 };
+	VkDeviceSize mPeakAllocationBytes{ 0 };
+	uint32_t mPeakBlockCount{ 0 };
+	double mAverageFragmentation{ 0.0 };
+	double mPeakFragmentation{ 0.0 };
+};
+
+// Returns false if the file couldn't be read or isn't a VMA recording.
+bool runVmaReplay(const VmaReplaySettings& settings, VmaReplayResult& result);
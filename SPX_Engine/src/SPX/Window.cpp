@@ -1,6 +1,7 @@
 #include "../pch.h"
 #include "Window.h"
 #include "../Events/Event.h"
+#include "AllocationCounter.h"
 #include <iostream>
 
 #define GLFW_INCLUDE_VULKAN
@@ -8,6 +9,7 @@
 
 Window::Window(uint32_t width, uint32_t height, std::string title)
 	:mTitle(title), mWidth(width), mHeight(height) {
+	SPX_ALLOCATION_SCOPE(AllocationTag::Events);
 	glfwInit();
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // Makes sure glfw doesnt create an OpenGL context with the window
@@ -29,14 +31,20 @@ Window::Window(uint32_t width, uint32_t height, std::string title)
 Window::~Window() {}
 
 void Window::createKeyboardEvent(int key, int action) {
+	SPX_ALLOCATION_SCOPE(AllocationTag::Events);
 	if (action == GLFW_PRESS) {
-		mEventsQueue.push_back(new Event(key, EventType::KeyPressed, EventCategoryKeyboard));
+		mEventsQueue.push_back(mEventArena.create<Event>(key, EventType::KeyPressed, EventCategoryKeyboard));
 	}
 	if (action == GLFW_RELEASE) {
-		mEventsQueue.push_back(new Event(key, EventType::KeyReleased, EventCategoryKeyboard));
+		mEventsQueue.push_back(mEventArena.create<Event>(key, EventType::KeyReleased, EventCategoryKeyboard));
 	}
 }
 
+void Window::clearEvents() {
+	mEventsQueue.clear();
+	mEventArena.reset();
+}
+
 void Window::pollEvents() {
 	glfwPollEvents();	
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../pch.h"
+#include "FrameArena.h"
 
 struct GLFWwindow;
 class Event;
@@ -17,9 +18,14 @@ public:
 	void pollEvents();
 	// Update later
 	void createKeyboardEvent(int key, int action);
+	// Throws away this frame's events once everything has looked at them.
+	void clearEvents();
 
+	// Only good until clearEvents, the events live in mEventArena.
 	std::vector<Event*> mEventsQueue;
 
 private:
 	GLFWwindow* mContext;
+	// A frame's worth of events. Reset with the queue, so making events doesn't go to the heap.
+	FrameArena mEventArena{ 4096, "Event arena" };
 };
\ No newline at end of file
@@ -15,12 +15,173 @@
 
 #include "Engine.h"
 #include "Log.h"
+#include "JobBenchmark.h"
+#include "SceneBenchmark.h"
+#include "MicroBenchmark.h"
+#include "VmaReplay.h"
+#include "Profiler.h"
+#include "AllocationCounter.h"
+#include "../Renderer/VulkanRenderer.h"
 
-int main() {
+namespace {
+	// The engine on its own, until the window closes or --frames N have been drawn (required when headless).
+	// --frames-in-flight N trades latency for throughput without a rebuild, the renderer clamps it to 1-4. --capture DIR
+	// writes every headless frame there.
+	int runEngine(int argc, char** argv, bool headless, bool hiZCulling, const std::string& vmaRecordFile) {
+		Engine engine(1920, 1080, "SPX Engine", headless);
+		engine.mRenderer->mVmaRecordFile = vmaRecordFile;
+		engine.mRenderer->mEnableHiZCulling = hiZCulling;
+
+		for (int i = 1; i + 1 < argc; i++) {
+			if (std::string(argv[i]) == "--frames-in-flight")
+				engine.mRenderer->mFramesInFlight = static_cast<uint32_t>(std::atoi(argv[i + 1]));
+			else if (std::string(argv[i]) == "--frames")
+				engine.mFrameLimit = std::strtoull(argv[i + 1], nullptr, 10);
+			else if (std::string(argv[i]) == "--capture")
+				engine.mRenderer->mCaptureDirectory = argv[i + 1];
+		}
+
+		if (headless && engine.mFrameLimit == 0) {
+			CORE_ERROR("--headless needs --frames N, there's no window to close.");
+			return 1;
+		}
+
+		engine.init();
+		engine.run();
+		return 0;
+	}
+}
+
+int main(int argc, char** argv) {
 	Log::init();
+	SPX_PROFILE_THREAD("Main");
+
+	// Measures how the job system scales with thread count, then exits without opening a window.
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--job-benchmark") {
+			runJobScalingBenchmark();
+			return 0;
+		}
+	}
+
+	// Times asset loading and the per object CPU paths on their own. --iterations, --mesh-size, --texture-size and
+	// --objects size the fixtures.
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) != "--micro-benchmark")
+			continue;
+
+		MicroBenchmarkSettings settings;
+		for (int j = 1; j + 1 < argc; j++) {
+			uint32_t value = static_cast<uint32_t>(std::atoi(argv[j + 1]));
+			if (std::string(argv[j]) == "--iterations")
+				settings.mIterations = value;
+			else if (std::string(argv[j]) == "--mesh-size")
+				settings.mMeshGridSize = value;
+			else if (std::string(argv[j]) == "--texture-size")
+				settings.mTextureSize = value;
+			else if (std::string(argv[j]) == "--objects")
+				settings.mObjectCount = value;
+		}
+
+		runMicroBenchmarks(settings);
+		return 0;
+	}
+
+	// --vma-replay FILE plays back a recording made with --record-vma. --block-size MB, --strategy best|worst|first,
+	// --pools default|linear|buddy and --iterations N change how it's replayed.
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) != "--vma-replay")
+			continue;
+
+		VmaReplaySettings settings;
+		settings.mFile = argv[i + 1];
+		for (int j = 1; j + 1 < argc; j++) {
+			std::string option = argv[j];
+			std::string value = argv[j + 1];
+			if (option == "--block-size")
+				settings.mBlockSize = std::strtoull(value.c_str(), nullptr, 10) * 1024 * 1024;
+			else if (option == "--iterations")
+				settings.mIterations = static_cast<uint32_t>(std::atoi(value.c_str()));
+			else if (option == "--strategy")
+				settings.mStrategy = value == "best" ? ReplayStrategy::BestFit : value == "worst" ? ReplayStrategy::WorstFit :
+					value == "first" ? ReplayStrategy::FirstFit : ReplayStrategy::Recorded;
+			else if (option == "--pools")
+				settings.mPools = value == "linear" ? ReplayPoolAlgorithm::Linear : value == "buddy" ? ReplayPoolAlgorithm::Buddy :
+					ReplayPoolAlgorithm::Default;
+		}
+
+		VmaReplayResult result;
+		return runVmaReplay(settings, result) ? 0 : 1;
+	}
+
+	// Options for the engine itself, whether it runs normally or as --benchmark:
+	// --headless renders offscreen without a window or display, for CI and servers.
+	// --hiz culls on the GPU against a depth pyramid instead of with the CPU occlusion culler.
+	// --record-vma FILE records every VMA call for --vma-replay. Recordings are kept in vma-replays/.
+	// --profile FILE records CPU zones from startup to exit and writes them as a Chrome trace (open it in ui.perfetto.dev).
+	// --leak-report FILE writes the CPU allocations made after the first frame that are still live once the engine is
+	// destroyed. Only builds with SPX_TRACK_ALLOCATIONS can write one.
+	bool headless = false;
+	bool hiZCulling = false;
+	std::string vmaRecordFile;
+	std::string profileFile;
+	std::string leakReportFile;
+	for (int i = 1; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--headless")
+			headless = true;
+		else if (option == "--hiz")
+			hiZCulling = true;
+		else if (i + 1 < argc && option == "--record-vma")
+			vmaRecordFile = argv[i + 1];
+		else if (i + 1 < argc && option == "--profile")
+			profileFile = argv[i + 1];
+		else if (i + 1 < argc && option == "--leak-report")
+			leakReportFile = argv[i + 1];
+	}
+#ifndef SPX_ENABLE_PROFILING
+	if (!profileFile.empty())
+		CORE_WARN("--profile: built without SPX_ENABLE_PROFILING (Debug builds define it), the trace will be empty.");
+#endif
+	if (!profileFile.empty())
+		Profiler::beginCapture();
+
+	// --benchmark <scene file|synthetic:N> renders the scene along its camera path and reports frame time percentiles.
+	// --frames, --frames-in-flight and the engine options above apply to it too, --benchmark-out FILE writes the results
+	// as JSON.
+	int exitCode = -1;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) != "--benchmark")
+			continue;
+
+		SceneBenchmarkSettings settings;
+		settings.mScene = argv[i + 1];
+		settings.mHeadless = headless;
+		settings.mHiZCulling = hiZCulling;
+		settings.mVmaRecordFile = vmaRecordFile;
+		for (int j = 1; j + 1 < argc; j++) {
+			if (std::string(argv[j]) == "--frames")
+				settings.mFrames = static_cast<uint32_t>(std::atoi(argv[j + 1]));
+			else if (std::string(argv[j]) == "--frames-in-flight")
+				settings.mFramesInFlight = static_cast<uint32_t>(std::atoi(argv[j + 1]));
+			else if (std::string(argv[j]) == "--benchmark-out")
+				settings.mOutputFile = argv[j + 1];
+		}
+
+		SceneBenchmarkResult result;
+		exitCode = runSceneBenchmark(settings, result) ? 0 : 1;
+		break;
+	}
+	if (exitCode < 0)
+		exitCode = runEngine(argc, argv, headless, hiZCulling, vmaRecordFile);
 
-	Engine engine(1920, 1080, "SPX Engine");
-	engine.init();
-	engine.run();
-	return 0;
-}
\ No newline at end of file
+	if (!profileFile.empty()) {
+		Profiler::endCapture();
+		Profiler::writeChromeTrace(profileFile);
+	}
+	// The engine only lives inside runEngine and runSceneBenchmark, so it's been destroyed by now and what's left is what
+	// it never gave back.
+	if (!leakReportFile.empty())
+		AllocationCounter::writeLeakReport(leakReportFile);
+	return exitCode;
+}
@@ -1,3 +1,5 @@
 D:/Vulkan/1.2.170.0/Bin32/glslangValidator.exe -V shader.vert
 D:/Vulkan/1.2.170.0/Bin32/glslangValidator.exe -V shader.frag
+D:/Vulkan/1.2.170.0/Bin32/glslangValidator.exe -V depthreduce.comp -o depthreduce.spv
+D:/Vulkan/1.2.170.0/Bin32/glslangValidator.exe -V hizcull.comp -o hizcull.spv
 pause
\ No newline at end of file
@@ -1,6 +1,13 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// Set per pipeline through specialization constants (MeshShaderVariant). Branches on these are removed when the
+// pipeline is built.
+layout(constant_id = 0) const bool USE_TEXTURE = true;
+layout(constant_id = 1) const bool USE_VERTEX_COLOR = false;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+layout(constant_id = 3) const float ALPHA_CUTOFF = 0.5;
+
 layout(binding = 1) uniform sampler2D texSampler;
 
 layout(location = 0) in vec3 fragColor;
@@ -10,5 +17,13 @@ layout(location = 0) out vec4 outColor;
 
 void main()
 {
-	outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+	vec4 color = vec4(1.0);
+	if (USE_TEXTURE)
+		color = texture(texSampler, fragTexCoord);
+	if (USE_VERTEX_COLOR)
+		color.rgb *= fragColor;
+	if (ALPHA_TEST && color.a < ALPHA_CUTOFF)
+		discard;
+
+	outColor = color;
+}